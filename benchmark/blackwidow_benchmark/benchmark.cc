@@ -10,6 +10,10 @@
 #include <functional>
 
 #include "blackwidow/blackwidow.h"
+#include "dataset.h"
+#include "engine_stats.h"
+#include "placement.h"
+#include "profiler.h"
 
 const int KEY_SIZE = 50;
 const int VALUE_SIZE = 50;
@@ -32,6 +36,7 @@ using namespace std::chrono;
 using std::default_random_engine;
 
 static int32_t last_seed = 0;
+static std::string dataset_path;
 const std::string KEY_PREFIX = "KEY_";
 const std::string VALUE_PREFIX = "VALUE_";
 const std::string FIELD_PREFIX = "FIELD_";
@@ -63,6 +68,19 @@ void GenerateRandomString(const std::string& prefix,
   }
 }
 
+// 指定了数据集文件时直接mmap数据集(由benchmark/dataset中的
+// dataset_generator生成), 否则和之前一样在内存中生成数据
+static bool OpenDataset(dataset::Dataset* ds) {
+  if (dataset_path.empty()) {
+    return false;
+  }
+  if (!ds->Open(dataset_path)) {
+    printf("Open dataset failed, error: %s\n", ds->error().c_str());
+    exit(-1);
+  }
+  return true;
+}
+
 // Blackwidow : Test Set 10000000 KV Cost: 63s QPS: 158730  (5.9.2)
 // Blackwidow : Test Set 10000000 KV Cost: 63s QPS: 158730  (5.9.2)
 // Blackwidow : Test Set 10000000 KV Cost: 63s QPS: 158730  (5.9.2)
@@ -93,6 +111,7 @@ void BenchSet() {
   blackwidow::Options options;
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -100,23 +119,37 @@ void BenchSet() {
     printf("Open db failed, error: %s\n", s.ToString().c_str());
     return;
   }
+  dataset::Dataset ds;
   blackwidow::KeyValue kv;
   std::vector<blackwidow::KeyValue> kvs;
-  for (int i = 0; i < TEN_MILLION; i++) {
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
-    GenerateRandomString(KEY_PREFIX, VALUE_SIZE, &kv.value);
-    kvs.push_back(kv);
+  if (!OpenDataset(&ds)) {
+    for (int i = 0; i < TEN_MILLION; i++) {
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
+      GenerateRandomString(KEY_PREFIX, VALUE_SIZE, &kv.value);
+      kvs.push_back(kv);
+    }
   }
 
+  profiler::Start("Set");
   auto start = system_clock::now();
-  for (const auto& kv : kvs) {
-    db.Set(kv.key, kv.value);
+  if (ds.size() != 0) {
+    for (auto iter = ds.begin(); iter != ds.end(); ++iter) {
+      dataset::Record record = *iter;
+      db.Set(Slice(record.key.data(), record.key.size()),
+             Slice(record.value.data(), record.value.size()));
+    }
+  } else {
+    for (const auto& kv : kvs) {
+      db.Set(kv.key, kv.value);
+    }
   }
   auto end = system_clock::now();
+  profiler::Stop();
+  uint64_t num = ds.size() != 0 ? ds.size() : kvs.size();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
-  std::cout << "Test Set " << kvs.size() << " KV Cost: " << cost << "s QPS: "
-    << kvs.size() / cost << std::endl;
+  std::cout << "Test Set " << num << " KV Cost: " << cost << "s QPS: "
+    << num / cost << std::endl;
 }
 
 // Blackwidow : Test MultiThread Set 200000000 KV Cost: 542s QPS: 369003  (5.9.2)
@@ -142,6 +175,7 @@ void BenchMultiThreadSet() {
   printf("====== Multi Thread Set ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -150,18 +184,35 @@ void BenchMultiThreadSet() {
     return;
   }
 
+  dataset::Dataset ds;
   blackwidow::KeyValue kv;
   std::vector<blackwidow::KeyValue> kvs;
-  for (int i = 0; i < TEN_MILLION; i++) {
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
-    GenerateRandomString(KEY_PREFIX, VALUE_SIZE, &kv.value);
-    kvs.push_back(kv);
+  if (!OpenDataset(&ds)) {
+    for (int i = 0; i < TEN_MILLION; i++) {
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
+      GenerateRandomString(KEY_PREFIX, VALUE_SIZE, &kv.value);
+      kvs.push_back(kv);
+    }
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("MultiThreadSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
+    if (ds.size() != 0) {
+      // 所有线程共享同一份映射, 不再各自拷贝一份数据
+      jobs.emplace_back([&db, &ds]() {
+        profiler::PinThread();
+        for (auto iter = ds.begin(); iter != ds.end(); ++iter) {
+          dataset::Record record = *iter;
+          db.Set(Slice(record.key.data(), record.key.size()),
+                 Slice(record.value.data(), record.value.size()));
+        }
+      });
+      continue;
+    }
     jobs.emplace_back([&db](std::vector<blackwidow::KeyValue> kvs) {
+      profiler::PinThread();
       for (const auto& kv : kvs) {
         db.Set(kv.key , kv.value);
       }
@@ -171,10 +222,12 @@ void BenchMultiThreadSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
+  uint64_t num = ds.size() != 0 ? ds.size() : kvs.size();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
-  std::cout << "Test MultiThread Set " << THREADNUM * kvs.size() << " KV Cost: "
-    << cost << "s QPS: " << (THREADNUM * kvs.size()) / cost << std::endl;
+  std::cout << "Test MultiThread Set " << THREADNUM * num << " KV Cost: "
+    << cost << "s QPS: " << (THREADNUM * num) / cost << std::endl;
 }
 
 void BenchMSet() {
@@ -182,6 +235,7 @@ void BenchMSet() {
   blackwidow::Options options;
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -198,11 +252,13 @@ void BenchMSet() {
     kvs.push_back(kv);
   }
 
+  profiler::Start("MSet");
   auto start = system_clock::now();
   for (int i = 0; i < 1000000; i++) {
     db.MSet(kvs);
   }
   auto end = system_clock::now();
+  profiler::Stop();
 
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
@@ -233,6 +289,7 @@ void BenchScan() {
   printf("====== Scan ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -257,6 +314,7 @@ void BenchScan() {
   int64_t total = 0;
   int64_t cursor_origin, cursor_ret = 0;
   std::vector<std::string> keys;
+  profiler::Start("Scan");
   auto start = system_clock::now();
   for (; ;) {
     total += keys.size();
@@ -268,6 +326,7 @@ void BenchScan() {
     }
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Scan " << total
@@ -295,6 +354,7 @@ void BenchKeys() {
   printf("====== Keys * ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -332,6 +392,7 @@ void BenchKeys() {
   int64_t total = 0;
   int64_t cursor_origin, cursor_ret = 0;
   std::vector<std::string> keys;
+  profiler::Start("Keys");
   auto start = system_clock::now();
   for (; ;) {
     keys.clear();
@@ -343,6 +404,7 @@ void BenchKeys() {
     }
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Keys " << total
@@ -365,6 +427,7 @@ void BenchHSet() {
   printf("====== HSet ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -382,9 +445,11 @@ void BenchHSet() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("HSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<blackwidow::FieldValue> fvs) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         int32_t ret;
         std::string cur_key = "KEYS_HSET_" + std::to_string(index * TEN_THOUSAND + j);
@@ -398,6 +463,7 @@ void BenchHSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test HSet " << THREADNUM * TEN_THOUSAND << " Hashes Table Cost: "
@@ -420,6 +486,7 @@ void BenchHMSet() {
   printf("====== HMSet ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -437,9 +504,11 @@ void BenchHMSet() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("HMSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<blackwidow::FieldValue> fvs) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         db.HMSet("KEYS_HMSET_" + std::to_string(index * TEN_THOUSAND + j), fvs);
       }
@@ -449,6 +518,7 @@ void BenchHMSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test HMSet " << THREADNUM * TEN_THOUSAND << " Hashes Table Cost: "
@@ -481,6 +551,7 @@ void BenchHDel() {
   printf("====== HDel ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -503,11 +574,13 @@ void BenchHDel() {
   }
   db.HMSet("HDEL_KEY", fvs);
 
+  profiler::Start("HDel");
   auto start = system_clock::now();
   for (const auto& field : fields) {
     db.HDel("HDEL_KEY", {field}, &ret);
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test HDel " << fvs.size()
@@ -532,6 +605,7 @@ void BenchHKeys() {
   printf("====== HKeys ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -559,9 +633,11 @@ void BenchHKeys() {
   fvs.resize(TEN_THOUSAND);
   db.HMSet("HDEL_KEY", fvs);
 
+  profiler::Start("HKeys");
   auto start = system_clock::now();
   db.HKeys("HDEL_KEY", &field);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test HKeys " << field.size() << " Field Hash Table Cost: " << cost
@@ -596,6 +672,7 @@ void BenchHGetall() {
   printf("====== HGetall ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -621,9 +698,11 @@ void BenchHGetall() {
   db.HMSet("HGETALL_KEY1", fvs_in);
 
   fvs_out.clear();
+  profiler::Start("HGetall_1");
   auto start = system_clock::now();
   db.HGetall("HGETALL_KEY1", &fvs_out);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test case 1, HGetall " << fvs_out.size()
@@ -655,9 +734,11 @@ void BenchHGetall() {
   db.HMSet("HGETALL_KEY2", fvs_in);
 
   fvs_out.clear();
+  profiler::Start("HGetall_2");
   start = system_clock::now();
   db.HGetall("HGETALL_KEY2", &fvs_out);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test case 2, HGetall " << fvs_out.size()
@@ -683,6 +764,7 @@ void BenchSAdd() {
   printf("====== SAdd ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -697,9 +779,11 @@ void BenchSAdd() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SAdd");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<std::string> members_in) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         int32_t ret;
         std::string cur_key = "SADD_KEY" + std::to_string(index * TEN_THOUSAND + j);
@@ -713,6 +797,7 @@ void BenchSAdd() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SAdd " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -742,6 +827,7 @@ void BenchSRem() {
   printf("====== SRem ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -765,11 +851,13 @@ void BenchSRem() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SRem");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index,
                             std::vector<std::string> keys,
                             std::vector<std::vector<std::string>> sets) {
+      profiler::PinThread();
       int32_t ret;
       for (int j = 0; j < TEN_THOUSAND; j++) {
         std::string key = keys[index * TEN_THOUSAND + j];
@@ -783,6 +871,7 @@ void BenchSRem() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SRem " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -808,6 +897,7 @@ void BenchSMove() {
   printf("====== SMove ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -835,12 +925,14 @@ void BenchSMove() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SMove");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index,
                             std::vector<std::string> keys_source,
                             std::vector<std::string> keys_destination,
                             std::vector<std::vector<std::string>> sets) {
+      profiler::PinThread();
       int32_t ret;
       for (int j = 0; j < TEN_THOUSAND; j++) {
         std::string source = keys_source[index * TEN_THOUSAND + j];
@@ -855,6 +947,7 @@ void BenchSMove() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SMove " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -865,6 +958,7 @@ void BenchSPop() {
   printf("====== SPop ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -881,11 +975,13 @@ void BenchSPop() {
   }
   db.SAdd("SPOP_KEY", members_in, &ret);
 
+  profiler::Start("SPop");
   auto start = system_clock::now();
   for (uint32_t i = 0; i < ONE_HUNDRED_THOUSAND; ++i) {
     //db.SPop("SPOP_KEY", i, &members_out);
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test SPop " << TEN_THOUSAND << " Cost: " << cost << "ms" << std::endl;
@@ -923,6 +1019,7 @@ void BenchSMembers() {
   printf("====== SMembers ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -940,9 +1037,11 @@ void BenchSMembers() {
   }
   db.SAdd("SMEMBERS_KEY1", members_in, &ret);
 
+  profiler::Start("SMembers_1");
   auto start = system_clock::now();
   db.SMembers("SMEMBERS_KEY1", &members_out);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Case 1, SMembers " << members_out.size() << " Cost: " << cost << "ms" << std::endl;
@@ -963,9 +1062,11 @@ void BenchSMembers() {
   }
   db.SAdd("SMEMBERS_KEY2", members_in, &ret);
 
+  profiler::Start("SMembers_2");
   start = system_clock::now();
   db.SMembers("SMEMBERS_KEY2", &members_out);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Case 2, SMembers " << members_out.size() << " Cost: " << cost << "ms" << std::endl;
@@ -975,6 +1076,7 @@ void BenchLRange() {
   printf("====== LRange ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   blackwidow::BlackWidow db;
   blackwidow::Status s = db.Open(bw_options, "./db");
 
@@ -993,37 +1095,45 @@ void BenchLRange() {
   std::vector<std::string> result;
 
   // 100000
+  profiler::Start("LRange_1");
   auto start = system_clock::now();
   db.LRange("BENCHMARK_LRANGE", 0, ONE_HUNDRED_THOUSAND, &result);
   result.clear();
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << ONE_HUNDRED_THOUSAND << "  interval Cost: " << cost << "ms" << std::endl;
 
   // 1000000
+  profiler::Start("LRange_2");
   start = system_clock::now();
   db.LRange("BENCHMARK_LRANGE", 0, ONE_MILLION, &result);
   result.clear();
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << ONE_MILLION << " interval Cost: " << cost << "ms" << std::endl;
 
   // 10000000
+  profiler::Start("LRange_3");
   start = system_clock::now();
   db.LRange("BENCHMARK_LRANGE", 0, TEN_MILLION, &result);
   result.clear();
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << TEN_MILLION << " interval Cost: " << cost << "ms" << std::endl;
 
   // 10 * 10000000
+  profiler::Start("LRange_4");
   start = system_clock::now();
   db.LRange("BENCHMARK_LRANGE", 0, 10 * TEN_MILLION, &result);
   result.clear();
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << 10 * TEN_MILLION << " interval Cost: " << cost << "ms" << std::endl;
@@ -1033,6 +1143,7 @@ void BenchZAdd() {
   printf("====== ZAdd ======\n");
   blackwidow::BlackwidowOptions bw_options;
   bw_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&bw_options.options);
   rocksdb::Status s;
 
   blackwidow::ScoreMember sm;
@@ -1051,9 +1162,11 @@ void BenchZAdd() {
     return;
   }
   std::vector<std::thread> test1_jobs;
+  profiler::Start("ZAdd_1");
   auto test1_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test1_jobs.emplace_back([&test1_db](std::vector<blackwidow::ScoreMember> sms) {
+      profiler::PinThread();
       size_t idx;
       int32_t ret = 0;
       std::vector<blackwidow::ScoreMember> sub_sms;
@@ -1078,6 +1191,7 @@ void BenchZAdd() {
   }
 
   auto test1_end = system_clock::now();
+  profiler::Stop();
   duration<double> test1_elapsed_seconds = test1_end - test1_start;
   auto test1_cost = duration_cast<std::chrono::milliseconds>(test1_elapsed_seconds).count();
   std::cout << "Test case 1, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test1_cost << "ms" << std::endl;
@@ -1091,9 +1205,11 @@ void BenchZAdd() {
     return;
   }
   std::vector<std::thread> test2_jobs;
+  profiler::Start("ZAdd_2");
   auto test2_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test2_jobs.emplace_back([&test2_db](std::vector<blackwidow::ScoreMember> sms) {
+      profiler::PinThread();
       size_t idx;
       int32_t ret = 0;
       std::vector<blackwidow::ScoreMember> sub_sms;
@@ -1118,6 +1234,7 @@ void BenchZAdd() {
   }
 
   auto test2_end = system_clock::now();
+  profiler::Stop();
   duration<double> test2_elapsed_seconds = test2_end - test2_start;
   auto test2_cost = duration_cast<std::chrono::milliseconds>(test2_elapsed_seconds).count();
   std::cout << "Test case 2, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test2_cost << "ms" << std::endl;
@@ -1131,9 +1248,11 @@ void BenchZAdd() {
     return;
   }
   std::vector<std::thread> test3_jobs;
+  profiler::Start("ZAdd_3");
   auto test3_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test3_jobs.emplace_back([&test3_db](std::vector<blackwidow::ScoreMember> sms) {
+      profiler::PinThread();
       size_t idx;
       int32_t ret = 0;
       std::vector<blackwidow::ScoreMember> sub_sms;
@@ -1158,6 +1277,7 @@ void BenchZAdd() {
   }
 
   auto test3_end = system_clock::now();
+  profiler::Stop();
   duration<double> test3_elapsed_seconds = test3_end - test3_start;
   auto test3_cost = duration_cast<std::chrono::milliseconds>(test3_elapsed_seconds).count();
   std::cout << "Test case 3, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test3_cost << "ms" << std::endl;
@@ -1165,15 +1285,20 @@ void BenchZAdd() {
 
 static void usage() {
   std::cout << "Usage: " << std::endl;
-  std::cout << "      ./benchmark_bw [Set|MultiThreadSet|Scan|Keys|HSet|HMSet|HDel|HKeys|HGetall|SAdd|SRem|SMove|SMembers|LRange]\n";
+  std::cout << "      ./benchmark_bw [Set|MultiThreadSet|Scan|Keys|HSet|HMSet|HDel|HKeys|HGetall|SAdd|SRem|SMove|SMembers|LRange] [dataset] [--profile] [--cpus=0-7|node:N]\n";
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
+  argc = profiler::Profiler::Instance()->ParseFlags(argc, argv);
+  argc = profiler::Placement::Instance()->ParseFlags(argc, argv);
+  if (argc != 2 && argc != 3) {
     usage();
     exit(-1);
   }
   std::string interface = std::string(argv[1]);
+  if (argc == 3) {
+    dataset_path = std::string(argv[2]);
+  }
 
   if (interface == "Set") {
     BenchSet();
@@ -0,0 +1,423 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef BENCHMARK_DATASET_H_
+#define BENCHMARK_DATASET_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// The benchmark inputs are generated once by dataset_generator into a
+// binary file, the benchmarks mmap() it and iterate the records in
+// place, nothing is copied onto the heap and the page cache is shared
+// by the repeated runs of all the benchmark programs.
+//
+// File layout, all integers are little endian:
+//
+//   header (64 bytes)
+//     magic            8   "GDATASET"
+//     format version   4
+//     header checksum  4   crc32c of the 64 header bytes, this field as 0
+//     num records      8
+//     data offset      8
+//     data size        8
+//     index offset     8
+//     data checksum    4   crc32c of the data and the index
+//     padding         12
+//   data
+//     key size(4) | key | value size(4) | value, back to back
+//   index
+//     offset(8) of every record inside the data, for random access
+//     and for splitting the records between threads
+namespace dataset {
+
+const char kMagic[8] = {'G', 'D', 'A', 'T', 'A', 'S', 'E', 'T'};
+const uint32_t kFormatVersion = 1;
+const size_t kHeaderSize = 64;
+
+// The fixed size integers are little endian, on a little endian host
+// (every host the benchmarks run on) they are plain loads and stores
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+const bool kLittleEndian = true;
+#else
+const bool kLittleEndian = false;
+#endif
+
+inline uint32_t DecodeFixed32(const char* ptr) {
+  uint32_t result = 0;
+  if (kLittleEndian) {
+    memcpy(&result, ptr, sizeof(result));
+  } else {
+    for (size_t i = 0; i < sizeof(result); i++) {
+      result |= static_cast<uint32_t>(static_cast<unsigned char>(ptr[i]))
+        << (8 * i);
+    }
+  }
+  return result;
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+  uint64_t result = 0;
+  if (kLittleEndian) {
+    memcpy(&result, ptr, sizeof(result));
+  } else {
+    for (size_t i = 0; i < sizeof(result); i++) {
+      result |= static_cast<uint64_t>(static_cast<unsigned char>(ptr[i]))
+        << (8 * i);
+    }
+  }
+  return result;
+}
+
+inline void EncodeFixed32(char* buf, uint32_t value) {
+  if (kLittleEndian) {
+    memcpy(buf, &value, sizeof(value));
+  } else {
+    for (size_t i = 0; i < sizeof(value); i++) {
+      buf[i] = static_cast<char>(value >> (8 * i));
+    }
+  }
+}
+
+inline void EncodeFixed64(char* buf, uint64_t value) {
+  if (kLittleEndian) {
+    memcpy(buf, &value, sizeof(value));
+  } else {
+    for (size_t i = 0; i < sizeof(value); i++) {
+      buf[i] = static_cast<char>(value >> (8 * i));
+    }
+  }
+}
+
+struct Crc32cTable {
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+      }
+      entries[i] = c;
+    }
+  }
+  uint32_t entries[256];
+};
+
+inline uint32_t Crc32cScalar(uint32_t crc, const char* data, size_t n) {
+  static const Crc32cTable table;
+  crc = ~crc;
+  for (size_t i = 0; i < n; i++) {
+    crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xff]
+      ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+inline uint32_t Crc32cSSE42(uint32_t crc, const char* data, size_t n) {
+  uint64_t c = ~crc & 0xffffffffu;
+  while (n >= 8) {
+    c = _mm_crc32_u64(c, DecodeFixed64(data));
+    data += 8;
+    n -= 8;
+  }
+  uint32_t c32 = static_cast<uint32_t>(c);
+  while (n > 0) {
+    c32 = _mm_crc32_u8(c32, static_cast<unsigned char>(*data));
+    data++;
+    n--;
+  }
+  return ~c32;
+}
+#endif
+
+// Extends crc with data, the hardware instruction is used when
+// the cpu has it, both paths compute the same crc32c
+inline uint32_t Crc32c(uint32_t crc, const char* data, size_t n) {
+#if defined(__x86_64__)
+  static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+  if (has_sse42) {
+    return Crc32cSSE42(crc, data, n);
+  }
+#endif
+  return Crc32cScalar(crc, data, n);
+}
+
+// A pointer and a length into the mapped file
+class StringView {
+ public:
+  StringView() : data_(""), size_(0) {
+  }
+  StringView(const char* data, size_t size) : data_(data), size_(size) {
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string ToString() const { return std::string(data_, size_); }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+struct Record {
+  StringView key;
+  StringView value;
+};
+
+class DatasetWriter {
+ public:
+  DatasetWriter() : file_(nullptr), data_size_(0), crc_(0) {
+  }
+  ~DatasetWriter() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path) {
+    path_ = path;
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return SetError();
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    // The header is written by Finish()
+    char header[kHeaderSize] = {0};
+    if (fwrite(header, 1, sizeof(header), file_) != sizeof(header)) {
+      return SetError();
+    }
+    return true;
+  }
+
+  bool Add(const char* key, size_t key_size,
+           const char* value, size_t value_size) {
+    offsets_.push_back(data_size_);
+    data_size_ += 2 * sizeof(uint32_t) + key_size + value_size;
+    char buf[4];
+    EncodeFixed32(buf, static_cast<uint32_t>(key_size));
+    if (!Write(buf, sizeof(buf)) || !Write(key, key_size)) {
+      return false;
+    }
+    EncodeFixed32(buf, static_cast<uint32_t>(value_size));
+    return Write(buf, sizeof(buf)) && Write(value, value_size);
+  }
+  bool Add(const std::string& key, const std::string& value) {
+    return Add(key.data(), key.size(), value.data(), value.size());
+  }
+
+  bool Finish() {
+    uint64_t index_offset = kHeaderSize + data_size_;
+    char buf[8];
+    for (uint64_t offset : offsets_) {
+      EncodeFixed64(buf, offset);
+      if (!Write(buf, sizeof(buf))) {
+        return false;
+      }
+    }
+
+    char header[kHeaderSize] = {0};
+    memcpy(header, kMagic, sizeof(kMagic));
+    EncodeFixed32(header + 8, kFormatVersion);
+    EncodeFixed64(header + 16, offsets_.size());
+    EncodeFixed64(header + 24, kHeaderSize);
+    EncodeFixed64(header + 32, data_size_);
+    EncodeFixed64(header + 40, index_offset);
+    EncodeFixed32(header + 48, crc_);
+    EncodeFixed32(header + 12, Crc32c(0, header, sizeof(header)));
+    if (fseek(file_, 0, SEEK_SET) != 0
+      || fwrite(header, 1, sizeof(header), file_) != sizeof(header)) {
+      return SetError();
+    }
+    int ret = fclose(file_);
+    file_ = nullptr;
+    return ret == 0 || SetError();
+  }
+
+  uint64_t num_records() const { return offsets_.size(); }
+  const std::string& error() const { return error_; }
+
+ private:
+  // Appends to the data or the index, both are covered by crc_
+  bool Write(const char* data, size_t n) {
+    if (n != 0 && fwrite(data, 1, n, file_) != n) {
+      return SetError();
+    }
+    crc_ = Crc32c(crc_, data, n);
+    return true;
+  }
+
+  bool SetError() {
+    error_ = path_ + ": " + strerror(errno);
+    return false;
+  }
+
+  std::string path_;
+  FILE* file_;
+  uint64_t data_size_;
+  uint32_t crc_;
+  std::vector<uint64_t> offsets_;
+  std::string error_;
+
+  // No copying allowed
+  DatasetWriter(const DatasetWriter&);
+  void operator=(const DatasetWriter&);
+};
+
+class Dataset {
+ public:
+  class Iterator {
+   public:
+    Iterator(const char* ptr, uint64_t index) : ptr_(ptr), index_(index) {
+    }
+
+    Record operator*() const {
+      Record record;
+      uint32_t key_size = DecodeFixed32(ptr_);
+      record.key = StringView(ptr_ + sizeof(uint32_t), key_size);
+      const char* value = ptr_ + sizeof(uint32_t) + key_size;
+      record.value = StringView(value + sizeof(uint32_t),
+                                DecodeFixed32(value));
+      return record;
+    }
+    Iterator& operator++() {
+      uint32_t key_size = DecodeFixed32(ptr_);
+      const char* value = ptr_ + sizeof(uint32_t) + key_size;
+      ptr_ = value + sizeof(uint32_t) + DecodeFixed32(value);
+      index_++;
+      return *this;
+    }
+    bool operator!=(const Iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    const char* ptr_;
+    uint64_t index_;
+  };
+
+  Dataset() : base_(nullptr), length_(0), num_records_(0),
+              data_(nullptr), data_size_(0), index_(nullptr), crc_(0) {
+  }
+  ~Dataset() {
+    if (base_ != nullptr) {
+      munmap(const_cast<char*>(base_), length_);
+    }
+  }
+
+  // Maps the file and checks the header, the checksum of
+  // the records is only checked by Verify()
+  bool Open(const std::string& path) {
+    path_ = path;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return SetError(strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return SetError(strerror(errno));
+    }
+    length_ = st.st_size;
+    if (length_ < kHeaderSize) {
+      close(fd);
+      return SetError("file too short");
+    }
+    void* base = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return SetError(strerror(errno));
+    }
+    base_ = static_cast<const char*>(base);
+    madvise(base, length_, MADV_SEQUENTIAL);
+
+    char header[kHeaderSize];
+    memcpy(header, base_, kHeaderSize);
+    uint32_t header_crc = DecodeFixed32(header + 12);
+    EncodeFixed32(header + 12, 0);
+    if (memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+      return SetError("bad magic");
+    } else if (Crc32c(0, header, kHeaderSize) != header_crc) {
+      return SetError("header checksum mismatch");
+    } else if (DecodeFixed32(header + 8) != kFormatVersion) {
+      return SetError("unknown format version");
+    }
+    num_records_ = DecodeFixed64(header + 16);
+    uint64_t data_offset = DecodeFixed64(header + 24);
+    data_size_ = DecodeFixed64(header + 32);
+    uint64_t index_offset = DecodeFixed64(header + 40);
+    crc_ = DecodeFixed32(header + 48);
+    if (data_offset + data_size_ != index_offset
+      || index_offset + num_records_ * sizeof(uint64_t) != length_) {
+      return SetError("truncated file");
+    }
+    data_ = base_ + data_offset;
+    index_ = base_ + index_offset;
+    return true;
+  }
+
+  // Reads the whole file once and compares the checksum
+  bool Verify() {
+    uint32_t crc = Crc32c(0, data_, length_ - (data_ - base_));
+    return crc == crc_ || SetError("data checksum mismatch");
+  }
+
+  uint64_t size() const { return num_records_; }
+
+  Record Get(uint64_t i) const {
+    return *At(i);
+  }
+
+  // The iterator positioned at record i, [At(i), At(j)) is the
+  // share of one thread when the records are split between threads
+  Iterator At(uint64_t i) const {
+    if (i >= num_records_) {
+      return end();
+    }
+    return Iterator(data_ + DecodeFixed64(index_ + i * sizeof(uint64_t)), i);
+  }
+  Iterator begin() const { return Iterator(data_, 0); }
+  Iterator end() const { return Iterator(data_ + data_size_, num_records_); }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  bool SetError(const std::string& message) {
+    error_ = path_ + ": " + message;
+    return false;
+  }
+
+  std::string path_;
+  const char* base_;
+  size_t length_;
+  uint64_t num_records_;
+  const char* data_;
+  uint64_t data_size_;
+  const char* index_;
+  uint32_t crc_;
+  std::string error_;
+
+  // No copying allowed
+  Dataset(const Dataset&);
+  void operator=(const Dataset&);
+};
+
+}  //  namespace dataset
+
+#endif  //  BENCHMARK_DATASET_H_
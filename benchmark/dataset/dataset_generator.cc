@@ -0,0 +1,135 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "dataset.h"
+
+using namespace std::chrono;
+using std::default_random_engine;
+
+static int32_t last_seed = 0;
+
+// The same generator as the benchmarks, a dataset holds exactly the
+// records a benchmark used to generate in memory before each run
+void GenerateRandomString(const std::string& prefix,
+                          int32_t len,
+                          std::string* target) {
+  target->clear();
+  char c_map[67] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'g',
+                    'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't',
+                    'u', 'v', 'w', 'x', 'y', 'z', 'A', 'B', 'C', 'D',
+                    'E', 'F', 'G', 'H', 'I', 'G', 'K', 'L', 'M', 'N',
+                    'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+                    'Y', 'Z', '~', '!', '@', '#', '$', '%', '^', '&',
+                    '*', '(', ')', '-', '=', '_', '+'};
+
+  if (prefix.size() >= static_cast<size_t>(len)) {
+    *target = prefix.substr(0, len);
+  } else {
+    *target = prefix;
+    default_random_engine e;
+    for (size_t i = 0; i < len - prefix.size(); i++) {
+      e.seed(last_seed);
+      last_seed = e();
+      int32_t rand_num = last_seed % 67;
+      target->push_back(c_map[rand_num]);
+    }
+  }
+}
+
+static int Generate(const std::string& path, int64_t count,
+                    const std::string& key_prefix, int32_t key_size,
+                    const std::string& value_prefix, int32_t value_size) {
+  auto start = system_clock::now();
+  dataset::DatasetWriter writer;
+  if (!writer.Open(path)) {
+    std::cerr << writer.error() << std::endl;
+    return -1;
+  }
+  std::string key, value;
+  for (int64_t i = 0; i < count; i++) {
+    GenerateRandomString(key_prefix, key_size, &key);
+    GenerateRandomString(value_prefix, value_size, &value);
+    if (!writer.Add(key, value)) {
+      std::cerr << writer.error() << std::endl;
+      return -1;
+    }
+  }
+  if (!writer.Finish()) {
+    std::cerr << writer.error() << std::endl;
+    return -1;
+  }
+  auto cost = duration_cast<milliseconds>(system_clock::now() - start).count();
+  std::cout << "Generate " << writer.num_records() << " Records Cost: "
+    << cost << "ms" << std::endl;
+  return 0;
+}
+
+static int Verify(const std::string& path) {
+  auto start = system_clock::now();
+  dataset::Dataset ds;
+  if (!ds.Open(path) || !ds.Verify()) {
+    std::cerr << ds.error() << std::endl;
+    return -1;
+  }
+  auto cost = duration_cast<milliseconds>(system_clock::now() - start).count();
+  std::cout << "Verify " << ds.size() << " Records Cost: " << cost
+    << "ms" << std::endl;
+  return 0;
+}
+
+static int Dump(const std::string& path, int64_t count) {
+  dataset::Dataset ds;
+  if (!ds.Open(path)) {
+    std::cerr << ds.error() << std::endl;
+    return -1;
+  }
+  std::cout << "Records: " << ds.size() << std::endl;
+  for (auto iter = ds.begin(); iter != ds.end() && count > 0;
+       ++iter, count--) {
+    dataset::Record record = *iter;
+    std::cout << record.key.ToString() << " : "
+      << record.value.ToString() << std::endl;
+  }
+  return 0;
+}
+
+static void usage() {
+  std::cout << "Usage: " << std::endl;
+  std::cout << "      ./dataset_generator generate <path> <count> "
+    "<key_prefix> <key_size> <value_prefix> <value_size>\n";
+  std::cout << "      ./dataset_generator verify <path>\n";
+  std::cout << "      ./dataset_generator dump <path> [count]\n";
+  std::cout << "Example: " << std::endl;
+  std::cout << "      ./dataset_generator generate ./kv_10m.dataset "
+    "10000000 KEY_ 50 KEY_ 50\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    usage();
+    exit(-1);
+  }
+  std::string command = std::string(argv[1]);
+  std::string path = std::string(argv[2]);
+
+  if (command == "generate" && argc == 8) {
+    return Generate(path, atoll(argv[3]), argv[4], atoi(argv[5]),
+                    argv[6], atoi(argv[7]));
+  } else if (command == "verify" && argc == 3) {
+    return Verify(path);
+  } else if (command == "dump" && (argc == 3 || argc == 4)) {
+    return Dump(path, argc == 4 ? atoll(argv[3]) : 10);
+  } else {
+    usage();
+  }
+  return -1;
+}
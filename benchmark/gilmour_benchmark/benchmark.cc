@@ -0,0 +1,2038 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <ctype.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <set>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <new>
+
+#include "gilmour/gilmour.h"
+#include "gilmour/bulk_loader.h"
+#include "gilmour/glob_matcher.h"
+#include "gilmour/key_codec.h"
+#include "gilmour/replication.h"
+#include "gilmour/sharded_gilmour.h"
+#include "engine_stats.h"
+#include "placement.h"
+#include "profiler.h"
+
+const int KEY_SIZE = 50;
+const int VALUE_SIZE = 50;
+const int MEMBER_SIZE = 50;
+const int FIELD_SIZE = 50;
+const int THREADNUM = 20;
+const int ONE_HUNDRED = 100;
+const int ONE_THOUSAND = 1000;
+const int TEN_THOUSAND = 10000;
+const int ONE_HUNDRED_THOUSAND = 100000;
+const int ONE_MILLION = 1000000;
+const int TEN_MILLION = 10000000;
+
+using namespace gilmour;
+using namespace std::chrono;
+using std::default_random_engine;
+
+// 当前线程的堆分配次数, 用来统计每次操作的分配
+static thread_local uint64_t allocations = 0;
+// 当前线程经operator new分配且尚未释放的字节数(含malloc的对齐),
+// 只在分配和释放都发生在同一线程时有意义
+static thread_local int64_t heap_bytes = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  heap_bytes += malloc_usable_size(ptr);
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    heap_bytes -= malloc_usable_size(ptr);
+  }
+  free(ptr);
+}
+
+static int32_t last_seed = 0;
+const std::string KEY_PREFIX = "KEY_";
+const std::string VALUE_PREFIX = "VALUE_";
+const std::string FIELD_PREFIX = "FIELD_";
+const std::string MEMBER_PREFIX = "MEMBER_";
+
+void GenerateRandomString(const std::string& prefix,
+                          size_t len,
+                          std::string* target) {
+  target->clear();
+  char c_map[67] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'g',
+                    'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't',
+                    'u', 'v', 'w', 'x', 'y', 'z', 'A', 'B', 'C', 'D',
+                    'E', 'F', 'G', 'H', 'I', 'G', 'K', 'L', 'M', 'N',
+                    'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+                    'Y', 'Z', '~', '!', '@', '#', '$', '%', '^', '&',
+                    '*', '(', ')', '-', '=', '_', '+'};
+
+  if (prefix.size() >= len) {
+    *target = prefix.substr(0, len);
+  } else {
+    *target = prefix;
+    default_random_engine e;
+    for (size_t i = 0; i < len - prefix.size(); i++) {
+      e.seed(last_seed);
+      last_seed = e();
+      int32_t rand_num = last_seed % 67;
+      target->push_back(c_map[rand_num]);
+    }
+  }
+}
+
+// The byte by byte matcher used by redis, blackwidow and nemo
+// (stringmatchlen() in redis util.c), kept here as the baseline
+static int StringMatchLen(const char *pattern, int patternLen,
+                          const char *string, int stringLen, int nocase) {
+  while (patternLen && stringLen) {
+    switch (pattern[0]) {
+      case '*':
+        while (patternLen && pattern[1] == '*') {
+          pattern++;
+          patternLen--;
+        }
+        if (patternLen == 1) {
+          return 1;
+        }
+        while (stringLen) {
+          if (StringMatchLen(pattern + 1, patternLen - 1,
+                             string, stringLen, nocase)) {
+            return 1;
+          }
+          string++;
+          stringLen--;
+        }
+        return 0;
+      case '?':
+        string++;
+        stringLen--;
+        break;
+      case '[': {
+        int negate, match;
+        pattern++;
+        patternLen--;
+        negate = pattern[0] == '^';
+        if (negate) {
+          pattern++;
+          patternLen--;
+        }
+        match = 0;
+        while (1) {
+          if (pattern[0] == '\\' && patternLen >= 2) {
+            pattern++;
+            patternLen--;
+            if (pattern[0] == string[0]) {
+              match = 1;
+            }
+          } else if (pattern[0] == ']') {
+            break;
+          } else if (patternLen == 0) {
+            pattern--;
+            patternLen++;
+            break;
+          } else if (patternLen >= 3 && pattern[1] == '-') {
+            int start = pattern[0];
+            int end = pattern[2];
+            int c = string[0];
+            if (start > end) {
+              int t = start;
+              start = end;
+              end = t;
+            }
+            if (nocase) {
+              start = tolower(start);
+              end = tolower(end);
+              c = tolower(c);
+            }
+            pattern += 2;
+            patternLen -= 2;
+            if (c >= start && c <= end) {
+              match = 1;
+            }
+          } else {
+            if (!nocase) {
+              if (pattern[0] == string[0]) {
+                match = 1;
+              }
+            } else {
+              if (tolower(static_cast<int>(pattern[0]))
+                == tolower(static_cast<int>(string[0]))) {
+                match = 1;
+              }
+            }
+          }
+          pattern++;
+          patternLen--;
+        }
+        if (negate) {
+          match = !match;
+        }
+        if (!match) {
+          return 0;
+        }
+        string++;
+        stringLen--;
+        break;
+      }
+      case '\\':
+        if (patternLen >= 2) {
+          pattern++;
+          patternLen--;
+        }
+        /* fall through */
+      default:
+        if (!nocase) {
+          if (pattern[0] != string[0]) {
+            return 0;
+          }
+        } else {
+          if (tolower(static_cast<int>(pattern[0]))
+            != tolower(static_cast<int>(string[0]))) {
+            return 0;
+          }
+        }
+        string++;
+        stringLen--;
+        break;
+    }
+    pattern++;
+    patternLen--;
+    if (stringLen == 0) {
+      while (*pattern == '*') {
+        pattern++;
+        patternLen--;
+      }
+      break;
+    }
+  }
+  if (patternLen == 0 && stringLen == 0) {
+    return 1;
+  }
+  return 0;
+}
+
+// Engine Stats的L0文件数等取自db的属性
+static profiler::EngineStats::PropertyGetter DBProperty(Gilmour* db) {
+  return [db](const std::string& property) {
+    return db->GetProperty(property);
+  };
+}
+
+// Test Glob SCAN_KEY* 10000000 Keys Naive Cost: 115ms Compiled Cost: 141ms Matched: 1000000
+// Test Glob SCAN_KEY* 10000000 Keys Seek Cost: 7ms Matched: 1000000
+// Test Glob *KEY1* 10000000 Keys Naive Cost: 2379ms Compiled Cost: 384ms Matched: 111111
+// Test Glob KEY_*abc* 10000000 Keys Naive Cost: 1687ms Compiled Cost: 321ms Matched: 1319
+// Test Glob KEY_*abc* 10000000 Keys Seek Cost: 1317ms Matched: 1319
+// Test Glob KEY_*[a-c]?x* 10000000 Keys Naive Cost: 5146ms Compiled Cost: 383ms Matched: 261219
+// Test Glob KEY_*[a-c]?x* 10000000 Keys Seek Cost: 1565ms Matched: 261219
+// Test Glob *Z*Z*Z* 10000000 Keys Naive Cost: 2318ms Compiled Cost: 560ms Matched: 282306
+// 测试场景 : 准备10000000个Key(其中十分之一以SCAN_KEY开头), 分别用逐字节
+// 匹配的StringMatchLen和预编译的GlobMatcher对所有Key做模式匹配, 对于
+// 带有字面前缀的模式, 额外测试把前缀转换成Seek以及上界之后的耗时(用有序
+// 数组上的lower_bound模拟迭代器的Seek).
+// 测试结果 : 带有'*'的模式GlobMatcher比StringMatchLen快4~13倍, 纯前缀
+// 模式两者相当, 但是转换成Seek之后只需要访问匹配的Key. KEY_开头的Key
+// 占九成, 这两个模式的Seek省下的不多.
+//
+// 结果分析 : StringMatchLen遇到'*'时会对Key的每个位置递归尝试剩余的模式,
+// 最坏情况下是O(N*M)并且每个字节都有分支. GlobMatcher在构造时把模式按'*'
+// 切分成定长的片段, 片段只需要按顺序找最左边的匹配位置, 纯字面片段使用
+// AVX2(或SSE4.2)一次比较32(16)个位置.
+void BenchGlob() {
+  printf("====== Glob ======\n");
+  std::string key;
+  std::vector<std::string> keys;
+  for (int i = 0; i < TEN_MILLION; i++) {
+    if (i % 10 == 0) {
+      keys.push_back("SCAN_KEY" + std::to_string(i));
+    } else {
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &key);
+      keys.push_back(key);
+    }
+  }
+  std::vector<std::string> sorted_keys(keys);
+  std::sort(sorted_keys.begin(), sorted_keys.end());
+
+  std::vector<std::string> patterns = {"SCAN_KEY*", "*KEY1*", "KEY_*abc*",
+                                       "KEY_*[a-c]?x*", "*Z*Z*Z*"};
+  for (const auto& pattern : patterns) {
+    int64_t naive_matched = 0;
+    profiler::Start("Glob_Naive");
+    auto start = system_clock::now();
+    for (const auto& key : keys) {
+      if (StringMatchLen(pattern.data(), pattern.size(),
+                         key.data(), key.size(), 0)) {
+        naive_matched++;
+      }
+    }
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto naive_cost = duration_cast<milliseconds>(end - start).count();
+
+    int64_t compiled_matched = 0;
+    profiler::Start("Glob_Compiled");
+    start = system_clock::now();
+    gilmour::GlobMatcher matcher(pattern);
+    for (const auto& key : keys) {
+      if (matcher.Match(key)) {
+        compiled_matched++;
+      }
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    auto compiled_cost = duration_cast<milliseconds>(end - start).count();
+
+    std::cout << "Test Glob " << pattern << " " << keys.size()
+      << " Keys Naive Cost: " << naive_cost << "ms Compiled Cost: "
+      << compiled_cost << "ms Matched: " << compiled_matched;
+    if (naive_matched != compiled_matched) {
+      std::cout << " (mismatch, naive matched " << naive_matched << ")";
+    }
+    std::cout << std::endl;
+
+    if (matcher.prefix().empty()) {
+      continue;
+    }
+    int64_t seek_matched = 0;
+    profiler::Start("Glob_Seek");
+    start = system_clock::now();
+    auto iter = std::lower_bound(sorted_keys.begin(), sorted_keys.end(),
+                                 matcher.prefix());
+    std::string upper_bound = matcher.PrefixUpperBound();
+    for (; iter != sorted_keys.end()
+      && (upper_bound.empty() || *iter < upper_bound); ++iter) {
+      if (matcher.prefix_only() || matcher.Match(*iter)) {
+        seek_matched++;
+      }
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    auto seek_cost = duration_cast<milliseconds>(end - start).count();
+    std::cout << "Test Glob " << pattern << " " << keys.size()
+      << " Keys Seek Cost: " << seek_cost << "ms Matched: "
+      << seek_matched << std::endl;
+  }
+}
+
+// Nemo的EncodeSetKey式的编码: 追加到std::string并按值返回,
+// 字段和Gilmour的数据key相同(tag | key size | key | version | member)
+static std::string EncodeToString(char tag, const std::string& key,
+                                  uint64_t version,
+                                  const std::string& member) {
+  std::string encoded;
+  encoded.push_back(tag);
+  uint32_t key_size = static_cast<uint32_t>(key.size());
+  encoded.append(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  encoded.append(key);
+  encoded.append(reinterpret_cast<const char*>(&version), sizeof(version));
+  encoded.append(member);
+  return encoded;
+}
+
+static void DecodeToString(const std::string& encoded, std::string* key,
+                           uint64_t* version, std::string* member) {
+  uint32_t key_size;
+  memcpy(&key_size, encoded.data() + 1, sizeof(key_size));
+  *key = encoded.substr(1 + sizeof(key_size), key_size);
+  memcpy(version, encoded.data() + 1 + sizeof(key_size) + key_size,
+         sizeof(*version));
+  *member = encoded.substr(1 + sizeof(key_size) + key_size
+                           + sizeof(*version));
+}
+
+// Case 1 / Case 2 / Case 3 / Case 4
+// 测试场景 : 10000000个(key, version, member)组合, key和member都是50字节,
+// 分别用追加到std::string并按值返回的方式和KeyEncoder写入栈上缓冲区的
+// 方式编码, 再分别解码成std::string和指向key内部的Slice, 统计每次操作
+// 的耗时(ns)和堆分配次数.
+//
+// 说明 : 超过SSO长度的std::string每次编码至少分配一次(追加时扩容还会
+// 再分配), 解码成std::string的每个字段也要分配. KeyEncoder只写调用方
+// 给的缓冲区, KeyDecoder返回的Slice指向原key, 两者都不分配内存.
+void BenchKeyCodec() {
+  printf("====== KeyCodec ======\n");
+  const char tag = 's';
+  std::vector<std::string> keys(ONE_THOUSAND), members(ONE_THOUSAND);
+  for (int i = 0; i < ONE_THOUSAND; i++) {
+    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &keys[i]);
+    GenerateRandomString(MEMBER_PREFIX, MEMBER_SIZE, &members[i]);
+  }
+  // 解码用的1000个key, 两种格式各一份
+  char buf[256];
+  std::vector<std::string> string_keys, codec_keys;
+  for (int i = 0; i < ONE_THOUSAND; i++) {
+    string_keys.push_back(EncodeToString(tag, keys[i], i, members[i]));
+    KeyEncoder encoder(buf, sizeof(buf));
+    encoder.PutByte(tag).PutLengthPrefixed(keys[i]).PutFixed64(i)
+      .PutBytes(members[i]);
+    codec_keys.push_back(encoder.slice().ToString());
+  }
+
+  const int ops = TEN_MILLION;
+  uint64_t checksum = 0;
+  uint64_t allocs = 0;
+  system_clock::time_point start;
+  auto report = [&](const std::string& name) {
+    auto cost = duration_cast<nanoseconds>(system_clock::now() - start);
+    uint64_t op_allocs = allocations - allocs;
+    profiler::Stop();
+    std::cout << name << ": " << static_cast<double>(cost.count()) / ops
+      << "ns/op, " << static_cast<double>(op_allocs) / ops
+      << " allocs/op (checksum " << checksum << ")" << std::endl;
+  };
+  auto begin = [&](const char* name) {
+    checksum = 0;
+    allocs = allocations;
+    profiler::Start(name);
+    start = system_clock::now();
+  };
+
+  begin("KeyCodec_EncodeString");
+  for (int i = 0; i < ops; i++) {
+    const std::string& member = members[(i / ONE_THOUSAND) % ONE_THOUSAND];
+    std::string key = EncodeToString(tag, keys[i % ONE_THOUSAND], i, member);
+    checksum += key.size();
+  }
+  report("Test case 1, Encode std::string");
+
+  begin("KeyCodec_EncodeStack");
+  for (int i = 0; i < ops; i++) {
+    const std::string& member = members[(i / ONE_THOUSAND) % ONE_THOUSAND];
+    KeyEncoder encoder(buf, sizeof(buf));
+    encoder.PutByte(tag).PutLengthPrefixed(keys[i % ONE_THOUSAND])
+      .PutFixed64(i).PutBytes(member);
+    checksum += encoder.slice().size();
+  }
+  report("Test case 2, Encode KeyEncoder");
+
+  begin("KeyCodec_DecodeString");
+  for (int i = 0; i < ops; i++) {
+    // 和按值返回的解码一样, 每次都是新的std::string
+    std::string key, member;
+    uint64_t version = 0;
+    DecodeToString(string_keys[i % ONE_THOUSAND], &key, &version, &member);
+    checksum += key.size() + member.size() + version;
+  }
+  report("Test case 3, Decode std::string");
+
+  begin("KeyCodec_DecodeSlice");
+  for (int i = 0; i < ops; i++) {
+    KeyDecoder decoder(codec_keys[i % ONE_THOUSAND]);
+    char decoded_tag;
+    Slice key;
+    uint64_t version = 0;
+    decoder.GetByte(&decoded_tag);
+    decoder.GetLengthPrefixed(&key);
+    decoder.GetFixed64(&version);
+    checksum += key.size() + decoder.remaining().size() + version;
+  }
+  report("Test case 4, Decode KeyDecoder");
+}
+
+// 尽量排除操作系统page cache的影响, 需要root权限, 失败时忽略
+static void DropPageCache() {
+  FILE* file = fopen("/proc/sys/vm/drop_caches", "w");
+  if (file != nullptr) {
+    fputs("3", file);
+    fclose(file);
+  }
+}
+
+// Case 1 / Case 2
+// 测试场景 : 写入100000个String和10000个各有1000个field的Hash表(共
+// 10000000个field), Compact之后清空page cache, 分别用KEYS *和每次
+// COUNT 1000的SCAN遍历所有的key, 统计耗时和读盘的数据量.
+//
+// 说明 : meta(包括String)和每种集合的数据都在各自的Column Family中,
+// KEYS和SCAN只迭代meta所在的family, 读到的sst文件里没有集合的数据,
+// 耗时只和key的个数有关, 和集合的大小无关.
+void BenchKeys() {
+  printf("====== Keys ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  Gilmour db;
+  Status s = db.Open(options, "./db_keys");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+  for (int i = 0; i < ONE_HUNDRED_THOUSAND; i++) {
+    db.Set(KEY_PREFIX + std::to_string(i), value);
+  }
+  std::vector<FieldValue> fvs;
+  for (int i = 0; i < ONE_THOUSAND; i++) {
+    fvs.push_back({"FIELD_" + std::to_string(i), value});
+  }
+  for (int i = 0; i < TEN_THOUSAND; i++) {
+    db.HMSet("HASH_KEY_" + std::to_string(i), fvs);
+  }
+  db.Compact();
+  DropPageCache();
+
+  std::vector<std::string> keys;
+  profiler::Start("Keys_All");
+  auto start = system_clock::now();
+  db.Keys("*", &keys);
+  auto end = system_clock::now();
+  profiler::Stop();
+  std::cout << "Test case 1, Keys * " << keys.size() << " Keys Cost: "
+    << duration_cast<milliseconds>(end - start).count() << "ms" << std::endl;
+
+  DropPageCache();
+  int64_t scanned = 0;
+  profiler::Start("Keys_Scan");
+  start = system_clock::now();
+  std::string next_key;
+  do {
+    keys.clear();
+    db.Scan(next_key, "*", ONE_THOUSAND, &keys, &next_key);
+    scanned += keys.size();
+  } while (!next_key.empty());
+  end = system_clock::now();
+  profiler::Stop();
+  std::cout << "Test case 2, Scan Count " << ONE_THOUSAND << " " << scanned
+    << " Keys Cost: " << duration_cast<milliseconds>(end - start).count()
+    << "ms" << std::endl;
+}
+
+// Case 1
+// 测试场景 : 创建一个大小为100000的Hash表, 然后进行HGetall测试.
+//
+// Case 2 / Case 3
+// 测试场景 : 创建一个大小为10000000的Hash表, 然后删除该Hash表, 再创建一个
+// 大小为10000的同名Hash表, 然后进行HGetall测试, Case 2使用默认配置(开启
+// (key, version)前缀的Bloom Filter), Case 3关闭前缀Bloom Filter作为对比.
+//
+// 说明 : 被删除的旧版本数据在Compaction之前一直留在sst文件中, 新旧版本
+// 的数据前缀不同, HGetall时迭代器Seek到[tag | key | version]前缀, 并且
+// 设置了iterate_upper_bound, 开启前缀Bloom Filter之后Seek可以直接跳过
+// 只包含旧版本数据的sst文件.
+void BenchHGetall() {
+  printf("====== HGetall ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  // 关闭后台的定向Compaction, 保留被删除的旧版本数据
+  options.small_compaction_threshold = 0;
+  Gilmour db;
+  Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  FieldValue fv;
+  std::vector<FieldValue> fvs_in;
+  std::vector<FieldValue> fvs_out;
+
+  // 1. Create the hash table then insert hash table 100000 field
+  // 2. HGetall the hash table 100000 field (statistics cost time)
+  for (size_t i = 0; i < ONE_HUNDRED_THOUSAND; ++i) {
+    fv.field = "FIELD_" + std::to_string(i);
+    fv.value = "VALUE_" + std::to_string(i);
+    fvs_in.push_back(fv);
+  }
+  db.HMSet("HGETALL_KEY1", fvs_in);
+
+  profiler::Start("HGetall_1");
+  auto start = system_clock::now();
+  db.HGetall("HGETALL_KEY1", &fvs_out);
+  auto end = system_clock::now();
+  profiler::Stop();
+  duration<double> elapsed_seconds = end - start;
+  auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
+  std::cout << "Test case 1, HGetall " << fvs_out.size()
+    << " Field HashTable Cost: "<< cost << "ms" << std::endl;
+
+
+  // 1. Create the hash table then insert hash table 10000000 field
+  // 2. Delete the hash table
+  // 3. Create the hash table whos key same as before,
+  //    then insert the hash table 10000 field
+  // 4. HGetall the hash table 10000 field (statistics cost time)
+  GilmourOptions no_prefix_bloom_options(options);
+  no_prefix_bloom_options.prefix_bloom_bits_per_key = 0;
+  Gilmour no_prefix_bloom_db;
+  s = no_prefix_bloom_db.Open(no_prefix_bloom_options, "./db_no_prefix_bloom");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&no_prefix_bloom_db));
+
+  std::vector<std::pair<std::string, Gilmour*>> cases = {
+    {"Test case 2, HGetall ", &db},
+    {"Test case 3 (no prefix bloom), HGetall ", &no_prefix_bloom_db}};
+  for (const auto& test_case : cases) {
+    Gilmour* cur_db = test_case.second;
+    fvs_in.clear();
+    for (size_t i = 0; i < TEN_MILLION; ++i) {
+      fv.field = "FIELD_" + std::to_string(i);
+      fv.value = "VALUE_" + std::to_string(i);
+      fvs_in.push_back(fv);
+    }
+    cur_db->HMSet("HGETALL_KEY2", fvs_in);
+    int64_t count;
+    cur_db->Del({"HGETALL_KEY2"}, &count);
+    fvs_in.resize(TEN_THOUSAND);
+    cur_db->HMSet("HGETALL_KEY2", fvs_in);
+
+    fvs_out.clear();
+    profiler::Start("HGetall_2");
+    start = system_clock::now();
+    cur_db->HGetall("HGETALL_KEY2", &fvs_out);
+    end = system_clock::now();
+    profiler::Stop();
+    elapsed_seconds = end - start;
+    cost = duration_cast<milliseconds>(elapsed_seconds).count();
+    std::cout << test_case.first << fvs_out.size()
+      << " Field HashTable Cost: "<< cost << "ms" << std::endl;
+  }
+}
+
+// Case 1
+// 测试场景 : 创建一个大小为100000的Set集合, 然后进行SMembers测试.
+//
+// Case 2 / Case 3
+// 测试场景 : 创建一个大小为10000000的Set集合, 然后删除该集合, 再创建一个
+// 大小为100000的同名集合, 然后进行SMembers测试, Case 3关闭前缀Bloom
+// Filter作为对比.
+void BenchSMembers() {
+  printf("====== SMembers ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  // 关闭后台的定向Compaction, 保留被删除的旧版本数据
+  options.small_compaction_threshold = 0;
+  Gilmour db;
+  Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  // Test Case 1
+  int32_t ret;
+  std::vector<std::string> members_in;
+  std::vector<std::string> members_out;
+  for (int i = 0; i < ONE_HUNDRED_THOUSAND; i++) {
+    members_in.push_back("MEMBER_" + std::to_string(i));
+  }
+  db.SAdd("SMEMBERS_KEY1", members_in, &ret);
+
+  profiler::Start("SMembers_1");
+  auto start = system_clock::now();
+  db.SMembers("SMEMBERS_KEY1", &members_out);
+  auto end = system_clock::now();
+  profiler::Stop();
+  duration<double> elapsed_seconds = end - start;
+  auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
+  std::cout << "Test Case 1, SMembers " << members_out.size() << " Cost: " << cost << "ms" << std::endl;
+
+
+  // Test Case 2 and 3
+  GilmourOptions no_prefix_bloom_options(options);
+  no_prefix_bloom_options.prefix_bloom_bits_per_key = 0;
+  Gilmour no_prefix_bloom_db;
+  s = no_prefix_bloom_db.Open(no_prefix_bloom_options, "./db_no_prefix_bloom");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&no_prefix_bloom_db));
+
+  std::vector<std::pair<std::string, Gilmour*>> cases = {
+    {"Test Case 2, SMembers ", &db},
+    {"Test Case 3 (no prefix bloom), SMembers ", &no_prefix_bloom_db}};
+  for (const auto& test_case : cases) {
+    Gilmour* cur_db = test_case.second;
+    members_in.clear();
+    for (size_t i = 0; i < TEN_MILLION; i++) {
+      members_in.push_back("MEMBER_" + std::to_string(i));
+    }
+    cur_db->SAdd("SMEMBERS_KEY2", members_in, &ret);
+    int64_t count;
+    cur_db->Del({"SMEMBERS_KEY2"}, &count);
+    members_in.resize(ONE_HUNDRED_THOUSAND);
+    cur_db->SAdd("SMEMBERS_KEY2", members_in, &ret);
+
+    members_out.clear();
+    profiler::Start("SMembers_2");
+    start = system_clock::now();
+    cur_db->SMembers("SMEMBERS_KEY2", &members_out);
+    end = system_clock::now();
+    profiler::Stop();
+    elapsed_seconds = end - start;
+    cost = duration_cast<milliseconds>(elapsed_seconds).count();
+    std::cout << test_case.first << members_out.size() << " Cost: " << cost << "ms" << std::endl;
+  }
+}
+
+// 空间放大 = sst文件和memtable的总大小 / 存活数据的大小
+// Case 1 ~ Case 4
+// 测试场景 : 创建一个有1000000个member的ZSet(score随机), 分别在关闭和
+// 开启zset索引的两个db中测试第一次ZRank的耗时, 然后随机选取100个member
+// 做ZRank, 100个随机的排名做ZRange(每次10个member), 100个随机的score
+// 区间做ZRangeByScore, 统计每次操作的平均耗时.
+//
+// 说明 : 没有索引时ZRank和ZRange要从第一个score key开始迭代, 耗时和
+// 排名成正比. 开启索引之后第一次读扫描全部score key, 在内存中建立跳表,
+// 跳表的每一层记录跨过的member数, 之后按排名和按score的查找都是O(log n).
+//
+// Case 5
+// 测试场景 : 不计时, 两个db执行同一组1000次ZRank(包括不存在的member),
+// ZRange(包括负数和越界的排名)和ZRangeByScore, 逐条比较结果, 不一致时
+// 输出第一条不一致的查询并退出.
+void BenchZRank() {
+  printf("====== ZRank ======\n");
+  std::vector<ScoreMember> sms;
+  default_random_engine e(1);
+  for (int i = 0; i < ONE_MILLION; i++) {
+    sms.push_back({static_cast<double>(e() % ONE_MILLION),
+                   "MEMBER_" + std::to_string(i)});
+  }
+
+  std::vector<std::pair<std::string, int32_t>> cases = {
+    {"scan", 0}, {"index", 1}};
+  std::vector<std::vector<std::string>> results(cases.size());
+  for (size_t c = 0; c < cases.size(); c++) {
+    const auto& test_case = cases[c];
+    GilmourOptions options;
+    options.options.create_if_missing = true;
+    options.zset_index_keys = test_case.second;
+    profiler::EngineStats engine_stats(&options.options);
+    Gilmour db;
+    Status s = db.Open(options, "./db_zrank_" + test_case.first);
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    engine_stats.Watch(DBProperty(&db));
+    int32_t ret;
+    for (size_t i = 0; i < sms.size(); i += TEN_THOUSAND) {
+      std::vector<ScoreMember> batch(sms.begin() + i,
+                                     sms.begin() + i + TEN_THOUSAND);
+      db.ZAdd("ZRANK_KEY", batch, &ret);
+    }
+    db.Compact();
+    std::string title = " (" + test_case.first + "), ";
+
+    int32_t rank;
+    profiler::Start("ZRank_First_" + test_case.first);
+    auto start = system_clock::now();
+    db.ZRank("ZRANK_KEY", sms[0].member, &rank);
+    auto end = system_clock::now();
+    profiler::Stop();
+    std::cout << "Test case 1" << title << "First ZRank Cost: "
+      << duration_cast<milliseconds>(end - start).count()
+      << "ms, Index Bytes: " << db.GetProperty("gilmour.zset-index-bytes")
+      << std::endl;
+
+    auto report = [&](const std::string& name,
+                      const std::function<void(int)>& op) {
+      profiler::Start(name + "_" + test_case.first);
+      auto start = system_clock::now();
+      for (int i = 0; i < ONE_HUNDRED; i++) {
+        op(i);
+      }
+      auto cost = duration_cast<microseconds>(system_clock::now() - start);
+      profiler::Stop();
+      std::cout << name << " " << ONE_HUNDRED << " Times Avg: "
+        << cost.count() / ONE_HUNDRED << "us" << std::endl;
+    };
+    std::vector<ScoreMember> score_members;
+    report("Test case 2" + title + "ZRank", [&](int i) {
+      db.ZRank("ZRANK_KEY", sms[e() % sms.size()].member, &rank);
+    });
+    report("Test case 3" + title + "ZRange", [&](int i) {
+      int32_t first = e() % ONE_MILLION;
+      score_members.clear();
+      db.ZRange("ZRANK_KEY", first, first + 9, &score_members);
+    });
+    report("Test case 4" + title + "ZRangeByScore", [&](int i) {
+      double min = e() % ONE_MILLION;
+      score_members.clear();
+      db.ZRangeByScore("ZRANK_KEY", min, min + 10, &score_members);
+    });
+
+    // 两个db的查询来自同一个种子
+    default_random_engine query(2);
+    std::vector<std::string>& result = results[c];
+    auto record = [&](const Status& s) {
+      std::string r = s.ToString();
+      for (const auto& sm : score_members) {
+        r += " " + sm.member + ":" + std::to_string(sm.score);
+      }
+      result.push_back(r);
+    };
+    for (int i = 0; i < ONE_THOUSAND; i++) {
+      std::string member = i == 0 ? "NO_SUCH_MEMBER"
+        : sms[query() % sms.size()].member;
+      s = db.ZRank("ZRANK_KEY", member, &rank);
+      result.push_back(s.ToString() + " "
+                       + std::to_string(s.ok() ? rank : -1));
+      int32_t first = static_cast<int32_t>(query() % (ONE_MILLION + 20)) - 10;
+      score_members.clear();
+      record(db.ZRange("ZRANK_KEY", first, first + 9, &score_members));
+      double min = static_cast<double>(query() % (ONE_MILLION + 20)) - 10;
+      score_members.clear();
+      record(db.ZRangeByScore("ZRANK_KEY", min, min + 10, &score_members));
+    }
+  }
+
+  for (size_t i = 0; i < results[0].size(); i++) {
+    if (results[0][i] != results[1][i]) {
+      std::cout << "Test case 5, Query " << i << " Mismatch, scan: "
+        << results[0][i] << ", index: " << results[1][i] << std::endl;
+      exit(1);
+    }
+  }
+  std::cout << "Test case 5, " << results[0].size()
+    << " Queries Match" << std::endl;
+}
+
+// Case 1 / Case 2
+// 测试场景 : 每次RPush 100个元素, 向List中写入10000000个元素, 然后每次
+// RPush 1个元素, 向另一个List中写入100000个元素, 统计写入的吞吐.
+//
+// Case 3 ~ Case 5
+// 测试场景 : 从第一个元素开始分别LRange 100000, 1000000和10000000个元素.
+//
+// Case 6
+// 测试场景 : 随机LIndex 1000次, 统计每次的平均耗时.
+//
+// Case 7
+// 测试场景 : 不计时, 对另一个List随机LPush/RPush(每次1~300个元素)和
+// LPop/RPop(每次1~200个元素)共1000次, 每100次把List弹空一次. 每次操作
+// 之后把LLen, 首尾和块边界上的LIndex, 以及跨首尾块的LRange和std::deque
+// 中记录的内容比较, 不一致时输出那次操作并退出.
+//
+// 说明 : List的元素按顺序打包成块, 每块128个元素一个key, meta中记录首尾
+// 两块的编号和首块的元素个数, 中间的块都是满的. LIndex和LRange由下标直接
+// 算出所在的块, LIndex只Get一个块, LRange Seek到起始块之后顺序读连续的块.
+// RPush只改写尾块, 单个元素的RPush也要读出再写回尾块.
+void BenchLRange() {
+  printf("====== LRange ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  Gilmour db;
+  Status s = db.Open(options, "./db_lrange");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+  std::vector<std::string> values(ONE_HUNDRED, value);
+  int32_t len;
+  profiler::Start("LRange_RPush_Batch");
+  auto start = system_clock::now();
+  for (int i = 0; i < TEN_MILLION / ONE_HUNDRED; i++) {
+    db.RPush("LRANGE_KEY", values, &len);
+  }
+  auto end = system_clock::now();
+  profiler::Stop();
+  auto cost = duration_cast<milliseconds>(end - start).count();
+  std::cout << "Test case 1, RPush " << len << " Elements " << ONE_HUNDRED
+    << " Per Call Cost: " << cost << "ms, "
+    << static_cast<int64_t>(len) * 1000 / std::max<int64_t>(cost, 1)
+    << " Elements/s" << std::endl;
+
+  values.resize(1);
+  profiler::Start("LRange_RPush_Single");
+  start = system_clock::now();
+  for (int i = 0; i < ONE_HUNDRED_THOUSAND; i++) {
+    db.RPush("LRANGE_SINGLE_KEY", values, &len);
+  }
+  end = system_clock::now();
+  profiler::Stop();
+  cost = duration_cast<milliseconds>(end - start).count();
+  std::cout << "Test case 2, RPush " << len << " Elements 1 Per Call Cost: "
+    << cost << "ms, "
+    << static_cast<int64_t>(len) * 1000 / std::max<int64_t>(cost, 1)
+    << " Elements/s" << std::endl;
+
+  const int sizes[] = {ONE_HUNDRED_THOUSAND, ONE_MILLION, TEN_MILLION};
+  for (int i = 0; i < 3; i++) {
+    std::vector<std::string> elements;
+    profiler::Start("LRange_" + std::to_string(sizes[i]));
+    start = system_clock::now();
+    db.LRange("LRANGE_KEY", 0, sizes[i] - 1, &elements);
+    end = system_clock::now();
+    profiler::Stop();
+    std::cout << "Test case " << i + 3 << ", LRange " << elements.size()
+      << " Elements Cost: " << duration_cast<milliseconds>(end - start).count()
+      << "ms" << std::endl;
+  }
+
+  default_random_engine e(1);
+  profiler::Start("LRange_LIndex");
+  start = system_clock::now();
+  for (int i = 0; i < ONE_THOUSAND; i++) {
+    db.LIndex("LRANGE_KEY", e() % TEN_MILLION, &value);
+  }
+  end = system_clock::now();
+  profiler::Stop();
+  std::cout << "Test case 6, LIndex " << ONE_THOUSAND << " Times Avg: "
+    << duration_cast<microseconds>(end - start).count() / ONE_THOUSAND
+    << "us" << std::endl;
+
+  std::deque<std::string> expected;
+  int32_t next = 0;
+  auto fail = [](int op, const std::string& what) {
+    std::cout << "Test case 7, Operation " << op << " " << what
+      << " Mismatch" << std::endl;
+    exit(1);
+  };
+  auto pop = [&](int op, bool left) {
+    s = left ? db.LPop("LRANGE_CHECK_KEY", &value)
+      : db.RPop("LRANGE_CHECK_KEY", &value);
+    if (expected.empty()) {
+      if (!s.IsNotFound()) {
+        fail(op, "Pop Of Empty List");
+      }
+      return;
+    }
+    if (!s.ok() || value != (left ? expected.front() : expected.back())) {
+      fail(op, left ? "LPop" : "RPop");
+    }
+    if (left) {
+      expected.pop_front();
+    } else {
+      expected.pop_back();
+    }
+  };
+  const int32_t chunk = options.list_chunk_size;
+  for (int op = 0; op < ONE_THOUSAND; op++) {
+    int kind = e() % 4;
+    if (op % ONE_HUNDRED == ONE_HUNDRED - 1) {
+      while (!expected.empty()) {
+        pop(op, expected.size() % 2 == 0);
+      }
+      pop(op, true);
+    } else if (kind < 2) {
+      std::vector<std::string> pushed(1 + e() % 300);
+      for (auto& element : pushed) {
+        element = std::to_string(next++);
+      }
+      if (kind == 0) {
+        db.LPush("LRANGE_CHECK_KEY", pushed, &len);
+        for (const auto& element : pushed) {
+          expected.push_front(element);
+        }
+      } else {
+        db.RPush("LRANGE_CHECK_KEY", pushed, &len);
+        expected.insert(expected.end(), pushed.begin(), pushed.end());
+      }
+      if (len != static_cast<int32_t>(expected.size())) {
+        fail(op, "Push Length");
+      }
+    } else {
+      for (int n = 1 + e() % 200; n > 0 && !expected.empty(); n--) {
+        pop(op, kind == 2);
+      }
+    }
+
+    const int32_t size = static_cast<int32_t>(expected.size());
+    db.LLen("LRANGE_CHECK_KEY", &len);
+    if (len != size) {
+      fail(op, "LLen");
+    }
+    const int32_t indexes[] = {0, 1, chunk - 1, chunk, size / 2,
+                               size - chunk, size - 1, size, -1, -chunk,
+                               -size, -size - 1};
+    for (int32_t index : indexes) {
+      int32_t i = index >= 0 ? index : size + index;
+      s = db.LIndex("LRANGE_CHECK_KEY", index, &value);
+      if (0 <= i && i < size ? !s.ok() || value != expected[i]
+        : !s.IsNotFound()) {
+        fail(op, "LIndex " + std::to_string(index));
+      }
+    }
+    const std::pair<int32_t, int32_t> ranges[] = {
+      {0, -1}, {chunk / 2, chunk * 2}, {-chunk * 2, -chunk / 2},
+      {size / 2 - chunk, size / 2 + chunk}, {size - 1, size + chunk}};
+    for (const auto& range : ranges) {
+      std::vector<std::string> elements;
+      db.LRange("LRANGE_CHECK_KEY", range.first, range.second, &elements);
+      int32_t first = std::max(range.first >= 0 ? range.first
+                               : size + range.first, 0);
+      int32_t last = std::min(range.second >= 0 ? range.second
+                              : size + range.second, size - 1);
+      if (first > last ? !elements.empty()
+        : static_cast<int32_t>(elements.size()) != last - first + 1
+          || !std::equal(elements.begin(), elements.end(),
+                         expected.begin() + first)) {
+        fail(op, "LRange " + std::to_string(range.first) + " "
+             + std::to_string(range.second));
+      }
+    }
+  }
+  std::cout << "Test case 7, " << ONE_THOUSAND << " Operations Match"
+    << std::endl;
+}
+
+// Case 1 / Case 2
+// 测试场景 : 分别在开启和关闭(packed_max_entries = 0)小集合打包的两个db
+// 中, 逐个field HSet 200000个Hash表, 每个Hash表100个field, 然后执行一次
+// 全量Compaction, 统计写入耗时, 磁盘占用, 随机HGet 100000次和随机
+// HGetall 10000次的平均耗时, 写放大见profiler的输出.
+//
+// Case 3
+// 测试场景 : 不计时, 在开启打包的db中对一个Hash表和一个Set随机执行
+// 2000次HSet, HMSet, HDel, SAdd和SRem, field和member取自201个(包括空
+// 字符串), 少数value超过64字节, 每100次Del一次. 条目超过128个或者
+// value超过64字节时拆包, Del之后重新打包. 每次操作之后把返回值, HLen,
+// HGetall, HKeys, HGet, SCard, SMembers和SIsMember与std::map和std::set
+// 中记录的内容比较, 不一致时输出那次操作并退出.
+//
+// 说明 : 打包的Hash表只有一个data key, 条目按field排序, 末尾的offset
+// 数组让HGet可以二分查找. 每个field不再重复key前缀和version, 但是每次
+// HSet都要读出并重写整个打包的value.
+void BenchPacked() {
+  printf("====== Packed ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  GilmourOptions unpacked_options(options);
+  unpacked_options.packed_max_entries = 0;
+
+  Gilmour packed_db;
+  Status s = packed_db.Open(options, "./db_packed");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&packed_db));
+  Gilmour unpacked_db;
+  s = unpacked_db.Open(unpacked_options, "./db_unpacked");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&unpacked_db));
+
+  const int num_keys = THREADNUM * TEN_THOUSAND;
+  std::vector<std::pair<std::string, Gilmour*>> cases = {
+    {"Test case 1 (packed),", &packed_db},
+    {"Test case 2 (unpacked),", &unpacked_db}};
+  for (const auto& test_case : cases) {
+    Gilmour* cur_db = test_case.second;
+    int32_t ret;
+    profiler::Start("Packed_HSet");
+    auto start = system_clock::now();
+    for (int i = 0; i < num_keys; i++) {
+      std::string key = "KEYS_HSET_" + std::to_string(i);
+      for (int j = 0; j < ONE_HUNDRED; j++) {
+        cur_db->HSet(key, "FIELD_" + std::to_string(j),
+                     "VALUE_" + std::to_string(j), &ret);
+      }
+    }
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto hset_cost = duration_cast<milliseconds>(end - start).count();
+    cur_db->Compact();
+    uint64_t total_size = cur_db->GetProperty("rocksdb.total-sst-files-size");
+
+    default_random_engine e(1);
+    std::string value;
+    profiler::Start("Packed_HGet");
+    start = system_clock::now();
+    for (int i = 0; i < ONE_HUNDRED_THOUSAND; i++) {
+      cur_db->HGet("KEYS_HSET_" + std::to_string(e() % num_keys),
+                   "FIELD_" + std::to_string(e() % ONE_HUNDRED), &value);
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    auto hget_cost = duration_cast<microseconds>(end - start).count();
+
+    std::vector<FieldValue> fvs;
+    profiler::Start("Packed_HGetall");
+    start = system_clock::now();
+    for (int i = 0; i < TEN_THOUSAND; i++) {
+      fvs.clear();
+      cur_db->HGetall("KEYS_HSET_" + std::to_string(e() % num_keys), &fvs);
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    auto hgetall_cost = duration_cast<microseconds>(end - start).count();
+
+    std::cout << test_case.first << " HSet " << num_keys
+      << " Hashes Table Cost: " << hset_cost << "ms, Total Size: "
+      << total_size / 1024 / 1024 << "MB, HGet Avg: "
+      << hget_cost / ONE_HUNDRED_THOUSAND << "us, HGetall Avg: "
+      << hgetall_cost / TEN_THOUSAND << "us" << std::endl;
+  }
+
+  std::map<std::string, std::string> expected_hash;
+  std::set<std::string> expected_set;
+  default_random_engine e(2);
+  auto fail = [](int op, const std::string& what) {
+    std::cout << "Test case 3, Operation " << op << " " << what
+      << " Mismatch" << std::endl;
+    exit(1);
+  };
+  auto random_field = [&]() {
+    int i = e() % 201;
+    return i == 200 ? std::string() : "FIELD_" + std::to_string(i);
+  };
+  auto random_fields = [&](int max) {
+    std::vector<std::string> fields(1 + e() % max);
+    for (auto& field : fields) {
+      field = random_field();
+    }
+    return fields;
+  };
+  auto random_value = [&]() {
+    return std::string(e() % 20 == 0 ? 65 + e() % 16 : 1 + e() % 64, 'v');
+  };
+  int32_t ret;
+  for (int op = 0; op < 2 * ONE_THOUSAND; op++) {
+    int kind = e() % 5;
+    int32_t expected_ret = 0;
+    if (op % ONE_HUNDRED == ONE_HUNDRED - 1) {
+      int64_t count;
+      packed_db.Del({"PACKED_CHECK_HASH", "PACKED_CHECK_SET"}, &count);
+      expected_hash.clear();
+      expected_set.clear();
+    } else if (kind == 0) {
+      std::string field = random_field();
+      std::string value = random_value();
+      packed_db.HSet("PACKED_CHECK_HASH", field, value, &ret);
+      expected_ret = expected_hash.count(field) == 0;
+      expected_hash[field] = value;
+      if (ret != expected_ret) {
+        fail(op, "HSet");
+      }
+    } else if (kind == 1) {
+      std::vector<FieldValue> fvs;
+      for (const auto& field : random_fields(40)) {
+        fvs.push_back({field, random_value()});
+        expected_hash[field] = fvs.back().value;
+      }
+      packed_db.HMSet("PACKED_CHECK_HASH", fvs);
+    } else if (kind == 2) {
+      std::vector<std::string> fields = random_fields(20);
+      packed_db.HDel("PACKED_CHECK_HASH", fields, &ret);
+      for (const auto& field : fields) {
+        expected_ret += static_cast<int32_t>(expected_hash.erase(field));
+      }
+      if (ret != expected_ret) {
+        fail(op, "HDel");
+      }
+    } else {
+      std::vector<std::string> members = random_fields(40);
+      if (kind == 3) {
+        packed_db.SAdd("PACKED_CHECK_SET", members, &ret);
+        for (const auto& member : members) {
+          expected_ret += expected_set.insert(member).second;
+        }
+      } else {
+        packed_db.SRem("PACKED_CHECK_SET", members, &ret);
+        for (const auto& member : members) {
+          expected_ret += static_cast<int32_t>(expected_set.erase(member));
+        }
+      }
+      if (ret != expected_ret) {
+        fail(op, kind == 3 ? "SAdd" : "SRem");
+      }
+    }
+
+    s = packed_db.HLen("PACKED_CHECK_HASH", &ret);
+    if ((s.ok() ? ret : 0) != static_cast<int32_t>(expected_hash.size())) {
+      fail(op, "HLen");
+    }
+    std::vector<FieldValue> fvs;
+    packed_db.HGetall("PACKED_CHECK_HASH", &fvs);
+    std::vector<std::string> fields;
+    packed_db.HKeys("PACKED_CHECK_HASH", &fields);
+    if (fvs.size() != expected_hash.size()
+      || fields.size() != expected_hash.size()) {
+      fail(op, "HGetall Size");
+    }
+    auto iter = expected_hash.begin();
+    for (size_t i = 0; i < fvs.size(); i++, ++iter) {
+      if (fvs[i].field != iter->first || fvs[i].value != iter->second
+        || fields[i] != iter->first) {
+        fail(op, "HGetall");
+      }
+    }
+    std::vector<std::string> members;
+    packed_db.SMembers("PACKED_CHECK_SET", &members);
+    s = packed_db.SCard("PACKED_CHECK_SET", &ret);
+    if ((s.ok() ? ret : 0) != static_cast<int32_t>(expected_set.size())
+      || members.size() != expected_set.size()
+      || !std::equal(expected_set.begin(), expected_set.end(),
+                     members.begin())) {
+      fail(op, "SMembers");
+    }
+    for (int i = 0; i < 3; i++) {
+      std::string field = random_field();
+      std::string value;
+      s = packed_db.HGet("PACKED_CHECK_HASH", field, &value);
+      auto found = expected_hash.find(field);
+      if (found == expected_hash.end() ? !s.IsNotFound()
+        : !s.ok() || value != found->second) {
+        fail(op, "HGet");
+      }
+      s = packed_db.SIsMember("PACKED_CHECK_SET", field, &ret);
+      int32_t is_member = static_cast<int32_t>(expected_set.count(field));
+      if ((s.ok() ? ret : 0) != is_member) {
+        fail(op, "SIsMember");
+      }
+    }
+  }
+  std::cout << "Test case 3, " << 2 * ONE_THOUSAND << " Operations Match"
+    << std::endl;
+}
+
+// Case 1 / Case 2
+// 测试场景 : 构造10000000条key和value都是50字节的记录, 分别放在
+// std::vector<KeyValue>(Case 1)和KeyValueBatch(Case 2)中, 统计构造的
+// 耗时, 堆分配次数和占用的堆内存. 然后把前1000000条记录以每批1000条
+// MSet写入, 统计写入耗时.
+//
+// 说明 : 50字节超过了libstdc++ std::string 15字节的SSO长度, 每条记录
+// 两次堆分配加上两个32字节的string头. KeyValueBatch把所有的字节连续
+// 放在一个arena中, 每条记录只多两个8字节的offset, MSet直接从arena中
+// 取Slice, 不再逐条构造std::string.
+void BenchBatch() {
+  printf("====== Batch ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  Gilmour db;
+  Status s = db.Open(options, "./db_batch");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  // 原地改写同一个key, 构造记录时不产生额外的分配
+  std::string key = KEY_PREFIX;
+  key.resize(KEY_SIZE, 'k');
+  auto key_at = [&key](int64_t i) -> const std::string& {
+    std::string id = std::to_string(i);
+    key.replace(KEY_PREFIX.size(), id.size(), id);
+    return key;
+  };
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+
+  {
+    uint64_t allocs = allocations;
+    int64_t bytes = heap_bytes;
+    profiler::Start("Batch_Build_Vector");
+    auto start = system_clock::now();
+    std::vector<KeyValue> kvs;
+    kvs.reserve(TEN_MILLION);
+    for (int64_t i = 0; i < TEN_MILLION; i++) {
+      kvs.push_back({key_at(i), value});
+    }
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto build_cost = duration_cast<milliseconds>(end - start).count();
+    std::cout << "Test case 1, Build std::vector<KeyValue> " << kvs.size()
+      << " Records Cost: " << build_cost << "ms, Allocations: "
+      << allocations - allocs << ", Memory: "
+      << (heap_bytes - bytes) / 1024 / 1024 << "MB" << std::endl;
+
+    profiler::Start("Batch_MSet_Vector");
+    start = system_clock::now();
+    for (int64_t i = 0; i < ONE_MILLION; i += ONE_THOUSAND) {
+      db.MSet(std::vector<KeyValue>(kvs.begin() + i,
+                                    kvs.begin() + i + ONE_THOUSAND));
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    std::cout << "Test case 1, MSet " << ONE_MILLION << " Records Cost: "
+      << duration_cast<milliseconds>(end - start).count() << "ms"
+      << std::endl;
+  }
+
+  {
+    uint64_t allocs = allocations;
+    int64_t bytes = heap_bytes;
+    profiler::Start("Batch_Build_Batch");
+    auto start = system_clock::now();
+    KeyValueBatch kvs;
+    kvs.Reserve(TEN_MILLION,
+                static_cast<size_t>(TEN_MILLION) * (KEY_SIZE + VALUE_SIZE));
+    for (int64_t i = 0; i < TEN_MILLION; i++) {
+      kvs.Add(key_at(i), value);
+    }
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto build_cost = duration_cast<milliseconds>(end - start).count();
+    std::cout << "Test case 2, Build KeyValueBatch " << kvs.size()
+      << " Records Cost: " << build_cost << "ms, Allocations: "
+      << allocations - allocs << ", Memory: "
+      << (heap_bytes - bytes) / 1024 / 1024 << "MB" << std::endl;
+
+    KeyValueBatch part;
+    profiler::Start("Batch_MSet_Batch");
+    start = system_clock::now();
+    for (int64_t i = 0; i < ONE_MILLION; i += ONE_THOUSAND) {
+      part.Clear();
+      for (int64_t j = i; j < i + ONE_THOUSAND; j++) {
+        part.Add(kvs.key(j), kvs.value(j));
+      }
+      db.MSet(part);
+    }
+    end = system_clock::now();
+    profiler::Stop();
+    std::cout << "Test case 2, MSet " << ONE_MILLION << " Records Cost: "
+      << duration_cast<milliseconds>(end - start).count() << "ms"
+      << std::endl;
+  }
+}
+
+static void PrintSpaceAndHGetall(const std::string& title, Gilmour* db,
+                                 const std::string& key, uint64_t live_size) {
+  uint64_t total_size = db->GetProperty("rocksdb.total-sst-files-size")
+    + db->GetProperty("rocksdb.cur-size-all-mem-tables");
+  std::vector<FieldValue> fvs_out;
+  profiler::Start("Compaction_HGetall");
+  auto start = system_clock::now();
+  db->HGetall(key, &fvs_out);
+  auto end = system_clock::now();
+  profiler::Stop();
+  auto cost = duration_cast<milliseconds>(end - start).count();
+  std::cout << title << " Total Size: " << total_size / 1024 / 1024
+    << "MB, Space Amplification: " << total_size / live_size
+    << "x, HGetall " << fvs_out.size() << " Field Cost: " << cost
+    << "ms" << std::endl;
+}
+
+// Case 1 / Case 2
+// 测试场景 : 关闭后台的定向Compaction, 创建一个大小为10000000的Hash表,
+// 删除该Hash表, 再创建一个大小为10000的同名Hash表, 统计空间放大和
+// HGetall耗时(Case 1), 然后执行一次全量Compaction再统计一次(Case 2).
+//
+// Case 3
+// 测试场景 : 使用默认配置, 删除Hash表时被孤立的数据超过了
+// small_compaction_threshold, 后台线程对该key的范围执行CompactRange,
+// 等待后台Compaction结束之后统计空间放大和HGetall耗时.
+//
+// 说明 : Del只删除meta, 旧版本的数据由Compaction Filter在Compaction时
+// 丢弃(meta不存在/已过期/类型不符/版本号小于meta中的版本号), 在此之前
+// 它们一直占用磁盘空间, 并且会拖慢覆盖这段范围的读.
+void BenchCompaction() {
+  printf("====== Compaction ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  GilmourOptions no_bg_compaction_options(options);
+  no_bg_compaction_options.small_compaction_threshold = 0;
+
+  Gilmour no_bg_compaction_db;
+  Status s = no_bg_compaction_db.Open(no_bg_compaction_options,
+                                      "./db_no_bg_compaction");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&no_bg_compaction_db));
+  Gilmour db;
+  s = db.Open(options, "./db");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+
+  FieldValue fv;
+  std::vector<FieldValue> fvs_in;
+  uint64_t live_size = 0;
+  for (size_t i = 0; i < TEN_MILLION; ++i) {
+    fv.field = "FIELD_" + std::to_string(i);
+    fv.value = "VALUE_" + std::to_string(i);
+    fvs_in.push_back(fv);
+    if (i < TEN_THOUSAND) {
+      live_size += fv.field.size() + fv.value.size();
+    }
+  }
+
+  for (Gilmour* cur_db : {&no_bg_compaction_db, &db}) {
+    cur_db->HMSet("COMPACTION_KEY", fvs_in);
+    int64_t count;
+    cur_db->Del({"COMPACTION_KEY"}, &count);
+    std::vector<FieldValue> fvs(fvs_in.begin(), fvs_in.begin() + TEN_THOUSAND);
+    cur_db->HMSet("COMPACTION_KEY", fvs);
+  }
+
+  PrintSpaceAndHGetall("Test case 1 (before compaction),",
+                       &no_bg_compaction_db, "COMPACTION_KEY", live_size);
+
+  profiler::Start("Compaction_Full");
+  auto start = system_clock::now();
+  no_bg_compaction_db.Compact();
+  auto end = system_clock::now();
+  profiler::Stop();
+  auto cost = duration_cast<milliseconds>(end - start).count();
+  std::cout << "Full Compaction Cost: " << cost << "ms" << std::endl;
+  PrintSpaceAndHGetall("Test case 2 (after full compaction),",
+                       &no_bg_compaction_db, "COMPACTION_KEY", live_size);
+
+  // CompactRange会先Flush memtable, 等到所有的Flush和Compaction都结束
+  std::this_thread::sleep_for(seconds(1));
+  while (db.GetProperty("rocksdb.num-running-compactions") != 0
+    || db.GetProperty("rocksdb.num-running-flushes") != 0) {
+    std::this_thread::sleep_for(milliseconds(100));
+  }
+  PrintSpaceAndHGetall("Test case 3 (background compaction),",
+                       &db, "COMPACTION_KEY", live_size);
+}
+
+// Case 1 / Case 2 / Case 3
+// 测试场景 : 分别创建大小为1000, 1000000, 10000000的Hash表, 然后统计
+// 三种删除方式的耗时:
+//   1. Del, 默认配置, 除了删除meta之外对数据所在的前缀写一个Range
+//      Tombstone(DeleteRange)
+//   2. Del, range_delete_threshold = 0, 只删除meta, 数据留给
+//      Compaction Filter
+//   3. HDel所有的field, 逐条写Tombstone作为对比
+//
+// 说明 : 前两种方式的耗时与集合的大小无关, 写入的只有一个meta的
+// Tombstone和一个Range Tombstone, Range Tombstone覆盖的是旧版本的
+// 前缀, 新版本的读Seek到新的前缀, 不会进入这段范围.
+void BenchDel() {
+  printf("====== Del ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+  options.small_compaction_threshold = 0;
+  GilmourOptions no_range_delete_options(options);
+  no_range_delete_options.range_delete_threshold = 0;
+
+  Gilmour db;
+  Status s = db.Open(options, "./db");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&db));
+  Gilmour no_range_delete_db;
+  s = no_range_delete_db.Open(no_range_delete_options,
+                              "./db_no_range_delete");
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  engine_stats.Watch(DBProperty(&no_range_delete_db));
+
+  std::vector<int> sizes = {ONE_THOUSAND, ONE_MILLION, TEN_MILLION};
+  for (size_t idx = 0; idx < sizes.size(); idx++) {
+    std::vector<FieldValue> fvs;
+    std::vector<std::string> fields;
+    for (int i = 0; i < sizes[idx]; ++i) {
+      fvs.push_back({"FIELD_" + std::to_string(i),
+                     "VALUE_" + std::to_string(i)});
+      fields.push_back(fvs.back().field);
+    }
+    std::string key = "DEL_KEY_" + std::to_string(sizes[idx]);
+    db.HMSet(key + "_RANGE", fvs);
+    no_range_delete_db.HMSet(key + "_META", fvs);
+    db.HMSet(key + "_HDEL", fvs);
+
+    int64_t count;
+    profiler::Start("Del_Range");
+    auto start = system_clock::now();
+    db.Del({key + "_RANGE"}, &count);
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto range_cost = duration_cast<microseconds>(end - start).count();
+
+    profiler::Start("Del_Meta");
+    start = system_clock::now();
+    no_range_delete_db.Del({key + "_META"}, &count);
+    end = system_clock::now();
+    profiler::Stop();
+    auto meta_cost = duration_cast<microseconds>(end - start).count();
+
+    int32_t ret;
+    profiler::Start("Del_HDel");
+    start = system_clock::now();
+    db.HDel(key + "_HDEL", fields, &ret);
+    end = system_clock::now();
+    profiler::Stop();
+    auto hdel_cost = duration_cast<microseconds>(end - start).count();
+
+    std::cout << "Test case " << idx + 1 << ", " << sizes[idx]
+      << " Field HashTable, Del (DeleteRange) Cost: " << range_cost
+      << "us, Del (meta only) Cost: " << meta_cost
+      << "us, HDel all fields Cost: " << hdel_cost << "us" << std::endl;
+  }
+}
+
+// Case 1 / Case 2
+// 测试场景 : 分别写入10000000和100000000个String类型的key, key以乱序
+// 到达, 统计两种写入方式的耗时:
+//   1. MSet, 每1000个key一个WriteBatch, 经过WAL和memtable, 再由后台
+//      Flush和Compaction整理
+//   2. BulkLoader, 外部归并排序(内存上限256MB, 4个线程并行排序),
+//      SstFileWriter直接生成sst文件, 最后一次IngestExternalFile
+//
+// 说明 : BulkLoader的耗时包含排序, 生成sst文件以及Ingest的全部时间,
+// Ingest之后数据直接进入最底层, 不需要再经过Compaction.
+void BenchBulkLoad() {
+  printf("====== BulkLoad ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.options);
+
+  std::vector<int64_t> sizes = {TEN_MILLION, 10LL * TEN_MILLION};
+  for (size_t idx = 0; idx < sizes.size(); idx++) {
+    int64_t size = sizes[idx];
+    // 乘以一个与size互质的数, 得到0 ~ size - 1的一个排列
+    auto key_at = [size](int64_t i) {
+      return "KEY_" + std::to_string(i * 2654435761LL % size);
+    };
+
+    Gilmour batch_db;
+    Status s = batch_db.Open(options, "./db_batch_" + std::to_string(size));
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    profiler::Start("BulkLoad_MSet");
+    auto start = system_clock::now();
+    std::vector<KeyValue> kvs;
+    for (int64_t i = 0; i < size; i++) {
+      std::string key = key_at(i);
+      kvs.push_back({key, "VALUE_" + key});
+      if (kvs.size() == ONE_THOUSAND) {
+        batch_db.MSet(kvs);
+        kvs.clear();
+      }
+    }
+    batch_db.MSet(kvs);
+    auto end = system_clock::now();
+    profiler::Stop();
+    auto batch_cost = duration_cast<milliseconds>(end - start).count();
+
+    Gilmour bulk_load_db;
+    s = bulk_load_db.Open(options, "./db_bulk_load_" + std::to_string(size));
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    profiler::Start("BulkLoad_Loader");
+    start = system_clock::now();
+    BulkLoaderOptions bulk_load_options;
+    BulkLoader loader(&bulk_load_db, bulk_load_options);
+    for (int64_t i = 0; i < size; i++) {
+      std::string key = key_at(i);
+      loader.Set(key, "VALUE_" + key);
+    }
+    s = loader.Finish();
+    end = system_clock::now();
+    profiler::Stop();
+    auto bulk_load_cost = duration_cast<milliseconds>(end - start).count();
+    if (!s.ok()) {
+      printf("Bulk load failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+
+    std::cout << "Test case " << idx + 1 << ", " << size
+      << " Records, Batched MSet Cost: " << batch_cost
+      << "ms, BulkLoader Cost: " << bulk_load_cost << "ms" << std::endl;
+  }
+}
+
+// Case 1 ~ Case 5
+// 测试场景 : 20个线程并发Set, 每个线程写入100000个不同的key, 分别使用
+// 1, 2, 4, 8, 16个分片, 每种分片数各测两种方式:
+//   1. Direct, 命令在调用线程中直接执行, 只是写入不同分片的rocksdb实例
+//   2. ThreadPerShard, 每个分片一个线程, 调用线程把命令交给分片线程
+//      执行并等待结果
+//
+// 说明 : 单个rocksdb实例的所有写入都要经过同一个写队列(WAL + memtable),
+// 分片之后每个实例有自己的WAL, memtable和后台Compaction, 写入只在同一
+// 分片内排队. 1个分片的Direct方式相当于不分片.
+void BenchShards() {
+  printf("====== Shards ======\n");
+  ShardedGilmourOptions options;
+  options.gilmour_options.options.create_if_missing = true;
+  profiler::EngineStats engine_stats(&options.gilmour_options.options);
+
+  std::vector<std::vector<std::string>> thread_keys(THREADNUM);
+  for (int i = 0; i < THREADNUM; i++) {
+    for (int j = 0; j < ONE_HUNDRED_THOUSAND; j++) {
+      thread_keys[i].push_back(KEY_PREFIX + std::to_string(i) + "_"
+                               + std::to_string(j));
+    }
+  }
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+
+  // 每一轮都打开新的db, 属性总是取自当前这一个
+  ShardedGilmour* current = nullptr;
+  engine_stats.Watch([&current](const std::string& property) {
+    return current != nullptr ? current->GetProperty(property) : 0;
+  });
+
+  std::vector<int> shard_nums = {1, 2, 4, 8, 16};
+  for (size_t idx = 0; idx < shard_nums.size(); idx++) {
+    std::vector<int64_t> costs;
+    for (int thread_per_shard = 0; thread_per_shard < 2; thread_per_shard++) {
+      options.num_shards = shard_nums[idx];
+      options.thread_per_shard = thread_per_shard != 0;
+      ShardedGilmour db;
+      Status s = db.Open(options, "./db_shards_" + std::to_string(idx)
+                         + "_" + std::to_string(thread_per_shard));
+      if (!s.ok()) {
+        printf("Open db failed, error: %s\n", s.ToString().c_str());
+        return;
+      }
+      current = &db;
+
+      std::vector<std::thread> jobs;
+      profiler::Start(thread_per_shard ? "Shards_ThreadPerShard"
+                      : "Shards_Direct");
+      auto start = system_clock::now();
+      for (int i = 0; i < THREADNUM; i++) {
+        jobs.emplace_back([&db, &thread_keys, &value, i]() {
+          profiler::PinThread();
+          for (const auto& key : thread_keys[i]) {
+            db.Set(key, value);
+          }
+        });
+      }
+      for (auto& job : jobs) {
+        job.join();
+      }
+      auto end = system_clock::now();
+      profiler::Stop();
+      costs.push_back(duration_cast<milliseconds>(end - start).count());
+      current = nullptr;
+    }
+
+    int64_t num = static_cast<int64_t>(THREADNUM) * ONE_HUNDRED_THOUSAND;
+    std::cout << "Test case " << idx + 1 << ", " << shard_nums[idx]
+      << " Shards, " << num << " Set, Direct Cost: " << costs[0]
+      << "ms QPS: " << num * 1000 / std::max<int64_t>(costs[0], 1)
+      << ", ThreadPerShard Cost: " << costs[1] << "ms QPS: "
+      << num * 1000 / std::max<int64_t>(costs[1], 1) << std::endl;
+  }
+}
+
+// Case 1 / Case 2
+// 测试场景 : MultiThreadSet, 20个线程并发Set, 每个线程写入100000个不同
+// 的key, 分别在没有副本和有一个副本(同一台机器, 走回环地址)的主库上
+// 执行, 统计:
+//   1. 两种情况下主库的QPS, 以及副本带来的吞吐损失
+//   2. 写入过程中每10ms采样一次副本落后的sequence数, 取最大值
+//   3. 写入结束之后副本追上主库的时间
+//   4. 同步的字节数, 压缩前后
+//
+// 说明 : 副本先全量同步空库的快照, 之后主库的每个发送线程用
+// GetUpdatesSince()读WAL, 按256KB一段压缩发送, 副本的4个apply线程按
+// key的hash分担写入. 主库的额外开销是读WAL, 压缩和发送.
+void BenchReplication() {
+  printf("====== Replication ======\n");
+  GilmourOptions options;
+  options.options.create_if_missing = true;
+  // 副本落后时要从WAL中读, 刷盘之后的WAL文件也要保留
+  options.options.WAL_ttl_seconds = 3600;
+  options.options.WAL_size_limit_MB = 4096;
+  profiler::EngineStats engine_stats(&options.options);
+  ReplicationOptions replication_options;
+
+  std::vector<std::vector<std::string>> thread_keys(THREADNUM);
+  for (int i = 0; i < THREADNUM; i++) {
+    for (int j = 0; j < ONE_HUNDRED_THOUSAND; j++) {
+      thread_keys[i].push_back(KEY_PREFIX + std::to_string(i) + "_"
+                               + std::to_string(j));
+    }
+  }
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+
+  Gilmour* current = nullptr;
+  engine_stats.Watch([&current](const std::string& property) {
+    return current != nullptr ? current->GetProperty(property) : 0;
+  });
+
+  int64_t costs[2];
+  for (int with_replica = 0; with_replica < 2; with_replica++) {
+    Gilmour db;
+    Status s = db.Open(options, "./db_replication_primary_"
+                       + std::to_string(with_replica));
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    current = &db;
+    ReplicationMaster master(&db, replication_options);
+    Replica replica(replication_options);
+    ReplicationStats stats;
+    if (with_replica) {
+      s = master.Start(9321);
+      if (s.ok()) {
+        s = replica.Open(options, "./db_replication_replica",
+                         "127.0.0.1:9321");
+      }
+      if (!s.ok()) {
+        printf("Start replication failed, error: %s\n",
+               s.ToString().c_str());
+        return;
+      }
+      // 等全量同步完成, 只统计增量同步
+      do {
+        usleep(10000);
+        replica.GetStats(&stats);
+      } while (stats.connections == 0 || stats.full_syncs == 0
+               || stats.applied_sequence < stats.primary_sequence);
+    }
+
+    std::atomic<bool> writing(true);
+    uint64_t max_lag = 0;
+    std::thread sampler;
+    if (with_replica) {
+      sampler = std::thread([&]() {
+        while (writing) {
+          ReplicationStats primary, sample;
+          master.GetStats(&primary);
+          replica.GetStats(&sample);
+          if (primary.primary_sequence > sample.applied_sequence) {
+            max_lag = std::max(max_lag, primary.primary_sequence
+                               - sample.applied_sequence);
+          }
+          usleep(10000);
+        }
+      });
+    }
+
+    std::vector<std::thread> jobs;
+    profiler::Start(with_replica ? "Replication_OneReplica"
+                    : "Replication_NoReplica");
+    auto start = system_clock::now();
+    for (int i = 0; i < THREADNUM; i++) {
+      jobs.emplace_back([&db, &thread_keys, &value, i]() {
+        profiler::PinThread();
+        for (const auto& key : thread_keys[i]) {
+          db.Set(key, value);
+        }
+      });
+    }
+    for (auto& job : jobs) {
+      job.join();
+    }
+    auto end = system_clock::now();
+    profiler::Stop();
+    costs[with_replica] = duration_cast<milliseconds>(end - start).count();
+    writing = false;
+    if (!with_replica) {
+      current = nullptr;
+      continue;
+    }
+    sampler.join();
+
+    // 主库不再写入, 等副本应用到主库最新的sequence
+    ReplicationStats primary;
+    master.GetStats(&primary);
+    do {
+      usleep(1000);
+      replica.GetStats(&stats);
+    } while (stats.applied_sequence < primary.primary_sequence);
+    auto caught_up = system_clock::now();
+    replica.Close();
+    master.Stop();
+    current = nullptr;
+
+    int64_t num = static_cast<int64_t>(THREADNUM) * ONE_HUNDRED_THOUSAND;
+    std::cout << "Test case 1, MultiThread Set " << num
+      << " KV, No Replica Cost: " << costs[0] << "ms QPS: "
+      << num * 1000 / std::max<int64_t>(costs[0], 1)
+      << ", One Replica Cost: " << costs[1] << "ms QPS: "
+      << num * 1000 / std::max<int64_t>(costs[1], 1)
+      << ", Overhead: " << (costs[1] - costs[0]) * 100
+        / std::max<int64_t>(costs[0], 1) << "%" << std::endl;
+    std::cout << "Test case 2, Replication Max Lag: " << max_lag
+      << " Sequences, Catch Up After Writes: "
+      << duration_cast<milliseconds>(caught_up - end).count()
+      << "ms, Segments: " << stats.segments << ", Bytes: " << stats.bytes
+      << " (" << stats.raw_bytes << " before compression)" << std::endl;
+  }
+}
+
+// 90%的读落在前hot个key上, 其余的均匀分布在全部key上, 返回每个
+// window_ms时间窗口内完成的读
+static std::vector<int64_t> RunHotReads(Gilmour* db, int64_t num_keys,
+                                        int64_t hot, int windows,
+                                        int window_ms) {
+  std::vector<std::atomic<int64_t>> counts(windows);
+  for (auto& count : counts) {
+    count = 0;
+  }
+  auto start = system_clock::now();
+  auto deadline = start + milliseconds(windows * window_ms);
+  std::vector<std::thread> jobs;
+  for (int i = 0; i < THREADNUM; i++) {
+    jobs.emplace_back([&, i]() {
+      profiler::PinThread();
+      default_random_engine engine(i);
+      std::string value;
+      while (true) {
+        auto now = system_clock::now();
+        if (now >= deadline) {
+          break;
+        }
+        int64_t id = engine() % 10 != 0 ? engine() % hot
+          : engine() % num_keys;
+        db->Get(KEY_PREFIX + std::to_string(id), &value);
+        int64_t window = duration_cast<milliseconds>(now - start).count()
+          / window_ms;
+        counts[std::min<int64_t>(window, windows - 1)]++;
+      }
+    });
+  }
+  for (auto& job : jobs) {
+    job.join();
+  }
+  std::vector<int64_t> result;
+  for (auto& count : counts) {
+    result.push_back(count);
+  }
+  return result;
+}
+
+// Case 1 / Case 2
+// 测试场景 : 20个线程并发Set, 每个线程写入100000个不同的key, 写入期间不
+// 刷盘, 关闭时也不刷盘(模拟崩溃), 数据全部在WAL中. 分别用1个和8个分片,
+// 统计重新打开(重放WAL)的耗时.
+//
+// Case 3 / Case 4
+// 测试场景 : 写入1000000个key并刷盘, 用90%的读落在前10000个key上的负载
+// 跑2秒之后关闭, 关闭时保存热点key. 分别在不预热和预热热点key的情况下
+// 重新打开, 用同样的负载跑3秒, 统计打开的耗时, 预热完成的时间以及每
+// 500ms的QPS.
+//
+// 说明 : 每个分片重放自己的WAL, 多个分片同时打开, 恢复的时间取决于最大
+// 的分片而不是全部数据. 预热在后台线程中读热点key的meta和集合的前几个
+// 成员, 不阻塞Open, 重启之后的前几秒QPS是否接近正常水平是主要的指标.
+void BenchRestart() {
+  printf("====== Restart ======\n");
+  ShardedGilmourOptions options;
+  options.gilmour_options.options.create_if_missing = true;
+  options.gilmour_options.options.write_buffer_size = 1024 << 20;
+  options.gilmour_options.options.avoid_flush_during_shutdown = true;
+  // 恢复之后不刷盘, 每次打开都要重放完整的WAL
+  options.gilmour_options.options.avoid_flush_during_recovery = true;
+  options.gilmour_options.hot_keys = 0;
+  options.thread_per_shard = false;
+  profiler::EngineStats engine_stats(&options.gilmour_options.options);
+
+  ShardedGilmour* sharded_current = nullptr;
+  Gilmour* current = nullptr;
+  engine_stats.Watch([&sharded_current, &current](const std::string& property) {
+    if (sharded_current != nullptr) {
+      return sharded_current->GetProperty(property);
+    }
+    return current != nullptr ? current->GetProperty(property) : 0;
+  });
+
+  std::string value;
+  GenerateRandomString(VALUE_PREFIX, VALUE_SIZE, &value);
+  std::vector<int> shard_nums = {1, 8};
+  for (size_t idx = 0; idx < shard_nums.size(); idx++) {
+    options.num_shards = shard_nums[idx];
+    std::string path = "./db_restart_" + std::to_string(shard_nums[idx]);
+    {
+      ShardedGilmour db;
+      Status s = db.Open(options, path);
+      if (!s.ok()) {
+        printf("Open db failed, error: %s\n", s.ToString().c_str());
+        return;
+      }
+      std::vector<std::thread> jobs;
+      for (int i = 0; i < THREADNUM; i++) {
+        jobs.emplace_back([&db, &value, i]() {
+          for (int j = 0; j < ONE_HUNDRED_THOUSAND; j++) {
+            db.Set(KEY_PREFIX + std::to_string(i) + "_" + std::to_string(j),
+                   value);
+          }
+        });
+      }
+      for (auto& job : jobs) {
+        job.join();
+      }
+    }
+    DropPageCache();
+    profiler::Start("Restart_Recovery");
+    auto start = system_clock::now();
+    ShardedGilmour db;
+    Status s = db.Open(options, path);
+    auto end = system_clock::now();
+    sharded_current = &db;
+    profiler::Stop();
+    sharded_current = nullptr;
+    if (!s.ok()) {
+      printf("Reopen db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    std::cout << "Test case " << idx + 1 << ", " << shard_nums[idx]
+      << " Shards, Recover " << THREADNUM * ONE_HUNDRED_THOUSAND
+      << " Set from WAL Cost: "
+      << duration_cast<milliseconds>(end - start).count() << "ms"
+      << std::endl;
+  }
+
+  // 沿用engine_stats挂在options上的统计, 恢复正常的刷盘
+  GilmourOptions gilmour_options = options.gilmour_options;
+  gilmour_options.options.write_buffer_size = 64 << 20;
+  gilmour_options.options.avoid_flush_during_shutdown = false;
+  gilmour_options.options.avoid_flush_during_recovery = false;
+  gilmour_options.hot_keys = TEN_THOUSAND;
+  const int64_t num_keys = ONE_MILLION;
+  const int64_t hot = TEN_THOUSAND;
+  {
+    Gilmour db;
+    Status s = db.Open(gilmour_options, "./db_restart_warm");
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    std::vector<KeyValue> kvs;
+    for (int64_t i = 0; i < num_keys; i++) {
+      kvs.push_back({KEY_PREFIX + std::to_string(i), value});
+      if (kvs.size() == ONE_THOUSAND) {
+        db.MSet(kvs);
+        kvs.clear();
+      }
+    }
+  }
+  {
+    // 重放WAL时刷盘, 之后的读都来自sst文件
+    Gilmour db;
+    db.Open(gilmour_options, "./db_restart_warm");
+    RunHotReads(&db, num_keys, hot, 4, 500);
+  }
+
+  for (int preload = 0; preload < 2; preload++) {
+    gilmour_options.hot_keys = preload ? TEN_THOUSAND : 0;
+    DropPageCache();
+    profiler::Start(preload ? "Restart_Preload" : "Restart_Cold");
+    auto start = system_clock::now();
+    Gilmour db;
+    Status s = db.Open(gilmour_options, "./db_restart_warm");
+    auto opened = system_clock::now();
+    if (!s.ok()) {
+      printf("Reopen db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+    current = &db;
+    std::atomic<int64_t> preload_ms(0);
+    std::thread watcher([&]() {
+      while (db.GetProperty("gilmour.preload-running") != 0) {
+        std::this_thread::sleep_for(milliseconds(1));
+      }
+      preload_ms = duration_cast<milliseconds>(system_clock::now()
+                                               - start).count();
+    });
+    std::vector<int64_t> counts = RunHotReads(&db, num_keys, hot, 6, 500);
+    watcher.join();
+    profiler::Stop();
+    current = nullptr;
+
+    std::cout << "Test case " << preload + 3 << (preload ? ", Preload "
+                                                 : ", No Preload ")
+      << db.GetProperty("gilmour.preloaded-keys") << " Hot Keys, Open Cost: "
+      << duration_cast<milliseconds>(opened - start).count() << "ms";
+    if (preload) {
+      std::cout << ", Preload Done After: " << preload_ms << "ms";
+    }
+    std::cout << ", QPS per 500ms:";
+    for (auto count : counts) {
+      std::cout << " " << count * 2;
+    }
+    std::cout << std::endl;
+  }
+}
+
+static void usage() {
+  std::cout << "Usage: " << std::endl;
+  std::cout << "      ./benchmark [Glob|KeyCodec|Keys|HGetall|SMembers|ZRank|LRange|Packed|Batch|Compaction|Del|BulkLoad|Shards|Replication|Restart] [--profile] [--cpus=0-7|node:N]\n";
+}
+
+int main(int argc, char *argv[]) {
+  argc = profiler::Profiler::Instance()->ParseFlags(argc, argv);
+  argc = profiler::Placement::Instance()->ParseFlags(argc, argv);
+  // Shards, Replication和Restart之外的场景都在主线程中执行
+  profiler::PinThread();
+  if (argc != 2) {
+    usage();
+    exit(-1);
+  }
+  std::string interface = std::string(argv[1]);
+
+  if (interface == "Glob") {
+    BenchGlob();
+  } else if (interface == "KeyCodec") {
+    BenchKeyCodec();
+  } else if (interface == "Keys") {
+    BenchKeys();
+  } else if (interface == "HGetall") {
+    BenchHGetall();
+  } else if (interface == "SMembers") {
+    BenchSMembers();
+  } else if (interface == "ZRank") {
+    BenchZRank();
+  } else if (interface == "LRange") {
+    BenchLRange();
+  } else if (interface == "Packed") {
+    BenchPacked();
+  } else if (interface == "Batch") {
+    BenchBatch();
+  } else if (interface == "Compaction") {
+    BenchCompaction();
+  } else if (interface == "Del") {
+    BenchDel();
+  } else if (interface == "BulkLoad") {
+    BenchBulkLoad();
+  } else if (interface == "Shards") {
+    BenchShards();
+  } else if (interface == "Replication") {
+    BenchReplication();
+  } else if (interface == "Restart") {
+    BenchRestart();
+  } else {
+   usage();
+  }
+  return 0;
+}
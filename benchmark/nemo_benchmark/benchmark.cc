@@ -10,6 +10,11 @@
 #include <functional>
 
 #include "nemo.h"
+#include "dataset.h"
+// nemo::Options不暴露RocksDB的Options, Engine Stats中只有进程的磁盘IO
+#include "engine_stats.h"
+#include "placement.h"
+#include "profiler.h"
 
 const int KEY_SIZE = 50;
 const int VALUE_SIZE = 50;
@@ -31,6 +36,7 @@ using namespace std::chrono;
 using std::default_random_engine;
 
 static int32_t last_seed = 0;
+static std::string dataset_path;
 const std::string KEY_PREFIX = "KEY_";
 const std::string VALUE_PREFIX = "VALUE_";
 const std::string FIELD_PREFIX = "FIELD_";
@@ -62,9 +68,23 @@ void GenerateRandomString(const std::string& prefix,
   }
 }
 
+// 指定了数据集文件时直接mmap数据集(由benchmark/dataset中的
+// dataset_generator生成), 否则和之前一样在内存中生成数据
+static bool OpenDataset(dataset::Dataset* ds) {
+  if (dataset_path.empty()) {
+    return false;
+  }
+  if (!ds->Open(dataset_path)) {
+    printf("Open dataset failed, error: %s\n", ds->error().c_str());
+    exit(-1);
+  }
+  return true;
+}
+
 void BenchSet() {
   printf("====== Set ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -72,29 +92,44 @@ void BenchSet() {
     printf("Open db failed\n");
     return;
   }
+  dataset::Dataset ds;
   nemo::KV kv;
   std::vector<nemo::KV> kvs;
-  for (int i = 0; i < TEN_MILLION; i++) {
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.val);
-    kvs.push_back(kv);
+  if (!OpenDataset(&ds)) {
+    for (int i = 0; i < TEN_MILLION; i++) {
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.val);
+      kvs.push_back(kv);
+    }
   }
 
+  profiler::Start("Set");
   auto start = system_clock::now();
-  for (const auto& kv : kvs) {
-    db->Set(kv.key, kv.val);
+  if (ds.size() != 0) {
+    for (auto iter = ds.begin(); iter != ds.end(); ++iter) {
+      dataset::Record record = *iter;
+      // Nemo的接口只接受std::string, 记录需要先拷贝一次
+      db->Set(record.key.ToString(), record.value.ToString());
+    }
+  } else {
+    for (const auto& kv : kvs) {
+      db->Set(kv.key, kv.val);
+    }
   }
   auto end = system_clock::now();
+  profiler::Stop();
+  uint64_t num = ds.size() != 0 ? ds.size() : kvs.size();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
-  std::cout << "Test Set " << kvs.size() << " KV Cost: " << cost << "s QPS: "
-    << kvs.size() / cost << std::endl;
+  std::cout << "Test Set " << num << " KV Cost: " << cost << "s QPS: "
+    << num / cost << std::endl;
   delete db;
 }
 
 void BenchMultiThreadSet() {
   printf("====== Multi Thread Set ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -103,18 +138,34 @@ void BenchMultiThreadSet() {
     return;
   }
 
+  dataset::Dataset ds;
   nemo::KV kv;
   std::vector<nemo::KV> kvs;
-  for (int i = 0; i < TEN_MILLION; i++) {
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
-    GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.val);
-    kvs.push_back(kv);
+  if (!OpenDataset(&ds)) {
+    for (int i = 0; i < TEN_MILLION; i++) {
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.key);
+      GenerateRandomString(KEY_PREFIX, KEY_SIZE, &kv.val);
+      kvs.push_back(kv);
+    }
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("MultiThreadSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
+    if (ds.size() != 0) {
+      // 所有线程共享同一份映射, 不再各自拷贝一份数据
+      jobs.emplace_back([&db, &ds]() {
+        profiler::PinThread();
+        for (auto iter = ds.begin(); iter != ds.end(); ++iter) {
+          dataset::Record record = *iter;
+          db->Set(record.key.ToString(), record.value.ToString());
+        }
+      });
+      continue;
+    }
     jobs.emplace_back([&db](std::vector<nemo::KV> kvs) {
+      profiler::PinThread();
       for (const auto& kv : kvs) {
         db->Set(kv.key, kv.val);
       }
@@ -124,16 +175,19 @@ void BenchMultiThreadSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
+  uint64_t num = ds.size() != 0 ? ds.size() : kvs.size();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
-  std::cout << "Test MultiThread Set " << THREADNUM * kvs.size() << " KV Cost: "
-    << cost << "s QPS: " << (THREADNUM * kvs.size()) / cost << std::endl;
+  std::cout << "Test MultiThread Set " << THREADNUM * num << " KV Cost: "
+    << cost << "s QPS: " << (THREADNUM * num) / cost << std::endl;
   delete db;
 }
 
 void BenchMSet() {
   printf("====== MSet ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -150,11 +204,13 @@ void BenchMSet() {
     kvs.push_back(kv);
   }
 
+  profiler::Start("MSet");
   auto start = system_clock::now();
   for (int i = 0; i < 1000000; i++) {
     db->MSet(kvs);
   }
   auto end = system_clock::now();
+  profiler::Stop();
 
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
@@ -166,6 +222,7 @@ void BenchMSet() {
 void BenchScan() {
   printf("====== Scan ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -191,6 +248,7 @@ void BenchScan() {
   std::string pattern = "SCAN_KEY*";
   int64_t cursor_origin, cursor_ret = 0;
   std::vector<std::string> keys;
+  profiler::Start("Scan");
   auto start = system_clock::now();
   for (; ;) {
     total += keys.size();
@@ -202,6 +260,7 @@ void BenchScan() {
     }
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Scan " << total
@@ -213,6 +272,7 @@ void BenchScan() {
 void BenchKeys() {
   printf("====== Keys * ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -253,6 +313,7 @@ void BenchKeys() {
   std::string pattern = "*";
   int64_t cursor_origin, cursor_ret = 0;
   std::vector<std::string> keys;
+  profiler::Start("Keys");
   auto start = system_clock::now();
   for (; ;) {
     keys.clear();
@@ -264,6 +325,7 @@ void BenchKeys() {
     }
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Keys " << total
@@ -275,6 +337,7 @@ void BenchKeys() {
 void BenchHSet() {
   printf("====== HSet ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -293,9 +356,11 @@ void BenchHSet() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("HSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<nemo::FV> fvs) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         int32_t ret;
         std::string cur_key = "KEYS_HSET_" + std::to_string(index * TEN_THOUSAND + j);
@@ -309,6 +374,7 @@ void BenchHSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test HSet " << THREADNUM * TEN_THOUSAND << " Hashes Table Cost: "
@@ -319,6 +385,7 @@ void BenchHSet() {
 void BenchHMSet() {
   printf("====== HMSet ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -337,9 +404,11 @@ void BenchHMSet() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("HMSet");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<nemo::FV> fvs) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         db->HMSet("KEYS_HMSET_" + std::to_string(index * TEN_THOUSAND + j), fvs);
       }
@@ -349,6 +418,7 @@ void BenchHMSet() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test HMSet " << THREADNUM * TEN_THOUSAND << " Hashes Table Cost: "
@@ -359,6 +429,7 @@ void BenchHMSet() {
 void BenchHDel() {
   printf("====== HDel ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -381,11 +452,13 @@ void BenchHDel() {
   }
   db->HMSet("HDEL_KEY", fvs);
 
+  profiler::Start("HDel");
   auto start = system_clock::now();
   for (const auto& field : fields) {
     db->HDel("HDEL_KEY", field);
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test HDel " << fvs.size()
@@ -396,6 +469,7 @@ void BenchHDel() {
 void BenchHKeys() {
   printf("====== HKeys ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -423,9 +497,11 @@ void BenchHKeys() {
   fvs.resize(TEN_THOUSAND);
   db->HMSet("HDEL_KEY", fvs);
 
+  profiler::Start("HKeys");
   auto start = system_clock::now();
   db->HKeys("HDEL_KEY", field);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test HKeys " << field.size() << " Field Hash Table Cost: " << cost
@@ -436,6 +512,7 @@ void BenchHKeys() {
 void BenchHGetall() {
   printf("====== HGetall ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -460,9 +537,11 @@ void BenchHGetall() {
   db->HMSet("HGETALL_KEY1", fvs_in);
 
   fvs_out.clear();
+  profiler::Start("HGetall_1");
   auto start = system_clock::now();
   db->HGetall("HGETALL_KEY1", fvs_out);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test case 1, HGetall " << fvs_out.size()
@@ -492,9 +571,11 @@ void BenchHGetall() {
   db->HMSet("HGETALL_KEY2", fvs_in);
 
   fvs_out.clear();
+  profiler::Start("HGetall_2");
   start = system_clock::now();
   db->HGetall("HGETALL_KEY2", fvs_out);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test case 2, HGetall " << fvs_out.size()
@@ -506,6 +587,7 @@ void BenchHGetall() {
 void BenchSAdd() {
   printf("====== SAdd ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -520,9 +602,11 @@ void BenchSAdd() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SAdd");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index, std::vector<std::string> members_in) {
+      profiler::PinThread();
       for (size_t j = 0; j < TEN_THOUSAND ; ++j) {
         int64_t ret;
         std::string cur_key = "SADD_KEY" + std::to_string(index * TEN_THOUSAND + j);
@@ -536,6 +620,7 @@ void BenchSAdd() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SAdd " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -547,6 +632,7 @@ void BenchSAdd() {
 void BenchSRem() {
   printf("====== SRem ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -570,11 +656,13 @@ void BenchSRem() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SRem");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index,
                             std::vector<std::string> keys,
                             std::vector<std::vector<std::string>> sets) {
+      profiler::PinThread();
       int64_t ret;
       for (int j = 0; j < TEN_THOUSAND; j++) {
         std::string key = keys[index * TEN_THOUSAND + j];
@@ -588,6 +676,7 @@ void BenchSRem() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SRem " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -599,6 +688,7 @@ void BenchSRem() {
 void BenchSMove() {
   printf("====== SMove ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -626,12 +716,14 @@ void BenchSMove() {
   }
 
   std::vector<std::thread> jobs;
+  profiler::Start("SMove");
   auto start = system_clock::now();
   for (size_t i = 0; i < THREADNUM; ++i) {
     jobs.emplace_back([&db](size_t index,
                             std::vector<std::string> keys_source,
                             std::vector<std::string> keys_destination,
                             std::vector<std::vector<std::string>> sets) {
+      profiler::PinThread();
       int64_t ret;
       for (int j = 0; j < TEN_THOUSAND; j++) {
         std::string source = keys_source[index * TEN_THOUSAND + j];
@@ -646,6 +738,7 @@ void BenchSMove() {
     job.join();
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::seconds>(elapsed_seconds).count();
   std::cout << "Test SMove " << (THREADNUM * TEN_THOUSAND) << " Sets Cost: " << cost
@@ -657,6 +750,7 @@ void BenchSMove() {
 void BenchSPop() {
   printf("====== SPop ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -675,11 +769,13 @@ void BenchSPop() {
     db->SAdd("SPOP_KEY", member, &ret);
   }
 
+  profiler::Start("SPop");
   auto start = system_clock::now();
   for (uint32_t i = 0; i < ONE_HUNDRED_THOUSAND; ++i) {
     db->SPop("SPOP_KEY", members_out);
   }
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test SPop " << TEN_THOUSAND << " Cost: " << cost << "ms" << std::endl;
@@ -690,6 +786,7 @@ void BenchSPop() {
 void BenchSMembers() {
   printf("====== SMembers ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -705,9 +802,11 @@ void BenchSMembers() {
     db->SAdd("SMEMBERS_KEY1", "MEMBER_" + std::to_string(i), &ret);
   }
 
+  profiler::Start("SMembers_1");
   auto start = system_clock::now();
   db->SMembers("SMEMBERS_KEY1", members_out);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Case 1, SMembers " << members_out.size() << " Cost: " << cost << "ms" << std::endl;
@@ -723,9 +822,11 @@ void BenchSMembers() {
     db->SAdd("SMEMBERS_KEY2", "MEMBER_" + std::to_string(i), &ret);
   }
 
+  profiler::Start("SMembers_2");
   start = system_clock::now();
   db->SMembers("SMEMBERS_KEY2", members_out);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test Case 2, SMembers " << members_out.size() << " Cost: " << cost << "ms" << std::endl;
@@ -735,6 +836,7 @@ void BenchSMembers() {
 void BenchLRange() {
   printf("====== LRange ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
   nemo::Nemo* db = new nemo::Nemo("./db", options);
 
@@ -755,33 +857,41 @@ void BenchLRange() {
   std::vector<nemo::IV> result;
 
   // 100000
+  profiler::Start("LRange_1");
   auto start = system_clock::now();
   db->LRange("BENCHMARK_LRANGE", 0, ONE_HUNDRED_THOUSAND, result);
   auto end = system_clock::now();
+  profiler::Stop();
   duration<double> elapsed_seconds = end - start;
   auto cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << ONE_HUNDRED_THOUSAND << "  interval Cost: " << cost << "ms" << std::endl;
 
   // 1000000
+  profiler::Start("LRange_2");
   start = system_clock::now();
   db->LRange("BENCHMARK_LRANGE", 0, ONE_MILLION, result);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << ONE_MILLION << " interval Cost: " << cost << "ms" << std::endl;
 
   // 10000000
+  profiler::Start("LRange_3");
   start = system_clock::now();
   db->LRange("BENCHMARK_LRANGE", 0, TEN_MILLION, result);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << TEN_MILLION << " interval Cost: " << cost << "ms" << std::endl;
 
   // 10 * 10000000
+  profiler::Start("LRange_4");
   start = system_clock::now();
   db->LRange("BENCHMARK_LRANGE", 0, 10 * TEN_MILLION, result);
   end = system_clock::now();
+  profiler::Stop();
   elapsed_seconds = end - start;
   cost = duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
   std::cout << "Test LRange " << 10 * TEN_MILLION << " interval Cost: " << cost << "ms" << std::endl;
@@ -790,6 +900,7 @@ void BenchLRange() {
 void BenchZAdd() {
   printf("====== ZAdd ======\n");
   nemo::Options options;
+  profiler::EngineStats engine_stats;
   options.create_if_missing = true;
 
   nemo::SM sm;
@@ -803,9 +914,11 @@ void BenchZAdd() {
   // Test Case 1, Don't do batch
   nemo::Nemo* test1_db = new nemo::Nemo("./db_zadd_test1", options);
   std::vector<std::thread> test1_jobs;
+  profiler::Start("ZAdd_1");
   auto test1_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test1_jobs.emplace_back([&test1_db](std::vector<nemo::SM> sms) {
+      profiler::PinThread();
       size_t idx;
       int64_t ret = 0;
       for (idx = 0; idx + BATCH_LIMIT_TEM < sms.size(); idx += BATCH_LIMIT_TEM) {
@@ -827,6 +940,7 @@ void BenchZAdd() {
   delete test1_db;
 
   auto test1_end = system_clock::now();
+  profiler::Stop();
   duration<double> test1_elapsed_seconds = test1_end - test1_start;
   auto test1_cost = duration_cast<std::chrono::milliseconds>(test1_elapsed_seconds).count();
   std::cout << "Test case 1, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test1_cost << "ms" << std::endl;
@@ -835,9 +949,11 @@ void BenchZAdd() {
   // Test Case 2, Make batch in groups of ten
   nemo::Nemo* test2_db = new nemo::Nemo("./db_zadd_test2", options);
   std::vector<std::thread> test2_jobs;
+  profiler::Start("ZAdd_2");
   auto test2_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test2_jobs.emplace_back([&test2_db](std::vector<nemo::SM> sms) {
+      profiler::PinThread();
       size_t idx;
       int64_t ret = 0;
       for (idx = 0; idx + BATCH_LIMIT_ONE_HUNDRED < sms.size(); idx += BATCH_LIMIT_ONE_HUNDRED) {
@@ -859,6 +975,7 @@ void BenchZAdd() {
   delete test2_db;
 
   auto test2_end = system_clock::now();
+  profiler::Stop();
   duration<double> test2_elapsed_seconds = test2_end - test2_start;
   auto test2_cost = duration_cast<std::chrono::milliseconds>(test2_elapsed_seconds).count();
   std::cout << "Test case 2, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test2_cost << "ms" << std::endl;
@@ -867,9 +984,11 @@ void BenchZAdd() {
   // Test Case 3, Make batch in groups of one hundred
   nemo::Nemo* test3_db = new nemo::Nemo("./db_zadd_test3", options);
   std::vector<std::thread> test3_jobs;
+  profiler::Start("ZAdd_3");
   auto test3_start = system_clock::now();
   for (size_t i = 0; i < THREADNUM_SIX; ++i) {
     test3_jobs.emplace_back([&test3_db](std::vector<nemo::SM> sms) {
+      profiler::PinThread();
       size_t idx;
       int64_t ret = 0;
       for (idx = 0; idx + BATCH_LIMIT_ONE_THOUSAND < sms.size(); idx += BATCH_LIMIT_ONE_THOUSAND) {
@@ -891,6 +1010,7 @@ void BenchZAdd() {
   delete test3_db;
 
   auto test3_end = system_clock::now();
+  profiler::Stop();
   duration<double> test3_elapsed_seconds = test3_end - test3_start;
   auto test3_cost = duration_cast<std::chrono::milliseconds>(test3_elapsed_seconds).count();
   std::cout << "Test case 3, MultiThread ZAdd " << THREADNUM_SIX * sms.size() << " Score Member Cost: " << test3_cost << "ms" << std::endl;
@@ -898,15 +1018,20 @@ void BenchZAdd() {
 
 static void usage() {
   std::cout << "Usage: " << std::endl;
-  std::cout << "      ./benchmark_nemo [Set|MultiThreadSet|Scan|Keys|HSet|HMSet|HDel|HKeys|HGetall|SAdd|SRem|SMove|SMembers|LRange]\n";
+  std::cout << "      ./benchmark_nemo [Set|MultiThreadSet|Scan|Keys|HSet|HMSet|HDel|HKeys|HGetall|SAdd|SRem|SMove|SMembers|LRange] [dataset] [--profile] [--cpus=0-7|node:N]\n";
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
+  argc = profiler::Profiler::Instance()->ParseFlags(argc, argv);
+  argc = profiler::Placement::Instance()->ParseFlags(argc, argv);
+  if (argc != 2 && argc != 3) {
     usage();
     exit(-1);
   }
   std::string interface = std::string(argv[1]);
+  if (argc == 3) {
+    dataset_path = std::string(argv[2]);
+  }
 
   if (interface == "Set") {
     BenchSet();
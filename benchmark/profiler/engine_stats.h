@@ -0,0 +1,231 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef BENCHMARK_ENGINE_STATS_H_
+#define BENCHMARK_ENGINE_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/listener.h"
+#include "rocksdb/options.h"
+#include "rocksdb/statistics.h"
+
+#include "profiler.h"
+
+// Snapshots what the storage engine did during every measured phase
+// and prints the deltas next to the benchmark result, so a throughput
+// difference can be traced to flushes, compactions, stalls or cache
+// misses instead of being guessed at:
+//
+//   - RocksDB tickers, when the engine takes rocksdb::Options: user
+//     bytes written, WAL/flush/compaction bytes and the write
+//     amplification they add up to, stall micros, block cache hits
+//   - memtable flushes and compactions finished, from an EventListener
+//   - the L0 file count and pending compaction bytes, for the engines
+//     which expose the db properties through Watch()
+//   - the bytes the process read from and wrote to the disk, from
+//     /proc/self/io, these are available for every engine
+//
+// Lives as long as the scenario, it registers with the profiler in
+// the constructor and unregisters in the destructor.
+namespace profiler {
+
+class EngineStats : public PhaseListener {
+ public:
+  typedef std::function<uint64_t(const std::string& property)> PropertyGetter;
+
+  // For the engines whose rocksdb::Options can not be reached
+  EngineStats() {
+    Profiler::Instance()->AddListener(this);
+  }
+
+  // Must be called before the db is opened with options
+  explicit EngineStats(rocksdb::Options* options)
+      : statistics_(rocksdb::CreateDBStatistics()),
+        listener_(std::make_shared<Listener>()) {
+    options->statistics = statistics_;
+    options->listeners.push_back(listener_);
+    Profiler::Instance()->AddListener(this);
+  }
+
+  ~EngineStats() {
+    Profiler::Instance()->RemoveListener(this);
+  }
+
+  // The properties of every watched db are added up
+  void Watch(const PropertyGetter& getter) {
+    getters_.push_back(getter);
+  }
+
+  void OnPhaseStart(const std::string& scenario) override {
+    Take(&start_);
+  }
+
+  void OnPhaseStop(const std::string& scenario) override {
+    Snapshot end;
+    Take(&end);
+    std::string report;
+    if (statistics_ != nullptr) {
+      uint64_t user_bytes = Delta(end, kBytesWritten);
+      uint64_t written = Delta(end, kWalBytes) + Delta(end, kFlushBytes)
+        + Delta(end, kCompactWriteBytes);
+      uint64_t hit = Delta(end, kBlockCacheHit);
+      uint64_t miss = Delta(end, kBlockCacheMiss);
+      report += " User Write: " + MB(user_bytes);
+      if (user_bytes != 0) {
+        report += " Write Amp: " + Ratio(written, user_bytes);
+      }
+      report += " Flush: " + std::to_string(Delta(end, kFlushes))
+        + " (" + MB(Delta(end, kFlushBytes)) + ")"
+        + " Compaction: " + std::to_string(Delta(end, kCompactions))
+        + " (read " + MB(Delta(end, kCompactReadBytes))
+        + " write " + MB(Delta(end, kCompactWriteBytes)) + ")"
+        + " Stall: " + std::to_string(Delta(end, kStallMicros)) + "us";
+      if (hit + miss != 0) {
+        report += " Block Cache Hit Rate: " + Ratio(hit * 100, hit + miss)
+          + "%";
+      }
+    }
+    if (!getters_.empty()) {
+      report += " L0 Files: " + std::to_string(start_.values[kL0Files])
+        + " -> " + std::to_string(end.values[kL0Files])
+        + " Pending Compaction: "
+        + MB(end.values[kPendingCompactionBytes]);
+    }
+    if (end.has_io) {
+      report += " Disk Read: " + MB(Delta(end, kDiskRead))
+        + " Disk Write: " + MB(Delta(end, kDiskWrite));
+    }
+    printf("Engine Stats %s:%s\n", scenario.c_str(), report.c_str());
+  }
+
+ private:
+  enum Value {
+    kBytesWritten = 0,
+    kWalBytes,
+    kFlushBytes,
+    kCompactReadBytes,
+    kCompactWriteBytes,
+    kStallMicros,
+    kBlockCacheHit,
+    kBlockCacheMiss,
+    kFlushes,
+    kCompactions,
+    kL0Files,
+    kPendingCompactionBytes,
+    kDiskRead,
+    kDiskWrite,
+    kNumValues,
+  };
+
+  struct Snapshot {
+    Snapshot() : has_io(false) {
+      memset(values, 0, sizeof(values));
+    }
+    uint64_t values[kNumValues];
+    bool has_io;
+  };
+
+  class Listener : public rocksdb::EventListener {
+   public:
+    void OnFlushCompleted(rocksdb::DB* db,
+                          const rocksdb::FlushJobInfo& info) override {
+      flushes++;
+    }
+    void OnCompactionCompleted(
+        rocksdb::DB* db, const rocksdb::CompactionJobInfo& info) override {
+      compactions++;
+    }
+    std::atomic<uint64_t> flushes{0};
+    std::atomic<uint64_t> compactions{0};
+  };
+
+  void Take(Snapshot* snapshot) {
+    if (statistics_ != nullptr) {
+      static const struct {
+        Value value;
+        uint32_t ticker;
+      } tickers[] = {
+        {kBytesWritten, rocksdb::BYTES_WRITTEN},
+        {kWalBytes, rocksdb::WAL_FILE_BYTES},
+        {kFlushBytes, rocksdb::FLUSH_WRITE_BYTES},
+        {kCompactReadBytes, rocksdb::COMPACT_READ_BYTES},
+        {kCompactWriteBytes, rocksdb::COMPACT_WRITE_BYTES},
+        {kStallMicros, rocksdb::STALL_MICROS},
+        {kBlockCacheHit, rocksdb::BLOCK_CACHE_HIT},
+        {kBlockCacheMiss, rocksdb::BLOCK_CACHE_MISS},
+      };
+      for (const auto& ticker : tickers) {
+        snapshot->values[ticker.value] =
+          statistics_->getTickerCount(ticker.ticker);
+      }
+      snapshot->values[kFlushes] = listener_->flushes;
+      snapshot->values[kCompactions] = listener_->compactions;
+    }
+    for (const auto& getter : getters_) {
+      snapshot->values[kL0Files] += getter("rocksdb.num-files-at-level0");
+      snapshot->values[kPendingCompactionBytes] +=
+        getter("rocksdb.estimate-pending-compaction-bytes");
+    }
+    snapshot->has_io = ReadProcessIO(&snapshot->values[kDiskRead],
+                                     &snapshot->values[kDiskWrite]);
+  }
+
+  uint64_t Delta(const Snapshot& end, Value value) const {
+    return end.values[value] - start_.values[value];
+  }
+
+  static bool ReadProcessIO(uint64_t* read_bytes, uint64_t* write_bytes) {
+    FILE* file = fopen("/proc/self/io", "r");
+    if (file == nullptr) {
+      return false;
+    }
+    char line[128];
+    int found = 0;
+    unsigned long long value;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      if (sscanf(line, "read_bytes: %llu", &value) == 1) {
+        *read_bytes = value;
+        found++;
+      } else if (sscanf(line, "write_bytes: %llu", &value) == 1) {
+        *write_bytes = value;
+        found++;
+      }
+    }
+    fclose(file);
+    return found == 2;
+  }
+
+  static std::string MB(uint64_t bytes) {
+    return Ratio(bytes, 1 << 20) + "MB";
+  }
+
+  static std::string Ratio(uint64_t a, uint64_t b) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", static_cast<double>(a) / b);
+    return buf;
+  }
+
+  std::shared_ptr<rocksdb::Statistics> statistics_;
+  std::shared_ptr<Listener> listener_;
+  std::vector<PropertyGetter> getters_;
+  Snapshot start_;
+
+  // No copying allowed
+  EngineStats(const EngineStats&);
+  void operator=(const EngineStats&);
+};
+
+}  //  namespace profiler
+
+#endif  //  BENCHMARK_ENGINE_STATS_H_
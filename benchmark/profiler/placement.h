@@ -0,0 +1,95 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef BENCHMARK_PLACEMENT_H_
+#define BENCHMARK_PLACEMENT_H_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "gilmour/cpu_placement.h"
+
+// Where the benchmark threads run, set by --cpus on the command line:
+//
+//   --cpus=0-7       every benchmark thread is pinned to one of the
+//                    cpus, round robin in the order they start
+//   --cpus=node:1    the same with the cpus of NUMA node 1, and the
+//                    memory of the whole process is taken from node 1,
+//                    the data generated before the threads start too
+//
+// Without --cpus the scheduler places the threads as before, so a run
+// with and a run without the flag compare pinned against the default.
+namespace profiler {
+
+class Placement {
+ public:
+  static Placement* Instance() {
+    static Placement placement;
+    return &placement;
+  }
+
+  // Removes the placement flags from argv, returns the new argc
+  int ParseFlags(int argc, char* argv[]) {
+    int new_argc = 1;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 7, "--cpus=") == 0) {
+        Init(arg.substr(7));
+      } else {
+        argv[new_argc++] = argv[i];
+      }
+    }
+    return new_argc;
+  }
+
+  // Called at the start of every benchmark thread
+  void PinThread() {
+    if (cpus_.empty()) {
+      return;
+    }
+    gilmour::PinThread(cpus_[next_++ % cpus_.size()]);
+  }
+
+ private:
+  Placement() : node_(-1), next_(0) {
+  }
+
+  void Init(const std::string& spec) {
+    if (!gilmour::ParsePlacement(spec, &cpus_, &node_)) {
+      fprintf(stderr, "placement: bad cpus %s, threads are not pinned\n",
+              spec.c_str());
+      cpus_.clear();
+      return;
+    }
+    if (node_ >= 0) {
+      // The main thread keeps all the cpus of the node, the threads it
+      // creates inherit both restrictions
+      gilmour::PinThread(cpus_);
+      if (!gilmour::BindMemory(node_, gilmour::kMpolBind)) {
+        fprintf(stderr, "placement: can not bind memory to node %d\n",
+                node_);
+      }
+    }
+  }
+
+  std::vector<int> cpus_;
+  int node_;
+  std::atomic<size_t> next_;
+
+  // No copying allowed
+  Placement(const Placement&);
+  void operator=(const Placement&);
+};
+
+inline void PinThread() {
+  Placement::Instance()->PinThread();
+}
+
+}  //  namespace profiler
+
+#endif  //  BENCHMARK_PLACEMENT_H_
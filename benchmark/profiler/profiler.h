@@ -0,0 +1,406 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef BENCHMARK_PROFILER_H_
+#define BENCHMARK_PROFILER_H_
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Profiles the measured phase of a benchmark scenario, so that the
+// explanations written next to the results can be checked. Enabled by
+// --profile on the command line of a benchmark, every phase bracketed
+// by Start() and Stop() then gets:
+//
+//   - the hardware counters of the process (cycles, instructions,
+//     cache misses, branch misses), read with perf_event_open, the
+//     threads created during the phase are counted as well
+//   - a CPU profile taken by a SIGPROF sampler, written as folded
+//     stacks into <profile_dir>/<seq>_<scenario>.folded, ready for
+//     flamegraph.pl
+//
+// The binaries must be linked with -rdynamic for the stacks to have
+// function names, static functions show up as [module].
+namespace profiler {
+
+const int kMaxFrames = 64;
+// The handler and the signal trampoline
+const int kSkipFrames = 2;
+
+struct Counter {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+const Counter kCounters[] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+const size_t kNumCounters = sizeof(kCounters) / sizeof(kCounters[0]);
+
+// Filled by the signal handler, which must not allocate or lock:
+// the space is reserved in Init(), every sample claims a slot with
+// one fetch_add
+struct SampleBuffer {
+  std::vector<void*> frames;
+  std::vector<int> depths;
+  size_t capacity = 0;
+  std::atomic<size_t> next{0};
+  std::atomic<uint64_t> lost{0};
+  std::atomic<bool> active{false};
+  std::atomic<int> in_handler{0};
+
+  static SampleBuffer* Instance() {
+    static SampleBuffer buffer;
+    return &buffer;
+  }
+};
+
+inline void HandleSigprof(int sig, siginfo_t* info, void* context) {
+  int saved_errno = errno;
+  SampleBuffer* buffer = SampleBuffer::Instance();
+  buffer->in_handler.fetch_add(1);
+  if (buffer->active.load()) {
+    size_t slot = buffer->next.fetch_add(1);
+    if (slot < buffer->capacity) {
+      void* frames[kMaxFrames + kSkipFrames];
+      int depth = backtrace(frames, kMaxFrames + kSkipFrames) - kSkipFrames;
+      depth = std::max(depth, 0);
+      memcpy(&buffer->frames[slot * kMaxFrames], frames + kSkipFrames,
+             depth * sizeof(void*));
+      buffer->depths[slot] = depth;
+    } else {
+      buffer->lost.fetch_add(1);
+    }
+  }
+  buffer->in_handler.fetch_sub(1);
+  errno = saved_errno;
+}
+
+// Told about every measured phase whether or not --profile is
+// given, the engine statistics are snapshotted this way
+class PhaseListener {
+ public:
+  virtual ~PhaseListener() {}
+  virtual void OnPhaseStart(const std::string& scenario) = 0;
+  virtual void OnPhaseStop(const std::string& scenario) = 0;
+};
+
+class Profiler {
+ public:
+  static Profiler* Instance() {
+    static Profiler profiler;
+    return &profiler;
+  }
+
+  // Strips the profiler flags from argv and returns the new argc:
+  //   --profile              enables the profiler
+  //   --profile_dir=<dir>    where the folded stacks go, ./profile
+  //   --profile_hz=<hz>      samples per second of cpu time, 1000,
+  //                          the kernel tick may make it coarser
+  int ParseFlags(int argc, char* argv[]) {
+    int new_argc = 1;
+    bool enable = false;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--profile") {
+        enable = true;
+      } else if (arg.compare(0, 14, "--profile_dir=") == 0) {
+        output_dir_ = arg.substr(14);
+      } else if (arg.compare(0, 13, "--profile_hz=") == 0) {
+        sample_hz_ = std::max(atoi(arg.c_str() + 13), 1);
+      } else {
+        argv[new_argc++] = argv[i];
+      }
+    }
+    if (enable) {
+      Init();
+    }
+    return new_argc;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  void AddListener(PhaseListener* listener) {
+    listeners_.push_back(listener);
+  }
+
+  void RemoveListener(PhaseListener* listener) {
+    listeners_.erase(std::remove(listeners_.begin(), listeners_.end(),
+                                 listener), listeners_.end());
+  }
+
+  // Starts a measured phase, it is only profiled with --profile
+  void Start(const std::string& scenario) {
+    if (running_) {
+      return;
+    }
+    running_ = true;
+    scenario_ = scenario;
+    for (PhaseListener* listener : listeners_) {
+      listener->OnPhaseStart(scenario_);
+    }
+    if (!enabled_) {
+      return;
+    }
+    OpenCounters();
+    for (int fd : counter_fds_) {
+      if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+
+    SampleBuffer* buffer = SampleBuffer::Instance();
+    buffer->next = 0;
+    buffer->lost = 0;
+    buffer->active = true;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / sample_hz_;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+  }
+
+  // Stops the phase started last, prints the counters and
+  // writes the folded stacks
+  void Stop() {
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    if (enabled_) {
+      StopProfiling();
+    }
+    for (PhaseListener* listener : listeners_) {
+      listener->OnPhaseStop(scenario_);
+    }
+  }
+
+ private:
+  Profiler() : enabled_(false), running_(false), warned_(false),
+               sample_hz_(1000), output_dir_("./profile"), seq_(0) {
+    for (size_t i = 0; i < kNumCounters; i++) {
+      counter_fds_[i] = -1;
+      counter_values_[i] = 0;
+    }
+  }
+
+  void StopProfiling() {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    SampleBuffer* buffer = SampleBuffer::Instance();
+    buffer->active = false;
+    while (buffer->in_handler.load() != 0) {
+      std::this_thread::yield();
+    }
+
+    std::string counters;
+    for (size_t i = 0; i < kNumCounters; i++) {
+      uint64_t value;
+      if (ReadCounter(counter_fds_[i], &value)) {
+        counter_values_[i] = value;
+        counters += std::string(" ") + kCounters[i].name + ": "
+          + std::to_string(value);
+      } else {
+        counter_values_[i] = 0;
+      }
+    }
+    CloseCounters();
+    if (counter_values_[0] != 0) {
+      char ipc[32];
+      snprintf(ipc, sizeof(ipc), " IPC: %.2f",
+               static_cast<double>(counter_values_[1]) / counter_values_[0]);
+      counters += ipc;
+    }
+
+    std::string path = output_dir_ + "/" + std::to_string(seq_++) + "_"
+      + scenario_ + ".folded";
+    size_t samples = std::min(buffer->next.load(), buffer->capacity);
+    WriteFolded(path, samples);
+    printf("Profile %s:%s samples: %lu lost: %lu folded: %s\n",
+           scenario_.c_str(), counters.c_str(),
+           static_cast<unsigned long>(samples),
+           static_cast<unsigned long>(buffer->lost.load()), path.c_str());
+  }
+
+  void Init() {
+    mkdir(output_dir_.c_str(), 0755);
+    // 128 seconds of cpu time, summed over all the threads, the
+    // samples taken after that are only counted as lost
+    SampleBuffer* buffer = SampleBuffer::Instance();
+    buffer->capacity = static_cast<size_t>(sample_hz_) * 128;
+    buffer->frames.resize(buffer->capacity * kMaxFrames);
+    buffer->depths.resize(buffer->capacity);
+    // The first backtrace() loads libgcc, which is not async signal safe
+    void* frames[1];
+    backtrace(frames, 1);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = HandleSigprof;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+    enabled_ = true;
+  }
+
+  void OpenCounters() {
+    for (size_t i = 0; i < kNumCounters; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = kCounters[i].type;
+      attr.config = kCounters[i].config;
+      attr.disabled = 1;
+      // Threads spawned by the phase are added up when they exit
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      counter_fds_[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr,
+                                                 0, -1, -1, 0));
+      if (counter_fds_[i] == -1 && !warned_) {
+        printf("Profile: perf_event_open %s failed, error: %s\n",
+               kCounters[i].name, strerror(errno));
+        warned_ = true;
+      }
+    }
+  }
+
+  void CloseCounters() {
+    for (size_t i = 0; i < kNumCounters; i++) {
+      if (counter_fds_[i] != -1) {
+        close(counter_fds_[i]);
+        counter_fds_[i] = -1;
+      }
+    }
+  }
+
+  // Scales the value up when the counter was multiplexed
+  static bool ReadCounter(int fd, uint64_t* value) {
+    uint64_t data[3];
+    if (fd == -1) {
+      return false;
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, data, sizeof(data)) != sizeof(data)) {
+      return false;
+    }
+    *value = data[2] == 0 ? 0 : static_cast<uint64_t>(
+        static_cast<double>(data[0]) * data[1] / data[2]);
+    return true;
+  }
+
+  const std::string& Symbolize(void* address) {
+    auto iter = symbols_.find(address);
+    if (iter != symbols_.end()) {
+      return iter->second;
+    }
+    std::string name;
+    Dl_info info;
+    if (dladdr(address, &info) == 0) {
+      name = "[unknown]";
+    } else if (info.dli_sname != nullptr) {
+      int status;
+      char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr,
+                                            nullptr, &status);
+      name = status == 0 ? demangled : info.dli_sname;
+      free(demangled);
+    } else {
+      // Without a name the samples of one function would be split
+      // by their addresses, they are grouped by module instead
+      const char* module = strrchr(info.dli_fname, '/');
+      name = std::string("[") + (module ? module + 1 : info.dli_fname) + "]";
+    }
+    // ';' separates the frames of a folded stack
+    std::replace(name.begin(), name.end(), ';', ':');
+    return symbols_[address] = name;
+  }
+
+  void WriteFolded(const std::string& path, size_t samples) {
+    SampleBuffer* buffer = SampleBuffer::Instance();
+    std::map<std::string, uint64_t> stacks;
+    std::string stack;
+    for (size_t i = 0; i < samples; i++) {
+      void** frames = &buffer->frames[i * kMaxFrames];
+      stack.clear();
+      for (int j = buffer->depths[i] - 1; j >= 0; j--) {
+        if (!stack.empty()) {
+          stack.push_back(';');
+        }
+        stack.append(Symbolize(frames[j]));
+      }
+      if (!stack.empty()) {
+        stacks[stack]++;
+      }
+    }
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+      printf("Profile: open %s failed, error: %s\n", path.c_str(),
+             strerror(errno));
+      return;
+    }
+    for (const auto& stack : stacks) {
+      fprintf(file, "%s %lu\n", stack.first.c_str(),
+              static_cast<unsigned long>(stack.second));
+    }
+    fclose(file);
+  }
+
+  bool enabled_;
+  bool running_;
+  bool warned_;
+  int sample_hz_;
+  std::string output_dir_;
+  std::string scenario_;
+  uint64_t seq_;
+  int counter_fds_[kNumCounters];
+  uint64_t counter_values_[kNumCounters];
+  std::unordered_map<void*, std::string> symbols_;
+  std::vector<PhaseListener*> listeners_;
+
+  // No copying allowed
+  Profiler(const Profiler&);
+  void operator=(const Profiler&);
+};
+
+inline void Start(const std::string& scenario) {
+  Profiler::Instance()->Start(scenario);
+}
+
+inline void Stop() {
+  Profiler::Instance()->Stop();
+}
+
+}  //  namespace profiler
+
+#endif  //  BENCHMARK_PROFILER_H_
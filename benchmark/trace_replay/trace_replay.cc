@@ -0,0 +1,487 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gilmour/cpu_placement.h"
+#include "gilmour/gilmour.h"
+#include "trace.h"
+
+// 把epoll_server用-t录制的trace回放到存储引擎上, 用线上真实的
+// key分布和大小分布来评估存储引擎的改动:
+//
+//   ./trace_replay -f trace_file [-e gilmour|null] [-d db_path]
+//                  [-t threads] [-s speed]
+//
+// -s 0 表示尽可能快地回放, 1表示按录制时的速度, 2表示两倍速...
+// 多线程回放时命令按第一个key分配到线程, 同一个key上的命令
+// 保持录制时的顺序, 涉及多个key的命令只保证第一个key的顺序
+
+const size_t kBatchSize = 256;
+const size_t kMaxPendingBatches = 64;
+
+using namespace std::chrono;
+
+enum ExecuteResult {
+  kExecuteOk = 0,
+  kExecuteError = 1,
+  kExecuteUnsupported = 2,
+};
+
+// 存储引擎的适配层, 回放其他引擎时实现一个Engine即可
+class Engine {
+ public:
+  virtual ~Engine() {}
+  virtual bool Open(const std::string& path) = 0;
+  // argv[0]已经转成了大写
+  virtual ExecuteResult Execute(const std::vector<std::string>& argv) = 0;
+};
+
+// 不访问存储, 用于衡量回放工具本身的开销
+class NullEngine : public Engine {
+ public:
+  bool Open(const std::string& path) override {
+    return true;
+  }
+  ExecuteResult Execute(const std::vector<std::string>& argv) override {
+    return kExecuteOk;
+  }
+};
+
+class GilmourEngine : public Engine {
+ public:
+  GilmourEngine();
+
+  bool Open(const std::string& path) override {
+    gilmour::GilmourOptions options;
+    options.options.create_if_missing = true;
+    gilmour::Status s = db_.Open(options, path);
+    if (!s.ok()) {
+      std::cout << "Open db failed, error: " << s.ToString() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  ExecuteResult Execute(const std::vector<std::string>& argv) override {
+    auto iter = commands_.find(argv[0]);
+    if (iter == commands_.end() || argv.size() < iter->second.min_argc) {
+      return kExecuteUnsupported;
+    }
+    gilmour::Status s = iter->second.handler(argv);
+    return s.ok() || s.IsNotFound() ? kExecuteOk : kExecuteError;
+  }
+
+ private:
+  typedef std::function<gilmour::Status(const std::vector<std::string>&)>
+    Handler;
+  struct Command {
+    size_t min_argc;
+    Handler handler;
+  };
+
+  void Add(const std::string& name, size_t min_argc, Handler handler) {
+    commands_[name] = {min_argc, handler};
+  }
+
+  gilmour::Gilmour db_;
+  std::unordered_map<std::string, Command> commands_;
+};
+
+GilmourEngine::GilmourEngine() {
+  typedef const std::vector<std::string>& Argv;
+  gilmour::Gilmour* db = &db_;
+  Add("SET", 3, [db](Argv argv) {
+    return db->Set(argv[1], argv[2]);
+  });
+  Add("GET", 2, [db](Argv argv) {
+    std::string value;
+    return db->Get(argv[1], &value);
+  });
+  Add("DEL", 2, [db](Argv argv) {
+    int64_t count;
+    return db->Del(std::vector<std::string>(argv.begin() + 1, argv.end()),
+                   &count);
+  });
+  Add("EXPIRE", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->Expire(argv[1], atoi(argv[2].c_str()), &ret);
+  });
+  Add("TTL", 2, [db](Argv argv) {
+    int64_t ttl;
+    return db->TTL(argv[1], &ttl);
+  });
+  Add("KEYS", 2, [db](Argv argv) {
+    std::vector<std::string> keys;
+    return db->Keys(argv[1], &keys);
+  });
+  Add("HSET", 4, [db](Argv argv) {
+    int32_t ret;
+    return db->HSet(argv[1], argv[2], argv[3], &ret);
+  });
+  Add("HMSET", 4, [db](Argv argv) {
+    std::vector<gilmour::FieldValue> fvs;
+    for (size_t i = 2; i + 1 < argv.size(); i += 2) {
+      fvs.push_back({argv[i], argv[i + 1]});
+    }
+    return db->HMSet(argv[1], fvs);
+  });
+  Add("HGET", 3, [db](Argv argv) {
+    std::string value;
+    return db->HGet(argv[1], argv[2], &value);
+  });
+  Add("HGETALL", 2, [db](Argv argv) {
+    std::vector<gilmour::FieldValue> fvs;
+    return db->HGetall(argv[1], &fvs);
+  });
+  Add("HKEYS", 2, [db](Argv argv) {
+    std::vector<std::string> fields;
+    return db->HKeys(argv[1], &fields);
+  });
+  Add("HDEL", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->HDel(argv[1],
+                    std::vector<std::string>(argv.begin() + 2, argv.end()),
+                    &ret);
+  });
+  Add("HLEN", 2, [db](Argv argv) {
+    int32_t ret;
+    return db->HLen(argv[1], &ret);
+  });
+  Add("SADD", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->SAdd(argv[1],
+                    std::vector<std::string>(argv.begin() + 2, argv.end()),
+                    &ret);
+  });
+  Add("SREM", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->SRem(argv[1],
+                    std::vector<std::string>(argv.begin() + 2, argv.end()),
+                    &ret);
+  });
+  Add("SMEMBERS", 2, [db](Argv argv) {
+    std::vector<std::string> members;
+    return db->SMembers(argv[1], &members);
+  });
+  Add("SISMEMBER", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->SIsMember(argv[1], argv[2], &ret);
+  });
+  Add("SCARD", 2, [db](Argv argv) {
+    int32_t ret;
+    return db->SCard(argv[1], &ret);
+  });
+  Add("ZADD", 4, [db](Argv argv) {
+    std::vector<gilmour::ScoreMember> score_members;
+    for (size_t i = 2; i + 1 < argv.size(); i += 2) {
+      score_members.push_back({strtod(argv[i].c_str(), NULL), argv[i + 1]});
+    }
+    int32_t ret;
+    return db->ZAdd(argv[1], score_members, &ret);
+  });
+  Add("ZSCORE", 3, [db](Argv argv) {
+    double score;
+    return db->ZScore(argv[1], argv[2], &score);
+  });
+  Add("ZRANGE", 4, [db](Argv argv) {
+    std::vector<gilmour::ScoreMember> score_members;
+    return db->ZRange(argv[1], atoi(argv[2].c_str()), atoi(argv[3].c_str()),
+                      &score_members);
+  });
+  Add("ZRANGEBYSCORE", 4, [db](Argv argv) {
+    std::vector<gilmour::ScoreMember> score_members;
+    return db->ZRangeByScore(argv[1], strtod(argv[2].c_str(), NULL),
+                             strtod(argv[3].c_str(), NULL), &score_members);
+  });
+  Add("ZRANK", 3, [db](Argv argv) {
+    int32_t rank;
+    return db->ZRank(argv[1], argv[2], &rank);
+  });
+  Add("ZREM", 3, [db](Argv argv) {
+    int32_t ret;
+    return db->ZRem(argv[1],
+                    std::vector<std::string>(argv.begin() + 2, argv.end()),
+                    &ret);
+  });
+  Add("ZCARD", 2, [db](Argv argv) {
+    int32_t ret;
+    return db->ZCard(argv[1], &ret);
+  });
+  Add("LPUSH", 3, [db](Argv argv) {
+    int32_t len;
+    return db->LPush(argv[1],
+                     std::vector<std::string>(argv.begin() + 2, argv.end()),
+                     &len);
+  });
+  Add("RPUSH", 3, [db](Argv argv) {
+    int32_t len;
+    return db->RPush(argv[1],
+                     std::vector<std::string>(argv.begin() + 2, argv.end()),
+                     &len);
+  });
+  Add("LPOP", 2, [db](Argv argv) {
+    std::string element;
+    return db->LPop(argv[1], &element);
+  });
+  Add("RPOP", 2, [db](Argv argv) {
+    std::string element;
+    return db->RPop(argv[1], &element);
+  });
+  Add("LINDEX", 3, [db](Argv argv) {
+    std::string element;
+    return db->LIndex(argv[1], atoi(argv[2].c_str()), &element);
+  });
+  Add("LRANGE", 4, [db](Argv argv) {
+    std::vector<std::string> elements;
+    return db->LRange(argv[1], atoi(argv[2].c_str()), atoi(argv[3].c_str()),
+                      &elements);
+  });
+  Add("LLEN", 2, [db](Argv argv) {
+    int32_t len;
+    return db->LLen(argv[1], &len);
+  });
+}
+
+typedef std::vector<trace::TraceRecord> Batch;
+
+// 每个线程一个队列, 队列的长度有上限, 回放速度跟不上
+// 读取速度的时候读取线程会等待, 不会把整个trace读进内存
+class Worker {
+ public:
+  Worker() : done_(false) {
+  }
+
+  void Push(Batch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return batches_.size() < kMaxPendingBatches;
+    });
+    batches_.emplace_back();
+    batches_.back().swap(*batch);
+    not_empty_.notify_one();
+  }
+
+  void Finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    not_empty_.notify_one();
+  }
+
+  // Returns false once all the batches were taken
+  bool Pop(Batch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return done_ || !batches_.empty(); });
+    if (batches_.empty()) {
+      return false;
+    }
+    batch->swap(batches_.front());
+    batches_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<Batch> batches_;
+  bool done_;
+};
+
+struct ReplayStats {
+  std::atomic<uint64_t> executed{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> unsupported{0};
+  // 按录制速度回放时, 命令执行时刻落后于计划时刻的最大值
+  std::atomic<uint64_t> max_lag_us{0};
+};
+
+static void Replay(Engine* engine, Worker* worker, double speed,
+                   uint64_t first_time, steady_clock::time_point start,
+                   int cpu, ReplayStats* stats) {
+  if (cpu >= 0) {
+    gilmour::PinThread(cpu);
+  }
+  Batch batch;
+  while (worker->Pop(&batch)) {
+    for (const auto& record : batch) {
+      if (speed > 0) {
+        auto target = start + microseconds(static_cast<int64_t>(
+                (record.time - first_time) / speed));
+        auto now = steady_clock::now();
+        if (now < target) {
+          std::this_thread::sleep_until(target);
+        } else {
+          uint64_t lag = duration_cast<microseconds>(now - target).count();
+          uint64_t max_lag = stats->max_lag_us.load();
+          while (lag > max_lag
+            && !stats->max_lag_us.compare_exchange_weak(max_lag, lag)) {
+          }
+        }
+      }
+      switch (engine->Execute(record.argv)) {
+        case kExecuteOk:
+          break;
+        case kExecuteError:
+          stats->errors++;
+          break;
+        case kExecuteUnsupported:
+          stats->unsupported++;
+          break;
+      }
+      stats->executed++;
+    }
+  }
+}
+
+static void usage() {
+  std::cout << "Usage:\n";
+  std::cout << "      ./trace_replay -f trace_file [-e gilmour|null] "
+    "[-d db_path] [-t threads] [-s speed] [-a cpus]\n";
+  std::cout << "      cpus为0-7这样的cpu列表时每个回放线程依次绑定一个cpu,\n";
+  std::cout << "      为node:N时绑定NUMA节点N的cpu, 内存也从节点N分配\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::string trace_path;
+  std::string engine_name = "gilmour";
+  std::string db_path = "./db";
+  size_t thread_num = 1;
+  double speed = 0;
+  std::vector<int> cpus;
+  int node = -1;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:e:d:t:s:a:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        trace_path = optarg;
+        break;
+      case 'e':
+        engine_name = optarg;
+        break;
+      case 'd':
+        db_path = optarg;
+        break;
+      case 't':
+        thread_num = std::max(atoi(optarg), 1);
+        break;
+      case 's':
+        speed = atof(optarg);
+        break;
+      case 'a':
+        if (!gilmour::ParsePlacement(optarg, &cpus, &node)) {
+          usage();
+          exit(-1);
+        }
+        break;
+      default:
+        usage();
+        exit(-1);
+    }
+  }
+  if (trace_path.empty()) {
+    usage();
+    exit(-1);
+  }
+
+  if (node >= 0) {
+    // 在打开db之前, db的内存和后台线程也留在这个节点上
+    gilmour::PinThread(cpus);
+    gilmour::BindMemory(node, gilmour::kMpolBind);
+  }
+
+  std::unique_ptr<Engine> engine;
+  if (engine_name == "gilmour") {
+    engine.reset(new GilmourEngine());
+  } else if (engine_name == "null") {
+    engine.reset(new NullEngine());
+  } else {
+    usage();
+    exit(-1);
+  }
+  if (!engine->Open(db_path)) {
+    exit(-1);
+  }
+
+  trace::TraceReader reader;
+  if (!reader.Open(trace_path)) {
+    std::cout << "Open trace failed, error: " << reader.error() << std::endl;
+    exit(-1);
+  }
+  trace::TraceRecord record;
+  if (!reader.Next(&record)) {
+    std::cout << "Empty trace " << reader.error() << std::endl;
+    exit(-1);
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<Batch> batches(thread_num);
+  std::vector<std::thread> jobs;
+  ReplayStats stats;
+  uint64_t first_time = record.time;
+  auto start = steady_clock::now();
+  for (size_t i = 0; i < thread_num; i++) {
+    workers.emplace_back(new Worker());
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    jobs.emplace_back(Replay, engine.get(), workers.back().get(), speed,
+                      first_time, start, cpu, &stats);
+  }
+
+  std::hash<std::string> hash;
+  do {
+    if (record.argv.empty()) {
+      continue;
+    }
+    std::string& name = record.argv[0];
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    size_t index = record.argv.size() > 1
+      ? hash(record.argv[1]) % thread_num : 0;
+    batches[index].push_back(std::move(record));
+    if (batches[index].size() >= kBatchSize) {
+      workers[index]->Push(&batches[index]);
+      batches[index].clear();
+    }
+    record = trace::TraceRecord();
+  } while (reader.Next(&record));
+  if (!reader.error().empty()) {
+    std::cout << "Read trace stopped, error: " << reader.error() << std::endl;
+  }
+  for (size_t i = 0; i < thread_num; i++) {
+    if (!batches[i].empty()) {
+      workers[i]->Push(&batches[i]);
+    }
+    workers[i]->Finish();
+  }
+  for (auto& job : jobs) {
+    job.join();
+  }
+
+  auto end = steady_clock::now();
+  double cost = duration_cast<duration<double>>(end - start).count();
+  std::cout << "Replay " << stats.executed << " Commands Cost: " << cost
+    << "s QPS: " << static_cast<uint64_t>(stats.executed / cost)
+    << " Errors: " << stats.errors << " Unsupported: " << stats.unsupported;
+  if (speed > 0) {
+    std::cout << " Max Lag: " << stats.max_lag_us << "us";
+  }
+  std::cout << std::endl;
+  return 0;
+}
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cluster_client.h"
+#include "slot.h"
+
+#define SEED        "127.0.0.1:7001"
+
+//集群压测: 多个线程各用一个ClusterClient, 按流水线发送SET/GET, 每秒
+//输出一行吞吐和流水线往返延迟的分位数.
+//
+//吞吐随节点数的变化: 分别启动1, 2, 4个节点的集群, 用同样的参数压测
+//
+//  ./cluster_node -p 7001 -c 127.0.0.1:7001,127.0.0.1:7002 &
+//  ./cluster_node -p 7002 -c 127.0.0.1:7001,127.0.0.1:7002 &
+//  ./cluster_bench -s 127.0.0.1:7001 -t 8 -P 16 -d 10
+//
+//迁移对延迟的影响: -M在压测开始-w秒后把一段slot迁到另一个节点, 按
+//迁移之前, 迁移之中和迁移之后分别统计p99
+//
+//  ./cluster_bench -d 30 -M 0-4095:127.0.0.1:7002 -w 10
+//
+//迁移中的list: -l另开一个线程, 对迁移范围内的一个list不停地RPUSH,
+//每三次LPOP一次, 按本地记录的内容检查每个回复, 结束时用LRANGE检查
+//迁移后的整个list. 迁移期间这些命令返回TRYAGAIN, 等迁移结束再重发
+//
+//  ./cluster_bench -d 30 -M 0-4095:127.0.0.1:7002 -w 10 -l
+//
+//备份对延迟的影响: -B在-w秒后让种子节点做一次增量备份, 参数是每秒
+//拷贝的字节数, 0表示不限速. 先灌入足够的数据(比如100GB), 分别用限速
+//和不限速的备份各跑一次, 比较备份之中的p99
+//
+//  ./cluster_bench -d 600 -r 90 -B 0 -w 60
+//  ./cluster_bench -d 600 -r 90 -B 104857600 -w 60
+
+static uint64_t now_micros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+struct Sample {
+  uint32_t second;
+  uint32_t latency;     //一个流水线的往返时间, 微秒
+};
+
+struct ThreadResult {
+  std::vector<Sample> samples;
+  uint64_t ops;
+  uint64_t errors;
+  uint64_t moved;
+  uint64_t tryagain;
+};
+
+static std::atomic<bool> running(true);
+
+static void run_client(const std::string& seed, int pipeline, int keyspace,
+                       int read_percent, int value_size, uint64_t start,
+                       int index, ThreadResult* result) {
+  cluster::ClusterClient client;
+  result->ops = 0;
+  result->errors = 0;
+  if (!client.Connect(seed)) {
+    fprintf(stderr, "connect to %s failed\n", seed.c_str());
+    result->errors++;
+    return;
+  }
+  std::mt19937 rng(index);
+  std::string value(value_size, 'v');
+  std::vector<std::vector<std::string>> commands(pipeline);
+  std::vector<cluster::Reply> replies;
+  while (running) {
+    for (int i = 0; i < pipeline; i++) {
+      std::string key = "key:" + std::to_string(rng() % keyspace);
+      if (static_cast<int>(rng() % 100) < read_percent) {
+        commands[i] = {"GET", key};
+      } else {
+        commands[i] = {"SET", key, value};
+      }
+    }
+    uint64_t begin = now_micros();
+    if (!client.Pipeline(commands, &replies)) {
+      result->errors++;
+      //节点可能刚刚不可用, 重新取slot表
+      usleep(10000);
+      client.Connect(seed);
+      continue;
+    }
+    uint64_t end = now_micros();
+    for (const auto& reply : replies) {
+      result->errors += reply.IsError();
+    }
+    result->ops += pipeline;
+    result->samples.push_back({static_cast<uint32_t>((end - start) / 1000000),
+                               static_cast<uint32_t>(end - begin)});
+  }
+  result->moved = client.moved();
+  result->tryagain = client.tryagain();
+}
+
+struct ListCheck {
+  uint64_t pushes;
+  uint64_t pops;
+  uint64_t tryagain;
+  std::string error;    //空表示list的内容始终和本地记录一致
+};
+
+//key在slot first到last之间
+static void run_list_check(const std::string& seed, int first, int last,
+                           ListCheck* result) {
+  result->pushes = 0;
+  result->pops = 0;
+  result->tryagain = 0;
+  cluster::ClusterClient client;
+  if (!client.Connect(seed)) {
+    result->error = "connect to " + seed + " failed";
+    return;
+  }
+  std::string key;
+  for (int i = 0; ; i++) {
+    key = "list:" + std::to_string(i);
+    int slot = cluster::KeySlot(key);
+    if (first <= slot && slot <= last) {
+      break;
+    }
+  }
+  cluster::Reply reply;
+  if (!client.Call({"DEL", key}, &reply) || reply.IsError()) {
+    result->error = "DEL failed";
+    return;
+  }
+
+  std::deque<std::string> expected;
+  std::vector<cluster::Reply> replies;
+  uint64_t n = 0;
+  while (running && result->error.empty()) {
+    bool pop = n % 3 == 2 && !expected.empty();
+    std::string value = std::to_string(n);
+    std::vector<std::vector<std::string>> command;
+    if (pop) {
+      command.push_back({"LPOP", key});
+    } else {
+      command.push_back({"RPUSH", key, value});
+    }
+    if (!client.Pipeline(command, &replies)) {
+      //TRYAGAIN用完了重试次数, 命令没有执行, 稍后重发同一个命令
+      if (replies[0].IsError("TRYAGAIN")) {
+        result->tryagain++;
+        usleep(10000);
+        continue;
+      }
+      result->error = "connection failed, the list can not be checked";
+      return;
+    }
+    const cluster::Reply& r = replies[0];
+    if (pop) {
+      if (r.str != expected.front()) {
+        result->error = "LPOP returned '" + r.str + "', expected '"
+          + expected.front() + "'";
+      }
+      expected.pop_front();
+      result->pops++;
+    } else {
+      expected.push_back(value);
+      if (r.integer != static_cast<int64_t>(expected.size())) {
+        result->error = "RPUSH returned " + std::to_string(r.integer)
+          + ", expected " + std::to_string(expected.size());
+      }
+      result->pushes++;
+    }
+    n++;
+  }
+  if (!result->error.empty()) {
+    return;
+  }
+
+  if (!client.Call({"LRANGE", key, "0", "-1"}, &reply) || reply.IsError()) {
+    result->error = "LRANGE failed";
+    return;
+  }
+  if (reply.elements.size() != expected.size()) {
+    result->error = "LRANGE returned " + std::to_string(reply.elements.size())
+      + " elements, expected " + std::to_string(expected.size());
+    return;
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (reply.elements[i].str != expected[i]) {
+      result->error = "element " + std::to_string(i) + " is '"
+        + reply.elements[i].str + "', expected '" + expected[i] + "'";
+      return;
+    }
+  }
+}
+
+static uint32_t percentile(std::vector<uint32_t>* latencies, double p) {
+  if (latencies->empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(latencies->size() * p);
+  if (index >= latencies->size()) {
+    index = latencies->size() - 1;
+  }
+  std::nth_element(latencies->begin(), latencies->begin() + index,
+                   latencies->end());
+  return (*latencies)[index];
+}
+
+static std::string info_field(const std::string& info,
+                              const std::string& name) {
+  size_t pos = info.find(name + ":");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos += name.size() + 1;
+  return info.substr(pos, info.find("\r\n", pos) - pos);
+}
+
+static void usage() {
+  printf("Usage:\n");
+  printf("      ./cluster_bench [-s seed] [-t threads] [-P pipeline] [-d seconds]\n");
+  printf("                      [-k keyspace] [-r read_percent] [-v value_size]\n");
+  printf("                      [-M first-last:host:port] [-B backup_rate]\n");
+  printf("                      [-w event_after] [-l]\n");
+}
+
+int main(int argc, char *argv[]) {
+  std::string seed = SEED;
+  int threads = 8;
+  int pipeline = 16;
+  int duration = 10;
+  int keyspace = 100000;
+  int read_percent = 50;
+  int value_size = 64;
+  std::string migrate;
+  std::string backup_rate;
+  int migrate_after = -1;
+  bool list_check = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:P:d:k:r:v:M:B:w:lh")) != -1) {
+    switch (opt) {
+      case 's':
+        seed = optarg;
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'P':
+        pipeline = atoi(optarg);
+        break;
+      case 'd':
+        duration = atoi(optarg);
+        break;
+      case 'k':
+        keyspace = atoi(optarg);
+        break;
+      case 'r':
+        read_percent = atoi(optarg);
+        break;
+      case 'v':
+        value_size = atoi(optarg);
+        break;
+      case 'M':
+        migrate = optarg;
+        break;
+      case 'B':
+        backup_rate = optarg;
+        break;
+      case 'w':
+        migrate_after = atoi(optarg);
+        break;
+      case 'l':
+        list_check = true;
+        break;
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  //first-last:host:port
+  std::string range, target;
+  int first = 0, last = 0;
+  if (!migrate.empty()) {
+    size_t colon = migrate.find(':');
+    if (colon == std::string::npos) {
+      usage();
+      exit(1);
+    }
+    range = migrate.substr(0, colon);
+    target = migrate.substr(colon + 1);
+    if (!cluster::ParseSlotRange(range, &first, &last)) {
+      usage();
+      exit(1);
+    }
+  }
+  if (list_check && migrate.empty()) {
+    usage();
+    exit(1);
+  }
+  if ((!migrate.empty() || !backup_rate.empty()) && migrate_after < 0) {
+    migrate_after = duration / 3;
+  }
+
+  cluster::ClusterClient admin;
+  if (!admin.Connect(seed)) {
+    fprintf(stderr, "connect to %s failed\n", seed.c_str());
+    exit(1);
+  }
+  printf("Nodes: %zu, Threads: %d, Pipeline: %d, Read: %d%%\n",
+         admin.slot_map().nodes().size(), threads, pipeline, read_percent);
+
+  uint64_t start = now_micros();
+  std::vector<ThreadResult> results(threads);
+  std::vector<std::thread> jobs;
+  for (int i = 0; i < threads; i++) {
+    jobs.emplace_back(run_client, seed, pipeline, keyspace, read_percent,
+                      value_size, start, i, &results[i]);
+  }
+  ListCheck list_result;
+  if (list_check) {
+    jobs.emplace_back(run_list_check, seed, first, last, &list_result);
+  }
+
+  //迁移(备份)从发出MIGRATE(BACKUP)开始, 到节点报告done(或failed)为止.
+  //迁移发给slot所在的节点, 备份发给种子节点
+  cluster::NodeConnection seed_node;
+  std::vector<std::string> event_command;
+  std::string event_name, state_field;
+  if (!migrate.empty()) {
+    event_command = {"CLUSTER", "MIGRATE", range, target};
+    event_name = "Migration";
+    state_field = "migration_state";
+  } else if (!backup_rate.empty()) {
+    event_command = {"BACKUP", backup_rate};
+    event_name = "Backup";
+    state_field = "backup_state";
+  }
+  int event_start = -1, event_end = -1;
+  std::string event_info;
+  while (now_micros() - start < static_cast<uint64_t>(duration) * 1000000) {
+    usleep(100000);
+    int second = static_cast<int>((now_micros() - start) / 1000000);
+    cluster::NodeConnection* node = NULL;
+    if (!migrate.empty()) {
+      node = admin.NodeOf(first);
+    } else if (!backup_rate.empty()) {
+      node = seed_node.connected() || seed_node.Connect(seed)
+        ? &seed_node : NULL;
+    }
+    if (!event_command.empty() && event_start < 0
+      && second >= migrate_after) {
+      cluster::Reply reply;
+      if (node == NULL || !node->Call(event_command, &reply)
+        || reply.IsError()) {
+        fprintf(stderr, "%s failed: %s\n", event_name.c_str(),
+                reply.str.c_str());
+        event_command.clear();
+        continue;
+      }
+      event_start = second;
+    } else if (event_start >= 0 && event_end < 0) {
+      cluster::Reply reply;
+      if (node != NULL && node->Call({"CLUSTER", "INFO"}, &reply)) {
+        std::string state = info_field(reply.str, state_field);
+        if (state == "done" || state.compare(0, 6, "failed") == 0) {
+          event_end = second;
+          event_info = reply.str;
+        }
+      }
+    }
+  }
+  running = false;
+  for (auto& job : jobs) {
+    job.join();
+  }
+  uint64_t elapsed = now_micros() - start;
+
+  //按秒和按迁移(备份)阶段汇总
+  std::vector<std::vector<uint32_t>> per_second(duration + 1);
+  std::vector<uint32_t> phases[3];
+  uint64_t ops = 0, errors = 0, moved = 0, tryagain = 0;
+  for (const auto& result : results) {
+    ops += result.ops;
+    errors += result.errors;
+    moved += result.moved;
+    tryagain += result.tryagain;
+    for (const auto& sample : result.samples) {
+      if (sample.second < per_second.size()) {
+        per_second[sample.second].push_back(sample.latency);
+      }
+      int phase = 0;
+      if (event_start >= 0 && static_cast<int>(sample.second) >= event_start) {
+        phase = event_end < 0 || static_cast<int>(sample.second) <= event_end
+          ? 1 : 2;
+      }
+      phases[phase].push_back(sample.latency);
+    }
+  }
+  for (size_t second = 0; second < per_second.size(); second++) {
+    std::vector<uint32_t>& latencies = per_second[second];
+    if (latencies.empty()) {
+      continue;
+    }
+    const char* mark = "";
+    if (event_start >= 0 && static_cast<int>(second) >= event_start
+      && (event_end < 0 || static_cast<int>(second) <= event_end)) {
+      mark = migrate.empty() ? " backing up" : " migrating";
+    }
+    printf("Second %zu: %lu ops/s, p50 %u us, p99 %u us, p999 %u us%s\n",
+           second, (unsigned long)latencies.size() * pipeline,
+           percentile(&latencies, 0.5), percentile(&latencies, 0.99),
+           percentile(&latencies, 0.999), mark);
+  }
+  printf("Total: %lu ops, %.0f ops/s, %lu errors, %lu moved, %lu tryagain\n",
+         (unsigned long)ops, ops * 1e6 / elapsed, (unsigned long)errors,
+         (unsigned long)moved, (unsigned long)tryagain);
+  if (event_start >= 0) {
+    const char* names[] = {"before", "during", "after"};
+    for (int i = 0; i < 3; i++) {
+      printf("%s %s: p50 %u us, p99 %u us, p999 %u us\n", event_name.c_str(),
+             names[i], percentile(&phases[i], 0.5),
+             percentile(&phases[i], 0.99), percentile(&phases[i], 0.999));
+    }
+    if (event_info.empty()) {
+      printf("%s did not finish within the run\n", event_name.c_str());
+    } else if (!migrate.empty()) {
+      printf("Migration: %s, %s keys, %s tail commands, %s ms, cutover %s ms\n",
+             info_field(event_info, "migration_state").c_str(),
+             info_field(event_info, "migrated_keys").c_str(),
+             info_field(event_info, "migration_tail_commands").c_str(),
+             info_field(event_info, "migration_ms").c_str(),
+             info_field(event_info, "cutover_ms").c_str());
+    } else {
+      printf("Backup: %s, id %s, %s bytes, rate %s bytes/s, %s ms\n",
+             info_field(event_info, "backup_state").c_str(),
+             info_field(event_info, "backup_id").c_str(),
+             info_field(event_info, "backup_size").c_str(),
+             info_field(event_info, "backup_rate").c_str(),
+             info_field(event_info, "backup_ms").c_str());
+    }
+  }
+  if (list_check) {
+    printf("List check: %lu pushes, %lu pops, %lu tryagain, %s\n",
+           (unsigned long)list_result.pushes, (unsigned long)list_result.pops,
+           (unsigned long)list_result.tryagain,
+           list_result.error.empty() ? "ok" : list_result.error.c_str());
+    return list_result.error.empty() ? 0 : 1;
+  }
+  return 0;
+}
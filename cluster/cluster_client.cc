@@ -0,0 +1,131 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "cluster_client.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace cluster {
+
+ClusterClient::ClusterClient()
+    : moved_(0), tryagain_(0) {
+}
+
+ClusterClient::~ClusterClient() {
+  for (auto& address_connection : connections_) {
+    delete address_connection.second;
+  }
+}
+
+bool ClusterClient::Connect(const std::string& seed) {
+  seed_ = seed;
+  return RefreshSlots(seed);
+}
+
+bool ClusterClient::RefreshSlots(const std::string& address) {
+  NodeConnection* connection = GetConnection(address);
+  Reply reply;
+  if (connection == nullptr
+    || !connection->Call({"CLUSTER", "SLOTS"}, &reply)
+    || reply.type != '$') {
+    return false;
+  }
+  return slots_.Parse(reply.str);
+}
+
+NodeConnection* ClusterClient::GetConnection(const std::string& address) {
+  NodeConnection*& connection = connections_[address];
+  if (connection == nullptr) {
+    connection = new NodeConnection();
+  }
+  if (!connection->connected() && !connection->Connect(address)) {
+    return nullptr;
+  }
+  return connection;
+}
+
+NodeConnection* ClusterClient::NodeOf(int slot) {
+  const std::string& owner = slots_.Owner(slot);
+  return GetConnection(owner.empty() ? seed_ : owner);
+}
+
+bool ClusterClient::Pipeline(
+    const std::vector<std::vector<std::string>>& commands,
+    std::vector<Reply>* replies) {
+  replies->assign(commands.size(), Reply());
+  std::vector<size_t> pending(commands.size());
+  for (size_t i = 0; i < pending.size(); i++) {
+    pending[i] = i;
+  }
+
+  for (int attempt = 0; !pending.empty() && attempt < kMaxAttempts;
+       attempt++) {
+    std::map<std::string, std::vector<size_t>> groups;
+    for (size_t i : pending) {
+      const std::vector<std::string>& args = commands[i];
+      int slot = args.size() > 1 ? KeySlot(args[1]) : 0;
+      const std::string& owner = slots_.Owner(slot);
+      groups[owner.empty() ? seed_ : owner].push_back(i);
+    }
+    for (const auto& group : groups) {
+      std::string buf;
+      for (size_t i : group.second) {
+        AppendRequest(commands[i], &buf);
+      }
+      NodeConnection* connection = GetConnection(group.first);
+      if (connection == nullptr || !connection->Send(buf)) {
+        return false;
+      }
+    }
+
+    std::vector<size_t> retry;
+    std::string moved_to;
+    bool wait = false;
+    for (const auto& group : groups) {
+      NodeConnection* connection = GetConnection(group.first);
+      for (size_t i : group.second) {
+        Reply& reply = (*replies)[i];
+        if (connection == nullptr || !connection->ReadReply(&reply)) {
+          return false;
+        }
+        if (reply.IsError("MOVED")) {
+          // MOVED <slot> <host:port>
+          moved_++;
+          moved_to = reply.str.substr(reply.str.rfind(' ') + 1);
+          slots_.Assign(KeySlot(commands[i][1]), KeySlot(commands[i][1]),
+                        moved_to);
+          retry.push_back(i);
+        } else if (reply.IsError("TRYAGAIN")) {
+          tryagain_++;
+          wait = true;
+          retry.push_back(i);
+        }
+      }
+    }
+    // A migration moves whole ranges of slots, take them all at once
+    // instead of one MOVED per slot
+    if (!moved_to.empty()) {
+      RefreshSlots(moved_to);
+    }
+    if (wait) {
+      usleep(1000);
+    }
+    pending.swap(retry);
+  }
+  return pending.empty();
+}
+
+bool ClusterClient::Call(const std::vector<std::string>& args,
+                         Reply* reply) {
+  std::vector<Reply> replies;
+  if (!Pipeline({args}, &replies)) {
+    return false;
+  }
+  *reply = replies[0];
+  return true;
+}
+
+}  //  namespace cluster
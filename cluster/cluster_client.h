@@ -0,0 +1,72 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef CLUSTER_CLUSTER_CLIENT_H_
+#define CLUSTER_CLUSTER_CLIENT_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+#include "slot.h"
+
+// Smart client of a cluster: keeps a copy of the slot map and sends
+// every command straight to the node owning the slot of its key (the
+// first argument after the command name), no proxy hop. A pipeline is
+// split by node, written to all the nodes first and then read back, so
+// the nodes work on it in parallel.
+//
+// The slot map is refreshed from the node which answered MOVED, and
+// the command is resent there. TRYAGAIN, the short cutover at the end
+// of a slot migration, is resent after a millisecond. The list pushes
+// and pops get TRYAGAIN for the whole migration, and fail once
+// kMaxAttempts is used up: the caller retries them later. Not thread
+// safe, every thread uses a client of its own.
+namespace cluster {
+
+class ClusterClient {
+ public:
+  ClusterClient();
+  ~ClusterClient();
+
+  // Loads the slot map from seed, any node of the cluster
+  bool Connect(const std::string& seed);
+  bool RefreshSlots(const std::string& address);
+
+  // replies are in the order of commands, false when a node can not
+  // be reached or a command was still redirected after kMaxAttempts
+  bool Pipeline(const std::vector<std::vector<std::string>>& commands,
+                std::vector<Reply>* replies);
+  bool Call(const std::vector<std::string>& args, Reply* reply);
+
+  // The connection to the node owning slot
+  NodeConnection* NodeOf(int slot);
+  const SlotMap& slot_map() const { return slots_; }
+
+  uint64_t moved() const { return moved_; }
+  uint64_t tryagain() const { return tryagain_; }
+
+ private:
+  static const int kMaxAttempts = 100;
+
+  NodeConnection* GetConnection(const std::string& address);
+
+  std::string seed_;
+  SlotMap slots_;
+  std::map<std::string, NodeConnection*> connections_;
+  uint64_t moved_;
+  uint64_t tryagain_;
+
+  // No copying allowed
+  ClusterClient(const ClusterClient&);
+  void operator=(const ClusterClient&);
+};
+
+}  //  namespace cluster
+
+#endif  //  CLUSTER_CLUSTER_CLIENT_H_
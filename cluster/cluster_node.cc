@@ -0,0 +1,1436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gilmour/backup.h"
+#include "gilmour/gilmour.h"
+#include "gilmour/replication.h"
+#include "perfect_hash.h"
+#include "protocol.h"
+#include "slot.h"
+
+#define IPADDRESS   "127.0.0.1"
+#define PORT        7001
+#define LISTENQ     1024
+#define EPOLLEVENTS 1024
+//迁移时一次Scan的key数, 也是一批发给目标节点的key数
+#define SCANBATCH   1000
+//追赶阶段剩下的写入不超过这么多条时进入切换, 切换期间迁移中的
+//slot返回TRYAGAIN, 所以这个值决定了切换的长短
+#define CUTOVERTAIL 64
+//追赶的最多轮数, 写入一直比追赶快时也要切换
+#define MAXROUNDS   100
+
+//集群节点: 一个进程一个Gilmour, 拥有一部分hash slot. key不属于本节点
+//的请求返回-MOVED slot host:port, 客户端据此更新slot表后重发.
+//
+//  ./cluster_node -p 7001 -c 127.0.0.1:7001,127.0.0.1:7002 &
+//  ./cluster_node -p 7002 -c 127.0.0.1:7001,127.0.0.1:7002 &
+//
+//-c列出的节点平分全部slot, 所有节点用同样的-c启动. 之后slot的归属
+//只通过迁移改变:
+//
+//  CLUSTER MIGRATE first-last host:port
+//
+//发给slot当前所在的节点, 后台线程把这些slot的数据迁到目标节点:
+//  1. 开始记录这些slot上的写命令(tail)
+//  2. 分批Scan全部key, 属于这些slot的key读出来转成SET/HMSET/SADD/
+//     ZADD/EXPIRE发给目标节点. 每批Scan是一个快照, 批与批之间的写入
+//     都在tail中
+//  3. 按顺序重放tail, 直到剩下的写入足够少
+//  4. 切换: 停止这些slot的读写(返回TRYAGAIN), 重放最后一段tail, 通知
+//     目标节点和其他节点slot的新归属, 之后这些slot返回MOVED
+//  5. 删除本节点上这些slot的数据
+//重放的都是覆盖写, 同一个key先快照后tail得到的就是最后的值.
+//LPUSH/RPUSH/LPOP/RPOP不是覆盖写, 快照之前的一次写入再重放一次就多
+//了一个元素(或者多弹出一个), 所以整个迁移期间它们都返回TRYAGAIN,
+//list在快照之后不再变化.
+//迁移的连接先发CLUSTER IMPORTING, 目标节点执行这个连接上的命令而不
+//检查slot归属, 也不把它们记入tail. ASKING和Redis一样只对紧接着的一条
+//命令有效, 这条命令不检查slot归属, 但是仍然受迁移的TRYAGAIN限制,
+//写入仍然记入tail.
+//
+//复制: -R指定端口后, 本节点把WAL按批压缩后推给连上来的副本.
+//-f host:port启动的是那个节点的只读副本, 先全量同步一个快照, 之后
+//按sequence号增量同步, 重启后从记录的位置继续. 副本不检查slot归属,
+//执行所有读命令, 写命令返回READONLY:
+//
+//  ./cluster_node -p 7001 -R 7101 &
+//  ./cluster_node -p 7011 -f 127.0.0.1:7101 &
+//
+//备份: 不停止读写.
+//  CHECKPOINT dir   在同一个文件系统上硬链接出一个可以直接打开的db
+//  BACKUP [rate]    后台把db增量备份到-b指定的目录, 只拷贝之前的备份
+//                   中没有的sst文件, rate限制每秒拷贝的字节数
+
+struct Client {
+  std::string rbuf;
+  std::string wbuf;
+  size_t      wpos;
+  bool        asking;     //下一条命令不检查slot的归属
+  bool        importing;  //迁移连接, 不检查slot的归属, 写入不记入tail
+};
+
+//迁移的状态, 和slot表一起由cluster_mutex保护
+struct Migration {
+  bool        active;
+  bool        cutover;    //切换中, 这些slot的命令返回TRYAGAIN
+  bool        running;    //迁移线程还没有结束, 包括切换之后的清理
+  int         first;
+  int         last;
+  std::string target;
+  std::vector<std::vector<std::string>> tail;
+  std::string state;
+  uint64_t    keys;
+  uint64_t    tail_commands;
+  uint64_t    start_ms;
+  uint64_t    cutover_ms;
+  uint64_t    switched_ms;  //切换结束, slot已经属于目标节点
+  uint64_t    end_ms;
+};
+
+typedef void (*CommandProc)(const std::vector<std::string>& args,
+                            std::string* reply);
+
+//后台备份的状态, 由cluster_mutex保护
+struct Backup {
+  bool        active;
+  std::string state;
+  uint64_t    rate;
+  uint32_t    id;
+  uint64_t    size;
+  uint64_t    start_ms;
+  uint64_t    end_ms;
+};
+
+struct Command {
+  const char  *name;
+  int         arity;      //负数表示至少这么多个参数
+  bool        write;
+  //重放多次和一次的结果相同, 迁移中可以记入tail
+  bool        idempotent;
+  CommandProc proc;
+  //第一个key之后每隔key_step个参数还有一个key, 0表示只有一个key
+  int         key_step;
+};
+
+static gilmour::Gilmour* db = NULL;
+static gilmour::ReplicationMaster* replication_master = NULL;
+static gilmour::Replica* replica = NULL;
+static std::string self;
+static std::mutex cluster_mutex;
+static cluster::SlotMap slots;
+static Migration migration;
+static std::thread migration_thread;
+static std::string backup_dir;
+static Backup backup;
+static std::thread backup_thread;
+static std::vector<Client*> clients;
+static volatile sig_atomic_t stop = 0;
+
+static uint64_t now_ms() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+static uint64_t now_micros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static void reply_status(const gilmour::Status& s, std::string* reply) {
+  if (s.ok()) {
+    cluster::AppendStatus("OK", reply);
+  } else {
+    cluster::AppendError("ERR " + s.ToString(), reply);
+  }
+}
+
+//NotFound是空结果而不是错误
+static bool reply_error(const gilmour::Status& s, std::string* reply) {
+  if (s.ok() || s.IsNotFound()) {
+    return false;
+  }
+  std::string error = s.ToString();
+  size_t pos = error.find("WRONGTYPE");
+  cluster::AppendError(pos != std::string::npos ? error.substr(pos)
+                       : "ERR " + error, reply);
+  return true;
+}
+
+static std::string format_score(double score) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", score);
+  return buf;
+}
+
+static std::vector<std::string> range_args(
+    const std::vector<std::string>& args, size_t first) {
+  return std::vector<std::string>(args.begin() + first, args.end());
+}
+
+static void set_command(const std::vector<std::string>& args,
+                        std::string* reply) {
+  reply_status(db->Set(args[1], args[2]), reply);
+}
+
+static void get_command(const std::vector<std::string>& args,
+                        std::string* reply) {
+  std::string value;
+  gilmour::Status s = db->Get(args[1], &value);
+  if (reply_error(s, reply)) {
+    return;
+  } else if (s.IsNotFound()) {
+    cluster::AppendNil(reply);
+  } else {
+    cluster::AppendBulk(value, reply);
+  }
+}
+
+static void mset_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  gilmour::KeyValueBatch kvs;
+  for (size_t i = 1; i + 1 < args.size(); i += 2) {
+    kvs.Add(args[i], args[i + 1]);
+  }
+  reply_status(db->MSet(kvs), reply);
+}
+
+static void del_command(const std::vector<std::string>& args,
+                        std::string* reply) {
+  int64_t count = 0;
+  gilmour::Status s = db->Del(range_args(args, 1), &count);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(count, reply);
+  }
+}
+
+static void expire_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->Expire(args[1], atoi(args[2].c_str()), &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void ttl_command(const std::vector<std::string>& args,
+                        std::string* reply) {
+  int64_t ttl = 0;
+  gilmour::Status s = db->TTL(args[1], &ttl);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ttl, reply);
+  }
+}
+
+static void type_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  static const char* names[] = {"string", "hash", "set", "zset", "list"};
+  gilmour::DataType type;
+  gilmour::Status s = db->Type(args[1], &type);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  cluster::AppendStatus(s.IsNotFound() ? "none" : names[type], reply);
+}
+
+static void hset_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->HSet(args[1], args[2], args[3], &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void hmset_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  if (args.size() % 2 != 0) {
+    cluster::AppendError("ERR wrong number of arguments for 'hmset'", reply);
+    return;
+  }
+  gilmour::FieldValueBatch fvs;
+  for (size_t i = 2; i + 1 < args.size(); i += 2) {
+    fvs.Add(args[i], args[i + 1]);
+  }
+  reply_status(db->HMSet(args[1], fvs), reply);
+}
+
+static void hget_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  std::string value;
+  gilmour::Status s = db->HGet(args[1], args[2], &value);
+  if (reply_error(s, reply)) {
+    return;
+  } else if (s.IsNotFound()) {
+    cluster::AppendNil(reply);
+  } else {
+    cluster::AppendBulk(value, reply);
+  }
+}
+
+static void hgetall_command(const std::vector<std::string>& args,
+                            std::string* reply) {
+  std::vector<gilmour::FieldValue> fvs;
+  gilmour::Status s = db->HGetall(args[1], &fvs);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  cluster::AppendArrayHeader(fvs.size() * 2, reply);
+  for (const auto& fv : fvs) {
+    cluster::AppendBulk(fv.field, reply);
+    cluster::AppendBulk(fv.value, reply);
+  }
+}
+
+static void hdel_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->HDel(args[1], range_args(args, 2), &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void hlen_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->HLen(args[1], &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(s.IsNotFound() ? 0 : ret, reply);
+  }
+}
+
+static void sadd_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->SAdd(args[1], range_args(args, 2), &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void srem_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->SRem(args[1], range_args(args, 2), &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void smembers_command(const std::vector<std::string>& args,
+                             std::string* reply) {
+  std::vector<std::string> members;
+  gilmour::Status s = db->SMembers(args[1], &members);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  cluster::AppendArrayHeader(members.size(), reply);
+  for (const auto& member : members) {
+    cluster::AppendBulk(member, reply);
+  }
+}
+
+static void sismember_command(const std::vector<std::string>& args,
+                              std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->SIsMember(args[1], args[2], &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(s.IsNotFound() ? 0 : ret, reply);
+  }
+}
+
+static void scard_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->SCard(args[1], &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(s.IsNotFound() ? 0 : ret, reply);
+  }
+}
+
+static void zadd_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  if (args.size() % 2 != 0) {
+    cluster::AppendError("ERR wrong number of arguments for 'zadd'", reply);
+    return;
+  }
+  std::vector<gilmour::ScoreMember> score_members;
+  for (size_t i = 2; i + 1 < args.size(); i += 2) {
+    score_members.push_back({strtod(args[i].c_str(), NULL), args[i + 1]});
+  }
+  int32_t ret = 0;
+  gilmour::Status s = db->ZAdd(args[1], score_members, &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void zscore_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  double score = 0;
+  gilmour::Status s = db->ZScore(args[1], args[2], &score);
+  if (reply_error(s, reply)) {
+    return;
+  } else if (s.IsNotFound()) {
+    cluster::AppendNil(reply);
+  } else {
+    cluster::AppendBulk(format_score(score), reply);
+  }
+}
+
+static void zrange_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  std::vector<gilmour::ScoreMember> score_members;
+  gilmour::Status s = db->ZRange(args[1], atoi(args[2].c_str()),
+                                 atoi(args[3].c_str()), &score_members);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  bool withscores = args.size() > 4;
+  cluster::AppendArrayHeader(score_members.size() * (withscores ? 2 : 1),
+                             reply);
+  for (const auto& sm : score_members) {
+    cluster::AppendBulk(sm.member, reply);
+    if (withscores) {
+      cluster::AppendBulk(format_score(sm.score), reply);
+    }
+  }
+}
+
+static void zrangebyscore_command(const std::vector<std::string>& args,
+                                  std::string* reply) {
+  std::vector<gilmour::ScoreMember> score_members;
+  gilmour::Status s = db->ZRangeByScore(args[1], strtod(args[2].c_str(), NULL),
+                                        strtod(args[3].c_str(), NULL),
+                                        &score_members);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  bool withscores = args.size() > 4;
+  cluster::AppendArrayHeader(score_members.size() * (withscores ? 2 : 1),
+                             reply);
+  for (const auto& sm : score_members) {
+    cluster::AppendBulk(sm.member, reply);
+    if (withscores) {
+      cluster::AppendBulk(format_score(sm.score), reply);
+    }
+  }
+}
+
+static void zrank_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  int32_t rank = 0;
+  gilmour::Status s = db->ZRank(args[1], args[2], &rank);
+  if (reply_error(s, reply)) {
+    return;
+  } else if (s.IsNotFound()) {
+    cluster::AppendNil(reply);
+  } else {
+    cluster::AppendInteger(rank, reply);
+  }
+}
+
+static void zrem_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->ZRem(args[1], range_args(args, 2), &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(ret, reply);
+  }
+}
+
+static void zcard_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  int32_t ret = 0;
+  gilmour::Status s = db->ZCard(args[1], &ret);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(s.IsNotFound() ? 0 : ret, reply);
+  }
+}
+
+static void lpush_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  int32_t len = 0;
+  gilmour::Status s = db->LPush(args[1], range_args(args, 2), &len);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(len, reply);
+  }
+}
+
+static void rpush_command(const std::vector<std::string>& args,
+                          std::string* reply) {
+  int32_t len = 0;
+  gilmour::Status s = db->RPush(args[1], range_args(args, 2), &len);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(len, reply);
+  }
+}
+
+static void reply_element(const gilmour::Status& s,
+                          const std::string& element, std::string* reply) {
+  if (reply_error(s, reply)) {
+    return;
+  } else if (s.IsNotFound()) {
+    cluster::AppendNil(reply);
+  } else {
+    cluster::AppendBulk(element, reply);
+  }
+}
+
+static void lpop_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  std::string element;
+  gilmour::Status s = db->LPop(args[1], &element);
+  reply_element(s, element, reply);
+}
+
+static void rpop_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  std::string element;
+  gilmour::Status s = db->RPop(args[1], &element);
+  reply_element(s, element, reply);
+}
+
+static void lindex_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  std::string element;
+  gilmour::Status s = db->LIndex(args[1], atoi(args[2].c_str()), &element);
+  reply_element(s, element, reply);
+}
+
+static void lrange_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  std::vector<std::string> elements;
+  gilmour::Status s = db->LRange(args[1], atoi(args[2].c_str()),
+                                 atoi(args[3].c_str()), &elements);
+  if (reply_error(s, reply)) {
+    return;
+  }
+  cluster::AppendArrayHeader(elements.size(), reply);
+  for (const auto& element : elements) {
+    cluster::AppendBulk(element, reply);
+  }
+}
+
+static void llen_command(const std::vector<std::string>& args,
+                         std::string* reply) {
+  int32_t len = 0;
+  gilmour::Status s = db->LLen(args[1], &len);
+  if (!reply_error(s, reply)) {
+    cluster::AppendInteger(s.IsNotFound() ? 0 : len, reply);
+  }
+}
+
+static constexpr Command commands[] = {
+  {"set",       3,  true,  true,  set_command,       0},
+  {"get",       2,  false, true,  get_command,       0},
+  {"mset",      -3, true,  true,  mset_command,      2},
+  {"del",       -2, true,  true,  del_command,       1},
+  {"expire",    3,  true,  true,  expire_command,    0},
+  {"ttl",       2,  false, true,  ttl_command,       0},
+  {"type",      2,  false, true,  type_command,      0},
+  {"hset",      4,  true,  true,  hset_command,      0},
+  {"hmset",     -4, true,  true,  hmset_command,     0},
+  {"hget",      3,  false, true,  hget_command,      0},
+  {"hgetall",   2,  false, true,  hgetall_command,   0},
+  {"hdel",      -3, true,  true,  hdel_command,      0},
+  {"hlen",      2,  false, true,  hlen_command,      0},
+  {"sadd",      -3, true,  true,  sadd_command,      0},
+  {"srem",      -3, true,  true,  srem_command,      0},
+  {"smembers",  2,  false, true,  smembers_command,  0},
+  {"sismember", 3,  false, true,  sismember_command, 0},
+  {"scard",     2,  false, true,  scard_command,     0},
+  {"zadd",      -4, true,  true,  zadd_command,      0},
+  {"zscore",    3,  false, true,  zscore_command,    0},
+  {"zrange",    -4, false, true,  zrange_command,    0},
+  {"zrangebyscore", -4, false, true,  zrangebyscore_command, 0},
+  {"zrank",     3,  false, true,  zrank_command,     0},
+  {"zrem",      -3, true,  true,  zrem_command,      0},
+  {"zcard",     2,  false, true,  zcard_command,     0},
+  {"lpush",     -3, true,  false, lpush_command,     0},
+  {"rpush",     -3, true,  false, rpush_command,     0},
+  {"lpop",      2,  true,  false, lpop_command,      0},
+  {"rpop",      2,  true,  false, rpop_command,      0},
+  {"lindex",    3,  false, true,  lindex_command,    0},
+  {"lrange",    4,  false, true,  lrange_command,    0},
+  {"llen",      2,  false, true,  llen_command,      0},
+};
+
+//命令名的完美hash在编译期算出: 换seed直到所有命令名落在不同的slot,
+//查找只算一次hash, 读一个slot, 再比较一次命令名
+#define COMMANDSLOTS 256
+static constexpr uint32_t command_seed =
+  cluster::FindSeed(commands, cluster::kFnvOffsetBasis, COMMANDSLOTS);
+static constexpr cluster::SlotTable<COMMANDSLOTS> command_slots =
+  cluster::MakeSlotTable(commands, command_seed,
+      cluster::MakeIndexSequence<COMMANDSLOTS>::type());
+
+//name已经是小写
+static const Command* lookup_command(const std::string& name) {
+  uint8_t owner = command_slots.owners[
+    cluster::NameHash(name, command_seed) % COMMANDSLOTS];
+  if (owner == 0 || name != commands[owner - 1].name) {
+    return NULL;
+  }
+  return &commands[owner - 1];
+}
+
+//对比命令查找的耗时: 编译期的完美hash和unordered_map<string, Command*>,
+//按顺序反复查找全部命令名和一个不存在的命令名
+static void bench_lookup(int64_t rounds) {
+  std::vector<std::string> names;
+  std::unordered_map<std::string, const Command*> command_map;
+  for (const auto& command : commands) {
+    names.push_back(command.name);
+    command_map[command.name] = &command;
+  }
+  names.push_back("unknown");
+
+  uint64_t found = 0;
+  uint64_t start = now_micros();
+  for (int64_t i = 0; i < rounds; i++) {
+    for (const auto& name : names) {
+      found += lookup_command(name) != NULL;
+    }
+  }
+  uint64_t perfect_hash_us = now_micros() - start;
+
+  start = now_micros();
+  for (int64_t i = 0; i < rounds; i++) {
+    for (const auto& name : names) {
+      auto iter = command_map.find(name);
+      found += iter != command_map.end() && iter->second != NULL;
+    }
+  }
+  uint64_t map_us = now_micros() - start;
+
+  double lookups = static_cast<double>(rounds) * names.size();
+  printf("%.0f lookups (found %llu), perfect hash: %.2fns/lookup, "
+         "unordered_map: %.2fns/lookup\n", lookups,
+         static_cast<unsigned long long>(found),
+         perfect_hash_us * 1000.0 / lookups, map_us * 1000.0 / lookups);
+}
+
+//把一个key的当前值转成在目标节点重建它的命令, key不存在时返回0条
+static size_t dump_key(const std::string& key, std::string* buf) {
+  gilmour::DataType type;
+  if (!db->Type(key, &type).ok()) {
+    return 0;
+  }
+  std::vector<std::string> args;
+  gilmour::Status s;
+  if (type == gilmour::kStrings) {
+    std::string value;
+    s = db->Get(key, &value);
+    args = {"SET", key, value};
+  } else if (type == gilmour::kHashes) {
+    std::vector<gilmour::FieldValue> fvs;
+    s = db->HGetall(key, &fvs);
+    args = {"HMSET", key};
+    for (const auto& fv : fvs) {
+      args.push_back(fv.field);
+      args.push_back(fv.value);
+    }
+  } else if (type == gilmour::kSets) {
+    std::vector<std::string> members;
+    s = db->SMembers(key, &members);
+    args = {"SADD", key};
+    args.insert(args.end(), members.begin(), members.end());
+  } else if (type == gilmour::kLists) {
+    std::vector<std::string> elements;
+    s = db->LRange(key, 0, -1, &elements);
+    args = {"RPUSH", key};
+    args.insert(args.end(), elements.begin(), elements.end());
+  } else {
+    std::vector<gilmour::ScoreMember> score_members;
+    s = db->ZRange(key, 0, -1, &score_members);
+    args = {"ZADD", key};
+    for (const auto& sm : score_members) {
+      args.push_back(format_score(sm.score));
+      args.push_back(sm.member);
+    }
+  }
+  //读Type之后key可能刚被删除或过期
+  if (!s.ok() || args.size() == 2) {
+    return 0;
+  }
+  size_t count = 2;
+  //集合类型先删除目标节点上可能残留的旧值, 重建出的就是快照的值
+  cluster::AppendRequest({"DEL", key}, buf);
+  cluster::AppendRequest(args, buf);
+  int64_t ttl = 0;
+  if (db->TTL(key, &ttl).ok() && ttl > 0) {
+    cluster::AppendRequest({"EXPIRE", key, std::to_string(ttl)}, buf);
+    count++;
+  }
+  return count;
+}
+
+//发出count条命令并读回应答, 任何一条出错都算失败
+static bool send_batch(cluster::NodeConnection* conn, const std::string& buf,
+                       size_t count, std::string* error) {
+  if (count == 0) {
+    return true;
+  }
+  if (!conn->Send(buf)) {
+    *error = "send to " + conn->address() + " failed";
+    return false;
+  }
+  cluster::Reply reply;
+  for (size_t i = 0; i < count; i++) {
+    if (!conn->ReadReply(&reply)) {
+      *error = "read from " + conn->address() + " failed";
+      return false;
+    } else if (reply.IsError()) {
+      *error = reply.str;
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool in_migration(int slot) {
+  return migration.active && migration.first <= slot
+    && slot <= migration.last;
+}
+
+static bool migrate_slots(int first, int last, const std::string& target,
+                          std::string* error) {
+  cluster::NodeConnection conn;
+  cluster::Reply reply;
+  if (!conn.Connect(target) || !conn.Call({"CLUSTER", "IMPORTING"}, &reply)
+    || reply.IsError()) {
+    *error = "can not connect to " + target;
+    return false;
+  }
+
+  //快照: 分批Scan, 这之前开始的写入都已经在tail中
+  uint64_t keys = 0;
+  std::string cursor;
+  do {
+    std::vector<std::string> batch_keys;
+    gilmour::Status s = db->Scan(cursor, "*", SCANBATCH, &batch_keys, &cursor);
+    if (!s.ok()) {
+      *error = s.ToString();
+      return false;
+    }
+    std::string buf;
+    size_t count = 0;
+    for (const auto& key : batch_keys) {
+      int slot = cluster::KeySlot(key);
+      if (first <= slot && slot <= last) {
+        size_t n = dump_key(key, &buf);
+        keys += n != 0;
+        count += n;
+      }
+    }
+    if (!send_batch(&conn, buf, count, error)) {
+      return false;
+    }
+  } while (!cursor.empty());
+  {
+    std::lock_guard<std::mutex> l(cluster_mutex);
+    migration.keys = keys;
+    migration.state = "catching up";
+  }
+
+  //追赶tail, 剩下的足够少时在同一次加锁中进入切换, 此后这些slot
+  //不会再有新的写入
+  for (int round = 0; ; round++) {
+    std::vector<std::vector<std::string>> tail;
+    bool cutover = false;
+    {
+      std::lock_guard<std::mutex> l(cluster_mutex);
+      tail.swap(migration.tail);
+      migration.tail_commands += tail.size();
+      if (tail.size() <= CUTOVERTAIL || round + 1 >= MAXROUNDS) {
+        migration.cutover = true;
+        migration.cutover_ms = now_ms();
+        migration.state = "cutover";
+        cutover = true;
+      }
+    }
+    std::string buf;
+    for (const auto& args : tail) {
+      cluster::AppendRequest(args, &buf);
+    }
+    if (!send_batch(&conn, buf, tail.size(), error)) {
+      return false;
+    }
+    if (cutover) {
+      break;
+    }
+  }
+
+  std::string range = std::to_string(first) + "-" + std::to_string(last);
+  if (!conn.Call({"CLUSTER", "SETSLOT", range, target}, &reply)
+    || reply.IsError()) {
+    *error = "setslot on " + target + " failed";
+    return false;
+  }
+  std::vector<std::string> nodes;
+  {
+    std::lock_guard<std::mutex> l(cluster_mutex);
+    slots.Assign(first, last, target);
+    migration.switched_ms = now_ms();
+    migration.active = false;
+    migration.cutover = false;
+    migration.state = "cleaning up";
+    nodes = slots.nodes();
+  }
+  //其他节点尽量通知到, 没有通知到的节点由MOVED把客户端转过来
+  for (const auto& node : nodes) {
+    cluster::NodeConnection other;
+    if (node != self && node != target && other.Connect(node)) {
+      other.Call({"CLUSTER", "SETSLOT", range, target}, &reply);
+    }
+  }
+
+  //本节点的这些数据已经不会再被访问
+  cursor.clear();
+  do {
+    std::vector<std::string> batch_keys, moved_keys;
+    db->Scan(cursor, "*", SCANBATCH, &batch_keys, &cursor);
+    for (const auto& key : batch_keys) {
+      int slot = cluster::KeySlot(key);
+      if (first <= slot && slot <= last) {
+        moved_keys.push_back(key);
+      }
+    }
+    int64_t count;
+    db->Del(moved_keys, &count);
+  } while (!cursor.empty());
+  return true;
+}
+
+static void run_migration(int first, int last, std::string target) {
+  std::string error;
+  bool ok = migrate_slots(first, last, target, &error);
+  std::lock_guard<std::mutex> l(cluster_mutex);
+  migration.running = false;
+  migration.end_ms = now_ms();
+  if (ok) {
+    migration.state = "done";
+  } else {
+    //失败时slot仍然属于本节点, 目标节点上已经写入的数据不会被访问
+    migration.active = false;
+    migration.cutover = false;
+    migration.tail.clear();
+    migration.state = "failed: " + error;
+  }
+}
+
+static std::string replication_info() {
+  gilmour::ReplicationStats stats;
+  std::string role;
+  if (replica != NULL) {
+    replica->GetStats(&stats);
+    role = "replica";
+  } else if (replication_master != NULL) {
+    replication_master->GetStats(&stats);
+    role = "primary";
+  } else {
+    return "replication_role:none\r\n";
+  }
+  std::string info = "replication_role:" + role + "\r\n"
+    + "replication_connections:" + std::to_string(stats.connections) + "\r\n"
+    + "replication_full_syncs:" + std::to_string(stats.full_syncs) + "\r\n"
+    + "replication_segments:" + std::to_string(stats.segments) + "\r\n"
+    + "replication_bytes:" + std::to_string(stats.bytes) + "\r\n"
+    + "replication_raw_bytes:" + std::to_string(stats.raw_bytes) + "\r\n";
+  if (replica != NULL) {
+    info += "replication_applied_sequence:"
+      + std::to_string(stats.applied_sequence) + "\r\n"
+      + "replication_primary_sequence:"
+      + std::to_string(stats.primary_sequence) + "\r\n"
+      + "replication_lag:"
+      + std::to_string(stats.primary_sequence - stats.applied_sequence)
+      + "\r\n"
+      + "replication_apply_delay_us:"
+      + std::to_string(stats.apply_delay_micros) + "\r\n";
+  }
+  return info;
+}
+
+static void run_backup(uint64_t rate) {
+  gilmour::BackupOptions options;
+  options.backup_dir = backup_dir;
+  options.rate_limit = rate;
+  gilmour::BackupManager manager(options);
+  gilmour::BackupInfo info;
+  gilmour::Status s = manager.Open();
+  if (s.ok()) {
+    s = manager.CreateBackup(db, &info);
+  }
+  std::lock_guard<std::mutex> l(cluster_mutex);
+  backup.active = false;
+  backup.end_ms = now_ms();
+  if (s.ok()) {
+    backup.state = "done";
+    backup.id = info.id;
+    backup.size = info.size;
+  } else {
+    backup.state = "failed: " + s.ToString();
+  }
+}
+
+static std::string backup_info() {
+  uint64_t end = backup.end_ms != 0 ? backup.end_ms : now_ms();
+  std::string info = "backup_state:" + backup.state + "\r\n"
+    + "backup_dir:" + backup_dir + "\r\n"
+    + "backup_rate:" + std::to_string(backup.rate) + "\r\n"
+    + "backup_id:" + std::to_string(backup.id) + "\r\n"
+    + "backup_size:" + std::to_string(backup.size) + "\r\n";
+  if (backup.start_ms != 0) {
+    info += "backup_ms:" + std::to_string(end - backup.start_ms) + "\r\n";
+  }
+  return info;
+}
+
+//CHECKPOINT dir: 硬链接很快, 直接在事件循环中完成
+static void checkpoint_command(const std::vector<std::string>& args,
+                               std::string* reply) {
+  if (args.size() != 2) {
+    cluster::AppendError("ERR wrong number of arguments for 'checkpoint'",
+                         reply);
+    return;
+  }
+  reply_status(gilmour::BackupManager::CreateCheckpoint(db, args[1]), reply);
+}
+
+//BACKUP [rate]: 在后台线程中拷贝, 进度通过CLUSTER INFO查看
+static void backup_command(const std::vector<std::string>& args,
+                           std::string* reply) {
+  if (args.size() > 2) {
+    cluster::AppendError("ERR wrong number of arguments for 'backup'",
+                         reply);
+    return;
+  }
+  uint64_t rate = args.size() == 2 ? strtoull(args[1].c_str(), NULL, 10) : 0;
+  std::lock_guard<std::mutex> l(cluster_mutex);
+  if (backup.active) {
+    cluster::AppendError("ERR a backup is in progress", reply);
+    return;
+  }
+  if (backup_thread.joinable()) {
+    backup_thread.join();
+  }
+  backup.active = true;
+  backup.state = "running";
+  backup.rate = rate;
+  backup.id = 0;
+  backup.size = 0;
+  backup.start_ms = now_ms();
+  backup.end_ms = 0;
+  backup_thread = std::thread(run_backup, rate);
+  cluster::AppendStatus("OK", reply);
+}
+
+static void cluster_command(Client *client,
+                            const std::vector<std::string>& args,
+                            std::string* reply) {
+  std::string sub = args.size() > 1 ? args[1] : "";
+  for (auto& c : sub) {
+    c = tolower(c);
+  }
+  std::unique_lock<std::mutex> l(cluster_mutex);
+  if (sub == "slots") {
+    cluster::AppendBulk(slots.Describe(), reply);
+  } else if (sub == "info") {
+    uint64_t end = migration.end_ms != 0 ? migration.end_ms : now_ms();
+    std::string info = "node:" + self + "\r\n"
+      + "migration_state:" + migration.state + "\r\n"
+      + "migration_slots:" + std::to_string(migration.first) + "-"
+      + std::to_string(migration.last) + "\r\n"
+      + "migration_target:" + migration.target + "\r\n"
+      + "migrated_keys:" + std::to_string(migration.keys) + "\r\n"
+      + "migration_tail_commands:"
+      + std::to_string(migration.tail_commands) + "\r\n";
+    info += replication_info();
+    info += backup_info();
+    if (migration.start_ms != 0) {
+      info += "migration_ms:" + std::to_string(end - migration.start_ms)
+        + "\r\n";
+    }
+    if (migration.cutover_ms != 0) {
+      uint64_t switched = migration.switched_ms != 0
+        ? migration.switched_ms : end;
+      info += "cutover_ms:" + std::to_string(switched - migration.cutover_ms)
+        + "\r\n";
+    }
+    cluster::AppendBulk(info, reply);
+  } else if (sub == "setslot" && args.size() == 4) {
+    int first, last;
+    if (!cluster::ParseSlotRange(args[2], &first, &last)) {
+      cluster::AppendError("ERR invalid slot range", reply);
+      return;
+    }
+    slots.Assign(first, last, args[3]);
+    cluster::AppendStatus("OK", reply);
+  } else if (sub == "importing" && args.size() == 2) {
+    client->importing = true;
+    cluster::AppendStatus("OK", reply);
+  } else if (sub == "migrate" && args.size() == 4) {
+    int first, last;
+    if (!cluster::ParseSlotRange(args[2], &first, &last)) {
+      cluster::AppendError("ERR invalid slot range", reply);
+      return;
+    } else if (migration.running) {
+      cluster::AppendError("ERR a migration is in progress", reply);
+      return;
+    } else if (args[3] == self) {
+      cluster::AppendError("ERR can not migrate to myself", reply);
+      return;
+    }
+    for (int slot = first; slot <= last; slot++) {
+      if (slots.Owner(slot) != self) {
+        cluster::AppendError("ERR slot " + std::to_string(slot)
+                             + " is not served by me", reply);
+        return;
+      }
+    }
+    //上一个迁移线程已经不再加锁, 在锁外等它退出
+    std::thread finished;
+    finished.swap(migration_thread);
+    migration.active = true;
+    migration.cutover = false;
+    migration.running = true;
+    migration.first = first;
+    migration.last = last;
+    migration.target = args[3];
+    migration.tail.clear();
+    migration.state = "streaming";
+    migration.keys = 0;
+    migration.tail_commands = 0;
+    migration.start_ms = now_ms();
+    migration.cutover_ms = 0;
+    migration.switched_ms = 0;
+    migration.end_ms = 0;
+    migration_thread = std::thread(run_migration, first, last, args[3]);
+    cluster::AppendStatus("OK", reply);
+    l.unlock();
+    if (finished.joinable()) {
+      finished.join();
+    }
+  } else {
+    cluster::AppendError("ERR unknown cluster subcommand", reply);
+  }
+}
+
+static void process_command(Client *client,
+                            const std::vector<std::string>& args) {
+  std::string* reply = &client->wbuf;
+  std::string name = args[0];
+  for (auto& c : name) {
+    c = tolower(c);
+  }
+  if (name == "asking") {
+    client->asking = true;
+    cluster::AppendStatus("OK", reply);
+    return;
+  }
+  bool asking = client->asking;
+  client->asking = false;
+  if (name == "ping") {
+    cluster::AppendStatus("PONG", reply);
+    return;
+  } else if (name == "cluster") {
+    cluster_command(client, args, reply);
+    return;
+  } else if (name == "checkpoint") {
+    checkpoint_command(args, reply);
+    return;
+  } else if (name == "backup") {
+    backup_command(args, reply);
+    return;
+  }
+
+  const Command* command = lookup_command(name);
+  if (command == NULL) {
+    cluster::AppendError("ERR unknown command '" + args[0] + "'", reply);
+    return;
+  }
+  int argc = static_cast<int>(args.size());
+  if ((command->arity > 0 && argc != command->arity)
+    || (command->arity < 0 && argc < -command->arity)) {
+    cluster::AppendError("ERR wrong number of arguments for '" + name + "'",
+                         reply);
+    return;
+  }
+  //副本上只有读命令, 数据都来自主节点, 不属于哪些slot
+  if (replica != NULL) {
+    if (command->write) {
+      cluster::AppendError("READONLY You can't write against a read only "
+                           "replica", reply);
+    } else {
+      command->proc(args, reply);
+    }
+    return;
+  }
+
+  int slot = cluster::KeySlot(args[1]);
+  for (int i = 1 + command->key_step; command->key_step != 0 && i < argc;
+       i += command->key_step) {
+    if (cluster::KeySlot(args[i]) != slot) {
+      cluster::AppendError("CROSSSLOT Keys in request don't hash to the "
+                           "same slot", reply);
+      return;
+    }
+  }
+
+  //检查和执行在同一次加锁中完成, 迁移线程开始记录tail或者进入
+  //切换之后, 不会再有命令按旧的状态执行
+  std::lock_guard<std::mutex> l(cluster_mutex);
+  if (!client->importing && !asking) {
+    const std::string& owner = slots.Owner(slot);
+    if (owner.empty()) {
+      cluster::AppendError("CLUSTERDOWN Hash slot not served", reply);
+      return;
+    } else if (owner != self) {
+      cluster::AppendError("MOVED " + std::to_string(slot) + " " + owner,
+                           reply);
+      return;
+    }
+  }
+  if (!client->importing && in_migration(slot)
+    && (migration.cutover || (command->write && !command->idempotent))) {
+    cluster::AppendError("TRYAGAIN Slot is migrating", reply);
+    return;
+  }
+  command->proc(args, reply);
+  if (command->write && !client->importing && in_migration(slot)) {
+    migration.tail.push_back(args);
+  }
+}
+
+static void close_client(int epollfd, int fd) {
+  epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  delete clients[fd];
+  clients[fd] = NULL;
+}
+
+static void handle_read(int epollfd, int fd) {
+  Client *client = clients[fd];
+  char buf[16384];
+  ssize_t nread = read(fd, buf, sizeof(buf));
+  if (nread == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  } else if (nread <= 0) {
+    close_client(epollfd, fd);
+    return;
+  }
+  client->rbuf.append(buf, nread);
+
+  //一次读到的所有请求都执行完再写回, 流水线的应答合并成一次write
+  size_t pos = 0;
+  std::vector<std::string> args;
+  while (pos < client->rbuf.size()) {
+    int n = cluster::ParseRequest(client->rbuf.data() + pos,
+                                  client->rbuf.size() - pos, &args);
+    if (n < 0) {
+      close_client(epollfd, fd);
+      return;
+    } else if (n == 0) {
+      break;
+    }
+    pos += n;
+    if (!args.empty()) {
+      process_command(client, args);
+    }
+  }
+  client->rbuf.erase(0, pos);
+
+  while (client->wpos < client->wbuf.size()) {
+    ssize_t nwrite = write(fd, client->wbuf.data() + client->wpos,
+                           client->wbuf.size() - client->wpos);
+    if (nwrite == -1) {
+      if (errno == EAGAIN) {
+        //写不完的等可写事件, 在写完之前不再读新的请求
+        struct epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.fd = fd;
+        epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev);
+        return;
+      } else if (errno != EINTR) {
+        close_client(epollfd, fd);
+        return;
+      }
+      continue;
+    }
+    client->wpos += nwrite;
+  }
+  client->wbuf.clear();
+  client->wpos = 0;
+}
+
+static void handle_write(int epollfd, int fd) {
+  Client *client = clients[fd];
+  while (client->wpos < client->wbuf.size()) {
+    ssize_t nwrite = write(fd, client->wbuf.data() + client->wpos,
+                           client->wbuf.size() - client->wpos);
+    if (nwrite == -1) {
+      if (errno == EAGAIN) {
+        return;
+      } else if (errno != EINTR) {
+        close_client(epollfd, fd);
+        return;
+      }
+      continue;
+    }
+    client->wpos += nwrite;
+  }
+  client->wbuf.clear();
+  client->wpos = 0;
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void handle_accept(int epollfd, int listenfd) {
+  for (int i = 0; i < LISTENQ; i++) {
+    int fd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd == -1) {
+      if (errno != EAGAIN) {
+        perror("accept error:");
+      }
+      return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (static_cast<size_t>(fd) >= clients.size()) {
+      clients.resize(fd + 1, NULL);
+    }
+    clients[fd] = new Client();
+    clients[fd]->wpos = 0;
+    clients[fd]->asking = false;
+    clients[fd]->importing = false;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+static int socket_bind(const char* ip, int port) {
+  int listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listenfd == -1) {
+    perror("socket error:");
+    exit(1);
+  }
+  int on = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in servaddr;
+  bzero(&servaddr, sizeof(servaddr));
+  servaddr.sin_family = AF_INET;
+  inet_pton(AF_INET, ip, &servaddr.sin_addr);
+  servaddr.sin_port = htons(port);
+  if (bind(listenfd, (struct sockaddr*)&servaddr, sizeof(servaddr)) == -1) {
+    perror("bind error: ");
+    exit(1);
+  }
+  listen(listenfd, LISTENQ);
+  return listenfd;
+}
+
+static void handle_signal(int sig) {
+  stop = 1;
+}
+
+static void usage() {
+  printf("Usage:\n");
+  printf("      ./cluster_node [-p port] [-c node,node,...] [-d db_path]\n");
+  printf("      -c列出集群的全部节点(host:port), slot按顺序平分给它们,\n");
+  printf("      默认只有本节点, 拥有全部slot. db_path默认为./db_端口\n");
+  printf("      [-R repl_port] 在repl_port上接受副本的同步\n");
+  printf("      [-f host:repl_port] 作为那个节点的只读副本启动\n");
+  printf("      [-b backup_dir] BACKUP命令的备份目录, 默认为./backup_端口\n");
+  printf("      [-z zsets] 在内存中为最近读过的这么多个大zset建排名索引\n");
+  printf("      [-L rounds] 对比命令查找的耗时之后退出, 不启动节点\n");
+}
+
+int main(int argc, char *argv[]) {
+  int port = PORT;
+  std::string nodes;
+  std::string db_path;
+  int repl_port = 0;
+  std::string primary;
+  int zset_index_keys = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:c:d:R:f:b:z:L:h")) != -1) {
+    switch (opt) {
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'c':
+        nodes = optarg;
+        break;
+      case 'd':
+        db_path = optarg;
+        break;
+      case 'R':
+        repl_port = atoi(optarg);
+        break;
+      case 'f':
+        primary = optarg;
+        break;
+      case 'b':
+        backup_dir = optarg;
+        break;
+      case 'z':
+        zset_index_keys = atoi(optarg);
+        break;
+      case 'L':
+        bench_lookup(atoll(optarg));
+        return 0;
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  self = std::string(IPADDRESS) + ":" + std::to_string(port);
+  if (db_path.empty()) {
+    db_path = "./db_" + std::to_string(port);
+  }
+  if (backup_dir.empty()) {
+    backup_dir = "./backup_" + std::to_string(port);
+  }
+  std::vector<std::string> members;
+  for (size_t pos = 0; pos < nodes.size(); ) {
+    size_t comma = nodes.find(',', pos);
+    if (comma == std::string::npos) {
+      comma = nodes.size();
+    }
+    members.push_back(nodes.substr(pos, comma - pos));
+    pos = comma + 1;
+  }
+  if (members.empty()) {
+    members.push_back(self);
+  }
+  slots.AssignEvenly(members);
+  migration.active = false;
+  migration.cutover = false;
+  migration.running = false;
+  migration.first = 0;
+  migration.last = 0;
+  migration.state = "none";
+  migration.keys = 0;
+  migration.tail_commands = 0;
+  migration.start_ms = 0;
+  migration.cutover_ms = 0;
+  migration.switched_ms = 0;
+  migration.end_ms = 0;
+  backup.active = false;
+  backup.state = "none";
+  backup.rate = 0;
+  backup.id = 0;
+  backup.size = 0;
+  backup.start_ms = 0;
+  backup.end_ms = 0;
+
+  gilmour::GilmourOptions options;
+  options.options.create_if_missing = true;
+  options.zset_index_keys = zset_index_keys;
+  gilmour::ReplicationOptions replication_options;
+  gilmour::Status s;
+  if (!primary.empty()) {
+    replica = new gilmour::Replica(replication_options);
+    s = replica->Open(options, db_path, primary);
+    db = replica->db();
+  } else {
+    if (repl_port != 0) {
+      //副本落后时还要从WAL中读, 刷盘之后的WAL文件保留一段时间
+      options.options.WAL_ttl_seconds = 3600;
+      options.options.WAL_size_limit_MB = 4096;
+    }
+    db = new gilmour::Gilmour();
+    s = db->Open(options, db_path);
+  }
+  if (!s.ok()) {
+    fprintf(stderr, "open %s error: %s\n", db_path.c_str(),
+            s.ToString().c_str());
+    exit(1);
+  }
+  if (repl_port != 0 && replica == NULL) {
+    replication_master = new gilmour::ReplicationMaster(db,
+                                                        replication_options);
+    s = replication_master->Start(repl_port);
+    if (!s.ok()) {
+      fprintf(stderr, "replication on port %d error: %s\n", repl_port,
+              s.ToString().c_str());
+      exit(1);
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+  int listenfd = socket_bind(IPADDRESS, port);
+  int epollfd = epoll_create1(0);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = listenfd;
+  epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &ev);
+  struct epoll_event events[EPOLLEVENTS];
+  while (!stop) {
+    int ret = epoll_wait(epollfd, events, EPOLLEVENTS, 1000);
+    for (int i = 0; i < ret; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listenfd) {
+        handle_accept(epollfd, listenfd);
+      } else if (clients[fd] == NULL) {
+        continue;
+      } else if (events[i].events & EPOLLIN) {
+        handle_read(epollfd, fd);
+      } else if (events[i].events & EPOLLOUT) {
+        handle_write(epollfd, fd);
+      } else {
+        close_client(epollfd, fd);
+      }
+    }
+  }
+
+  if (migration_thread.joinable()) {
+    migration_thread.join();
+  }
+  if (backup_thread.joinable()) {
+    backup_thread.join();
+  }
+  for (size_t fd = 0; fd < clients.size(); fd++) {
+    if (clients[fd] != NULL) {
+      close_client(epollfd, fd);
+    }
+  }
+  close(epollfd);
+  close(listenfd);
+  //副本的db由Replica持有
+  delete replication_master;
+  if (replica != NULL) {
+    delete replica;
+  } else {
+    delete db;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef CLUSTER_PERFECT_HASH_H_
+#define CLUSTER_PERFECT_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// A perfect hash over the names of a constexpr table, built by the
+// compiler: FindSeed() tries seeds of an FNV-1a hash until the names
+// land in distinct slots of a table of Slots entries, and
+// MakeSlotTable() fills the slots with the index of the name in each.
+// A lookup is one hash of the name, one load and one compare of the
+// name found, nothing is allocated.
+//
+// The entries are any literal type with a const char* name member.
+// The recursion of the constexpr functions is linear in the number of
+// entries (C++11 constexpr functions have no loops), fine for the few
+// dozen names of a command table.
+namespace cluster {
+
+const uint32_t kFnvOffsetBasis = 2166136261u;
+const uint32_t kFnvPrime = 16777619u;
+
+constexpr size_t NameLength(const char* name) {
+  return *name == '\0' ? 0 : 1 + NameLength(name + 1);
+}
+
+constexpr uint32_t NameHash(const char* name, size_t size, uint32_t seed) {
+  return size == 0 ? seed
+    : NameHash(name + 1, size - 1,
+               (seed ^ static_cast<unsigned char>(*name)) * kFnvPrime);
+}
+
+// The same hash at run time
+inline uint32_t NameHash(const std::string& name, uint32_t seed) {
+  for (size_t i = 0; i < name.size(); i++) {
+    seed = (seed ^ static_cast<unsigned char>(name[i])) * kFnvPrime;
+  }
+  return seed;
+}
+
+template <typename T, size_t N>
+constexpr size_t SlotOf(const T (&entries)[N], size_t i, uint32_t seed,
+                        size_t slots) {
+  return NameHash(entries[i].name, NameLength(entries[i].name), seed)
+    % slots;
+}
+
+// Whether entry i shares its slot with any of the entries j and after
+template <typename T, size_t N>
+constexpr bool CollidesAfter(const T (&entries)[N], size_t i, size_t j,
+                             uint32_t seed, size_t slots) {
+  return j < N
+    && (SlotOf(entries, i, seed, slots) == SlotOf(entries, j, seed, slots)
+        || CollidesAfter(entries, i, j + 1, seed, slots));
+}
+
+// Whether two of the entries i and after share a slot
+template <typename T, size_t N>
+constexpr bool Collides(const T (&entries)[N], size_t i, uint32_t seed,
+                        size_t slots) {
+  return i < N
+    && (CollidesAfter(entries, i, i + 1, seed, slots)
+        || Collides(entries, i + 1, seed, slots));
+}
+
+// The first seed from seed on without collisions. Fails to compile,
+// exceeding the constexpr depth, when the slots are too few
+template <typename T, size_t N>
+constexpr uint32_t FindSeed(const T (&entries)[N], uint32_t seed,
+                            size_t slots) {
+  return !Collides(entries, 0, seed, slots) ? seed
+    : FindSeed(entries, seed + 1, slots);
+}
+
+// 1 + the index of the entry in slot, 0 if the slot is empty
+template <typename T, size_t N>
+constexpr uint8_t OwnerOf(const T (&entries)[N], size_t slot, size_t i,
+                          uint32_t seed, size_t slots) {
+  return i == N ? 0
+    : SlotOf(entries, i, seed, slots) == slot ? static_cast<uint8_t>(i + 1)
+    : OwnerOf(entries, slot, i + 1, seed, slots);
+}
+
+template <size_t Slots>
+struct SlotTable {
+  uint8_t owners[Slots];
+};
+
+template <size_t... I>
+struct IndexSequence {
+};
+
+template <size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {
+};
+
+template <size_t... I>
+struct MakeIndexSequence<0, I...> {
+  typedef IndexSequence<I...> type;
+};
+
+template <typename T, size_t N, size_t... S>
+constexpr SlotTable<sizeof...(S)> MakeSlotTable(const T (&entries)[N],
+                                                uint32_t seed,
+                                                IndexSequence<S...>) {
+  static_assert(N < 256, "An owner index is one byte");
+  return {{OwnerOf(entries, S, 0, seed, sizeof...(S))...}};
+}
+
+}  //  namespace cluster
+
+#endif  //  CLUSTER_PERFECT_HASH_H_
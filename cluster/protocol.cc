@@ -0,0 +1,294 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "protocol.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace cluster {
+
+// Arguments and bulks larger than this are refused
+static const int64_t kMaxBulkSize = 512 << 20;
+static const int64_t kMaxArraySize = 1 << 20;
+
+// Reads "<prefix><integer>\r\n" at buf, returns the bytes it took
+static int ParseLine(const char* buf, size_t len, int64_t* value) {
+  const char* end = static_cast<const char*>(memchr(buf, '\r', len));
+  if (end == nullptr || end + 1 >= buf + len) {
+    return 0;
+  }
+  if (end[1] != '\n') {
+    return -1;
+  }
+  char* parsed;
+  *value = strtoll(buf + 1, &parsed, 10);
+  if (parsed != end) {
+    return -1;
+  }
+  return static_cast<int>(end + 2 - buf);
+}
+
+void AppendRequest(const std::vector<std::string>& args, std::string* buf) {
+  AppendArrayHeader(args.size(), buf);
+  for (const auto& arg : args) {
+    AppendBulk(arg, buf);
+  }
+}
+
+int ParseRequest(const char* buf, size_t len,
+                 std::vector<std::string>* args) {
+  args->clear();
+  if (len == 0) {
+    return 0;
+  }
+  if (buf[0] != '*') {
+    const char* end = static_cast<const char*>(memchr(buf, '\n', len));
+    if (end == nullptr) {
+      return 0;
+    }
+    const char* p = buf;
+    while (p < end) {
+      while (p < end && (*p == ' ' || *p == '\r')) {
+        p++;
+      }
+      const char* start = p;
+      while (p < end && *p != ' ' && *p != '\r') {
+        p++;
+      }
+      if (p > start) {
+        args->push_back(std::string(start, p - start));
+      }
+    }
+    return static_cast<int>(end + 1 - buf);
+  }
+
+  int64_t count;
+  int pos = ParseLine(buf, len, &count);
+  if (pos <= 0) {
+    return pos;
+  } else if (count > kMaxArraySize) {
+    return -1;
+  }
+  for (int64_t i = 0; i < count; i++) {
+    if (static_cast<size_t>(pos) >= len) {
+      return 0;
+    } else if (buf[pos] != '$') {
+      return -1;
+    }
+    int64_t size;
+    int n = ParseLine(buf + pos, len - pos, &size);
+    if (n <= 0) {
+      return n;
+    } else if (size < 0 || size > kMaxBulkSize) {
+      return -1;
+    }
+    pos += n;
+    if (static_cast<size_t>(pos + size + 2) > len) {
+      return 0;
+    }
+    args->push_back(std::string(buf + pos, size));
+    pos += size + 2;
+  }
+  return pos;
+}
+
+void AppendStatus(const std::string& status, std::string* buf) {
+  buf->append("+").append(status).append("\r\n");
+}
+
+void AppendError(const std::string& error, std::string* buf) {
+  buf->append("-").append(error).append("\r\n");
+}
+
+void AppendInteger(int64_t value, std::string* buf) {
+  buf->append(":").append(std::to_string(value)).append("\r\n");
+}
+
+void AppendBulk(const std::string& value, std::string* buf) {
+  buf->append("$").append(std::to_string(value.size())).append("\r\n");
+  buf->append(value).append("\r\n");
+}
+
+void AppendNil(std::string* buf) {
+  buf->append("$-1\r\n");
+}
+
+void AppendArrayHeader(size_t size, std::string* buf) {
+  buf->append("*").append(std::to_string(size)).append("\r\n");
+}
+
+bool Reply::IsError(const char* prefix) const {
+  return type == '-' && str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+int ParseReply(const char* buf, size_t len, Reply* reply) {
+  if (len == 0) {
+    return 0;
+  }
+  reply->type = buf[0];
+  reply->nil = false;
+  reply->elements.clear();
+  switch (buf[0]) {
+    case '+':
+    case '-': {
+      const char* end = static_cast<const char*>(memchr(buf, '\r', len));
+      if (end == nullptr || end + 1 >= buf + len) {
+        return 0;
+      }
+      reply->str.assign(buf + 1, end - buf - 1);
+      return static_cast<int>(end + 2 - buf);
+    }
+    case ':':
+      return ParseLine(buf, len, &reply->integer);
+    case '$': {
+      int64_t size;
+      int pos = ParseLine(buf, len, &size);
+      if (pos <= 0) {
+        return pos;
+      } else if (size < 0) {
+        reply->nil = true;
+        return pos;
+      } else if (size > kMaxBulkSize) {
+        return -1;
+      } else if (static_cast<size_t>(pos + size + 2) > len) {
+        return 0;
+      }
+      reply->str.assign(buf + pos, size);
+      return static_cast<int>(pos + size + 2);
+    }
+    case '*': {
+      int64_t count;
+      int pos = ParseLine(buf, len, &count);
+      if (pos <= 0) {
+        return pos;
+      } else if (count < 0) {
+        reply->nil = true;
+        return pos;
+      } else if (count > kMaxArraySize) {
+        return -1;
+      }
+      reply->elements.resize(count);
+      for (int64_t i = 0; i < count; i++) {
+        int n = ParseReply(buf + pos, len - pos, &reply->elements[i]);
+        if (n <= 0) {
+          return n;
+        }
+        pos += n;
+      }
+      return pos;
+    }
+    default:
+      return -1;
+  }
+}
+
+NodeConnection::NodeConnection()
+    : fd_(-1), rpos_(0) {
+}
+
+NodeConnection::~NodeConnection() {
+  Close();
+}
+
+bool NodeConnection::Connect(const std::string& address) {
+  Close();
+  address_ = address;
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(address.c_str() + colon + 1));
+  if (inet_pton(AF_INET, address.substr(0, colon).c_str(),
+                &addr.sin_addr) != 1) {
+    return false;
+  }
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd_ == -1) {
+    return false;
+  }
+  if (connect(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) == -1) {
+    Close();
+    return false;
+  }
+  // The requests of a pipeline are written at once, never wait
+  // for the acknowledgement of the previous segment
+  int on = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return true;
+}
+
+void NodeConnection::Close() {
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+  rbuf_.clear();
+  rpos_ = 0;
+}
+
+bool NodeConnection::Send(const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd_, data.data() + written, data.size() - written);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      Close();
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+bool NodeConnection::ReadReply(Reply* reply) {
+  while (fd_ != -1) {
+    int n = ParseReply(rbuf_.data() + rpos_, rbuf_.size() - rpos_, reply);
+    if (n > 0) {
+      rpos_ += n;
+      if (rpos_ == rbuf_.size()) {
+        rbuf_.clear();
+        rpos_ = 0;
+      }
+      return true;
+    } else if (n < 0) {
+      break;
+    }
+    if (rpos_ > 0) {
+      rbuf_.erase(0, rpos_);
+      rpos_ = 0;
+    }
+    char buf[16384];
+    ssize_t nread = read(fd_, buf, sizeof(buf));
+    if (nread == -1 && errno == EINTR) {
+      continue;
+    } else if (nread <= 0) {
+      break;
+    }
+    rbuf_.append(buf, nread);
+  }
+  Close();
+  return false;
+}
+
+bool NodeConnection::Call(const std::vector<std::string>& args,
+                          Reply* reply) {
+  std::string request;
+  AppendRequest(args, &request);
+  return Send(request) && ReadReply(reply);
+}
+
+}  //  namespace cluster
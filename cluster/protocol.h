@@ -0,0 +1,82 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef CLUSTER_PROTOCOL_H_
+#define CLUSTER_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// The wire protocol of the cluster nodes, a subset of RESP: requests
+// are multi bulk arrays (or inline space separated lines, as typed
+// into nc), replies are status, error, integer, bulk and array. The
+// parsers take a buffer which may hold a partial message and return
+// how many bytes the message took, 0 until it is complete and -1 on
+// a protocol error, the connection is closed then.
+namespace cluster {
+
+void AppendRequest(const std::vector<std::string>& args, std::string* buf);
+int ParseRequest(const char* buf, size_t len, std::vector<std::string>* args);
+
+void AppendStatus(const std::string& status, std::string* buf);
+void AppendError(const std::string& error, std::string* buf);
+void AppendInteger(int64_t value, std::string* buf);
+void AppendBulk(const std::string& value, std::string* buf);
+void AppendNil(std::string* buf);
+void AppendArrayHeader(size_t size, std::string* buf);
+
+struct Reply {
+  // '+', '-', ':', '$' or '*'
+  char type = 0;
+  // A nil bulk or array
+  bool nil = false;
+  int64_t integer = 0;
+  // The text of a status, an error or a bulk
+  std::string str;
+  std::vector<Reply> elements;
+
+  bool IsError() const { return type == '-'; }
+  // True for the errors starting with prefix, e.g. "MOVED"
+  bool IsError(const char* prefix) const;
+};
+
+int ParseReply(const char* buf, size_t len, Reply* reply);
+
+// A blocking connection to a node, for the clients and the
+// migrations, requests can be pipelined: send any number of them
+// and then read the replies in order
+class NodeConnection {
+ public:
+  NodeConnection();
+  ~NodeConnection();
+
+  // address is "host:port"
+  bool Connect(const std::string& address);
+  void Close();
+  bool connected() const { return fd_ != -1; }
+  const std::string& address() const { return address_; }
+
+  bool Send(const std::string& data);
+  bool ReadReply(Reply* reply);
+  // Sends one request and reads its reply
+  bool Call(const std::vector<std::string>& args, Reply* reply);
+
+ private:
+  int fd_;
+  std::string address_;
+  std::string rbuf_;
+  size_t rpos_;
+
+  // No copying allowed
+  NodeConnection(const NodeConnection&);
+  void operator=(const NodeConnection&);
+};
+
+}  //  namespace cluster
+
+#endif  //  CLUSTER_PROTOCOL_H_
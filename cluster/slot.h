@@ -0,0 +1,155 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef CLUSTER_SLOT_H_
+#define CLUSTER_SLOT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// The keyspace of a cluster is cut into kNumSlots hash slots, every
+// slot is owned by one node. A key goes to CRC16(key) % kNumSlots like
+// in redis cluster, only the part between the first '{' and the next
+// '}' is hashed when there is one, so keys sharing such a tag always
+// live on one node and can be used together by one command.
+namespace cluster {
+
+const int kNumSlots = 16384;
+
+// CRC16-CCITT (XMODEM), the checksum of redis cluster
+inline uint16_t Crc16(const char* data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= static_cast<uint16_t>(static_cast<unsigned char>(data[i]) << 8);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+        : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+inline int KeySlot(const char* key, size_t size) {
+  const char* open = static_cast<const char*>(memchr(key, '{', size));
+  if (open != nullptr) {
+    const char* tag = open + 1;
+    const char* close = static_cast<const char*>(
+        memchr(tag, '}', key + size - tag));
+    // "{}" is not a tag, the whole key is hashed
+    if (close != nullptr && close != tag) {
+      return Crc16(tag, close - tag) % kNumSlots;
+    }
+  }
+  return Crc16(key, size) % kNumSlots;
+}
+
+inline int KeySlot(const std::string& key) {
+  return KeySlot(key.data(), key.size());
+}
+
+// "first-last" or a single slot
+inline bool ParseSlotRange(const std::string& range, int* first, int* last) {
+  char* end;
+  *first = static_cast<int>(strtol(range.c_str(), &end, 10));
+  *last = *first;
+  if (*end == '-') {
+    *last = static_cast<int>(strtol(end + 1, &end, 10));
+  }
+  return end != range.c_str() && *end == '\0' && 0 <= *first
+    && *first <= *last && *last < kNumSlots;
+}
+
+// Which node ("host:port") owns every slot. Not thread safe.
+class SlotMap {
+ public:
+  SlotMap() : owners_(kNumSlots, -1) {
+  }
+
+  // "" when the slot is not assigned
+  const std::string& Owner(int slot) const {
+    static const std::string kNone;
+    return owners_[slot] < 0 ? kNone : nodes_[owners_[slot]];
+  }
+
+  void Assign(int first, int last, const std::string& node) {
+    int index = NodeIndex(node);
+    for (int slot = first; slot <= last; slot++) {
+      owners_[slot] = index;
+    }
+  }
+
+  // Splits the slots evenly over nodes, in the order they are given
+  void AssignEvenly(const std::vector<std::string>& nodes) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      Assign(kNumSlots * i / nodes.size(),
+             kNumSlots * (i + 1) / nodes.size() - 1, nodes[i]);
+    }
+  }
+
+  // "host:port first-last" per line for every run of slots, the
+  // format of CLUSTER SLOTS and of Parse()
+  std::string Describe() const {
+    std::string result;
+    int first = 0;
+    for (int slot = 1; slot <= kNumSlots; slot++) {
+      if (slot < kNumSlots && owners_[slot] == owners_[first]) {
+        continue;
+      }
+      if (owners_[first] >= 0) {
+        result += nodes_[owners_[first]] + " " + std::to_string(first)
+          + "-" + std::to_string(slot - 1) + "\n";
+      }
+      first = slot;
+    }
+    return result;
+  }
+
+  bool Parse(const std::string& description) {
+    size_t pos = 0;
+    while (pos < description.size()) {
+      size_t end = description.find('\n', pos);
+      if (end == std::string::npos) {
+        end = description.size();
+      }
+      std::string line = description.substr(pos, end - pos);
+      pos = end + 1;
+      if (line.empty()) {
+        continue;
+      }
+      size_t space = line.find(' ');
+      int first, last;
+      if (space == std::string::npos || !ParseSlotRange(
+            line.substr(space + 1), &first, &last)) {
+        return false;
+      }
+      Assign(first, last, line.substr(0, space));
+    }
+    return true;
+  }
+
+  const std::vector<std::string>& nodes() const { return nodes_; }
+
+ private:
+  int NodeIndex(const std::string& node) {
+    for (size_t i = 0; i < nodes_.size(); i++) {
+      if (nodes_[i] == node) {
+        return static_cast<int>(i);
+      }
+    }
+    nodes_.push_back(node);
+    return static_cast<int>(nodes_.size() - 1);
+  }
+
+  std::vector<int> owners_;
+  std::vector<std::string> nodes_;
+};
+
+}  //  namespace cluster
+
+#endif  //  CLUSTER_SLOT_H_
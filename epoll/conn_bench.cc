@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gilmour/cpu_placement.h"
+
+#define IPADDRESS   "127.0.0.1"
+#define SERV_PORT   8787
+#define METRICSPORT 8788
+#define EPOLLEVENTS 1024
+//每个源地址最多使用的连接数, 本地端口范围默认约28000个
+#define CONNS_PER_SOURCE 20000
+
+//连接数压测: 建立大量空闲连接, 统计服务端的accept速率和每个连接
+//占用的内存(RSS), 最后抽样发送请求确认连接都还可用
+//
+//  ./epoll_server &
+//  ./conn_bench -n 100000 -p `pidof epoll_server`
+//
+//10万个连接需要ulimit -n和net.core.somaxconn足够大, 源地址轮流使用
+//127.0.0.2开始的多个地址, 以免耗尽本地端口
+//
+//-q指定时再在第一个连接上一问一答地发送这么多请求, 统计往返延迟,
+//用来比较服务端绑核, 忙轮询等配置与默认配置的差别, 例如
+//
+//  ./epoll_server -a 2 -p 50 &
+//  ./conn_bench -n 1 -q 100000 -a 3
+
+static uint64_t now_micros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+//进程的常驻内存, KB
+static long read_rss(int pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char line[128];
+  long rss = -1;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+      break;
+    }
+  }
+  fclose(file);
+  return rss;
+}
+
+//内核中TCP缓冲区占用的内存, 页
+static long read_tcp_mem() {
+  FILE *file = fopen("/proc/net/sockstat", "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char line[256];
+  long inuse, orphan, tw, alloc, mem = -1;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "TCP: inuse %ld orphan %ld tw %ld alloc %ld mem %ld",
+               &inuse, &orphan, &tw, &alloc, &mem) == 5) {
+      break;
+    }
+  }
+  fclose(file);
+  return mem;
+}
+
+//从服务端的统计信息中取connected_clients, 失败返回-1
+static long connected_clients(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  bzero(&addr, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, IPADDRESS, &addr.sin_addr);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  const char *request = "GET / HTTP/1.0\r\n\r\n";
+  write(fd, request, strlen(request));
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    response.append(buf, n);
+  }
+  close(fd);
+  size_t pos = response.find("connected_clients:");
+  if (pos == std::string::npos) {
+    return -1;
+  }
+  return atol(response.c_str() + pos + strlen("connected_clients:"));
+}
+
+static void usage() {
+  printf("Usage:\n");
+  printf("      ./conn_bench [-n connections] [-p server_pid] [-c concurrency]\n");
+  printf("                   [-m metrics_port] [-w hold_seconds] [-q requests] [-a cpu]\n");
+}
+
+int main(int argc, char *argv[]) {
+  int  num = 100000;
+  int  pid = 0;
+  int  concurrency = 1000;
+  int  metrics_port = METRICSPORT;
+  int  hold = 0;
+  int  requests = 0;
+  int  cpu = -1;
+  int  opt;
+  while ((opt = getopt(argc, argv, "n:p:c:m:w:q:a:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        num = atoi(optarg);
+        break;
+      case 'p':
+        pid = atoi(optarg);
+        break;
+      case 'c':
+        concurrency = atoi(optarg);
+        break;
+      case 'm':
+        metrics_port = atoi(optarg);
+        break;
+      case 'w':
+        hold = atoi(optarg);
+        break;
+      case 'q':
+        requests = atoi(optarg);
+        break;
+      case 'a':
+        cpu = atoi(optarg);
+        break;
+      default:
+        usage();
+        exit(1);
+    }
+  }
+
+  if (cpu >= 0) {
+    gilmour::PinThread(cpu);
+  }
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  getrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < static_cast<rlim_t>(num) + 16) {
+    fprintf(stderr, "open files limit %lu is too small for %d connections\n",
+            (unsigned long)limit.rlim_cur, num);
+    exit(1);
+  }
+
+  long base_clients = connected_clients(metrics_port);
+  long base_rss = pid != 0 ? read_rss(pid) : -1;
+  long base_tcp_mem = read_tcp_mem();
+
+  struct sockaddr_in servaddr;
+  bzero(&servaddr, sizeof(servaddr));
+  servaddr.sin_family = AF_INET;
+  servaddr.sin_port = htons(SERV_PORT);
+  inet_pton(AF_INET, IPADDRESS, &servaddr.sin_addr);
+
+  int epollfd = epoll_create1(0);
+  struct epoll_event events[EPOLLEVENTS];
+  std::vector<int> fds;
+  fds.reserve(num);
+  int started = 0, established = 0, failed = 0, inflight = 0;
+  uint64_t start = now_micros();
+  while (established + failed < num) {
+    //保持concurrency个连接在建立中
+    while (started < num && inflight < concurrency) {
+      int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+      if (fd == -1) {
+        perror("socket error:");
+        exit(1);
+      }
+      struct sockaddr_in local;
+      bzero(&local, sizeof(local));
+      local.sin_family = AF_INET;
+      local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + started / CONNS_PER_SOURCE);
+#ifdef IP_BIND_ADDRESS_NO_PORT
+      int on = 1;
+      setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+#endif
+      bind(fd, (struct sockaddr*)&local, sizeof(local));
+      started++;
+      if (connect(fd, (struct sockaddr*)&servaddr, sizeof(servaddr)) == 0) {
+        fds.push_back(fd);
+        established++;
+        continue;
+      }
+      if (errno != EINPROGRESS) {
+        close(fd);
+        failed++;
+        continue;
+      }
+      struct epoll_event ev;
+      ev.events = EPOLLOUT;
+      ev.data.fd = fd;
+      epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+      inflight++;
+    }
+    int ret = epoll_wait(epollfd, events, EPOLLEVENTS, 1000);
+    for (int i = 0; i < ret; i++) {
+      int fd = events[i].data.fd;
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
+      inflight--;
+      if (err == 0) {
+        fds.push_back(fd);
+        established++;
+      } else {
+        close(fd);
+        failed++;
+      }
+    }
+  }
+  uint64_t connected = now_micros();
+
+  //连接在backlog中就算建立了, 等服务端全部accept
+  long clients = -1;
+  if (base_clients != -1) {
+    while (now_micros() - connected < 10000000) {
+      clients = connected_clients(metrics_port);
+      if (clients == -1 || clients - base_clients >= established) {
+        break;
+      }
+      usleep(1000);
+    }
+  }
+  uint64_t accepted = now_micros();
+
+  printf("Connections: %d established, %d failed\n", established, failed);
+  printf("Connect: %.2f s, %.0f conn/s\n", (connected - start) / 1e6,
+         established * 1e6 / (connected - start));
+  if (clients != -1) {
+    printf("Accept: %ld clients, %.2f s, %.0f conn/s\n", clients - base_clients,
+           (accepted - start) / 1e6, (clients - base_clients) * 1e6 / (accepted - start));
+  }
+  if (base_rss != -1 && established != 0) {
+    long rss = read_rss(pid);
+    printf("Server RSS: %ld KB -> %ld KB, %.1f bytes/conn\n", base_rss, rss,
+           (rss - base_rss) * 1024.0 / established);
+  }
+  long tcp_mem = read_tcp_mem();
+  if (base_tcp_mem != -1 && tcp_mem != -1) {
+    printf("Kernel TCP mem: %ld -> %ld pages\n", base_tcp_mem, tcp_mem);
+  }
+
+  //抽样确认空闲连接仍然可用
+  int samples = 0, alive = 0;
+  for (size_t i = 0; i < fds.size(); i += fds.size() / 100 + 1) {
+    const char *request = "get key\n";
+    char buf[64];
+    samples++;
+    if (write(fds[i], request, strlen(request)) != (ssize_t)strlen(request)) {
+      continue;
+    }
+    struct pollfd pfd = {fds[i], POLLIN, 0};
+    if (poll(&pfd, 1, 1000) == 1 && read(fds[i], buf, sizeof(buf)) > 0) {
+      alive++;
+    }
+  }
+  printf("Alive: %d/%d sampled\n", alive, samples);
+
+  if (requests > 0 && !fds.empty()) {
+    //一问一答, 每次都等应答回来再发下一个请求
+    std::vector<uint64_t> latencies;
+    latencies.reserve(requests);
+    const char *request = "get key\n";
+    char buf[64];
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    for (int i = 0; i < requests; i++) {
+      uint64_t begin = now_micros();
+      if (write(fds[0], request, strlen(request)) != (ssize_t)strlen(request)) {
+        break;
+      }
+      size_t received = 0;
+      while (received < strlen(request)) {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n > 0) {
+          received += n;
+        } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+          break;
+        } else {
+          poll(&pfd, 1, 1000);
+        }
+      }
+      if (received < strlen(request)) {
+        break;
+      }
+      latencies.push_back(now_micros() - begin);
+    }
+    if (!latencies.empty()) {
+      uint64_t sum = 0;
+      for (size_t i = 0; i < latencies.size(); i++) {
+        sum += latencies[i];
+      }
+      std::sort(latencies.begin(), latencies.end());
+      size_t count = latencies.size();
+      printf("Round trips: %lu, avg %.1f us, p50 %lu us, p99 %lu us, p999 %lu us, max %lu us\n",
+             (unsigned long)count, (double)sum / count,
+             (unsigned long)latencies[count / 2],
+             (unsigned long)latencies[count * 99 / 100],
+             (unsigned long)latencies[count * 999 / 1000],
+             (unsigned long)latencies[count - 1]);
+    }
+  }
+
+  if (hold != 0) {
+    sleep(hold);
+  }
+  for (size_t i = 0; i < fds.size(); i++) {
+    close(fds[i]);
+  }
+  close(epollfd);
+  return 0;
+}
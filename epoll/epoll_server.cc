@@ -9,22 +9,73 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <vector>
+
+#include "gilmour/cpu_placement.h"
+#include "gilmour/timing_wheel.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define IPADDRESS   "127.0.0.1"
 #define PORT        8787
+#define METRICSPORT 8788
 #define MAXSIZE     1024
-#define LISTENQ     5
-#define FDSIZE      1000
-#define EPOLLEVENTS 100
+//实际的backlog还受net.core.somaxconn限制
+#define LISTENQ     4096
+#define EPOLLEVENTS 1024
+//一次可读事件最多accept的连接数, 避免连接风暴时饿死其他连接
+#define MAXACCEPTS  1024
+#define MAXARGS     64
+//没有读到换行的半行最多留这么长, 再长的行丢到换行为止, 不记录也不统计
+#define MAXLINE     65536
+#define NOTIMER     0xffffffff
+
+//每个连接的状态, 以fd为下标. 空闲连接不持有任何缓冲区, 只有等待
+//写回的应答和没读完的半行才分配内存, 用完即释放, 10万空闲连接只占几MB
+struct Connection {
+  char     *wbuf;         //待写回的数据
+  uint32_t wlen;
+  uint32_t wpos;
+  char     *line;         //上次读到的最后一行还没有换行, 等下次读接上
+  uint32_t line_len;
+  bool     skip_line;     //在丢弃过长的一行, 到下一个换行为止
+  bool     metrics;       //统计信息的连接, 写完应答就关闭
+  uint64_t read_time;     //读到请求的时间, 写回应答时统计延迟
+  uint64_t last_active;   //最后一次读到数据的时间, 毫秒
+  uint32_t timer;         //空闲超时的定时器
+  bool     open;
+};
+
+//-t指定时把收到的命令记录到trace文件中, 用于离线回放
+static trace::TraceRecorder* recorder = NULL;
+static volatile sig_atomic_t stop = 0;
+//按打开文件数的上限一次分配, 只有用到的页才占内存, 增长时不用搬移
+static Connection *connections = NULL;
+static size_t max_connections = 0;
+static int max_fd = -1;
+//忙轮询的时长(微秒), 0表示直接阻塞在epoll_wait上
+static uint64_t busy_poll = 0;
+//空闲超时(毫秒), 0表示不超时
+static uint64_t idle_timeout = 0;
+//空闲超时用的时间轮, 一个tick是一毫秒, 值是fd. 读到数据只更新
+//last_active, 不动定时器; 定时器到期时再检查, 没有超时的连接按
+//last_active重新加一个定时器, 所以每次读写都没有时间轮的操作
+static gilmour::TimingWheel<int>* wheel = NULL;
 
 //函数声明
 //创建套接字并进行绑定
 static int socket_bind(const char* ip, int port);
 //IO多路复用epoll
-static void do_epoll(int listenfd);
+static void do_epoll(int listenfd, int metricsfd);
 //事件处理函数
 static void
-handle_events(int epollfd, struct epoll_event *events, int num, int listenfd, char *buf);
+handle_events(int epollfd, struct epoll_event *events, int num, int listenfd, int metricsfd, char *buf);
 //处理接收到的连接
 static void handle_accpet(int epollfd, int listenfd);
 //读处理
@@ -37,15 +88,129 @@ static void add_event(int epollfd, int fd, int state);
 static void modify_event(int epollfd, int fd, int state);
 //删除事件
 static void delete_event(int epollfd, int fd, int state);
+//关闭连接并释放它的资源
+static void close_connection(int epollfd, int fd);
+//空闲超时的定时器到期
+static void handle_timer(int epollfd, int fd);
+//统计并记录读到的命令
+static void handle_commands(int fd, const char *buf, int len);
+//接受统计信息的连接
+static void handle_metrics(int epollfd, int metricsfd);
+//读到统计信息的请求, 以文本形式返回统计信息, curl或nc都可以直接查看
+static void do_metrics_read(int epollfd, int fd, char *buf);
+static void handle_signal(int sig);
+
+static void usage() {
+  printf("Usage:\n");
+  printf("      ./epoll_server [-t trace_file] [-l log_file|-] [-m metrics_port]\n");
+  printf("                     [-b backlog] [-i idle_timeout] [-a cpus] [-p busy_poll]\n");
+  printf("      默认不打印日志, metrics_port为0时不提供统计信息\n");
+  printf("      idle_timeout单位为秒, 默认为0, 不关闭空闲连接\n");
+  printf("      cpus为0-7这样的cpu列表时事件循环绑定第一个cpu, 为node:N时\n");
+  printf("      绑定NUMA节点N的cpu, 连接的内存都从事件循环所在的节点分配\n");
+  printf("      busy_poll单位为微秒, 阻塞之前先用epoll_wait(..., 0)轮询这么久\n");
+}
 
 int main(int argc,char *argv[]) {
   int  listenfd;
+  int  metricsfd = -1;
+  int  metrics_port = METRICSPORT;
+  int  backlog = LISTENQ;
+  std::vector<int> cpus;
+  int  node = -1;
+  int  opt;
+  while ((opt = getopt(argc, argv, "t:l:m:b:i:a:p:h")) != -1) {
+    switch (opt) {
+      case 't':
+        recorder = new trace::TraceRecorder();
+        if (!recorder->Open(optarg)) {
+          fprintf(stderr, "open trace error: %s\n", recorder->error().c_str());
+          exit(1);
+        }
+        break;
+      case 'l':
+        if (!logger::AsyncLogger::Instance()->Open(optarg)) {
+          exit(1);
+        }
+        break;
+      case 'm':
+        metrics_port = atoi(optarg);
+        break;
+      case 'b':
+        backlog = atoi(optarg);
+        break;
+      case 'i':
+        idle_timeout = atoi(optarg) * 1000ULL;
+        break;
+      case 'a':
+        if (!gilmour::ParsePlacement(optarg, &cpus, &node)) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'p':
+        busy_poll = atoi(optarg);
+        break;
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  //收到信号后退出事件循环, 把trace中剩余的记录刷到文件
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+  //连接数只受打开文件数限制, 把软限制提高到硬限制
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    printf("max open files: %lu\n", (unsigned long)limit.rlim_cur);
+  }
+  //日志和trace的线程已经创建, 不受影响, 只绑定事件循环所在的主线程
+  if (!cpus.empty()) {
+    if (node >= 0) {
+      gilmour::PinThread(cpus);
+      gilmour::BindMemory(node);
+    } else {
+      gilmour::PinThread(cpus[0]);
+      node = gilmour::CpuNode(cpus[0]);
+    }
+  }
+  max_connections = limit.rlim_cur < (1 << 22) ? limit.rlim_cur : (1 << 22);
+  connections = (Connection *)gilmour::AllocOnNode(
+      max_connections * sizeof(Connection), node);
+  if (connections == NULL) {
+    perror("mmap error:");
+    exit(1);
+  }
   listenfd = socket_bind(IPADDRESS,PORT);
-  listen(listenfd,LISTENQ);
-  do_epoll(listenfd);
+  //监听套接字非阻塞, 一次可读事件里把backlog中的连接都accept掉
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  listen(listenfd,backlog);
+  if (metrics_port != 0) {
+    metricsfd = socket_bind(IPADDRESS, metrics_port);
+    fcntl(metricsfd, F_SETFL, fcntl(metricsfd, F_GETFL) | O_NONBLOCK);
+    listen(metricsfd, LISTENQ);
+  }
+  do_epoll(listenfd, metricsfd);
+  delete wheel;
+  gilmour::FreeOnNode(connections, max_connections * sizeof(Connection));
+  logger::AsyncLogger::Instance()->Close();
+  if (recorder != NULL) {
+    recorder->Close();
+    printf("trace recorded %lu commands, dropped %lu\n",
+           recorder->recorded(), recorder->dropped());
+    delete recorder;
+  }
   return 0;
 }
 
+static void handle_signal(int sig) {
+  stop = 1;
+}
+
 static int socket_bind(const char* ip,int port) {
   int  listenfd;
   struct sockaddr_in servaddr;
@@ -54,6 +219,9 @@ static int socket_bind(const char* ip,int port) {
     perror("socket error:");
     exit(1);
   }
+  //服务端主动关闭的连接会留在TIME_WAIT, 不影响重启后bind
+  int reuse = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
   bzero(&servaddr,sizeof(servaddr));
   servaddr.sin_family = AF_INET;
   inet_pton(AF_INET, ip, &servaddr.sin_addr);
@@ -65,36 +233,83 @@ static int socket_bind(const char* ip,int port) {
   return listenfd;
 }
 
-static void do_epoll(int listenfd) {
+static void do_epoll(int listenfd, int metricsfd) {
   int epollfd;
   struct epoll_event events[EPOLLEVENTS];
   int ret;
   char buf[MAXSIZE];
   memset(buf,0,MAXSIZE);
-  //创建一个描述符
-  epollfd = epoll_create(FDSIZE);
+  //创建一个描述符, 自2.6.8起size参数已被忽略
+  epollfd = epoll_create1(EPOLL_CLOEXEC);
+  if (idle_timeout != 0) {
+    wheel = new gilmour::TimingWheel<int>(metrics::NowMicros() / 1000);
+  }
   //添加监听描述符事件
   add_event(epollfd, listenfd, EPOLLIN);
-  for ( ; ; ) {
-    //获取已经准备好的描述符事件
-    ret = epoll_wait(epollfd,events,EPOLLEVENTS,-1);
-    handle_events(epollfd,events,ret,listenfd,buf);
+  if (metricsfd != -1) {
+    add_event(epollfd, metricsfd, EPOLLIN);
+  }
+  while (!stop) {
+    //获取已经准备好的描述符事件, 最多等到下一个定时器到期
+    int timeout = -1;
+    if (wheel != NULL && wheel->size() != 0) {
+      //时间轮非空时不超过一圈最底层的槽数
+      timeout = wheel->TicksToNext(metrics::NowMicros() / 1000);
+    }
+    ret = 0;
+    if (busy_poll != 0) {
+      //连接较少时请求之间的间隔很短, 轮询省掉一次睡眠和唤醒的延迟
+      uint64_t spin_start = metrics::NowMicros();
+      do {
+        ret = epoll_wait(epollfd, events, EPOLLEVENTS, 0);
+      } while (ret == 0 && !stop && metrics::NowMicros() - spin_start < busy_poll);
+      if (ret > 0) {
+        metrics::Metrics::Instance()->Add(metrics::kBusyPollHits, 1);
+      }
+    }
+    if (ret == 0) {
+      metrics::Metrics::Instance()->Add(metrics::kBlockingWaits, 1);
+      ret = epoll_wait(epollfd,events,EPOLLEVENTS,timeout);
+    }
+    if (ret == -1) {
+      if (errno != EINTR) {
+        LOG("epoll_wait error: %s", strerror(errno));
+      }
+      continue;
+    }
+    metrics::Metrics::Instance()->AddReadyEvents(ret);
+    handle_events(epollfd,events,ret,listenfd,metricsfd,buf);
+    if (wheel != NULL) {
+      wheel->Advance(metrics::NowMicros() / 1000,
+                     [epollfd](int fd) { handle_timer(epollfd, fd); });
+    }
+  }
+  for (int fd = 0; fd <= max_fd; fd++) {
+    if (connections[fd].open) {
+      close_connection(epollfd, fd);
+    }
   }
   close(epollfd);
 }
 
-static void handle_events(int epollfd,struct epoll_event *events,int num,int listenfd,char *buf) {
+static void handle_events(int epollfd,struct epoll_event *events,int num,int listenfd,int metricsfd,char *buf) {
   int fd;
   //进行选好遍历
-  for (size_t i = 0; i < num; i++) {
+  for (int i = 0; i < num; i++) {
     fd = events[i].data.fd;
     //根据描述符的类型和事件类型进行处理
     if ((fd == listenfd) &&(events[i].events & EPOLLIN)) {
       handle_accpet(epollfd, listenfd);
+    } else if ((fd == metricsfd) && (events[i].events & EPOLLIN)) {
+      handle_metrics(epollfd, metricsfd);
+    } else if ((events[i].events & EPOLLIN) && connections[fd].metrics) {
+      do_metrics_read(epollfd, fd, buf);
     } else if (events[i].events & EPOLLIN) {
       do_read(epollfd, fd, buf);
     } else if (events[i].events & EPOLLOUT) {
       do_write(epollfd, fd, buf);
+    } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+      close_connection(epollfd, fd);
     }
   }
 }
@@ -103,29 +318,91 @@ static void handle_accpet(int epollfd, int listenfd) {
   int clifd;
   struct sockaddr_in cliaddr;
   socklen_t  cliaddrlen;
-  clifd = accept(listenfd, (struct sockaddr*)&cliaddr, &cliaddrlen);
-  if (clifd == -1) {
-    perror("accpet error:");
-  } else {
-    printf("accept a new client: %s:%d\n", inet_ntoa(cliaddr.sin_addr), cliaddr.sin_port);
+  uint64_t now = metrics::NowMicros() / 1000;
+  for (int i = 0; i < MAXACCEPTS; i++) {
+    cliaddrlen = sizeof(cliaddr);
+    clifd = accept4(listenfd, (struct sockaddr*)&cliaddr, &cliaddrlen,
+                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clifd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        //EMFILE时连接留在backlog中, 等有连接关闭后再accept
+        LOG("accpet error: %s", strerror(errno));
+      }
+      return;
+    }
+    if (static_cast<size_t>(clifd) >= max_connections) {
+      LOG("too many connections, close client %d", clifd);
+      close(clifd);
+      continue;
+    }
+    metrics::Metrics::Instance()->Add(metrics::kAccepts, 1);
+    LOG("accept a new client: %s:%d", inet_ntoa(cliaddr.sin_addr), cliaddr.sin_port);
+    if (clifd > max_fd) {
+      max_fd = clifd;
+    }
+    Connection *conn = &connections[clifd];
+    memset(conn, 0, sizeof(*conn));
+    conn->open = true;
+    conn->last_active = now;
+    conn->timer = NOTIMER;
+    if (wheel != NULL) {
+      conn->timer = wheel->Add(now + idle_timeout, clifd);
+    }
     //添加一个客户描述符和事件
     add_event(epollfd, clifd, EPOLLIN);
   }
 }
 
+static void close_connection(int epollfd, int fd) {
+  Connection *conn = &connections[fd];
+  delete_event(epollfd, fd, 0);
+  close(fd);
+  free(conn->wbuf);
+  conn->wbuf = NULL;
+  free(conn->line);
+  conn->line = NULL;
+  conn->line_len = 0;
+  if (conn->timer != NOTIMER) {
+    wheel->Cancel(conn->timer);
+    conn->timer = NOTIMER;
+  }
+  conn->open = false;
+  if (!conn->metrics) {
+    metrics::Metrics::Instance()->Add(metrics::kCloses, 1);
+  }
+}
+
 static void do_read(int epollfd,int fd,char *buf) {
   int nread;
+  metrics::Metrics* m = metrics::Metrics::Instance();
+  Connection *conn = &connections[fd];
+  //读缓冲区是所有连接共用的, 只有应答需要留到可写时才拷贝一份
   nread = read(fd, buf, MAXSIZE);
   if (nread == -1) {
-    perror("read error:");
-    close(fd);
-    delete_event(epollfd, fd, EPOLLIN);
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return;
+    }
+    LOG("read error: %s", strerror(errno));
+    m->Add(metrics::kReadErrors, 1);
+    close_connection(epollfd, fd);
   } else if (nread == 0) {
-    fprintf(stderr,"client close.\n");
-    close(fd);
-    delete_event(epollfd, fd, EPOLLIN);
+    LOG("client close.");
+    close_connection(epollfd, fd);
   } else {
-    printf("read message is : %s",buf);
+    conn->read_time = metrics::NowMicros();
+    conn->last_active = conn->read_time / 1000;
+    m->Add(metrics::kBytesIn, nread);
+    handle_commands(fd, buf, nread);
+    LOG("read message is : %.*s", nread, buf);
+    conn->wbuf = (char *)malloc(nread);
+    if (conn->wbuf == NULL) {
+      LOG("malloc error, close client %d", fd);
+      close_connection(epollfd, fd);
+      return;
+    }
+    memcpy(conn->wbuf, buf, nread);
+    conn->wlen = nread;
+    conn->wpos = 0;
     //修改描述符对应的事件，由读改为写
     modify_event(epollfd, fd, EPOLLOUT);
   }
@@ -133,17 +410,195 @@ static void do_read(int epollfd,int fd,char *buf) {
 
 static void do_write(int epollfd, int fd, char *buf) {
   int nwrite;
-  nwrite = write(fd, buf, strlen(buf));
+  metrics::Metrics* m = metrics::Metrics::Instance();
+  Connection *conn = &connections[fd];
+  nwrite = write(fd, conn->wbuf + conn->wpos, conn->wlen - conn->wpos);
   if (nwrite == -1) {
-    perror("write error:");
-    close(fd);
-    delete_event(epollfd, fd, EPOLLOUT);
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return;
+    }
+    LOG("write error: %s", strerror(errno));
+    m->Add(metrics::kWriteErrors, 1);
+    close_connection(epollfd, fd);
+  } else if (conn->metrics) {
+    conn->wpos += nwrite;
+    if (conn->wpos == conn->wlen) {
+      close_connection(epollfd, fd);
+    }
   } else {
+    m->Add(metrics::kBytesOut, nwrite);
+    conn->wpos += nwrite;
+    if (conn->wpos < conn->wlen) {
+      return;
+    }
+    m->AddLatency(metrics::NowMicros() - conn->read_time);
+    free(conn->wbuf);
+    conn->wbuf = NULL;
     modify_event(epollfd, fd, EPOLLIN);
-    memset(buf, 0, MAXSIZE);
   }
 }
 
+static void handle_timer(int epollfd, int fd) {
+  Connection *conn = &connections[fd];
+  uint64_t now = metrics::NowMicros() / 1000;
+  uint64_t expire = conn->last_active + idle_timeout;
+  if (expire > now || conn->wbuf != NULL) {
+    //期间有过读写, 或者应答还没写完, 按新的到期时间重新加入
+    conn->timer = wheel->Add(expire > now ? expire : now + idle_timeout, fd);
+  } else {
+    LOG("close idle client %d", fd);
+    metrics::Metrics::Instance()->Add(metrics::kIdleTimeouts, 1);
+    conn->timer = NOTIMER;
+    close_connection(epollfd, fd);
+  }
+}
+
+//每行是一条命令, 参数之间以空格分隔, 超过MAXARGS的参数被忽略.
+//一条命令可能分在几次read中, 读到换行才记录和统计, 之后的半行留在
+//连接上和下次读到的数据接起来
+static void handle_commands(int fd, const char *buf, int len) {
+  metrics::Metrics* m = metrics::Metrics::Instance();
+  Connection *conn = &connections[fd];
+  const char *data = buf;
+  size_t size = len;
+  if (conn->skip_line) {
+    const char *newline = (const char *)memchr(buf, '\n', len);
+    if (newline == NULL) {
+      return;
+    }
+    conn->skip_line = false;
+    data = newline + 1;
+    size = buf + len - data;
+  } else if (conn->line != NULL) {
+    char *line = (char *)realloc(conn->line, conn->line_len + len);
+    if (line == NULL) {
+      LOG("realloc error, drop the line of client %d", fd);
+      free(conn->line);
+      conn->line = NULL;
+      conn->line_len = 0;
+      conn->skip_line = true;
+      return;
+    }
+    memcpy(line + conn->line_len, buf, len);
+    conn->line = line;
+    data = line;
+    size = conn->line_len + len;
+  }
+
+  const char *end = data + size;
+  while (end > data && end[-1] != '\n') {
+    end--;
+  }
+  const char *argv[MAXARGS];
+  size_t argv_len[MAXARGS];
+  int argc = 0;
+  const char *p = data;
+  while (p < end) {
+    if (*p == '\n') {
+      if (argc != 0) {
+        m->AddCommand(metrics::CommandIndex(argv[0], argv_len[0]));
+        if (recorder != NULL) {
+          recorder->Record(fd, argc, argv, argv_len);
+        }
+        argc = 0;
+      }
+      p++;
+    } else if (*p == ' ' || *p == '\t' || *p == '\r') {
+      p++;
+    } else {
+      const char *start = p;
+      while (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
+      }
+      if (argc < MAXARGS) {
+        argv[argc] = start;
+        argv_len[argc] = p - start;
+        argc++;
+      }
+    }
+  }
+
+  size_t rest = data + size - end;
+  if (rest == 0 || rest > MAXLINE) {
+    if (rest != 0) {
+      LOG("line too long, drop it of client %d", fd);
+      conn->skip_line = true;
+    }
+    free(conn->line);
+    conn->line = NULL;
+    conn->line_len = 0;
+  } else if (conn->line != NULL) {
+    memmove(conn->line, end, rest);
+    conn->line_len = rest;
+  } else {
+    conn->line = (char *)malloc(rest);
+    if (conn->line == NULL) {
+      LOG("malloc error, drop the line of client %d", fd);
+      conn->skip_line = true;
+      return;
+    }
+    memcpy(conn->line, end, rest);
+    conn->line_len = rest;
+  }
+}
+
+//统计信息的连接和数据连接一样是非阻塞的, 由事件循环读写, 慢的或者
+//不读应答的客户端不会卡住其他连接
+static void handle_metrics(int epollfd, int metricsfd) {
+  int clifd = accept4(metricsfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (clifd == -1) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      LOG("accpet error: %s", strerror(errno));
+    }
+    return;
+  }
+  if (static_cast<size_t>(clifd) >= max_connections) {
+    close(clifd);
+    return;
+  }
+  if (clifd > max_fd) {
+    max_fd = clifd;
+  }
+  uint64_t now = metrics::NowMicros() / 1000;
+  Connection *conn = &connections[clifd];
+  memset(conn, 0, sizeof(*conn));
+  conn->open = true;
+  conn->metrics = true;
+  conn->last_active = now;
+  conn->timer = NOTIMER;
+  if (wheel != NULL) {
+    conn->timer = wheel->Add(now + idle_timeout, clifd);
+  }
+  add_event(epollfd, clifd, EPOLLIN);
+}
+
+//先读走请求再回复, 避免关闭时接收缓冲区中还有数据导致RST
+static void do_metrics_read(int epollfd, int fd, char *buf) {
+  Connection *conn = &connections[fd];
+  ssize_t nread = read(fd, buf, MAXSIZE);
+  if (nread == -1 && (errno == EAGAIN || errno == EWOULDBLOCK
+    || errno == EINTR)) {
+    return;
+  } else if (nread <= 0) {
+    close_connection(epollfd, fd);
+    return;
+  }
+  conn->last_active = metrics::NowMicros() / 1000;
+  std::string report = metrics::Metrics::Instance()->Report();
+  std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n"
+    "Content-Length: " + std::to_string(report.size()) + "\r\n\r\n" + report;
+  conn->wbuf = (char *)malloc(response.size());
+  if (conn->wbuf == NULL) {
+    LOG("malloc error, close metrics client %d", fd);
+    close_connection(epollfd, fd);
+    return;
+  }
+  memcpy(conn->wbuf, response.data(), response.size());
+  conn->wlen = response.size();
+  conn->wpos = 0;
+  modify_event(epollfd, fd, EPOLLOUT);
+}
+
 static void add_event(int epollfd, int fd, int state) {
   struct epoll_event ev;
   ev.events = state;
@@ -0,0 +1,147 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "logger.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <chrono>
+
+namespace logger {
+
+AsyncLogger* AsyncLogger::Instance() {
+  static AsyncLogger logger;
+  return &logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : enabled_(false),
+      file_(nullptr),
+      mask_(0),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      dropped_(0),
+      stop_(false) {
+}
+
+bool AsyncLogger::Open(const std::string& path, size_t num_slots) {
+  if (path == "-") {
+    file_ = stderr;
+  } else {
+    file_ = fopen(path.c_str(), "a");
+    if (file_ == nullptr) {
+      fprintf(stderr, "open log %s error: %s\n", path.c_str(),
+              strerror(errno));
+      return false;
+    }
+  }
+  size_t size = 1;
+  while (size < num_slots) {
+    size <<= 1;
+  }
+  slots_.reset(new Slot[size]);
+  for (size_t i = 0; i < size; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask_ = size - 1;
+  enqueue_pos_ = 0;
+  dequeue_pos_ = 0;
+  stop_ = false;
+  write_thread_ = std::thread(&AsyncLogger::WriteLoop, this);
+  enabled_ = true;
+  return true;
+}
+
+void AsyncLogger::Close() {
+  if (!enabled_) {
+    return;
+  }
+  enabled_ = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  write_thread_.join();
+  if (file_ != stderr) {
+    fclose(file_);
+  }
+  file_ = nullptr;
+}
+
+void AsyncLogger::Log(const char* format, ...) {
+  uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for ( ; ; ) {
+    slot = &slots_[pos & mask_];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence == pos) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < pos) {
+      // The writer has not freed this slot yet
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  struct tm tm;
+  localtime_r(&tv.tv_sec, &tm);
+  int len = snprintf(slot->data, kSlotSize,
+                     "%04d-%02d-%02d %02d:%02d:%02d.%06ld ",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     static_cast<long>(tv.tv_usec));
+  va_list ap;
+  va_start(ap, format);
+  len += vsnprintf(slot->data + len, kSlotSize - len, format, ap);
+  va_end(ap);
+  // Truncated messages keep their line break
+  if (len >= static_cast<int>(kSlotSize)) {
+    len = kSlotSize - 1;
+  }
+  if (slot->data[len - 1] != '\n') {
+    slot->data[len++] = '\n';
+  }
+  slot->size = len;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void AsyncLogger::WriteLoop() {
+  bool stop = false;
+  while (!stop) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, std::chrono::milliseconds(10),
+                   [this] { return stop_; });
+      stop = stop_;
+    }
+    // Only this thread dequeues
+    for ( ; ; ) {
+      Slot* slot = &slots_[dequeue_pos_ & mask_];
+      if (slot->sequence.load(std::memory_order_acquire)
+        != dequeue_pos_ + 1) {
+        break;
+      }
+      fwrite(slot->data, 1, slot->size, file_);
+      slot->sequence.store(dequeue_pos_ + mask_ + 1,
+                           std::memory_order_release);
+      dequeue_pos_++;
+    }
+    fflush(file_);
+  }
+}
+
+}  //  namespace logger
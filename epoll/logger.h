@@ -0,0 +1,84 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef EPOLL_LOGGER_H_
+#define EPOLL_LOGGER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Logging off the event loop: a message is formatted straight into a
+// slot of a bounded lock free queue and a background thread writes
+// the slots out. A full queue drops the message instead of blocking.
+// Disabled until Open(), then LOG() costs one branch.
+namespace logger {
+
+const size_t kSlotSize = 256;
+
+class AsyncLogger {
+ public:
+  static AsyncLogger* Instance();
+
+  // "-" logs to stderr
+  bool Open(const std::string& path, size_t num_slots = 1 << 16);
+  // Writes what is queued and stops the background thread
+  void Close();
+
+  bool enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  uint64_t dropped() const { return dropped_.load(); }
+
+  void Log(const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+ private:
+  // Bounded multi producer queue, a slot is free for the producer
+  // at position pos when sequence == pos, and holds a message for
+  // the consumer when sequence == pos + 1
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    uint32_t size;
+    char data[kSlotSize];
+  };
+
+  AsyncLogger();
+  void WriteLoop();
+
+  std::atomic<bool> enabled_;
+  FILE* file_;
+  std::unique_ptr<Slot[]> slots_;
+  uint64_t mask_;
+  std::atomic<uint64_t> enqueue_pos_;
+  uint64_t dequeue_pos_;
+  std::atomic<uint64_t> dropped_;
+
+  std::thread write_thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+
+  // No copying allowed
+  AsyncLogger(const AsyncLogger&);
+  void operator=(const AsyncLogger&);
+};
+
+}  //  namespace logger
+
+#define LOG(...)                                          \
+  do {                                                    \
+    if (logger::AsyncLogger::Instance()->enabled()) {     \
+      logger::AsyncLogger::Instance()->Log(__VA_ARGS__);  \
+    }                                                     \
+  } while (0)
+
+#endif  //  EPOLL_LOGGER_H_
@@ -0,0 +1,190 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+
+#include <algorithm>
+#include <new>
+
+namespace metrics {
+
+static thread_local ThreadMetrics* local_metrics = nullptr;
+
+size_t CommandIndex(const char* name, size_t len) {
+  for (size_t i = 0; i + 1 < kNumCommands; i++) {
+    if (strncasecmp(name, kCommandNames[i], len) == 0
+      && kCommandNames[i][len] == '\0') {
+      return i;
+    }
+  }
+  return kNumCommands - 1;
+}
+
+uint64_t NowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Histogram percentiles are reported as the upper bound of the bucket
+static uint64_t Percentile(const uint64_t* buckets, uint64_t count,
+                           double percentile) {
+  uint64_t target = static_cast<uint64_t>(count * percentile / 100);
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    seen += buckets[i];
+    if (seen > target) {
+      return i == 0 ? 0 : (1ULL << i) - 1;
+    }
+  }
+  return 0;
+}
+
+Metrics* Metrics::Instance() {
+  static Metrics metrics;
+  return &metrics;
+}
+
+Metrics::Metrics() : start_time_(NowMicros()) {
+}
+
+ThreadMetrics* Metrics::Local() {
+  if (local_metrics != nullptr) {
+    return local_metrics;
+  }
+  // Before C++17 new does not honor alignas, and two threads must
+  // never share a cache line
+  void* space = nullptr;
+  if (posix_memalign(&space, alignof(ThreadMetrics),
+                     sizeof(ThreadMetrics)) != 0) {
+    abort();
+  }
+  ThreadMetrics* thread_metrics = new (space) ThreadMetrics();
+  for (auto& counter : thread_metrics->counters) {
+    counter = 0;
+  }
+  for (auto& command : thread_metrics->commands) {
+    command = 0;
+  }
+  for (Histogram* histogram : {&thread_metrics->latency,
+                               &thread_metrics->ready_events}) {
+    for (auto& bucket : histogram->buckets) {
+      bucket = 0;
+    }
+    histogram->count = 0;
+    histogram->sum = 0;
+    histogram->max = 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.push_back(thread_metrics);
+  }
+  local_metrics = thread_metrics;
+  return thread_metrics;
+}
+
+void Metrics::Record(Histogram* histogram, uint64_t value) {
+  int bucket = value == 0 ? 0 : std::min(64 - __builtin_clzll(value),
+                                         kNumBuckets - 1);
+  Increase(&histogram->buckets[bucket], 1);
+  Increase(&histogram->count, 1);
+  Increase(&histogram->sum, value);
+  if (value > histogram->max.load(std::memory_order_relaxed)) {
+    histogram->max.store(value, std::memory_order_relaxed);
+  }
+}
+
+static void AppendLine(std::string* report, const char* name,
+                       uint64_t value) {
+  char line[128];
+  snprintf(line, sizeof(line), "%s:%lu\r\n", name,
+           static_cast<unsigned long>(value));
+  report->append(line);
+}
+
+static void AppendHistogram(std::string* report, const char* name,
+                            const std::vector<ThreadMetrics*>& threads,
+                            Histogram ThreadMetrics::*member) {
+  uint64_t buckets[kNumBuckets] = {0};
+  uint64_t count = 0, sum = 0, max = 0;
+  for (ThreadMetrics* thread_metrics : threads) {
+    const Histogram& histogram = thread_metrics->*member;
+    for (int i = 0; i < kNumBuckets; i++) {
+      buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+    }
+    count += histogram.count.load(std::memory_order_relaxed);
+    sum += histogram.sum.load(std::memory_order_relaxed);
+    max = std::max(max, histogram.max.load(std::memory_order_relaxed));
+  }
+  char line[256];
+  snprintf(line, sizeof(line),
+           "%s:count=%lu,avg=%.2f,p50=%lu,p99=%lu,p999=%lu,max=%lu\r\n",
+           name, static_cast<unsigned long>(count),
+           count == 0 ? 0.0 : static_cast<double>(sum) / count,
+           static_cast<unsigned long>(Percentile(buckets, count, 50)),
+           static_cast<unsigned long>(Percentile(buckets, count, 99)),
+           static_cast<unsigned long>(Percentile(buckets, count, 99.9)),
+           static_cast<unsigned long>(max));
+  report->append(line);
+}
+
+std::string Metrics::Report() {
+  std::vector<ThreadMetrics*> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads = threads_;
+  }
+  uint64_t counters[kNumCounters] = {0};
+  uint64_t commands[kNumCommands] = {0};
+  for (ThreadMetrics* thread_metrics : threads) {
+    for (size_t i = 0; i < kNumCounters; i++) {
+      counters[i] += thread_metrics->counters[i].load(
+          std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kNumCommands; i++) {
+      commands[i] += thread_metrics->commands[i].load(
+          std::memory_order_relaxed);
+    }
+  }
+
+  std::string report;
+  report.append("# Server\r\n");
+  AppendLine(&report, "uptime_in_seconds",
+             (NowMicros() - start_time_) / 1000000);
+  AppendLine(&report, "threads", threads.size());
+
+  report.append("\r\n# Stats\r\n");
+  AppendLine(&report, "connected_clients",
+             counters[kAccepts] - counters[kCloses]);
+  AppendLine(&report, "total_connections_received", counters[kAccepts]);
+  AppendLine(&report, "total_net_input_bytes", counters[kBytesIn]);
+  AppendLine(&report, "total_net_output_bytes", counters[kBytesOut]);
+  AppendLine(&report, "read_errors", counters[kReadErrors]);
+  AppendLine(&report, "write_errors", counters[kWriteErrors]);
+  AppendLine(&report, "idle_timeouts", counters[kIdleTimeouts]);
+  AppendLine(&report, "busy_poll_hits", counters[kBusyPollHits]);
+  AppendLine(&report, "blocking_waits", counters[kBlockingWaits]);
+  AppendHistogram(&report, "ready_events", threads,
+                  &ThreadMetrics::ready_events);
+
+  report.append("\r\n# Latency\r\n");
+  AppendHistogram(&report, "latency_us", threads, &ThreadMetrics::latency);
+
+  report.append("\r\n# Commandstats\r\n");
+  for (size_t i = 0; i < kNumCommands; i++) {
+    if (commands[i] != 0) {
+      std::string name = std::string("cmdstat_") + kCommandNames[i];
+      AppendLine(&report, name.c_str(), commands[i]);
+    }
+  }
+  return report;
+}
+
+}  //  namespace metrics
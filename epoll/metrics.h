@@ -0,0 +1,114 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef EPOLL_METRICS_H_
+#define EPOLL_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counters and latency histograms of the server. Every thread updates
+// its own cache line aligned block with plain relaxed loads and stores,
+// there is no lock and no read-modify-write on the hot path. Report()
+// adds the blocks of all the threads up, a counter it reads may be one
+// update behind.
+namespace metrics {
+
+enum Counter {
+  kAccepts = 0,
+  kCloses,
+  kBytesIn,
+  kBytesOut,
+  kReadErrors,
+  kWriteErrors,
+  kIdleTimeouts,
+  kBusyPollHits,
+  kBlockingWaits,
+  kNumCounters,
+};
+
+// The commands counted by name, everything else is "other"
+const char* const kCommandNames[] = {
+  "get", "set", "del", "expire", "ttl", "keys", "scan",
+  "hset", "hget", "hmset", "hdel", "hgetall", "hkeys", "hlen",
+  "sadd", "srem", "smembers", "sismember", "scard",
+  "zadd", "zrem", "zscore", "zrange", "zcard",
+  "info", "other",
+};
+const size_t kNumCommands = sizeof(kCommandNames) / sizeof(kCommandNames[0]);
+
+// Case insensitive, returns the index of "other" for unknown commands
+size_t CommandIndex(const char* name, size_t len);
+
+uint64_t NowMicros();
+
+// Power of two buckets: bucket i counts the values in [2^(i-1), 2^i)
+const int kNumBuckets = 64;
+
+struct Histogram {
+  std::atomic<uint64_t> buckets[kNumBuckets];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+};
+
+struct alignas(64) ThreadMetrics {
+  std::atomic<uint64_t> counters[kNumCounters];
+  std::atomic<uint64_t> commands[kNumCommands];
+  // From the read of a request to the write of its reply, microseconds
+  Histogram latency;
+  // Events returned by one epoll_wait, how deep the ready queue runs
+  Histogram ready_events;
+};
+
+class Metrics {
+ public:
+  static Metrics* Instance();
+
+  // Only the calling thread may update the returned block
+  ThreadMetrics* Local();
+
+  void Add(Counter counter, uint64_t n) {
+    Increase(&Local()->counters[counter], n);
+  }
+  void AddCommand(size_t index) {
+    Increase(&Local()->commands[index], 1);
+  }
+  void AddLatency(uint64_t micros) {
+    Record(&Local()->latency, micros);
+  }
+  void AddReadyEvents(uint64_t events) {
+    Record(&Local()->ready_events, events);
+  }
+
+  // INFO style text, "# Section" headers and "name:value" lines
+  std::string Report();
+
+ private:
+  Metrics();
+
+  static void Increase(std::atomic<uint64_t>* value, uint64_t n) {
+    value->store(value->load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+  static void Record(Histogram* histogram, uint64_t value);
+
+  uint64_t start_time_;
+  std::mutex mutex_;
+  std::vector<ThreadMetrics*> threads_;
+
+  // No copying allowed
+  Metrics(const Metrics&);
+  void operator=(const Metrics&);
+};
+
+}  //  namespace metrics
+
+#endif  //  EPOLL_METRICS_H_
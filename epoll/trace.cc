@@ -0,0 +1,296 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "trace.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace trace {
+
+static const size_t kMaxVarint32Length = 5;
+static const size_t kFileBufferSize = 1 << 20;
+
+static std::atomic<uint64_t> next_recorder_id(1);
+
+struct ThreadRingCache {
+  uint64_t recorder_id;
+  void* ring;
+};
+static thread_local ThreadRingCache thread_ring_cache = {0, nullptr};
+
+uint64_t NowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// Little endian whatever the byte order of the host
+static void EncodeFixed64(char* dst, uint64_t v) {
+  for (size_t i = 0; i < sizeof(v); i++) {
+    dst[i] = static_cast<char>(v >> (8 * i));
+  }
+}
+
+static uint64_t DecodeFixed64(const char* src) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < sizeof(v); i++) {
+    v |= static_cast<uint64_t>(static_cast<unsigned char>(src[i])) << (8 * i);
+  }
+  return v;
+}
+
+static char* EncodeVarint32(char* dst, uint32_t v) {
+  unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
+  while (v >= 128) {
+    *ptr++ = static_cast<unsigned char>(v | 128);
+    v >>= 7;
+  }
+  *ptr++ = static_cast<unsigned char>(v);
+  return reinterpret_cast<char*>(ptr);
+}
+
+static size_t VarintLength(uint64_t v) {
+  size_t len = 1;
+  while (v >= 128) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+TraceRecorder::TraceRecorder(size_t ring_size, int flush_interval_ms)
+    : ring_size_(1),
+      flush_interval_ms_(flush_interval_ms),
+      start_time_(0),
+      id_(next_recorder_id.fetch_add(1)),
+      file_(nullptr),
+      stop_(false),
+      recorded_(0),
+      dropped_(0) {
+  while (ring_size_ < ring_size) {
+    ring_size_ <<= 1;
+  }
+}
+
+TraceRecorder::~TraceRecorder() {
+  Close();
+}
+
+bool TraceRecorder::Open(const std::string& path) {
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    error_ = path + ": " + strerror(errno);
+    return false;
+  }
+  setvbuf(file_, nullptr, _IOFBF, kFileBufferSize);
+  start_time_ = NowMicros();
+  char header[kTraceHeaderSize];
+  memcpy(header, kTraceMagic, sizeof(kTraceMagic));
+  EncodeFixed64(header + sizeof(kTraceMagic), start_time_);
+  if (fwrite(header, 1, sizeof(header), file_) != sizeof(header)) {
+    error_ = path + ": " + strerror(errno);
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  stop_ = false;
+  flush_thread_ = std::thread(&TraceRecorder::FlushLoop, this);
+  return true;
+}
+
+void TraceRecorder::Close() {
+  if (file_ == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    stop_ = true;
+  }
+  flush_cv_.notify_one();
+  flush_thread_.join();
+  fclose(file_);
+  file_ = nullptr;
+}
+
+TraceRecorder::Ring* TraceRecorder::ThreadRing() {
+  if (thread_ring_cache.recorder_id == id_) {
+    return static_cast<Ring*>(thread_ring_cache.ring);
+  }
+  Ring* ring = new Ring(ring_size_);
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.emplace_back(ring);
+  }
+  thread_ring_cache.recorder_id = id_;
+  thread_ring_cache.ring = ring;
+  return ring;
+}
+
+void TraceRecorder::Put(Ring* ring, uint64_t* pos, const char* data,
+                        size_t size) {
+  size_t offset = *pos & ring->mask;
+  size_t first = std::min(size, ring->data.size() - offset);
+  memcpy(&ring->data[offset], data, first);
+  memcpy(&ring->data[0], data + first, size - first);
+  *pos += size;
+}
+
+void TraceRecorder::Record(uint32_t connection, int argc,
+                           const char* const* argv, const size_t* argv_len) {
+  if (file_ == nullptr) {
+    return;
+  }
+  uint64_t time = NowMicros() - start_time_;
+  char header[sizeof(time) + 2 * kMaxVarint32Length];
+  EncodeFixed64(header, time);
+  char* end = EncodeVarint32(header + sizeof(time), connection);
+  end = EncodeVarint32(end, static_cast<uint32_t>(argc));
+
+  size_t size = end - header;
+  for (int i = 0; i < argc; i++) {
+    size += VarintLength(argv_len[i]) + argv_len[i];
+  }
+
+  Ring* ring = ThreadRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  if (head - tail + size > ring->data.size()) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Put(ring, &head, header, end - header);
+  char len_buf[kMaxVarint32Length];
+  for (int i = 0; i < argc; i++) {
+    char* len_end = EncodeVarint32(len_buf,
+                                   static_cast<uint32_t>(argv_len[i]));
+    Put(ring, &head, len_buf, len_end - len_buf);
+    Put(ring, &head, argv[i], argv_len[i]);
+  }
+  // Only whole records become visible to the flush thread
+  ring->head.store(head, std::memory_order_release);
+  recorded_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TraceRecorder::Drain(Ring* ring) {
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (head == tail) {
+    return true;
+  }
+  size_t offset = tail & ring->mask;
+  size_t size = head - tail;
+  size_t first = std::min(size, ring->data.size() - offset);
+  bool ok = fwrite(&ring->data[offset], 1, first, file_) == first
+    && fwrite(&ring->data[0], 1, size - first, file_) == size - first;
+  ring->tail.store(head, std::memory_order_release);
+  return ok;
+}
+
+void TraceRecorder::FlushLoop() {
+  bool stop = false;
+  while (!stop) {
+    {
+      std::unique_lock<std::mutex> lock(flush_mutex_);
+      flush_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_),
+                         [this] { return stop_; });
+      stop = stop_;
+    }
+    // Rings are only added, the ones taken here stay valid
+    std::vector<Ring*> rings;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      for (const auto& ring : rings_) {
+        rings.push_back(ring.get());
+      }
+    }
+    bool ok = true;
+    for (Ring* ring : rings) {
+      ok = Drain(ring) && ok;
+    }
+    if (!ok || fflush(file_) != 0) {
+      fprintf(stderr, "write trace error: %s\n", strerror(errno));
+    }
+  }
+}
+
+TraceReader::TraceReader() : file_(nullptr), start_time_(0) {
+}
+
+TraceReader::~TraceReader() {
+  if (file_ != nullptr) {
+    fclose(file_);
+  }
+}
+
+bool TraceReader::Open(const std::string& path) {
+  file_ = fopen(path.c_str(), "rb");
+  if (file_ == nullptr) {
+    error_ = path + ": " + strerror(errno);
+    return false;
+  }
+  setvbuf(file_, nullptr, _IOFBF, kFileBufferSize);
+  char header[kTraceHeaderSize];
+  if (fread(header, 1, sizeof(header), file_) != sizeof(header)
+    || memcmp(header, kTraceMagic, sizeof(kTraceMagic)) != 0) {
+    error_ = path + ": not a trace file";
+    return false;
+  }
+  start_time_ = DecodeFixed64(header + sizeof(kTraceMagic));
+  return true;
+}
+
+bool TraceReader::ReadVarint32(uint32_t* value) {
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28; shift += 7) {
+    int byte = getc(file_);
+    if (byte == EOF) {
+      return false;
+    }
+    result |= static_cast<uint32_t>(byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TraceReader::Next(TraceRecord* record) {
+  char time[sizeof(record->time)];
+  size_t n = fread(time, 1, sizeof(time), file_);
+  if (n == 0 && feof(file_)) {
+    return false;
+  }
+  uint32_t argc;
+  if (n != sizeof(time)
+    || !ReadVarint32(&record->connection)
+    || !ReadVarint32(&argc)) {
+    error_ = "truncated record";
+    return false;
+  }
+  record->time = DecodeFixed64(time);
+  record->argv.resize(argc);
+  for (uint32_t i = 0; i < argc; i++) {
+    uint32_t size;
+    std::string& arg = record->argv[i];
+    if (!ReadVarint32(&size)) {
+      error_ = "truncated record";
+      return false;
+    }
+    arg.resize(size);
+    if (size != 0 && fread(&arg[0], 1, size, file_) != size) {
+      error_ = "truncated record";
+      return false;
+    }
+  }
+  return true;
+}
+
+}  //  namespace trace
@@ -0,0 +1,146 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef EPOLL_TRACE_H_
+#define EPOLL_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A trace is the stream of commands a server received, it is recorded
+// in production and replayed offline against any storage engine.
+//
+// File layout, all integers are little endian:
+//
+//   header
+//     magic            8   "GTRACE01"
+//     start time       8   unix time in microseconds
+//   records, back to back
+//     time             8   microseconds since the start time
+//     connection       varint32
+//     argc             varint32
+//     argv             argc times: size varint32 | bytes
+//
+// The records of one connection are in the order they were received,
+// records of different threads of the server may be interleaved out
+// of time order by up to one flush interval.
+namespace trace {
+
+const char kTraceMagic[8] = {'G', 'T', 'R', 'A', 'C', 'E', '0', '1'};
+const size_t kTraceHeaderSize = 16;
+
+uint64_t NowMicros();
+
+// Records commands with the least possible work on the server's
+// threads: every thread appends encoded records to its own lock free
+// ring buffer, a background thread drains the rings into the file.
+// When a ring is full the record is dropped and counted instead of
+// blocking the event loop.
+class TraceRecorder {
+ public:
+  // ring_size is rounded up to a power of two
+  explicit TraceRecorder(size_t ring_size = 4 << 20,
+                         int flush_interval_ms = 10);
+  // Flushes what is left and closes the file
+  ~TraceRecorder();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  // May be called from any number of threads
+  void Record(uint32_t connection, int argc, const char* const* argv,
+              const size_t* argv_len);
+
+  uint64_t recorded() const { return recorded_.load(); }
+  uint64_t dropped() const { return dropped_.load(); }
+  const std::string& error() const { return error_; }
+
+ private:
+  // Single producer, the owning thread, and single consumer,
+  // the flush thread. head and tail only grow, the position
+  // in data is head & mask
+  struct Ring {
+    explicit Ring(size_t size) : data(size), mask(size - 1), head(0),
+                                 tail(0) {
+    }
+    std::vector<char> data;
+    uint64_t mask;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+  };
+
+  Ring* ThreadRing();
+  void Put(Ring* ring, uint64_t* pos, const char* data, size_t size);
+  bool Drain(Ring* ring);
+  void FlushLoop();
+
+  size_t ring_size_;
+  int flush_interval_ms_;
+  uint64_t start_time_;
+  // Tells the thread local ring cache apart from the rings
+  // of a recorder opened before at the same address
+  uint64_t id_;
+  FILE* file_;
+  std::string error_;
+
+  std::mutex rings_mutex_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+
+  std::thread flush_thread_;
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cv_;
+  bool stop_;
+
+  std::atomic<uint64_t> recorded_;
+  std::atomic<uint64_t> dropped_;
+
+  // No copying allowed
+  TraceRecorder(const TraceRecorder&);
+  void operator=(const TraceRecorder&);
+};
+
+struct TraceRecord {
+  // Microseconds since the start of the trace
+  uint64_t time;
+  uint32_t connection;
+  std::vector<std::string> argv;
+};
+
+class TraceReader {
+ public:
+  TraceReader();
+  ~TraceReader();
+
+  bool Open(const std::string& path);
+  // Returns false at the end of the trace or on a truncated record,
+  // error() tells them apart
+  bool Next(TraceRecord* record);
+
+  uint64_t start_time() const { return start_time_; }
+  const std::string& error() const { return error_; }
+
+ private:
+  bool ReadVarint32(uint32_t* value);
+
+  FILE* file_;
+  uint64_t start_time_;
+  std::string error_;
+
+  // No copying allowed
+  TraceReader(const TraceReader&);
+  void operator=(const TraceReader&);
+};
+
+}  //  namespace trace
+
+#endif  //  EPOLL_TRACE_H_
@@ -0,0 +1,91 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_BACKUP_H
+#define INCLUDE_BACKUP_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "gilmour/gilmour.h"
+
+namespace rocksdb {
+class BackupEngine;
+}  //  namespace rocksdb
+
+namespace gilmour {
+
+struct BackupOptions {
+  // Holds all the backups, the sst files are shared between them, a
+  // new backup only copies the files none of the previous ones has
+  std::string backup_dir = "./backup";
+  // Bytes per second the files are copied at, keeps the copy from
+  // taking the disk away from the reads and the writes of the db.
+  // 0 copies as fast as the disks go
+  uint64_t rate_limit = 0;
+  int copy_threads = 1;
+  // Once a backup is taken only this many of the most recent ones are
+  // kept, the files no longer used by any of them are deleted. 0 keeps
+  // all of them
+  uint32_t max_backups = 0;
+  // Flushes the memtables before the copy, otherwise the live WAL
+  // files are copied along with the sst files
+  bool flush_before_backup = false;
+};
+
+struct BackupInfo {
+  uint32_t id;
+  int64_t timestamp;
+  // Of all the files of this backup, including the shared ones
+  uint64_t size;
+  uint32_t files;
+};
+
+// Backups of a Gilmour taken while it keeps serving reads and writes.
+// Both a checkpoint and a backup hold the db as of one sequence number:
+// the deletion of obsolete files is disabled while the live sst files,
+// the manifest and the WAL are linked or copied, and the WAL files are
+// copied up to the size they had when the copy started.
+class BackupManager {
+ public:
+  explicit BackupManager(const BackupOptions& options);
+  ~BackupManager();
+
+  Status Open();
+
+  // Hard links the sst files of db into checkpoint_dir and copies the
+  // rest, the result is a db of its own which opens as is. Takes about
+  // no space and no time, but checkpoint_dir must be on the file system
+  // of the db and must not exist
+  static Status CreateCheckpoint(Gilmour* db,
+                                 const std::string& checkpoint_dir);
+
+  // Takes a new incremental backup of db, sets info to it if not null
+  Status CreateBackup(Gilmour* db, BackupInfo* info);
+
+  // Oldest first
+  void GetBackups(std::vector<BackupInfo>* backups);
+
+  // Reads every file of the backup back and checks its size
+  Status Verify(uint32_t backup_id);
+
+  // Restores the backup, the latest one if backup_id is 0, into the
+  // db at db_path, which must not be open
+  Status Restore(uint32_t backup_id, const std::string& db_path);
+
+ private:
+  BackupOptions options_;
+  rocksdb::BackupEngine* engine_;
+
+  // No copying allowed
+  BackupManager(const BackupManager&);
+  void operator=(const BackupManager&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_BACKUP_H
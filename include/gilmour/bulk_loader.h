@@ -0,0 +1,78 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_BULK_LOADER_H
+#define INCLUDE_BULK_LOADER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "gilmour/gilmour.h"
+
+namespace gilmour {
+
+class ExternalSorter;
+
+struct BulkLoaderOptions {
+  // Holds the sorted runs and the sst files until they are
+  // ingested, should be on the same file system as the db so
+  // that the sst files are moved instead of copied
+  std::string tmp_dir = "./bulk_load_tmp";
+  // Memory used to sort the records, shared by the sort threads
+  size_t memory_limit = 256 << 20;
+  int sort_threads = 4;
+  uint64_t target_file_size = 256 << 20;
+};
+
+// Loads a large amount of data without going through the WAL and
+// the memtables: the records are encoded, sorted with an external
+// merge sort under memory_limit, written into sst files with
+// SstFileWriter and ingested into their column families. With
+// RocksDB 6 all the families are ingested in one atomic call. Older
+// versions ingest one family at a time with the metas last, in one
+// call, so either all the keys become visible or none; until then the
+// compaction filter keeps the data already ingested.
+//
+// A loaded key replaces whatever the db held at that key before, the
+// data of a replaced collection are dropped by the compaction filter.
+// Every key must be loaded with one type, and must not be written
+// through Gilmour while the load is in progress.
+class BulkLoader {
+ public:
+  BulkLoader(Gilmour* db, const BulkLoaderOptions& options);
+  ~BulkLoader();
+
+  Status Set(const Slice& key, const Slice& value);
+  Status HSet(const Slice& key, const Slice& field, const Slice& value);
+  Status SAdd(const Slice& key, const Slice& member);
+  Status ZAdd(const Slice& key, double score, const Slice& member);
+
+  // Sorts the records, writes and ingests the sst files,
+  // nothing can be added afterwards
+  Status Finish();
+
+ private:
+  Gilmour* db_;
+  BulkLoaderOptions options_;
+  Status status_;
+  // All the collections of one load share a version
+  uint64_t version_;
+
+  // Hash fields, set members and zset members, the zset scores
+  // and the metas are derived from them while they are merged
+  ExternalSorter* data_sorter_;
+  // Strings, metas and zset scores
+  ExternalSorter* meta_sorter_;
+
+  // No copying allowed
+  BulkLoader(const BulkLoader&);
+  void operator=(const BulkLoader&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_BULK_LOADER_H
@@ -0,0 +1,167 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_CPU_PLACEMENT_H
+#define INCLUDE_CPU_PLACEMENT_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// Pins threads to cpus and keeps their memory on a NUMA node, for the
+// reactors, workers and benchmark threads which should not migrate or
+// reach across sockets. Talks to the kernel through sched_setaffinity
+// and the raw set_mempolicy/mbind syscalls, libnuma is not needed. On
+// a single node box, or where the syscalls are refused, the memory
+// calls fail and the default first touch policy is left in place.
+//
+// A placement spec is either a cpu list in the format of /sys,
+// "0-3,8,10-11", or "node:N" for all the cpus of NUMA node N.
+namespace gilmour {
+
+// The mempolicy modes of <numaif.h>
+const int kMpolPreferred = 1;
+const int kMpolBind = 2;
+
+inline bool ParseCpuList(const std::string& list, std::vector<int>* cpus) {
+  cpus->clear();
+  const char* p = list.c_str();
+  while (*p != '\0') {
+    char* end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0) {
+      return false;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      p++;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first) {
+        return false;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0' && *p != '\n') {
+      return false;
+    } else {
+      break;
+    }
+  }
+  return !cpus->empty();
+}
+
+inline bool NodeCpus(int node, std::vector<int>* cpus) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+           node);
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char line[1024];
+  bool ok = fgets(line, sizeof(line), file) != nullptr
+    && ParseCpuList(line, cpus);
+  fclose(file);
+  return ok;
+}
+
+// -1 when the node of cpu is unknown
+inline int CpuNode(int cpu) {
+  for (int node = 0; node < 64; node++) {
+    std::vector<int> cpus;
+    if (!NodeCpus(node, &cpus)) {
+      break;
+    }
+    for (int node_cpu : cpus) {
+      if (node_cpu == cpu) {
+        return node;
+      }
+    }
+  }
+  return -1;
+}
+
+// node is set to -1 for a cpu list
+inline bool ParsePlacement(const std::string& spec, std::vector<int>* cpus,
+                           int* node) {
+  *node = -1;
+  if (spec.compare(0, 5, "node:") == 0) {
+    *node = atoi(spec.c_str() + 5);
+    return NodeCpus(*node, cpus);
+  }
+  return ParseCpuList(spec, cpus);
+}
+
+// Restricts the calling thread to cpus, the threads it creates
+// afterwards inherit the restriction
+inline bool PinThread(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+inline bool PinThread(int cpu) {
+  return PinThread(std::vector<int>(1, cpu));
+}
+
+// The pages the calling thread (and the threads it creates afterwards)
+// allocates from now on come from node, mode is kMpolBind to fail
+// rather than spill to another node, kMpolPreferred to spill
+inline bool BindMemory(int node, int mode = kMpolPreferred) {
+#ifdef SYS_set_mempolicy
+  unsigned long mask = 1UL << node;
+  return syscall(SYS_set_mempolicy, mode, &mask, sizeof(mask) * 8) == 0;
+#else
+  return false;
+#endif
+}
+
+// Zeroed anonymous memory whose pages come from node whichever thread
+// touches them first, nothing is faulted in before that, so a large
+// table sized for the worst case only costs what is used. node -1 is
+// a plain mmap. Release it with FreeOnNode().
+inline void* AllocOnNode(size_t size, int node) {
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+#ifdef SYS_mbind
+  if (node >= 0) {
+    unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, addr, size, kMpolPreferred, &mask, sizeof(mask) * 8,
+            0);
+  }
+#endif
+  return addr;
+}
+
+inline void FreeOnNode(void* addr, size_t size) {
+  if (addr != nullptr) {
+    munmap(addr, size);
+  }
+}
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_CPU_PLACEMENT_H
@@ -6,7 +6,482 @@
 #ifndef INCLUDE_GILMOUR_H
 #define INCLUDE_GILMOUR_H
 
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <iostream>
 
+#include "rocksdb/db.h"
+#include "rocksdb/options.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+
+#include "gilmour/pair_batch.h"
+#include "gilmour/timing_wheel.h"
+
+namespace gilmour {
+
+using Status = rocksdb::Status;
+using Slice = rocksdb::Slice;
+
+class LockMgr;
+class HotKeys;
+class ZSetIndex;
+class ZSetIndexCache;
+class LoadingVersions;
+class BulkLoader;
+class BackupManager;
+class ReplicationMaster;
+class Replica;
+
+enum DataType {
+  kStrings = 0,
+  kHashes = 1,
+  kSets = 2,
+  kZSets = 3,
+  kLists = 4,
+};
+
+struct KeyValue {
+  std::string key;
+  std::string value;
+};
+
+struct FieldValue {
+  std::string field;
+  std::string value;
+};
+
+struct ScoreMember {
+  double score;
+  std::string member;
+};
+
+// The tuning of one column family. The metas (with the strings), the
+// hash fields, the set members, the zset members, the zset scores and
+// the list chunks are each kept in a family of their own
+struct FamilyOptions {
+  explicit FamilyOptions(size_t block_size = 4 << 10,
+                         bool whole_key_filtering = true)
+      : block_size(block_size), whole_key_filtering(whole_key_filtering) {
+  }
+
+  size_t block_size;
+  // Whether the bloom filter holds the whole keys, only worth it for
+  // the families read with Get(). The data families always hold the
+  // (key, version) prefixes for Seek()
+  bool whole_key_filtering;
+  rocksdb::CompressionType compression = rocksdb::kSnappyCompression;
+  // 0 takes the value of GilmourOptions::options
+  int level0_file_num_compaction_trigger = 0;
+  uint64_t target_file_size_base = 0;
+};
+
+struct GilmourOptions {
+  // The db wide options, and the defaults of every column family
+  rocksdb::Options options;
+  // Bits per key of the bloom filters. In the data families they also
+  // hold the (key, version) prefix of every hash/set/zset data key,
+  // so Seek() into a collection skips the sst files which only hold
+  // the data of deleted versions. 0 disables the filters and the
+  // prefix extractor.
+  int prefix_bloom_bits_per_key = 10;
+  // Shared by all the column families
+  size_t block_cache_size = 64 << 20;
+  // Metas are read one at a time by every command, small blocks
+  FamilyOptions meta_family = FamilyOptions(4 << 10, true);
+  FamilyOptions hashes_family = FamilyOptions(4 << 10, true);
+  FamilyOptions sets_family = FamilyOptions(4 << 10, true);
+  FamilyOptions zset_members_family = FamilyOptions(4 << 10, true);
+  // The scores are only ever scanned in order by ZRange, larger
+  // blocks and no whole keys in the filter
+  FamilyOptions zset_scores_family = FamilyOptions(16 << 10, false);
+  // A list chunk is a few KB, read whole by LIndex and in runs by LRange
+  FamilyOptions lists_family = FamilyOptions(16 << 10, true);
+  // The elements of a list are packed this many to a data key, a push
+  // rewrites the chunk at the end it pushes to and a range read gets
+  // this many elements per key it reads. The lists created before a
+  // change keep the size they were created with.
+  int32_t list_chunk_size = 128;
+  // A hash or set with at most packed_max_entries members, none of
+  // whose fields, members or values is longer than packed_max_value_size
+  // bytes, is packed into one data key of sorted entries instead of a
+  // data key per member: one key to write and read and no per member
+  // key overhead, but every write rewrites it whole. It is unpacked
+  // once it outgrows either limit and never packed again. The bulk
+  // loader never packs. 0 disables packing.
+  int32_t packed_max_entries = 128;
+  int32_t packed_max_value_size = 64;
+  // Once this many entries of one key were deleted (HDel, SRem...) or
+  // orphaned (Del of a collection), a compaction of the range of that
+  // key is scheduled in the background, so the compaction filter drops
+  // them before the regular compactions get there. 0 disables it.
+  int64_t small_compaction_threshold = 5000;
+  // Del of a collection with at least this many members also writes
+  // a range tombstone over the data of its version, so the data are
+  // dropped by the compaction without being read back one by one.
+  // 0 leaves them to the compaction filter.
+  int32_t range_delete_threshold = 1000;
+  // Keys given a ttl by Expire() go on a timing wheel, once they expire
+  // the background thread deletes them in write batches of this many
+  // keys, instead of leaving them to a read or to the compaction. The
+  // wheel lives in memory only, the ttls set before a restart are left
+  // to the compaction filter. 0 disables the active expiry.
+  int32_t expire_batch_size = 256;
+  // A sample of the keys read or written is counted, the hottest this
+  // many are saved to HOT_KEYS in the db directory when the db is
+  // closed. The next Open() reads their metas and the first members of
+  // their collections in a background thread, so the block cache is
+  // warm before the clients come back. 0 disables it.
+  int32_t hot_keys = 10000;
+  // ZRange, ZRangeByScore and ZRank of a zset with at least
+  // zset_index_min_members members build an index of its members in
+  // memory, which the writes keep up to date. The rank lookups then
+  // take O(log n) instead of scanning the score keys from the first
+  // one. At most this many indexes are kept, the least recently used
+  // one is dropped first. 0 disables the indexes.
+  int32_t zset_index_keys = 0;
+  int32_t zset_index_min_members = 1000;
+};
+
+class Gilmour {
+ public:
+  Gilmour();
+  ~Gilmour();
+
+  // Opens the db at db_path with all its column families, the
+  // missing ones are created
+  Status Open(const GilmourOptions& options, const std::string& db_path);
+
+  // Strings Commands
+
+  // Set key to hold the string value. if key
+  // already holds a value, it is overwritten
+  Status Set(const Slice& key, const Slice& value);
+
+  // Get the value of key. If the key does not exist
+  // the special value nil is returned
+  Status Get(const Slice& key, std::string* value);
+
+  // Sets the given keys to their respective values
+  // MSet replaces existing values with new values
+  Status MSet(const std::vector<KeyValue>& kvs);
+  // The same without a std::string per key and value, the vector
+  // form is copied into a batch first
+  Status MSet(const KeyValueBatch& kvs);
+
+
+  // Keys Commands
+
+  // Removes the specified keys, count is set to the
+  // number of keys that were removed
+  Status Del(const std::vector<std::string>& keys, int64_t* count);
+
+  // Iterates the keys which are not less than start_key and match
+  // pattern, at most count keys are returned, next_key is set to the
+  // key the next call should start from, empty when the scan is over
+  Status Scan(const std::string& start_key, const std::string& pattern,
+              int64_t count, std::vector<std::string>* keys,
+              std::string* next_key);
+
+  // Returns all keys matching pattern
+  Status Keys(const std::string& pattern, std::vector<std::string>* keys);
+
+  // Set a timeout on key, ret is set to 1 if the timeout was set, 0 if
+  // key does not exist. A ttl not greater than 0 deletes the key
+  Status Expire(const Slice& key, int32_t ttl, int32_t* ret);
+
+  // Returns the remaining time to live of a key that has a timeout,
+  // -1 if the key exists but has no timeout, -2 if it does not exist
+  Status TTL(const Slice& key, int64_t* ttl);
+
+  // Sets type to the type of the value stored at key, NotFound
+  // if key does not exist
+  Status Type(const Slice& key, DataType* type);
+
+
+  // Hashes Commands
+
+  // Sets field in the hash stored at key to value. If key does not exist, a
+  // new key holding a hash is created. If field already exists in the hash,
+  // it is overwritten, res is set to 1 if field is a new field, otherwise 0
+  Status HSet(const Slice& key, const Slice& field, const Slice& value,
+              int32_t* res);
+
+  // Sets the specified fields to their respective values in the hash stored
+  // at key. This command overwrites any specified fields already existing in
+  // the hash. If key does not exist, a new key holding a hash is created
+  Status HMSet(const Slice& key, const std::vector<FieldValue>& fvs);
+  Status HMSet(const Slice& key, const FieldValueBatch& fvs);
+
+  // Returns the value associated with field in the hash stored at key
+  Status HGet(const Slice& key, const Slice& field, std::string* value);
+
+  // Returns all fields and values of the hash stored at key
+  Status HGetall(const Slice& key, std::vector<FieldValue>* fvs);
+
+  // Returns all field names in the hash stored at key
+  Status HKeys(const Slice& key, std::vector<std::string>* fields);
+
+  // Removes the specified fields from the hash stored at key, ret is set
+  // to the number of fields that were removed
+  Status HDel(const Slice& key, const std::vector<std::string>& fields,
+              int32_t* ret);
+
+  // Returns the number of fields contained in the hash stored at key
+  Status HLen(const Slice& key, int32_t* ret);
+
+
+  // Sets Commands
+
+  // Add the specified members to the set stored at key, ret is set to
+  // the number of members that were added
+  Status SAdd(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+
+  // Remove the specified members from the set stored at key, ret is set
+  // to the number of members that were removed
+  Status SRem(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+
+  // Returns all the members of the set value stored at key
+  Status SMembers(const Slice& key, std::vector<std::string>* members);
+
+  // ret is set to 1 if member is a member of the set stored at key
+  Status SIsMember(const Slice& key, const Slice& member, int32_t* ret);
+
+  // Returns the set cardinality of the set stored at key
+  Status SCard(const Slice& key, int32_t* ret);
+
+
+  // ZSets Commands
+
+  // Adds all the specified members with the specified scores to the sorted
+  // set stored at key, ret is set to the number of new members
+  Status ZAdd(const Slice& key, const std::vector<ScoreMember>& score_members,
+              int32_t* ret);
+
+  // Returns the score of member in the sorted set at key
+  Status ZScore(const Slice& key, const Slice& member, double* score);
+
+  // Returns the specified range of elements in the sorted set stored at key,
+  // ordered from the lowest to the highest score, start and stop are zero
+  // based indexes and can be negative numbers counting from the end
+  Status ZRange(const Slice& key, int32_t start, int32_t stop,
+                std::vector<ScoreMember>* score_members);
+
+  // Returns the elements in the sorted set at key with a score between min
+  // and max (inclusive), ordered from the lowest to the highest score
+  Status ZRangeByScore(const Slice& key, double min, double max,
+                       std::vector<ScoreMember>* score_members);
+
+  // Returns the zero based rank of member in the sorted set stored at key,
+  // ordered from the lowest to the highest score, NotFound if member
+  // is not in the sorted set
+  Status ZRank(const Slice& key, const Slice& member, int32_t* rank);
+
+  // Removes the specified members from the sorted set stored at key, ret is
+  // set to the number of members removed
+  Status ZRem(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+
+  // Returns the sorted set cardinality of the sorted set stored at key
+  Status ZCard(const Slice& key, int32_t* ret);
+
+
+  // Lists Commands
+
+  // Inserts all the specified values at the head of the list stored at key,
+  // one after the other, so the last one ends up first. len is set to the
+  // length of the list after the push
+  Status LPush(const Slice& key, const std::vector<std::string>& values,
+               int32_t* len);
+
+  // Inserts all the specified values at the tail of the list stored at key,
+  // len is set to the length of the list after the push
+  Status RPush(const Slice& key, const std::vector<std::string>& values,
+               int32_t* len);
+
+  // Removes and returns the first element of the list stored at key
+  Status LPop(const Slice& key, std::string* element);
+
+  // Removes and returns the last element of the list stored at key
+  Status RPop(const Slice& key, std::string* element);
+
+  // Returns the element at index in the list stored at key, negative
+  // indexes count from the end, NotFound if index is out of range
+  Status LIndex(const Slice& key, int32_t index, std::string* element);
+
+  // Returns the specified elements of the list stored at key, start and
+  // stop are zero based indexes and can be negative numbers counting
+  // from the end
+  Status LRange(const Slice& key, int32_t start, int32_t stop,
+                std::vector<std::string>* elements);
+
+  // Returns the length of the list stored at key
+  Status LLen(const Slice& key, int32_t* len);
+
+
+  // Admin Commands
+
+  // Compacts the whole db, the compaction filter drops all
+  // the expired keys and the data of deleted collections
+  Status Compact();
+
+  // Compacts the meta and the data ranges of one key
+  Status CompactKey(const Slice& key);
+
+  // Returns the value of an integer rocksdb property summed over the
+  // column families, 0 if unknown.
+  // Besides those of rocksdb, "gilmour.preloaded-keys" is the number of
+  // hot keys warmed up since Open() and "gilmour.preload-running" is 1
+  // until the warm up is over. "gilmour.zset-indexes" is the number of
+  // zset indexes in memory and "gilmour.zset-index-bytes" their size
+  uint64_t GetProperty(const std::string& property);
+
+ private:
+  friend class BulkLoader;
+  friend class BackupManager;
+  friend class ReplicationMaster;
+  friend class Replica;
+
+  // Every collection gets a new version when it is created, the data
+  // of an older version are invisible even before they are removed
+  uint64_t NewVersion();
+  // Starts the versions above the persisted limit, or for a db written
+  // before there was one, above the version of every meta
+  Status LoadVersionLimit();
+
+  // The column family of the data keys with tag
+  rocksdb::ColumnFamilyHandle* DataHandle(char tag);
+
+  // Reads the meta of key and checks that it holds the type, a stale
+  // (expired or empty) meta is reported as NotFound
+  Status GetMeta(const rocksdb::ReadOptions& read_options, const Slice& key,
+                 DataType type, std::string* meta_value);
+
+  // Called with the suffix (field, member...) and the value of every
+  // data key of a collection in order, returns false to stop early
+  typedef std::function<bool(const Slice& suffix, const Slice& value)>
+    DataHandler;
+
+  // Iterates the bounded prefix [tag | key | version] of the data keys
+  // of one version of a collection, from the first suffix not less
+  // than start
+  Status ScanData(const rocksdb::ReadOptions& read_options, char tag,
+                  const Slice& key, uint64_t version,
+                  const DataHandler& handler, const Slice& start = Slice());
+
+  // Whether a write to a hash or set goes to its packed entries: the
+  // meta found is packed, or none was found and packing is enabled, in
+  // which case meta_value is set to the meta of a new empty one
+  bool UsePacked(const Status& s, DataType type, std::string* meta_value);
+  // Reads the packed entries of the hash or set with meta_value, and
+  // decodes them into entries unless it is nullptr. A new one has none
+  Status ReadPacked(const rocksdb::ReadOptions& read_options, char tag,
+                    const Slice& key, const std::string& meta_value,
+                    std::string* packed,
+                    std::map<std::string, std::string>* entries = nullptr);
+  // Calls handler with the field (or member) and value of every packed
+  // entry in order, as ScanData() does with the data keys
+  Status ScanPacked(const rocksdb::ReadOptions& read_options, char tag,
+                    const Slice& key, const std::string& meta_value,
+                    const DataHandler& handler);
+  // Adds to batch the write of the hash or set at key with meta_value
+  // and its members in entries, unpacked if it no longer fits the
+  // packed limits
+  void WritePacked(char tag, const Slice& key, std::string* meta_value,
+                   const std::map<std::string, std::string>& entries,
+                   rocksdb::WriteBatch* batch);
+
+  // Adds count deleted or orphaned entries to the statistics of key,
+  // schedules CompactKey(key) once the threshold is reached
+  void UpdateKeyStatistics(const Slice& key, int64_t count);
+  void RunBGTask();
+
+  // Puts key on the expiry wheel, replacing its previous timer
+  void ScheduleExpire(const Slice& key, uint32_t etime);
+  // Deletes the keys whose timers fired, if they did expire
+  void DeleteExpiredKeys();
+
+  // Warms up the block cache with the keys saved in HOT_KEYS
+  void PreloadHotKeys();
+
+  // Called with the index of a zset and its version, holding the mutex
+  // of the index
+  typedef std::function<Status(const ZSetIndex& index, uint64_t version)>
+    ZSetIndexReader;
+
+  // Runs reader on the index of the zset at key, builds the index
+  // first if it is missing or stale. Returns false, leaving s alone,
+  // if the zset is too small to be indexed or the indexes are disabled
+  bool ReadZSetIndex(const Slice& key, const ZSetIndexReader& reader,
+                     Status* s);
+  // The index of version of the zset at key, if there is one
+  std::shared_ptr<ZSetIndex> FindZSetIndex(const Slice& key,
+                                           uint64_t version);
+
+  rocksdb::DB* db_;
+  // By Family, the default family holds the metas
+  std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+  LockMgr* lock_mgr_;
+  bool prefix_seek_;
+  std::atomic<uint64_t> last_version_;
+  // Persisted ahead of last_version_, kVersionLimitStep at a time
+  std::mutex version_mutex_;
+  std::atomic<uint64_t> version_limit_;
+
+  int64_t small_compaction_threshold_;
+  int32_t range_delete_threshold_;
+  std::mutex statistics_mutex_;
+  std::unordered_map<std::string, int64_t> key_statistics_;
+
+  // Keys waiting for CompactKey() in the background thread
+  std::thread bg_thread_;
+  std::mutex bg_mutex_;
+  std::condition_variable bg_cv_;
+  std::deque<std::string> bg_tasks_;
+  bool bg_stop_;
+
+  // Keys with a ttl by expire time in seconds
+  int32_t expire_batch_size_;
+  std::mutex expire_mutex_;
+  TimingWheel<std::string>* expire_wheel_;
+  std::unordered_map<std::string, TimingWheel<std::string>::TimerId>
+    expire_timers_;
+
+  HotKeys* hot_keys_;
+  std::thread preload_thread_;
+  std::atomic<bool> preload_stop_;
+  std::atomic<bool> preload_running_;
+  std::atomic<uint64_t> preloaded_keys_;
+
+  ZSetIndexCache* zset_indexes_;
+  int32_t zset_index_min_members_;
+
+  // Of the bulk loads in progress, read by the compaction filter
+  LoadingVersions* loading_versions_;
+
+  int32_t list_chunk_size_;
+
+  int32_t packed_max_entries_;
+  int32_t packed_max_value_size_;
+
+  // No copying allowed
+  Gilmour(const Gilmour&);
+  void operator=(const Gilmour&);
+};
+
+}  //  namespace gilmour
+
 #endif // INCLUDE_GILMOUR_H
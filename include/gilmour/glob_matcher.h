@@ -0,0 +1,89 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_GLOB_MATCHER_H
+#define INCLUDE_GLOB_MATCHER_H
+
+#include <stdint.h>
+
+#include <bitset>
+#include <string>
+#include <vector>
+
+namespace gilmour {
+
+// GlobMatcher compiles a redis style glob pattern ('*', '?', '[...]'
+// and '\' escapes, the same grammar as stringmatchlen()) once, so that
+// it can be matched against a large number of keys on the Scan/Keys
+// hot path.
+//
+// The pattern is split on '*' into fixed width segments:
+//   * the literal bytes in front of the first '*' are exposed through
+//     prefix()/PrefixUpperBound(), callers should turn them into an
+//     iterator Seek() and iterate_upper_bound instead of matching them
+//   * segments made only of literal bytes are located with a SSE4.2 or
+//     AVX2 substring search (picked at runtime), the others fall back
+//     to a byte by byte compare
+class GlobMatcher {
+ public:
+  explicit GlobMatcher(const std::string& pattern, bool nocase = false);
+
+  bool Match(const char* str, size_t len) const;
+  bool Match(const std::string& str) const {
+    return Match(str.data(), str.size());
+  }
+
+  // Every key matched by the pattern starts with prefix()
+  const std::string& prefix() const { return prefix_; }
+
+  // The smallest key greater than every key which starts with prefix(),
+  // empty if there is no such key (prefix() is empty or all 0xff)
+  std::string PrefixUpperBound() const;
+
+  // The pattern is "prefix*", every key inside
+  // [prefix(), PrefixUpperBound()) matches without calling Match()
+  bool prefix_only() const {
+    return has_star_ && segments_.size() == 2
+      && segments_[0].width == prefix_.size() && segments_[1].width == 0;
+  }
+
+  // The pattern is "*"
+  bool match_all() const { return prefix_only() && prefix_.empty(); }
+
+ private:
+  // Positions of a segment which are not literal bytes
+  enum {
+    kLiteral = -1,
+    kAnyByte = -2
+  };
+
+  struct Segment {
+    // One byte per position, meaningful where kinds[i] == kLiteral,
+    // already lower cased when nocase_ is set
+    std::string bytes;
+    // kLiteral, kAnyByte or an index into classes_
+    std::vector<int16_t> kinds;
+    size_t width = 0;
+    bool is_literal = true;
+    // First position holding a literal byte, -1 if none
+    int32_t first_literal = -1;
+  };
+
+  // c, lower cased when nocase_ is set
+  unsigned char Fold(char c) const;
+  bool MatchAt(const Segment& segment, const char* str) const;
+  // Leftmost position in [str, str + len) where segment matches
+  const char* Find(const Segment& segment, const char* str, size_t len) const;
+
+  bool nocase_;
+  bool has_star_;
+  std::string prefix_;
+  std::vector<Segment> segments_;
+  std::vector<std::bitset<256>> classes_;
+};
+
+}  //  namespace gilmour
+
+#endif // INCLUDE_GLOB_MATCHER_H
@@ -0,0 +1,274 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_KEY_CODEC_H
+#define INCLUDE_KEY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rocksdb/slice.h"
+
+namespace gilmour {
+
+using Slice = rocksdb::Slice;
+
+// Order preserving encodings of the components of a composite key, the
+// bytewise order of two encodings is the order of the values they hold:
+//
+//   Varint         v < 0xf0 : one byte v
+//                  otherwise: 0xf7 + n, then the n significant bytes
+//                             of v in big endian (n = 1..8)
+//   Fixed64        8 bytes big endian
+//   Score          a double as 8 bytes, see EncodeScore()
+//   LengthPrefixed Varint length, then the bytes, sorts by (length,
+//                  bytes), enough to keep the keys of one user key
+//                  together and to find where the next component starts
+//   Bytes          as is, only as the last component
+//
+// A small length or index takes one byte, the 4 byte fixed width
+// length it replaces is 3 bytes longer on every key of a collection.
+const size_t kMaxVarintLength = 9;
+const size_t kScoreLength = 8;
+
+inline size_t VarintLength(uint64_t value) {
+  if (value < 0xf0) {
+    return 1;
+  }
+  size_t n = 1;
+  while (n < 8 && (value >> (8 * n)) != 0) {
+    n++;
+  }
+  return 1 + n;
+}
+
+inline char* EncodeVarint(char* dst, uint64_t value) {
+  if (value < 0xf0) {
+    *dst++ = static_cast<char>(value);
+    return dst;
+  }
+  size_t n = VarintLength(value) - 1;
+  *dst++ = static_cast<char>(0xf7 + n);
+  for (size_t i = n; i > 0; i--) {
+    *dst++ = static_cast<char>(value >> (8 * (i - 1)));
+  }
+  return dst;
+}
+
+// Returns the position after the varint, nullptr if it does not fit
+// in [ptr, limit)
+inline const char* DecodeVarint(const char* ptr, const char* limit,
+                                uint64_t* value) {
+  if (ptr >= limit) {
+    return nullptr;
+  }
+  unsigned char first = static_cast<unsigned char>(*ptr++);
+  if (first < 0xf0) {
+    *value = first;
+    return ptr;
+  }
+  size_t n = first - 0xf7;
+  if (first < 0xf8 || static_cast<size_t>(limit - ptr) < n) {
+    return nullptr;
+  }
+  uint64_t result = 0;
+  for (size_t i = 0; i < n; i++) {
+    result = (result << 8) | static_cast<unsigned char>(*ptr++);
+  }
+  *value = result;
+  return ptr;
+}
+
+inline void EncodeBigEndian64(char* buf, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    buf[i] = static_cast<char>(value >> (56 - 8 * i));
+  }
+}
+
+inline uint64_t DecodeBigEndian64(const char* ptr) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8) | static_cast<unsigned char>(ptr[i]);
+  }
+  return value;
+}
+
+// The sign bit of a positive double is set, all the bits of a negative
+// one are flipped, so -inf < negatives < -0.0 < 0.0 < positives < inf
+// as unsigned integers
+inline uint64_t OrderedScore(double score) {
+  uint64_t bits;
+  memcpy(&bits, &score, sizeof(bits));
+  return (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
+}
+
+inline double ScoreOfOrdered(uint64_t bits) {
+  bits = (bits & (1ULL << 63)) ? bits & ~(1ULL << 63) : ~bits;
+  double score;
+  memcpy(&score, &bits, sizeof(score));
+  return score;
+}
+
+inline void EncodeScore(char* buf, double score) {
+  EncodeBigEndian64(buf, OrderedScore(score));
+}
+
+inline double DecodeScore(const char* ptr) {
+  return ScoreOfOrdered(DecodeBigEndian64(ptr));
+}
+
+// Appends the components of a key to a buffer of the caller, on its
+// stack or in its arena, nothing is allocated. Once a component does
+// not fit ok() is false and the rest are dropped.
+class KeyEncoder {
+ public:
+  KeyEncoder(char* dst, size_t capacity)
+      : start_(dst), ptr_(dst), limit_(dst + capacity) {
+  }
+
+  KeyEncoder& PutByte(char c) {
+    if (Room(1)) {
+      *ptr_++ = c;
+    }
+    return *this;
+  }
+
+  KeyEncoder& PutVarint(uint64_t value) {
+    if (Room(VarintLength(value))) {
+      ptr_ = EncodeVarint(ptr_, value);
+    }
+    return *this;
+  }
+
+  KeyEncoder& PutFixed64(uint64_t value) {
+    if (Room(8)) {
+      EncodeBigEndian64(ptr_, value);
+      ptr_ += 8;
+    }
+    return *this;
+  }
+
+  KeyEncoder& PutScore(double score) {
+    if (Room(kScoreLength)) {
+      EncodeScore(ptr_, score);
+      ptr_ += kScoreLength;
+    }
+    return *this;
+  }
+
+  KeyEncoder& PutLengthPrefixed(const Slice& bytes) {
+    if (Room(VarintLength(bytes.size()) + bytes.size())) {
+      ptr_ = EncodeVarint(ptr_, bytes.size());
+      memcpy(ptr_, bytes.data(), bytes.size());
+      ptr_ += bytes.size();
+    }
+    return *this;
+  }
+
+  KeyEncoder& PutBytes(const Slice& bytes) {
+    if (Room(bytes.size())) {
+      memcpy(ptr_, bytes.data(), bytes.size());
+      ptr_ += bytes.size();
+    }
+    return *this;
+  }
+
+  bool ok() const { return limit_ != nullptr; }
+  Slice slice() const { return Slice(start_, ptr_ - start_); }
+
+  static size_t LengthPrefixedLength(size_t size) {
+    return VarintLength(size) + size;
+  }
+
+ private:
+  bool Room(size_t n) {
+    if (limit_ == nullptr || static_cast<size_t>(limit_ - ptr_) < n) {
+      limit_ = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  char* start_;
+  char* ptr_;
+  char* limit_;
+};
+
+// Reads the components back in the order they were put, the slices
+// point into the key. A Get fails, and every one after it, once the
+// key is too short.
+class KeyDecoder {
+ public:
+  explicit KeyDecoder(const Slice& key)
+      : ptr_(key.data()), limit_(key.data() + key.size()), ok_(true) {
+  }
+
+  bool GetByte(char* c) {
+    if (!Need(1)) {
+      return false;
+    }
+    *c = *ptr_++;
+    return true;
+  }
+
+  bool GetVarint(uint64_t* value) {
+    const char* next = ok_ ? DecodeVarint(ptr_, limit_, value) : nullptr;
+    if (next == nullptr) {
+      ok_ = false;
+      return false;
+    }
+    ptr_ = next;
+    return true;
+  }
+
+  bool GetFixed64(uint64_t* value) {
+    if (!Need(8)) {
+      return false;
+    }
+    *value = DecodeBigEndian64(ptr_);
+    ptr_ += 8;
+    return true;
+  }
+
+  bool GetScore(double* score) {
+    if (!Need(kScoreLength)) {
+      return false;
+    }
+    *score = DecodeScore(ptr_);
+    ptr_ += kScoreLength;
+    return true;
+  }
+
+  bool GetLengthPrefixed(Slice* bytes) {
+    uint64_t size;
+    if (!GetVarint(&size) || !Need(size)) {
+      return false;
+    }
+    *bytes = Slice(ptr_, size);
+    ptr_ += size;
+    return true;
+  }
+
+  // Everything after the components read so far
+  Slice remaining() const { return Slice(ptr_, limit_ - ptr_); }
+  bool ok() const { return ok_; }
+
+ private:
+  bool Need(uint64_t n) {
+    if (!ok_ || static_cast<uint64_t>(limit_ - ptr_) < n) {
+      ok_ = false;
+    }
+    return ok_;
+  }
+
+  const char* ptr_;
+  const char* limit_;
+  bool ok_;
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_KEY_CODEC_H
@@ -0,0 +1,93 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_PAIR_BATCH_H
+#define INCLUDE_PAIR_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+namespace gilmour {
+
+using Slice = rocksdb::Slice;
+
+// Pairs of byte strings laid out in columns: the bytes of all of them
+// back to back in one arena, and the offsets where each one ends. A
+// pair costs its bytes and 16 bytes of offsets, where two std::string
+// cost 64 bytes of headers and, past the 15 bytes of the small string
+// buffer, a heap allocation each.
+//
+// The slices returned point into the arena, an Add() may move it.
+class PairBatch {
+ public:
+  PairBatch() {
+  }
+
+  // Room for pairs pairs of bytes bytes in total, so that building
+  // the batch does not grow the arena and the offsets again and again
+  void Reserve(size_t pairs, size_t bytes) {
+    arena_.reserve(bytes);
+    ends_.reserve(2 * pairs);
+  }
+
+  void Add(const Slice& first, const Slice& second) {
+    arena_.append(first.data(), first.size());
+    ends_.push_back(arena_.size());
+    arena_.append(second.data(), second.size());
+    ends_.push_back(arena_.size());
+  }
+
+  void Clear() {
+    arena_.clear();
+    ends_.clear();
+  }
+
+  size_t size() const { return ends_.size() / 2; }
+  bool empty() const { return ends_.empty(); }
+
+  // The bytes of all the pairs
+  size_t data_size() const { return arena_.size(); }
+  size_t ApproximateMemoryUsage() const {
+    return arena_.capacity() + ends_.capacity() * sizeof(uint64_t);
+  }
+
+ protected:
+  Slice first(size_t i) const { return Column(2 * i); }
+  Slice second(size_t i) const { return Column(2 * i + 1); }
+
+ private:
+  Slice Column(size_t n) const {
+    uint64_t start = n == 0 ? 0 : ends_[n - 1];
+    return Slice(arena_.data() + start, ends_[n] - start);
+  }
+
+  std::string arena_;
+  // The end of the first then of the second string of every pair,
+  // a string starts where the one before it ends
+  std::vector<uint64_t> ends_;
+};
+
+// The batch form of std::vector<KeyValue>, taken by MSet()
+class KeyValueBatch : public PairBatch {
+ public:
+  Slice key(size_t i) const { return first(i); }
+  Slice value(size_t i) const { return second(i); }
+};
+
+// The batch form of std::vector<FieldValue>, taken by HMSet()
+class FieldValueBatch : public PairBatch {
+ public:
+  Slice field(size_t i) const { return first(i); }
+  Slice value(size_t i) const { return second(i); }
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_PAIR_BATCH_H
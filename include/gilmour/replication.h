@@ -0,0 +1,177 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_REPLICATION_H
+#define INCLUDE_REPLICATION_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rocksdb/write_batch.h"
+
+#include "gilmour/gilmour.h"
+
+namespace gilmour {
+
+struct ReplicationOptions {
+  // The write batches read from the WAL are packed into segments of
+  // about this many bytes, one segment is one frame on the wire
+  size_t segment_size = 256 << 10;
+  // zlib level the segments are compressed with, 0 sends them as is
+  int compression_level = 1;
+  // A primary with nothing new to send still sends an empty segment
+  // this often, it carries its latest sequence number for the lag
+  int heartbeat_ms = 100;
+  // Threads applying the segments on the replica, the write batches
+  // are split by the hash of the user keys, so all the writes of one
+  // key go through one applier in the order of the primary
+  int apply_threads = 4;
+};
+
+struct ReplicationStats {
+  // Primary: replicas streaming now. Replica: 1 if connected
+  uint64_t connections = 0;
+  uint64_t full_syncs = 0;
+  uint64_t segments = 0;
+  uint64_t batches = 0;
+  // Bytes on the wire and before the compression
+  uint64_t bytes = 0;
+  uint64_t raw_bytes = 0;
+  // The latest sequence number of the primary, on a replica as of the
+  // last segment received
+  uint64_t primary_sequence = 0;
+  // Replica only: the last primary sequence number applied here
+  uint64_t applied_sequence = 0;
+  // Replica only: time from the primary sending the last
+  // applied segment to the appliers finishing it
+  uint64_t apply_delay_micros = 0;
+};
+
+// Streams the WAL of a Gilmour to replicas over TCP. A replica sends
+// the sequence number it wants to resume from, it gets the write
+// batches from there on, read with GetUpdatesSince() and packed into
+// compressed segments. A replica without a position, or one whose
+// position is no longer in the WAL, first gets a full copy of a
+// snapshot and then the batches after the snapshot.
+//
+// The WAL files are only kept for the replicas if the db was opened
+// with WAL_ttl_seconds or WAL_size_limit_MB set, otherwise a replica
+// which falls behind the flushes has to sync in full again.
+class ReplicationMaster {
+ public:
+  ReplicationMaster(Gilmour* db, const ReplicationOptions& options);
+  ~ReplicationMaster();
+
+  // Listens on port, every replica gets its own sender thread
+  Status Start(int port);
+  void Stop();
+
+  void GetStats(ReplicationStats* stats);
+
+ private:
+  void AcceptLoop();
+  void Serve(int fd);
+  // Sends a snapshot in segments, sequence is set to the
+  // position right after it
+  bool SendSnapshot(int fd, uint64_t* sequence);
+  bool SendSegment(int fd, const std::string& batches, int count,
+                   uint64_t next_sequence);
+
+  Gilmour* db_;
+  ReplicationOptions options_;
+  int listen_fd_;
+  std::atomic<bool> stop_;
+  std::thread accept_thread_;
+
+  std::mutex mutex_;
+  std::vector<int> fds_;
+  std::vector<std::thread> senders_;
+  // Senders which returned from Serve(), joined on the next accept
+  std::vector<std::thread::id> finished_;
+  ReplicationStats stats_;
+
+  // No copying allowed
+  ReplicationMaster(const ReplicationMaster&);
+  void operator=(const ReplicationMaster&);
+};
+
+// A read only copy of the Gilmour behind a ReplicationMaster. The
+// position it has applied up to is kept in the db, after a restart
+// it resumes from there. Reads go to db(), which must not be written
+// to while the replica runs, the writes would be lost on a resync.
+//
+// A segment is applied by all the appliers at once, each writes the
+// part of every batch whose keys hash to it, so one key always sees
+// the writes of the primary in order, but a batch touching several
+// keys is not atomic on the replica.
+class Replica {
+ public:
+  explicit Replica(const ReplicationOptions& options);
+  ~Replica();
+
+  // Opens the db at db_path and starts syncing from primary
+  // (host:port), the connection is retried until Close()
+  Status Open(const GilmourOptions& gilmour_options,
+              const std::string& db_path, const std::string& primary);
+  void Close();
+
+  Gilmour* db() { return db_; }
+  void GetStats(ReplicationStats* stats);
+
+ private:
+  struct Applier {
+    std::thread thread;
+    rocksdb::WriteBatch batch;
+  };
+
+  void SyncLoop();
+  // Reads frames until the connection breaks or Close()
+  void Stream(int fd);
+  bool ApplySegment(const std::string& payload);
+  // Drops all the data before a full sync
+  bool Clear();
+  void ApplyLoop(size_t index);
+  // Waits for the appliers to finish the segment handed to them,
+  // false if one of them failed
+  bool WaitApplied();
+
+  ReplicationOptions options_;
+  Gilmour* db_;
+  std::string primary_;
+  std::atomic<bool> stop_;
+  std::thread sync_thread_;
+  int fd_;
+
+  std::vector<Applier*> appliers_;
+  std::mutex apply_mutex_;
+  std::condition_variable apply_cv_;
+  std::condition_variable done_cv_;
+  uint64_t generation_;
+  int remaining_;
+  bool applying_;
+  bool apply_ok_;
+  // Where the next sync starts, the position of the last segment
+  // fully applied, and the position of the one in the appliers
+  uint64_t next_sequence_;
+  uint64_t pending_sequence_;
+  uint64_t send_micros_;
+
+  std::mutex stats_mutex_;
+  ReplicationStats stats_;
+
+  // No copying allowed
+  Replica(const Replica&);
+  void operator=(const Replica&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_REPLICATION_H
@@ -0,0 +1,156 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_SHARDED_GILMOUR_H
+#define INCLUDE_SHARDED_GILMOUR_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gilmour/gilmour.h"
+
+namespace gilmour {
+
+struct ShardedGilmourOptions {
+  // Applied to every shard, the block cache is split between them
+  GilmourOptions gilmour_options;
+  // Fixed when the store is created, reopening it with another
+  // number of shards fails since the keys would move
+  int num_shards = 8;
+  // Every shard gets a thread which runs all the commands of that
+  // shard, the callers only hand them over. Otherwise the commands
+  // run on the calling threads and only the engines are separate.
+  bool thread_per_shard = true;
+};
+
+// Shared nothing keyspace: the keys are hashed onto num_shards
+// independent Gilmour instances under db_path/shard_N, each with its
+// own WAL, memtables, write queue and background compactions, so the
+// writers of different shards never wait for each other. Only the
+// part of a key between the first '{' and the next '}' is hashed when
+// there is one, keys sharing such a tag live in the same shard.
+// The shards are opened in parallel, after a crash they replay their
+// WALs at the same time.
+//
+// A multi-key command (MSet, Del, Scan, Keys) is split by shard and
+// the parts run on their shards in parallel, the command returns once
+// all of them are done. Each part is atomic on its shard, the whole
+// command is not, give the keys one tag when that matters.
+class ShardedGilmour {
+ public:
+  typedef std::function<void(Gilmour* db)> Task;
+
+  ShardedGilmour();
+  ~ShardedGilmour();
+
+  Status Open(const ShardedGilmourOptions& options,
+              const std::string& db_path);
+
+  size_t num_shards() const { return shards_.size(); }
+  size_t ShardOf(const Slice& key) const;
+  Gilmour* shard(size_t index);
+
+  // Queues task on the thread of the shard and returns at once, meant
+  // for the reactors which must not block on the engine. task runs on
+  // the shard thread, the reply goes back to the reactor from there.
+  // task works on db directly, it must not wait for other shards.
+  // Without thread_per_shard the task runs before Submit() returns.
+  void Submit(size_t shard, const Task& task);
+
+  // The commands of Gilmour, routed by key
+
+  Status Set(const Slice& key, const Slice& value);
+  Status Get(const Slice& key, std::string* value);
+  Status MSet(const std::vector<KeyValue>& kvs);
+  Status MSet(const KeyValueBatch& kvs);
+
+  Status Del(const std::vector<std::string>& keys, int64_t* count);
+  // The keys of all the shards merged in order, next_key is the
+  // smallest key any shard stopped at, so up to count keys are
+  // scanned in every shard per call
+  Status Scan(const std::string& start_key, const std::string& pattern,
+              int64_t count, std::vector<std::string>* keys,
+              std::string* next_key);
+  Status Keys(const std::string& pattern, std::vector<std::string>* keys);
+  Status Expire(const Slice& key, int32_t ttl, int32_t* ret);
+  Status TTL(const Slice& key, int64_t* ttl);
+  Status Type(const Slice& key, DataType* type);
+
+  Status HSet(const Slice& key, const Slice& field, const Slice& value,
+              int32_t* res);
+  Status HMSet(const Slice& key, const std::vector<FieldValue>& fvs);
+  Status HMSet(const Slice& key, const FieldValueBatch& fvs);
+  Status HGet(const Slice& key, const Slice& field, std::string* value);
+  Status HGetall(const Slice& key, std::vector<FieldValue>* fvs);
+  Status HKeys(const Slice& key, std::vector<std::string>* fields);
+  Status HDel(const Slice& key, const std::vector<std::string>& fields,
+              int32_t* ret);
+  Status HLen(const Slice& key, int32_t* ret);
+
+  Status SAdd(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+  Status SRem(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+  Status SMembers(const Slice& key, std::vector<std::string>* members);
+  Status SIsMember(const Slice& key, const Slice& member, int32_t* ret);
+  Status SCard(const Slice& key, int32_t* ret);
+
+  Status ZAdd(const Slice& key, const std::vector<ScoreMember>& score_members,
+              int32_t* ret);
+  Status ZScore(const Slice& key, const Slice& member, double* score);
+  Status ZRange(const Slice& key, int32_t start, int32_t stop,
+                std::vector<ScoreMember>* score_members);
+  Status ZRangeByScore(const Slice& key, double min, double max,
+                       std::vector<ScoreMember>* score_members);
+  Status ZRank(const Slice& key, const Slice& member, int32_t* rank);
+  Status ZRem(const Slice& key, const std::vector<std::string>& members,
+              int32_t* ret);
+  Status ZCard(const Slice& key, int32_t* ret);
+
+  Status LPush(const Slice& key, const std::vector<std::string>& values,
+               int32_t* len);
+  Status RPush(const Slice& key, const std::vector<std::string>& values,
+               int32_t* len);
+  Status LPop(const Slice& key, std::string* element);
+  Status RPop(const Slice& key, std::string* element);
+  Status LIndex(const Slice& key, int32_t index, std::string* element);
+  Status LRange(const Slice& key, int32_t start, int32_t stop,
+                std::vector<std::string>* elements);
+  Status LLen(const Slice& key, int32_t* len);
+
+  Status Compact();
+  Status CompactKey(const Slice& key);
+  // The sum over all the shards
+  uint64_t GetProperty(const std::string& property);
+
+ private:
+  struct Shard;
+
+  typedef std::function<Status(Gilmour* db)> Command;
+  typedef std::function<Status(size_t shard, Gilmour* db)> ShardCommand;
+
+  // Runs command on the shard and waits for it
+  Status RunOn(size_t shard, const Command& command);
+  // Runs command on all the shards in parallel, returns the first error
+  Status RunOnShards(const std::vector<size_t>& shards,
+                     const ShardCommand& command);
+  Status RunOnAll(const ShardCommand& command);
+
+  void ShardLoop(Shard* shard);
+
+  bool thread_per_shard_;
+  std::vector<Shard*> shards_;
+
+  // No copying allowed
+  ShardedGilmour(const ShardedGilmour&);
+  void operator=(const ShardedGilmour&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_SHARDED_GILMOUR_H
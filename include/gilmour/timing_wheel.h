@@ -0,0 +1,194 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef INCLUDE_TIMING_WHEEL_H
+#define INCLUDE_TIMING_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+namespace gilmour {
+
+// Hierarchical timing wheel: kLevels wheels of kSlots slots, a slot of
+// level n spans kSlots^n ticks. A timer goes to the lowest level whose
+// range covers it and moves one level down whenever the slot above it
+// comes due, so Add() and Cancel() are O(1) and Advance() costs O(1)
+// per tick plus the timers it moves or fires. Timers further than the
+// top level reaches are parked in its last slot and placed again each
+// time that slot comes due.
+//
+// What a tick is depends on the caller, e.g. milliseconds for the idle
+// timeouts of connections and seconds for key expiry. The nodes live
+// in one vector and are linked by index, the ids stay valid until the
+// timer fires or is canceled. Not thread safe.
+template <typename T>
+class TimingWheel {
+ public:
+  typedef uint32_t TimerId;
+
+  static const int kLevelBits = 6;
+  static const uint32_t kSlots = 1 << kLevelBits;
+  static const int kLevels = 4;
+  static const uint64_t kMaxDelta = (1ULL << (kLevelBits * kLevels)) - 1;
+
+  explicit TimingWheel(uint64_t now)
+      : now_(now), size_(0), free_(kNil) {
+    // The first kLevels * kSlots nodes are the heads of the slot lists,
+    // the next one heads the timers added when already due
+    nodes_.resize(kDue + 1);
+    for (uint32_t i = 0; i < nodes_.size(); i++) {
+      nodes_[i].prev = i;
+      nodes_[i].next = i;
+    }
+  }
+
+  TimerId Add(uint64_t expire, const T& value) {
+    TimerId id;
+    if (free_ != kNil) {
+      id = free_;
+      free_ = nodes_[id].next;
+    } else {
+      id = static_cast<TimerId>(nodes_.size());
+      nodes_.push_back(Node());
+    }
+    nodes_[id].expire = expire;
+    nodes_[id].value = value;
+    Place(id);
+    size_++;
+    return id;
+  }
+
+  // id must be a timer which has not fired
+  void Cancel(TimerId id) {
+    Unlink(id);
+    Release(id);
+    size_--;
+  }
+
+  // Fires the timers with expire <= now in the order of their ticks,
+  // fn(value) is called after the timer is removed, so it may Add()
+  // timers for later ticks
+  template <typename Fn>
+  void Advance(uint64_t now, const Fn& fn) {
+    Fire(kDue, fn);
+    while (now_ <= now) {
+      uint32_t index = now_ & (kSlots - 1);
+      // Entering a new span of the level above moves its timers down
+      for (int level = 1; index == 0 && level < kLevels; level++) {
+        index = (now_ >> (kLevelBits * level)) & (kSlots - 1);
+        Cascade(level, index);
+      }
+      Fire(now_ & (kSlots - 1), fn);
+      now_++;
+    }
+  }
+
+  // Ticks from now until the next Advance() may fire a timer, exact
+  // for the lowest level and the next cascade otherwise, max() when
+  // the wheel is empty. Meant for the timeout of a blocking wait.
+  uint64_t TicksToNext(uint64_t now) const {
+    if (size_ == 0) {
+      return std::numeric_limits<uint64_t>::max();
+    } else if (nodes_[kDue].next != kDue) {
+      return 0;
+    }
+    uint64_t tick = now_;
+    for (uint32_t i = 0; i < kSlots; i++, tick++) {
+      uint32_t head = tick & (kSlots - 1);
+      // Slot 0 cascades, the level above may hold timers for this span
+      if (nodes_[head].next != head || head == 0) {
+        break;
+      }
+    }
+    return tick > now ? tick - now : 0;
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  static const TimerId kNil = std::numeric_limits<TimerId>::max();
+  static const TimerId kDue = kLevels * kSlots;
+
+  struct Node {
+    TimerId prev;
+    TimerId next;
+    uint64_t expire;
+    T value;
+  };
+
+  void Place(TimerId id) {
+    uint64_t expire = nodes_[id].expire;
+    uint32_t head;
+    if (expire < now_) {
+      head = kDue;
+    } else {
+      if (expire - now_ > kMaxDelta) {
+        expire = now_ + kMaxDelta;
+      }
+      uint64_t delta = expire - now_;
+      int level = 0;
+      while (delta >= (1ULL << (kLevelBits * (level + 1)))) {
+        level++;
+      }
+      head = level * kSlots
+        + ((expire >> (kLevelBits * level)) & (kSlots - 1));
+    }
+    Node& node = nodes_[id];
+    node.prev = nodes_[head].prev;
+    node.next = head;
+    nodes_[node.prev].next = id;
+    nodes_[head].prev = id;
+  }
+
+  void Cascade(int level, uint32_t index) {
+    uint32_t head = level * kSlots + index;
+    TimerId id = nodes_[head].next;
+    // Detach the whole list first, Place() may put a parked timer
+    // back into this very slot
+    nodes_[head].prev = head;
+    nodes_[head].next = head;
+    while (id != head) {
+      TimerId next = nodes_[id].next;
+      Place(id);
+      id = next;
+    }
+  }
+
+  template <typename Fn>
+  void Fire(uint32_t head, const Fn& fn) {
+    while (nodes_[head].next != head) {
+      TimerId id = nodes_[head].next;
+      Unlink(id);
+      T value = nodes_[id].value;
+      Release(id);
+      size_--;
+      fn(value);
+    }
+  }
+
+  void Unlink(TimerId id) {
+    Node& node = nodes_[id];
+    nodes_[node.prev].next = node.next;
+    nodes_[node.next].prev = node.prev;
+  }
+
+  void Release(TimerId id) {
+    nodes_[id].value = T();
+    nodes_[id].next = free_;
+    free_ = id;
+  }
+
+  uint64_t now_;
+  size_t size_;
+  TimerId free_;
+  std::vector<Node> nodes_;
+};
+
+}  //  namespace gilmour
+
+#endif  //  INCLUDE_TIMING_WHEEL_H
@@ -0,0 +1,90 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "gilmour/backup.h"
+
+#include <memory>
+
+#include "rocksdb/env.h"
+#include "rocksdb/utilities/backupable_db.h"
+#include "rocksdb/utilities/checkpoint.h"
+
+namespace gilmour {
+
+BackupManager::BackupManager(const BackupOptions& options)
+    : options_(options),
+      engine_(nullptr) {
+}
+
+BackupManager::~BackupManager() {
+  delete engine_;
+}
+
+Status BackupManager::Open() {
+  rocksdb::BackupableDBOptions backup_options(options_.backup_dir);
+  // Identical sst files are copied once and shared by the backups
+  backup_options.share_table_files = true;
+  backup_options.backup_rate_limit = options_.rate_limit;
+  backup_options.max_background_operations = options_.copy_threads;
+  return rocksdb::BackupEngine::Open(rocksdb::Env::Default(), backup_options,
+                                     &engine_);
+}
+
+Status BackupManager::CreateCheckpoint(Gilmour* db,
+                                       const std::string& checkpoint_dir) {
+  rocksdb::Checkpoint* checkpoint;
+  Status s = rocksdb::Checkpoint::Create(db->db_, &checkpoint);
+  if (!s.ok()) {
+    return s;
+  }
+  std::unique_ptr<rocksdb::Checkpoint> guard(checkpoint);
+  return checkpoint->CreateCheckpoint(checkpoint_dir);
+}
+
+Status BackupManager::CreateBackup(Gilmour* db, BackupInfo* info) {
+  Status s = engine_->CreateNewBackup(db->db_, options_.flush_before_backup);
+  if (!s.ok()) {
+    return s;
+  }
+  if (options_.max_backups > 0) {
+    s = engine_->PurgeOldBackups(options_.max_backups);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (info != nullptr) {
+    std::vector<BackupInfo> backups;
+    GetBackups(&backups);
+    if (backups.empty()) {
+      return Status::Corruption("Backup not found");
+    }
+    *info = backups.back();
+  }
+  return s;
+}
+
+void BackupManager::GetBackups(std::vector<BackupInfo>* backups) {
+  std::vector<rocksdb::BackupInfo> infos;
+  engine_->GetBackupInfo(&infos);
+  backups->clear();
+  for (const auto& info : infos) {
+    backups->push_back({info.backup_id, info.timestamp, info.size,
+                        info.number_files});
+  }
+}
+
+Status BackupManager::Verify(uint32_t backup_id) {
+  return engine_->VerifyBackup(backup_id);
+}
+
+Status BackupManager::Restore(uint32_t backup_id,
+                              const std::string& db_path) {
+  if (backup_id == 0) {
+    return engine_->RestoreDBFromLatestBackup(db_path, db_path);
+  }
+  return engine_->RestoreDBFromBackup(backup_id, db_path, db_path);
+}
+
+}  //  namespace gilmour
@@ -0,0 +1,254 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "gilmour/bulk_loader.h"
+
+#include <memory>
+
+#include "rocksdb/env.h"
+#include "rocksdb/sst_file_writer.h"
+#include "rocksdb/version.h"
+
+#include "src/external_sorter.h"
+#include "src/format.h"
+#include "src/gilmour_filter.h"
+
+namespace gilmour {
+
+// Writes records which arrive in order into sst files
+// of about target_file_size bytes each
+class SstFileSink {
+ public:
+  SstFileSink(const rocksdb::Options& options, const std::string& dir,
+              const std::string& name, uint64_t target_file_size)
+      : options_(options), dir_(dir), name_(name),
+        target_file_size_(target_file_size) {
+  }
+
+  Status Put(const Slice& key, const Slice& value) {
+    Status s;
+    if (writer_ == nullptr) {
+      writer_.reset(new rocksdb::SstFileWriter(rocksdb::EnvOptions(),
+                                               options_));
+      files_.push_back(dir_ + "/" + name_ + "_"
+                       + std::to_string(files_.size()) + ".sst");
+      s = writer_->Open(files_.back());
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    s = writer_->Put(key, value);
+    if (s.ok() && writer_->FileSize() >= target_file_size_) {
+      s = Finish();
+    }
+    return s;
+  }
+
+  Status Finish() {
+    if (writer_ == nullptr) {
+      return Status::OK();
+    }
+    Status s = writer_->Finish();
+    writer_.reset();
+    return s;
+  }
+
+  const std::vector<std::string>& files() const { return files_; }
+
+ private:
+  const rocksdb::Options& options_;
+  std::string dir_;
+  std::string name_;
+  uint64_t target_file_size_;
+  std::unique_ptr<rocksdb::SstFileWriter> writer_;
+  std::vector<std::string> files_;
+};
+
+BulkLoader::BulkLoader(Gilmour* db, const BulkLoaderOptions& options)
+    : db_(db),
+      options_(options),
+      version_(db->NewVersion()),
+      data_sorter_(new ExternalSorter(options.tmp_dir, "data",
+                                      options.memory_limit / 2,
+                                      options.sort_threads)),
+      meta_sorter_(new ExternalSorter(options.tmp_dir, "meta",
+                                      options.memory_limit / 2,
+                                      options.sort_threads)) {
+  status_ = db_->db_->GetEnv()->CreateDirIfMissing(options_.tmp_dir);
+}
+
+BulkLoader::~BulkLoader() {
+  delete data_sorter_;
+  delete meta_sorter_;
+}
+
+Status BulkLoader::Set(const Slice& key, const Slice& value) {
+  if (status_.ok()) {
+    status_ = meta_sorter_->Add(EncodeMetaKey(key),
+                                EncodeStringsValue(value, 0));
+  }
+  return status_;
+}
+
+Status BulkLoader::HSet(const Slice& key, const Slice& field,
+                        const Slice& value) {
+  if (status_.ok()) {
+    DataKey data_key(kHashesDataTag, key, version_, field);
+    status_ = data_sorter_->Add(data_key.Encode(), value);
+  }
+  return status_;
+}
+
+Status BulkLoader::SAdd(const Slice& key, const Slice& member) {
+  if (status_.ok()) {
+    DataKey data_key(kSetsDataTag, key, version_, member);
+    status_ = data_sorter_->Add(data_key.Encode(), Slice());
+  }
+  return status_;
+}
+
+Status BulkLoader::ZAdd(const Slice& key, double score,
+                        const Slice& member) {
+  if (status_.ok()) {
+    DataKey member_key(kZSetsMemberTag, key, version_, member);
+    status_ = data_sorter_->Add(member_key.Encode(),
+        Slice(reinterpret_cast<const char*>(&score), kScoreLength));
+  }
+  return status_;
+}
+
+Status BulkLoader::Finish() {
+  if (!status_.ok()) {
+    return status_;
+  }
+  // Every column family gets sst files of its own, written with its
+  // options. The keys of one family come out of the merges in order
+  std::vector<rocksdb::Options> family_options;
+  for (int i = 0; i < kFamilyCount; i++) {
+    family_options.push_back(db_->db_->GetOptions(db_->handles_[i]));
+  }
+  std::vector<std::unique_ptr<SstFileSink>> sinks;
+  for (int i = 0; i < kFamilyCount; i++) {
+    sinks.emplace_back(new SstFileSink(family_options[i], options_.tmp_dir,
+                                       kFamilyNames[i],
+                                       options_.target_file_size));
+  }
+
+  // The data keys of a collection come out of the merge next to each
+  // other, its meta is written once the prefix changes. A duplicated
+  // field or member was already dropped by the sorter, so the count is
+  // exact and the score keys are built from the final scores
+  std::string cur_prefix;
+  int32_t count = 0;
+  auto finish_collection = [&]() -> Status {
+    if (cur_prefix.empty()) {
+      return Status::OK();
+    }
+    ParsedDataKey parsed_data_key(cur_prefix);
+    return meta_sorter_->Add(EncodeMetaKey(parsed_data_key.key()),
+        EncodeMetaValue(DataTagType(parsed_data_key.tag()), 0,
+                        version_, count));
+  };
+
+  char score_buf[kScoreLength];
+  std::string score_member;
+  status_ = data_sorter_->Merge(
+      [&](const Slice& key, const Slice& value) -> Status {
+        Slice prefix(key.data(), DataKeyPrefixLength(key));
+        Status s;
+        if (prefix != Slice(cur_prefix)) {
+          s = finish_collection();
+          if (!s.ok()) {
+            return s;
+          }
+          cur_prefix.assign(prefix.data(), prefix.size());
+          count = 0;
+        }
+        s = sinks[FamilyOf(key[0])]->Put(key, value);
+        if (!s.ok()) {
+          return s;
+        }
+        count++;
+
+        if (key[0] == kZSetsMemberTag) {
+          ParsedDataKey parsed_data_key(key);
+          double score;
+          memcpy(&score, value.data(), sizeof(score));
+          EncodeScore(score_buf, score);
+          score_member.assign(score_buf, kScoreLength);
+          score_member.append(parsed_data_key.suffix().data(),
+                              parsed_data_key.suffix().size());
+          DataKey score_key(kZSetsScoreTag, parsed_data_key.key(),
+                            version_, score_member);
+          s = meta_sorter_->Add(score_key.Encode(), Slice());
+        }
+        return s;
+      });
+  if (status_.ok()) {
+    status_ = finish_collection();
+  }
+
+  // 'M' metas and 'Z' scores
+  if (status_.ok()) {
+    status_ = meta_sorter_->Merge(
+        [&sinks](const Slice& key, const Slice& value) {
+          return sinks[FamilyOf(key[0])]->Put(key, value);
+        });
+  }
+  for (int i = 0; i < kFamilyCount && status_.ok(); i++) {
+    status_ = sinks[i]->Finish();
+  }
+
+  rocksdb::IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+#if ROCKSDB_MAJOR >= 6
+  // All the families in one atomic ingestion
+  std::vector<rocksdb::IngestExternalFileArg> args;
+  for (int i = 0; i < kFamilyCount; i++) {
+    if (!sinks[i]->files().empty()) {
+      rocksdb::IngestExternalFileArg arg;
+      arg.column_family = db_->handles_[i];
+      arg.external_files = sinks[i]->files();
+      arg.options = ingest_options;
+      args.push_back(arg);
+    }
+  }
+  if (status_.ok() && !args.empty()) {
+    status_ = db_->db_->IngestExternalFiles(args);
+  }
+#else
+  // One family at a time, the metas go in last: the data ingested
+  // before them can not be reached until then, and are orphans if
+  // their ingestion fails. Meanwhile the compaction filter keeps the
+  // data of version_ and newer, which have no meta yet
+  db_->loading_versions_->Add(version_);
+  for (int i = kFamilyCount - 1; i >= 0 && status_.ok(); i--) {
+    if (!sinks[i]->files().empty()) {
+      status_ = db_->db_->IngestExternalFile(db_->handles_[i],
+                                             sinks[i]->files(),
+                                             ingest_options);
+    }
+  }
+  db_->loading_versions_->Remove(version_);
+#endif
+
+  // Whatever was not moved into the db
+  rocksdb::Env* env = db_->db_->GetEnv();
+  for (const auto& sink : sinks) {
+    for (const auto& file : sink->files()) {
+      if (env->FileExists(file).ok()) {
+        env->DeleteFile(file);
+      }
+    }
+  }
+  if (status_.ok()) {
+    // Nothing can be added after Finish()
+    status_ = Status::InvalidArgument("BulkLoader finished");
+    return Status::OK();
+  }
+  return status_;
+}
+
+}  //  namespace gilmour
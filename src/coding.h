@@ -0,0 +1,57 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_CODING_H_
+#define SRC_CODING_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+namespace gilmour {
+
+// Fixed width integers are stored in little endian, the
+// same as leveldb/rocksdb util/coding.h
+inline void EncodeFixed32(char* buf, uint32_t value) {
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = (value >> 24) & 0xff;
+}
+
+inline void EncodeFixed64(char* buf, uint64_t value) {
+  EncodeFixed32(buf, static_cast<uint32_t>(value));
+  EncodeFixed32(buf + 4, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint32_t DecodeFixed32(const char* ptr) {
+  return (static_cast<uint32_t>(static_cast<unsigned char>(ptr[0])))
+    | (static_cast<uint32_t>(static_cast<unsigned char>(ptr[1])) << 8)
+    | (static_cast<uint32_t>(static_cast<unsigned char>(ptr[2])) << 16)
+    | (static_cast<uint32_t>(static_cast<unsigned char>(ptr[3])) << 24);
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+  uint64_t lo = DecodeFixed32(ptr);
+  uint64_t hi = DecodeFixed32(ptr + 4);
+  return (hi << 32) | lo;
+}
+
+inline void PutFixed32(std::string* dst, uint32_t value) {
+  char buf[sizeof(value)];
+  EncodeFixed32(buf, value);
+  dst->append(buf, sizeof(buf));
+}
+
+inline void PutFixed64(std::string* dst, uint64_t value) {
+  char buf[sizeof(value)];
+  EncodeFixed64(buf, value);
+  dst->append(buf, sizeof(buf));
+}
+
+}  //  namespace gilmour
+
+#endif  //  SRC_CODING_H_
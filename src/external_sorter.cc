@@ -0,0 +1,269 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/external_sorter.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+
+#include "src/coding.h"
+
+namespace gilmour {
+
+static const size_t kFileBufferSize = 1 << 20;
+
+static Status IOError(const std::string& path) {
+  return Status::IOError(path, strerror(errno));
+}
+
+// Reads back the records of a run file one by one
+class RunReader {
+ public:
+  RunReader() : file_(nullptr) {
+  }
+  ~RunReader() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  Status Open(const std::string& path) {
+    path_ = path;
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      return IOError(path);
+    }
+    setvbuf(file_, nullptr, _IOFBF, kFileBufferSize);
+    return Status::OK();
+  }
+
+  // Returns false at the end of the run or on error
+  bool Next(Status* s) {
+    char header[8];
+    if (fread(header, 1, sizeof(header), file_) != sizeof(header)) {
+      if (ferror(file_)) {
+        *s = IOError(path_);
+      }
+      return false;
+    }
+    key_.resize(DecodeFixed32(header));
+    value_.resize(DecodeFixed32(header + 4));
+    if ((!key_.empty() && fread(&key_[0], 1, key_.size(), file_)
+         != key_.size())
+      || (!value_.empty() && fread(&value_[0], 1, value_.size(), file_)
+         != value_.size())) {
+      *s = Status::Corruption(path_, "truncated run");
+      return false;
+    }
+    return true;
+  }
+
+  Slice key() const { return key_; }
+  Slice value() const { return value_; }
+
+ private:
+  std::string path_;
+  FILE* file_;
+  std::string key_;
+  std::string value_;
+
+  // No copying allowed
+  RunReader(const RunReader&);
+  void operator=(const RunReader&);
+};
+
+ExternalSorter::ExternalSorter(const std::string& tmp_dir,
+                               const std::string& name,
+                               size_t memory_limit, int threads)
+    : tmp_dir_(tmp_dir),
+      name_(name),
+      threads_(std::max(threads, 1)),
+      num_records_(0),
+      buffer_(new Buffer()) {
+  // One buffer being filled and up to threads_ being sorted
+  buffer_limit_ = std::max<size_t>(memory_limit / (threads_ + 1), 1 << 20);
+}
+
+ExternalSorter::~ExternalSorter() {
+  WaitPendingRuns();
+  for (const auto& run : runs_) {
+    unlink(run.c_str());
+  }
+}
+
+Status ExternalSorter::Add(const Slice& key, const Slice& value) {
+  Buffer* buffer = buffer_.get();
+  buffer->entries.push_back({buffer->data.size(),
+                             static_cast<uint32_t>(key.size()),
+                             static_cast<uint32_t>(value.size())});
+  buffer->data.append(key.data(), key.size());
+  buffer->data.append(value.data(), value.size());
+  num_records_++;
+  if (buffer->data.size() + buffer->entries.size() * sizeof(Entry)
+    >= buffer_limit_) {
+    return Spill();
+  }
+  return Status::OK();
+}
+
+void ExternalSorter::SortBuffer(Buffer* buffer) {
+  const char* data = buffer->data.data();
+  // Stable, so that the later of two equal keys stays behind
+  std::stable_sort(buffer->entries.begin(), buffer->entries.end(),
+                   [data](const Entry& a, const Entry& b) {
+                     return Slice(data + a.offset, a.key_size).compare(
+                         Slice(data + b.offset, b.key_size)) < 0;
+                   });
+}
+
+Status ExternalSorter::WriteRun(const std::string& path,
+                                std::shared_ptr<Buffer> buffer) {
+  SortBuffer(buffer.get());
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return IOError(path);
+  }
+  setvbuf(file, nullptr, _IOFBF, kFileBufferSize);
+  const char* data = buffer->data.data();
+  char header[8];
+  for (const auto& entry : buffer->entries) {
+    EncodeFixed32(header, entry.key_size);
+    EncodeFixed32(header + 4, entry.value_size);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)
+      || fwrite(data + entry.offset, 1, entry.key_size + entry.value_size,
+                file) != entry.key_size + entry.value_size) {
+      fclose(file);
+      return IOError(path);
+    }
+  }
+  if (fclose(file) != 0) {
+    return IOError(path);
+  }
+  return Status::OK();
+}
+
+Status ExternalSorter::Spill() {
+  if (pending_.size() >= threads_) {
+    Status s = pending_.front().get();
+    pending_.pop_front();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  std::string path = tmp_dir_ + "/" + name_ + "_"
+    + std::to_string(runs_.size()) + ".run";
+  runs_.push_back(path);
+  pending_.push_back(std::async(std::launch::async, &ExternalSorter::WriteRun,
+                                path, buffer_));
+  buffer_.reset(new Buffer());
+  return Status::OK();
+}
+
+Status ExternalSorter::WaitPendingRuns() {
+  Status result;
+  while (!pending_.empty()) {
+    Status s = pending_.front().get();
+    pending_.pop_front();
+    if (result.ok() && !s.ok()) {
+      result = s;
+    }
+  }
+  return result;
+}
+
+Status ExternalSorter::Merge(const Handler& handler) {
+  Status s;
+  if (runs_.empty()) {
+    // Everything fits in memory
+    Buffer* buffer = buffer_.get();
+    SortBuffer(buffer);
+    const char* data = buffer->data.data();
+    for (size_t i = 0; i < buffer->entries.size(); i++) {
+      const Entry& entry = buffer->entries[i];
+      Slice key(data + entry.offset, entry.key_size);
+      if (i + 1 < buffer->entries.size()) {
+        const Entry& next = buffer->entries[i + 1];
+        if (key == Slice(data + next.offset, next.key_size)) {
+          continue;
+        }
+      }
+      s = handler(key, Slice(data + entry.offset + entry.key_size,
+                             entry.value_size));
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  if (!buffer_->entries.empty()) {
+    s = Spill();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  s = WaitPendingRuns();
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (const auto& run : runs_) {
+    readers.emplace_back(new RunReader());
+    s = readers.back()->Open(run);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  // Ordered by key then by run, runs are numbered in the order
+  // they were added, so the last of a group of equal keys popped
+  // from the heap holds the value added last
+  auto greater = [&readers](size_t a, size_t b) {
+    int cmp = readers[a]->key().compare(readers[b]->key());
+    return cmp > 0 || (cmp == 0 && a > b);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)>
+    heap(greater);
+  for (size_t i = 0; i < readers.size(); i++) {
+    if (readers[i]->Next(&s)) {
+      heap.push(i);
+    } else if (!s.ok()) {
+      return s;
+    }
+  }
+
+  std::string key, value;
+  bool has_key = false;
+  while (!heap.empty()) {
+    size_t i = heap.top();
+    heap.pop();
+    if (has_key && readers[i]->key() != Slice(key)) {
+      s = handler(key, value);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    key.assign(readers[i]->key().data(), readers[i]->key().size());
+    value.assign(readers[i]->value().data(), readers[i]->value().size());
+    has_key = true;
+    if (readers[i]->Next(&s)) {
+      heap.push(i);
+    } else if (!s.ok()) {
+      return s;
+    }
+  }
+  if (has_key) {
+    s = handler(key, value);
+  }
+  return s;
+}
+
+}  //  namespace gilmour
@@ -0,0 +1,85 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_EXTERNAL_SORTER_H_
+#define SRC_EXTERNAL_SORTER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+
+namespace gilmour {
+
+using Status = rocksdb::Status;
+using Slice = rocksdb::Slice;
+
+// Sorts more key value pairs than fit in memory. Records are buffered
+// until the buffer reaches its share of memory_limit, then the buffer
+// is sorted and spilled to a run file in a background thread while the
+// next one is filled, at most threads buffers are sorted at the same
+// time. Merge() does a k-way merge of the runs.
+class ExternalSorter {
+ public:
+  // Run files are created in tmp_dir, which must exist
+  ExternalSorter(const std::string& tmp_dir, const std::string& name,
+                 size_t memory_limit, int threads);
+  // Removes the run files
+  ~ExternalSorter();
+
+  Status Add(const Slice& key, const Slice& value);
+
+  // Called with every distinct key in bytewise order, if a key was
+  // added more than once the value added last wins. A non ok status
+  // returned by the handler stops the merge
+  typedef std::function<Status(const Slice& key, const Slice& value)> Handler;
+  Status Merge(const Handler& handler);
+
+  uint64_t num_records() const { return num_records_; }
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint32_t key_size;
+    uint32_t value_size;
+  };
+
+  // key | value of every entry back to back
+  struct Buffer {
+    std::string data;
+    std::vector<Entry> entries;
+  };
+
+  static void SortBuffer(Buffer* buffer);
+  static Status WriteRun(const std::string& path,
+                         std::shared_ptr<Buffer> buffer);
+  Status Spill();
+  Status WaitPendingRuns();
+
+  std::string tmp_dir_;
+  std::string name_;
+  size_t buffer_limit_;
+  size_t threads_;
+  uint64_t num_records_;
+
+  std::shared_ptr<Buffer> buffer_;
+  std::vector<std::string> runs_;
+  std::deque<std::future<Status>> pending_;
+
+  // No copying allowed
+  ExternalSorter(const ExternalSorter&);
+  void operator=(const ExternalSorter&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_EXTERNAL_SORTER_H_
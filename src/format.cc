@@ -0,0 +1,43 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/format.h"
+
+namespace gilmour {
+
+const char* kFamilyNames[kFamilyCount] = {
+  "default", "hashes", "sets", "zset_members", "zset_scores", "lists"
+};
+
+std::string PrefixUpperBound(const Slice& prefix) {
+  std::string bound = prefix.ToString();
+  while (!bound.empty()) {
+    unsigned char c = static_cast<unsigned char>(bound.back());
+    if (c != 0xff) {
+      bound.back() = static_cast<char>(c + 1);
+      return bound;
+    }
+    bound.pop_back();
+  }
+  return bound;
+}
+
+const char* DataKeyPrefixTransform::Name() const {
+  return "gilmour.DataKeyPrefix";
+}
+
+Slice DataKeyPrefixTransform::Transform(const Slice& key) const {
+  return Slice(key.data(), DataKeyPrefixLength(key));
+}
+
+bool DataKeyPrefixTransform::InDomain(const Slice& key) const {
+  return DataKeyPrefixLength(key) != 0;
+}
+
+bool DataKeyPrefixTransform::InRange(const Slice& dst) const {
+  return InDomain(dst) && Transform(dst).size() == dst.size();
+}
+
+}  //  namespace gilmour
@@ -0,0 +1,618 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_FORMAT_H_
+#define SRC_FORMAT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+#include "rocksdb/slice_transform.h"
+
+#include "src/coding.h"
+#include "gilmour/gilmour.h"
+#include "gilmour/key_codec.h"
+
+namespace gilmour {
+
+// All the data types share one keyspace:
+//
+// Meta key      : 'M' | user key
+// Strings value : type(1) | etime(4) | user value
+// Meta value    : type(1) | etime(4) | version(8) | count(4)
+// Lists value   : meta value | head seq(8) | tail seq(8) | head size(4)
+//                 | chunk size(4)
+// Packed value  : meta value | 'p', a packed hash or set
+//
+// Data key      : tag(1) | key size(varint) | user key | version(8)
+//                 | suffix
+//   'h' hash field      suffix = field             value = field value
+//   's' set member      suffix = member            value = ""
+//   'z' zset member     suffix = member            value = score(8)
+//   'Z' zset score      suffix = score(8) | member value = ""
+//   'l' list chunk      suffix = seq(8)            value = elements
+//   'h'/'s' packed      suffix = ""                value = entries
+//
+// etime is the unix time the key expires at, 0 means never. The
+// [tag | key size | user key | version] part of a data key is its
+// prefix, all the members of one version of a collection share it.
+// The data keys are built with the order preserving encodings of
+// gilmour/key_codec.h, the version is big endian so the versions of
+// a key sort in numeric order.
+//
+// A list is stored in chunks of up to chunk size elements, each a run
+// of element size(varint) | element. The chunks are numbered in list
+// order, see ParsedListsMetaValue.
+//
+// A small hash or set is packed: all its members are in one data key
+// with an empty suffix, see PackedEntries. Once it outgrows the limits
+// it is unpacked into a data key per member, in the same write that
+// deletes the packed one, so a version is either packed or not and
+// its packed key never meets the key of an empty field or member.
+const char kMetaPrefix = 'M';
+const char kHashesDataTag = 'h';
+const char kSetsDataTag = 's';
+const char kZSetsMemberTag = 'z';
+const char kZSetsScoreTag = 'Z';
+const char kListsDataTag = 'l';
+const char kPackedEncoding = 'p';
+
+const size_t kTypeLength = 1;
+const size_t kTimestampLength = 4;
+const size_t kVersionLength = 8;
+const size_t kCountLength = 4;
+const size_t kMetaValueLength = kTypeLength + kTimestampLength
+  + kVersionLength + kCountLength;
+const size_t kChunkSeqLength = 8;
+const size_t kListsMetaValueLength = kMetaValueLength
+  + 2 * kChunkSeqLength + 2 * kCountLength;
+// The seq of the first chunk of a list, leaves as much room for the
+// chunks pushed to the left as for those pushed to the right
+const uint64_t kInitialChunkSeq = 1ULL << 63;
+
+// Each kind of data key has a column family of its own, with its own
+// memtables, sst files, block size and bloom. The metas, and with them
+// the strings, are in the default family, KEYS and SCAN never read
+// a block of collection data.
+enum Family {
+  kMetaFamily = 0,
+  kHashesFamily = 1,
+  kSetsFamily = 2,
+  kZSetsMemberFamily = 3,
+  kZSetsScoreFamily = 4,
+  kListsFamily = 5,
+  kFamilyCount = 6,
+};
+
+// In the order of Family, the names of the column families
+extern const char* kFamilyNames[kFamilyCount];
+
+inline bool IsDataTag(char tag) {
+  return tag == kHashesDataTag || tag == kSetsDataTag
+    || tag == kZSetsMemberTag || tag == kZSetsScoreTag
+    || tag == kListsDataTag;
+}
+
+inline DataType DataTagType(char tag) {
+  switch (tag) {
+    case kHashesDataTag:
+      return kHashes;
+    case kSetsDataTag:
+      return kSets;
+    case kListsDataTag:
+      return kLists;
+    default:
+      return kZSets;
+  }
+}
+
+// The family a meta or data key is stored in
+inline Family FamilyOf(char tag) {
+  switch (tag) {
+    case kHashesDataTag:
+      return kHashesFamily;
+    case kSetsDataTag:
+      return kSetsFamily;
+    case kZSetsMemberTag:
+      return kZSetsMemberFamily;
+    case kZSetsScoreTag:
+      return kZSetsScoreFamily;
+    case kListsDataTag:
+      return kListsFamily;
+    default:
+      return kMetaFamily;
+  }
+}
+
+inline std::string EncodeMetaKey(const Slice& key) {
+  std::string meta_key;
+  meta_key.reserve(1 + key.size());
+  meta_key.push_back(kMetaPrefix);
+  meta_key.append(key.data(), key.size());
+  return meta_key;
+}
+
+// Builds a meta key in a stack buffer, only keys larger
+// than the buffer are allocated on the heap
+class MetaKey {
+ public:
+  explicit MetaKey(const Slice& key)
+      : start_(1 + key.size() <= sizeof(space_)
+               ? space_ : new char[1 + key.size()]),
+        size_(1 + key.size()) {
+    start_[0] = kMetaPrefix;
+    memcpy(start_ + 1, key.data(), key.size());
+  }
+
+  ~MetaKey() {
+    if (start_ != space_) {
+      delete[] start_;
+    }
+  }
+
+  Slice Encode() const { return Slice(start_, size_); }
+
+ private:
+  char space_[200];
+  char* start_;
+  size_t size_;
+
+  // No copying allowed
+  MetaKey(const MetaKey&);
+  void operator=(const MetaKey&);
+};
+
+inline std::string EncodeStringsValue(const Slice& value, uint32_t etime) {
+  std::string strings_value;
+  strings_value.reserve(kTypeLength + kTimestampLength + value.size());
+  strings_value.push_back(static_cast<char>(kStrings));
+  PutFixed32(&strings_value, etime);
+  strings_value.append(value.data(), value.size());
+  return strings_value;
+}
+
+inline std::string EncodeMetaValue(DataType type, uint32_t etime,
+                                   uint64_t version, int32_t count) {
+  std::string meta_value;
+  meta_value.reserve(kMetaValueLength);
+  meta_value.push_back(static_cast<char>(type));
+  PutFixed32(&meta_value, etime);
+  PutFixed64(&meta_value, version);
+  PutFixed32(&meta_value, static_cast<uint32_t>(count));
+  return meta_value;
+}
+
+// Parses the value of a meta key, the setters are only
+// usable when it was constructed from a std::string*
+class ParsedMetaValue {
+ public:
+  explicit ParsedMetaValue(std::string* meta_value)
+      : value_(meta_value), rep_(*meta_value) {
+  }
+  explicit ParsedMetaValue(const Slice& meta_value)
+      : value_(nullptr), rep_(meta_value) {
+  }
+
+  DataType type() const {
+    return static_cast<DataType>(rep_[0]);
+  }
+  uint32_t etime() const {
+    return DecodeFixed32(rep_.data() + kTypeLength);
+  }
+  uint64_t version() const {
+    return DecodeFixed64(rep_.data() + kTypeLength + kTimestampLength);
+  }
+  int32_t count() const {
+    return static_cast<int32_t>(DecodeFixed32(rep_.data()
+          + kTypeLength + kTimestampLength + kVersionLength));
+  }
+  // The value of a strings key
+  Slice user_value() const {
+    return Slice(rep_.data() + kTypeLength + kTimestampLength,
+                 rep_.size() - kTypeLength - kTimestampLength);
+  }
+
+  // A hash or set whose members are in one packed data key
+  bool packed() const {
+    return (type() == kHashes || type() == kSets)
+      && rep_.size() > kMetaValueLength
+      && rep_[kMetaValueLength] == kPackedEncoding;
+  }
+
+  // An expired key, or a collection whose members are all removed
+  bool IsStale(int64_t now) const {
+    if (etime() != 0 && etime() <= now) {
+      return true;
+    }
+    return type() != kStrings && count() <= 0;
+  }
+
+  void set_etime(uint32_t etime) {
+    EncodeFixed32(&(*value_)[kTypeLength], etime);
+  }
+  void ModifyCount(int32_t delta) {
+    EncodeFixed32(&(*value_)[kTypeLength + kTimestampLength + kVersionLength],
+                  static_cast<uint32_t>(count() + delta));
+  }
+  void set_count(int32_t count) {
+    EncodeFixed32(&(*value_)[kTypeLength + kTimestampLength + kVersionLength],
+                  static_cast<uint32_t>(count));
+  }
+  void Unpack() {
+    value_->resize(kMetaValueLength);
+    rep_ = *value_;
+  }
+
+ protected:
+  std::string* value_;
+  Slice rep_;
+};
+
+inline std::string EncodePackedMetaValue(DataType type, uint32_t etime,
+                                         uint64_t version) {
+  std::string meta_value = EncodeMetaValue(type, etime, version, 0);
+  meta_value.push_back(kPackedEncoding);
+  return meta_value;
+}
+
+inline std::string EncodeListsMetaValue(uint32_t etime, uint64_t version,
+                                        uint32_t chunk_size) {
+  std::string meta_value = EncodeMetaValue(kLists, etime, version, 0);
+  meta_value.reserve(kListsMetaValueLength);
+  PutFixed64(&meta_value, kInitialChunkSeq);
+  PutFixed64(&meta_value, kInitialChunkSeq);
+  PutFixed32(&meta_value, 0);
+  PutFixed32(&meta_value, chunk_size);
+  return meta_value;
+}
+
+// The chunks of a list are numbered head to tail, every chunk between
+// the head and the tail holds chunk size elements. Only the head and
+// the tail chunks fill up and empty as elements are pushed and popped,
+// so the chunk an element is in follows from its index and the meta
+// is all the index of the chunk boundaries a read needs.
+class ParsedListsMetaValue : public ParsedMetaValue {
+ public:
+  explicit ParsedListsMetaValue(std::string* meta_value)
+      : ParsedMetaValue(meta_value) {
+  }
+
+  uint64_t head() const {
+    return DecodeFixed64(rep_.data() + kMetaValueLength);
+  }
+  uint64_t tail() const {
+    return DecodeFixed64(rep_.data() + kMetaValueLength + kChunkSeqLength);
+  }
+  // The elements in the head chunk, all of them if it is the tail too
+  uint32_t head_size() const {
+    return DecodeFixed32(rep_.data() + kMetaValueLength
+                         + 2 * kChunkSeqLength);
+  }
+  // Fixed when the list is created
+  uint32_t chunk_size() const {
+    return DecodeFixed32(rep_.data() + kMetaValueLength
+                         + 2 * kChunkSeqLength + kCountLength);
+  }
+  uint32_t tail_size() const {
+    if (head() == tail()) {
+      return head_size();
+    }
+    return count() - head_size() - chunk_size() * (tail() - head() - 1);
+  }
+  int64_t chunks() const {
+    return static_cast<int64_t>(tail() - head() + 1);
+  }
+
+  // Sets seq to the chunk the element at index (0 <= index < count)
+  // is in and offset to its position in the chunk
+  void Locate(int64_t index, uint64_t* seq, uint32_t* offset) const {
+    if (index < head_size()) {
+      *seq = head();
+      *offset = static_cast<uint32_t>(index);
+      return;
+    }
+    index -= head_size();
+    *seq = head() + 1 + index / chunk_size();
+    *offset = static_cast<uint32_t>(index % chunk_size());
+  }
+
+  void set_head(uint64_t seq) {
+    EncodeFixed64(&(*value_)[kMetaValueLength], seq);
+  }
+  void set_tail(uint64_t seq) {
+    EncodeFixed64(&(*value_)[kMetaValueLength + kChunkSeqLength], seq);
+  }
+  void set_head_size(uint32_t size) {
+    EncodeFixed32(&(*value_)[kMetaValueLength + 2 * kChunkSeqLength], size);
+  }
+};
+
+// Appends an element to a list chunk
+inline void AppendChunkElement(std::string* chunk, const Slice& element) {
+  char buf[kMaxVarintLength];
+  chunk->append(buf, EncodeVarint(buf, element.size()) - buf);
+  chunk->append(element.data(), element.size());
+}
+
+// Sets elements to the elements of a list chunk, pointing into the
+// chunk, false if it is corrupted
+inline bool DecodeChunk(const Slice& chunk, std::vector<Slice>* elements) {
+  KeyDecoder decoder(chunk);
+  Slice element;
+  while (decoder.remaining().size() > 0) {
+    if (!decoder.GetLengthPrefixed(&element)) {
+      return false;
+    }
+    elements->push_back(element);
+  }
+  return true;
+}
+
+// The members of a packed hash or set, sorted by field (or member) the
+// way their data keys would be:
+//
+//   entry * n | offset(4) * n | n(4)
+//   entry = field size(varint) | field [| value size(varint) | value]
+//
+// A set has no values. The offsets of the entries let a lookup binary
+// search the fields in place, without decoding the entries before it.
+class PackedEntries {
+ public:
+  PackedEntries(const Slice& rep, bool with_values)
+      : rep_(rep), with_values_(with_values), size_(0) {
+    if (rep_.size() >= kCountLength) {
+      size_ = DecodeFixed32(rep_.data() + rep_.size() - kCountLength);
+      if (size_ > (rep_.size() - kCountLength) / kCountLength) {
+        size_ = 0;
+      }
+    }
+  }
+
+  uint32_t size() const { return size_; }
+
+  // Sets field, and value unless it is nullptr, to entry i (< size()),
+  // false if the entry is corrupted
+  bool Get(uint32_t i, Slice* field, Slice* value) const {
+    const char* offsets = rep_.data() + rep_.size() - kCountLength
+      - size_ * kCountLength;
+    uint32_t offset = DecodeFixed32(offsets + i * kCountLength);
+    if (offset > static_cast<size_t>(offsets - rep_.data())) {
+      return false;
+    }
+    KeyDecoder decoder(Slice(rep_.data() + offset,
+                             offsets - rep_.data() - offset));
+    decoder.GetLengthPrefixed(field);
+    if (with_values_ && value != nullptr) {
+      decoder.GetLengthPrefixed(value);
+    }
+    return decoder.ok();
+  }
+
+  // Sets index to the entry of field, false if there is none
+  bool Find(const Slice& field, uint32_t* index) const {
+    uint32_t low = 0;
+    uint32_t high = size_;
+    Slice cur;
+    while (low < high) {
+      uint32_t mid = low + (high - low) / 2;
+      if (!Get(mid, &cur, nullptr)) {
+        return false;
+      }
+      int cmp = cur.compare(field);
+      if (cmp == 0) {
+        *index = mid;
+        return true;
+      } else if (cmp < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return false;
+  }
+
+ private:
+  Slice rep_;
+  bool with_values_;
+  uint32_t size_;
+};
+
+// Packs entries, whose values are dropped unless with_values
+inline std::string EncodePackedEntries(
+    const std::map<std::string, std::string>& entries, bool with_values) {
+  std::string rep;
+  std::string offsets;
+  char buf[kMaxVarintLength];
+  for (const auto& entry : entries) {
+    PutFixed32(&offsets, static_cast<uint32_t>(rep.size()));
+    rep.append(buf, EncodeVarint(buf, entry.first.size()) - buf);
+    rep.append(entry.first);
+    if (with_values) {
+      rep.append(buf, EncodeVarint(buf, entry.second.size()) - buf);
+      rep.append(entry.second);
+    }
+  }
+  rep.append(offsets);
+  PutFixed32(&rep, static_cast<uint32_t>(entries.size()));
+  return rep;
+}
+
+// Adds the entries of a packed hash or set to entries, false if it is
+// corrupted
+inline bool DecodePackedEntries(const Slice& rep, bool with_values,
+                                std::map<std::string, std::string>* entries) {
+  PackedEntries packed(rep, with_values);
+  Slice field;
+  Slice value;
+  for (uint32_t i = 0; i < packed.size(); i++) {
+    if (!packed.Get(i, &field, &value)) {
+      return false;
+    }
+    (*entries)[field.ToString()] = with_values ? value.ToString() : "";
+  }
+  return true;
+}
+
+// Builds a data key in a stack buffer, only keys
+// larger than the buffer are allocated on the heap
+class DataKey {
+ public:
+  DataKey(char tag, const Slice& key, uint64_t version, const Slice& suffix)
+      : start_(nullptr), tag_(tag), key_(key), version_(version),
+        suffix_(suffix) {
+  }
+
+  ~DataKey() {
+    if (start_ != space_) {
+      delete[] start_;
+    }
+  }
+
+  // tag | key size | user key, shared by every version of the key
+  Slice EncodeKeyPrefix() {
+    Encode();
+    return Slice(start_, PrefixLength(key_.size()) - kVersionLength);
+  }
+
+  // tag | key size | user key | version
+  Slice EncodePrefix() {
+    Encode();
+    return Slice(start_, PrefixLength(key_.size()));
+  }
+
+  // tag | key size | user key | version | suffix
+  Slice Encode() {
+    size_t needed = PrefixLength(key_.size()) + suffix_.size();
+    if (start_ == nullptr) {
+      start_ = needed <= sizeof(space_) ? space_ : new char[needed];
+      KeyEncoder encoder(start_, needed);
+      encoder.PutByte(tag_).PutLengthPrefixed(key_).PutFixed64(version_)
+        .PutBytes(suffix_);
+    }
+    return Slice(start_, needed);
+  }
+
+  static size_t PrefixLength(size_t key_size) {
+    return 1 + KeyEncoder::LengthPrefixedLength(key_size) + kVersionLength;
+  }
+
+ private:
+  char space_[200];
+  char* start_;
+  char tag_;
+  Slice key_;
+  uint64_t version_;
+  Slice suffix_;
+
+  // No copying allowed
+  DataKey(const DataKey&);
+  void operator=(const DataKey&);
+};
+
+// Builds the data key of chunk seq of a list
+class ListChunkKey {
+ public:
+  ListChunkKey(const Slice& key, uint64_t version, uint64_t seq)
+      : data_key_(kListsDataTag, key, version,
+                  Slice(seq_, kChunkSeqLength)) {
+    EncodeBigEndian64(seq_, seq);
+  }
+
+  Slice Encode() { return data_key_.Encode(); }
+
+ private:
+  // Read by data_key_ once Encode() is called
+  char seq_[kChunkSeqLength];
+  DataKey data_key_;
+};
+
+// The length of the [tag | key size | user key | version] prefix of
+// a data key, 0 if data_key is not one
+inline size_t DataKeyPrefixLength(const Slice& data_key) {
+  if (data_key.size() == 0 || !IsDataTag(data_key[0])) {
+    return 0;
+  }
+  uint64_t key_size;
+  const char* ptr = DecodeVarint(data_key.data() + 1,
+                                 data_key.data() + data_key.size(),
+                                 &key_size);
+  if (ptr == nullptr) {
+    return 0;
+  }
+  size_t length = ptr - data_key.data() + key_size + kVersionLength;
+  return length <= data_key.size() ? length : 0;
+}
+
+class ParsedDataKey {
+ public:
+  explicit ParsedDataKey(const Slice& data_key)
+      : tag_(0), version_(0), ok_(false) {
+    KeyDecoder decoder(data_key);
+    ok_ = decoder.GetByte(&tag_) && decoder.GetLengthPrefixed(&key_)
+      && decoder.GetFixed64(&version_);
+    suffix_ = decoder.remaining();
+  }
+
+  // False if data_key is too short to hold a tag, a key and a version,
+  // the fields not decoded are then zero or empty
+  bool ok() const { return ok_; }
+  char tag() const { return tag_; }
+  Slice key() const { return key_; }
+  uint64_t version() const { return version_; }
+  Slice suffix() const { return suffix_; }
+
+ private:
+  char tag_;
+  Slice key_;
+  uint64_t version_;
+  Slice suffix_;
+  bool ok_;
+};
+
+// Returns the user key an encoded meta or data key belongs to, keys
+// of any other form are returned whole
+inline Slice UserKeyOf(const Slice& key) {
+  if (key.size() > 0 && key[0] == kMetaPrefix) {
+    return Slice(key.data() + 1, key.size() - 1);
+  } else if (key.size() > 0 && IsDataTag(key[0])) {
+    KeyDecoder decoder(Slice(key.data() + 1, key.size() - 1));
+    Slice user_key;
+    if (decoder.GetLengthPrefixed(&user_key)) {
+      return user_key;
+    }
+  }
+  return key;
+}
+
+// Keys starting with this byte are bookkeeping of the node, not user
+// data: they sort after every meta and data key, are never scanned,
+// copied to a replica or removed by a full resync
+const char kInternalPrefix = '\xff';
+// On a replica, the primary sequence number to resume the sync from
+const char kReplicationPositionKey[] = "\xff" "replication_position";
+// Every version handed out is below this one, Open() starts from it so
+// that a clock stepped back across a restart can not reuse old versions
+const char kVersionLimitKey[] = "\xff" "version_limit";
+
+// The smallest key greater than every key starting with
+// prefix, empty if there is no such key
+std::string PrefixUpperBound(const Slice& prefix);
+
+// Extracts [tag | key size | user key | version] from the data keys
+// of hashes, sets, zsets and lists, meta keys are out of its domain. The
+// prefix bloom filter and the memtable bloom are built on it.
+class DataKeyPrefixTransform : public rocksdb::SliceTransform {
+ public:
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+  bool InRange(const Slice& dst) const override;
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_FORMAT_H_
@@ -5,29 +5,2052 @@
 
 #include "gilmour/gilmour.h"
 
-#include "leveldb/db.h"
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
 
-int main() {
-  leveldb::DB* db;
-  leveldb::Options options;
-  options.create_if_missing = true;
+#include "rocksdb/cache.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/table.h"
+#include "rocksdb/write_batch.h"
 
-  std::string path = "./db";
-  leveldb::Status s = leveldb::DB::Open(options, path, &db);
+#include "gilmour/glob_matcher.h"
+#include "src/format.h"
+#include "src/gilmour_filter.h"
+#include "src/hot_keys.h"
+#include "src/lock_mgr.h"
+#include "src/scope_snapshot.h"
+#include "src/zset_index.h"
 
-  std::string key = "key";
-  std::string value = "value";
-  s = db->Put(leveldb::WriteOptions(), key, value);
-  assert(s.ok());
+namespace gilmour {
 
-  value.clear();
-  s = db->Get(leveldb::ReadOptions(), key, &value);
-  assert(s.ok());
-  std::cout << key << " : " << value << std::endl;
+static const char* kWrongType =
+  "WRONGTYPE Operation against a key holding the wrong kind of value";
 
-  s = db->Delete(leveldb::WriteOptions(), key);
-  assert(s.ok());
+// The statistics of keys which never reach the threshold
+// are thrown away once there are that many of them
+static const size_t kMaxStatisticsKeys = 100000;
 
-  delete db;
-  return 0;
+static const char* kHotKeysFile = "HOT_KEYS";
+// The warm up of a collection reads this many of its members, enough
+// to bring in the first data blocks without reading huge ones whole
+static const int kPreloadMembers = 128;
+// The version limit is persisted this far ahead, one write a minute
+// while the versions follow the clock
+static const uint64_t kVersionLimitStep = 60 * 1000000ULL;
+
+// Turns start and stop, which may count from the end, into the ranks
+// of the first and the last member of the range, false if it is empty
+static bool NormalizeRange(int64_t count, int32_t* start, int32_t* stop) {
+  int64_t first = *start >= 0 ? *start : count + *start;
+  int64_t last = *stop >= 0 ? *stop : count + *stop;
+  first = std::max(first, static_cast<int64_t>(0));
+  last = std::min(last, count - 1);
+  if (first > last) {
+    return false;
+  }
+  *start = static_cast<int32_t>(first);
+  *stop = static_cast<int32_t>(last);
+  return true;
+}
+
+Gilmour::Gilmour()
+    : db_(nullptr),
+      lock_mgr_(new LockMgr(1000)),
+      prefix_seek_(false),
+      last_version_(0),
+      version_limit_(0),
+      small_compaction_threshold_(0),
+      range_delete_threshold_(0),
+      bg_stop_(false),
+      expire_batch_size_(0),
+      expire_wheel_(nullptr),
+      hot_keys_(nullptr),
+      preload_stop_(false),
+      preload_running_(false),
+      preloaded_keys_(0),
+      zset_indexes_(nullptr),
+      zset_index_min_members_(0),
+      loading_versions_(new LoadingVersions()),
+      list_chunk_size_(0),
+      packed_max_entries_(0),
+      packed_max_value_size_(0) {
+}
+
+Gilmour::~Gilmour() {
+  {
+    std::lock_guard<std::mutex> l(bg_mutex_);
+    bg_stop_ = true;
+  }
+  bg_cv_.notify_one();
+  if (bg_thread_.joinable()) {
+    bg_thread_.join();
+  }
+  preload_stop_ = true;
+  if (preload_thread_.joinable()) {
+    preload_thread_.join();
+  }
+  if (hot_keys_ != nullptr) {
+    hot_keys_->Save(db_->GetName() + "/" + kHotKeysFile);
+    delete hot_keys_;
+  }
+  for (auto handle : handles_) {
+    delete handle;
+  }
+  delete db_;
+  delete lock_mgr_;
+  delete expire_wheel_;
+  delete zset_indexes_;
+  delete loading_versions_;
+}
+
+Status Gilmour::Open(const GilmourOptions& gilmour_options,
+                     const std::string& db_path) {
+  rocksdb::DBOptions db_options(gilmour_options.options);
+  db_options.create_missing_column_families = true;
+  std::shared_ptr<rocksdb::Cache> block_cache =
+    rocksdb::NewLRUCache(gilmour_options.block_cache_size);
+  std::shared_ptr<rocksdb::CompactionFilterFactory> filter_factory(
+      new GilmourFilterFactory(&db_, loading_versions_));
+  const FamilyOptions* family_options[kFamilyCount] = {
+    &gilmour_options.meta_family, &gilmour_options.hashes_family,
+    &gilmour_options.sets_family, &gilmour_options.zset_members_family,
+    &gilmour_options.zset_scores_family, &gilmour_options.lists_family
+  };
+  prefix_seek_ = gilmour_options.prefix_bloom_bits_per_key > 0;
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> families;
+  for (int i = 0; i < kFamilyCount; i++) {
+    const FamilyOptions& tuning = *family_options[i];
+    rocksdb::ColumnFamilyOptions options(gilmour_options.options);
+    rocksdb::BlockBasedTableOptions table_options;
+    table_options.block_cache = block_cache;
+    table_options.block_size = tuning.block_size;
+    if (prefix_seek_) {
+      // Full filters keyed on the whole key (point lookups of metas
+      // and fields) and on the data key prefix (Seek into a collection)
+      table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(
+            gilmour_options.prefix_bloom_bits_per_key, false));
+      table_options.whole_key_filtering = tuning.whole_key_filtering;
+      if (i != kMetaFamily) {
+        options.prefix_extractor.reset(new DataKeyPrefixTransform());
+        options.memtable_prefix_bloom_size_ratio = 0.1;
+      }
+    }
+    options.table_factory.reset(
+        rocksdb::NewBlockBasedTableFactory(table_options));
+    options.compaction_filter_factory = filter_factory;
+    options.compression = tuning.compression;
+    if (tuning.level0_file_num_compaction_trigger > 0) {
+      options.level0_file_num_compaction_trigger =
+        tuning.level0_file_num_compaction_trigger;
+    }
+    if (tuning.target_file_size_base > 0) {
+      options.target_file_size_base = tuning.target_file_size_base;
+    }
+    families.push_back(rocksdb::ColumnFamilyDescriptor(kFamilyNames[i],
+                                                       options));
+  }
+
+  range_delete_threshold_ = gilmour_options.range_delete_threshold;
+  Status s = rocksdb::DB::Open(db_options, db_path, families,
+                               &handles_, &db_);
+  if (!s.ok()) {
+    return s;
+  }
+  s = LoadVersionLimit();
+  if (!s.ok()) {
+    return s;
+  }
+  small_compaction_threshold_ = gilmour_options.small_compaction_threshold;
+  list_chunk_size_ = std::max(gilmour_options.list_chunk_size, 1);
+  packed_max_entries_ = gilmour_options.packed_max_entries;
+  packed_max_value_size_ = gilmour_options.packed_max_value_size;
+  if (gilmour_options.expire_batch_size > 0) {
+    expire_batch_size_ = gilmour_options.expire_batch_size;
+    int64_t now;
+    db_->GetEnv()->GetCurrentTime(&now);
+    expire_wheel_ = new TimingWheel<std::string>(now);
+  }
+  if (small_compaction_threshold_ > 0 || expire_wheel_ != nullptr) {
+    bg_thread_ = std::thread(&Gilmour::RunBGTask, this);
+  }
+  if (gilmour_options.hot_keys > 0) {
+    hot_keys_ = new HotKeys(gilmour_options.hot_keys);
+    preload_running_ = true;
+    preload_thread_ = std::thread(&Gilmour::PreloadHotKeys, this);
+  }
+  if (gilmour_options.zset_index_keys > 0) {
+    zset_indexes_ = new ZSetIndexCache(gilmour_options.zset_index_keys);
+    zset_index_min_members_ = gilmour_options.zset_index_min_members;
+  }
+  return s;
+}
+
+rocksdb::ColumnFamilyHandle* Gilmour::DataHandle(char tag) {
+  return handles_[FamilyOf(tag)];
+}
+
+uint64_t Gilmour::NewVersion() {
+  uint64_t now = db_->GetEnv()->NowMicros();
+  uint64_t last = last_version_.load();
+  uint64_t version;
+  do {
+    version = std::max(now, last + 1);
+  } while (!last_version_.compare_exchange_weak(last, version));
+
+  // The new limit goes into the WAL ahead of any write using version.
+  // If it can not be written the version is still good for this run,
+  // the next one retries
+  if (version >= version_limit_.load()) {
+    std::lock_guard<std::mutex> l(version_mutex_);
+    if (version >= version_limit_.load()) {
+      std::string limit;
+      PutFixed64(&limit, version + kVersionLimitStep);
+      if (db_->Put(rocksdb::WriteOptions(), kVersionLimitKey, limit).ok()) {
+        version_limit_ = version + kVersionLimitStep;
+      }
+    }
+  }
+  return version;
+}
+
+Status Gilmour::LoadVersionLimit() {
+  std::string limit;
+  Status s = db_->Get(rocksdb::ReadOptions(), kVersionLimitKey, &limit);
+  if (s.ok() && limit.size() == sizeof(uint64_t)) {
+    version_limit_ = DecodeFixed64(limit.data());
+    last_version_ = version_limit_.load();
+    return s;
+  } else if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+
+  // Once, the first time the db is opened with the limit
+  std::unique_ptr<rocksdb::Iterator> iter(
+      db_->NewIterator(rocksdb::ReadOptions(), handles_[kMetaFamily]));
+  uint64_t max_version = 0;
+  for (iter->Seek(std::string(1, kMetaPrefix));
+       iter->Valid() && iter->key()[0] == kMetaPrefix; iter->Next()) {
+    ParsedMetaValue parsed_meta_value(iter->value());
+    if (parsed_meta_value.type() != kStrings) {
+      max_version = std::max(max_version, parsed_meta_value.version());
+    }
+  }
+  last_version_ = max_version;
+  return iter->status();
+}
+
+Status Gilmour::GetMeta(const rocksdb::ReadOptions& read_options,
+                        const Slice& key, DataType type,
+                        std::string* meta_value) {
+  if (hot_keys_ != nullptr) {
+    hot_keys_->Record(key);
+  }
+  MetaKey meta_key(key);
+  Status s = db_->Get(read_options, meta_key.Encode(), meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  ParsedMetaValue parsed_meta_value(meta_value);
+  if (parsed_meta_value.IsStale(now)) {
+    return Status::NotFound("Stale");
+  } else if (parsed_meta_value.type() != type) {
+    return Status::InvalidArgument(kWrongType);
+  }
+  return Status::OK();
+}
+
+Status Gilmour::ScanData(const rocksdb::ReadOptions& read_options, char tag,
+                         const Slice& key, uint64_t version,
+                         const DataHandler& handler, const Slice& start) {
+  DataKey data_key(tag, key, version, start);
+  Slice prefix = data_key.EncodePrefix();
+  std::string upper_bound_key = PrefixUpperBound(prefix);
+  Slice upper_bound(upper_bound_key);
+
+  // The upper bound stops the iterator at the end of this version
+  // instead of walking into whatever follows it, and with the prefix
+  // extractor Seek() consults the prefix bloom of every sst file
+  rocksdb::ReadOptions bounded_options(read_options);
+  bounded_options.iterate_upper_bound = &upper_bound;
+  bounded_options.prefix_same_as_start = prefix_seek_;
+
+  std::unique_ptr<rocksdb::Iterator> iter(
+      db_->NewIterator(bounded_options, DataHandle(tag)));
+  for (iter->Seek(start.empty() ? prefix : data_key.Encode());
+       iter->Valid(); iter->Next()) {
+    Slice suffix(iter->key().data() + prefix.size(),
+                 iter->key().size() - prefix.size());
+    if (!handler(suffix, iter->value())) {
+      break;
+    }
+  }
+  return iter->status();
+}
+
+bool Gilmour::UsePacked(const Status& s, DataType type,
+                        std::string* meta_value) {
+  if (s.ok()) {
+    return ParsedMetaValue(meta_value).packed();
+  } else if (s.IsNotFound() && packed_max_entries_ > 0) {
+    *meta_value = EncodePackedMetaValue(type, 0, NewVersion());
+    return true;
+  }
+  return false;
+}
+
+Status Gilmour::ReadPacked(const rocksdb::ReadOptions& read_options,
+                           char tag, const Slice& key,
+                           const std::string& meta_value, std::string* packed,
+                           std::map<std::string, std::string>* entries) {
+  ParsedMetaValue parsed_meta_value(meta_value);
+  DataKey packed_key(tag, key, parsed_meta_value.version(), Slice());
+  // A new one is not written yet
+  Status s = parsed_meta_value.count() == 0 ? Status::NotFound()
+    : db_->Get(read_options, DataHandle(tag), packed_key.Encode(), packed);
+  if (s.IsNotFound()) {
+    packed->clear();
+  } else if (!s.ok()) {
+    return s;
+  }
+  if (entries != nullptr
+    && !DecodePackedEntries(*packed, tag == kHashesDataTag, entries)) {
+    return Status::Corruption("Bad packed entries");
+  }
+  return Status::OK();
+}
+
+Status Gilmour::ScanPacked(const rocksdb::ReadOptions& read_options,
+                           char tag, const Slice& key,
+                           const std::string& meta_value,
+                           const DataHandler& handler) {
+  std::string packed;
+  Status s = ReadPacked(read_options, tag, key, meta_value, &packed);
+  if (!s.ok()) {
+    return s;
+  }
+  PackedEntries entries(packed, tag == kHashesDataTag);
+  Slice field;
+  Slice value;
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    if (!entries.Get(i, &field, &value)) {
+      return Status::Corruption("Bad packed entries");
+    }
+    if (!handler(field, value)) {
+      break;
+    }
+  }
+  return Status::OK();
+}
+
+void Gilmour::WritePacked(char tag, const Slice& key, std::string* meta_value,
+                          const std::map<std::string, std::string>& entries,
+                          rocksdb::WriteBatch* batch) {
+  size_t max_size = static_cast<size_t>(packed_max_value_size_);
+  bool fits = entries.size() <= static_cast<size_t>(packed_max_entries_);
+  for (auto iter = entries.begin(); fits && iter != entries.end(); ++iter) {
+    fits = iter->first.size() <= max_size && iter->second.size() <= max_size;
+  }
+
+  ParsedMetaValue parsed_meta_value(meta_value);
+  parsed_meta_value.set_count(static_cast<int32_t>(entries.size()));
+  DataKey packed_key(tag, key, parsed_meta_value.version(), Slice());
+  if (fits && !entries.empty()) {
+    batch->Put(DataHandle(tag), packed_key.Encode(),
+               EncodePackedEntries(entries, tag == kHashesDataTag));
+  } else {
+    batch->Delete(DataHandle(tag), packed_key.Encode());
+  }
+  if (!fits) {
+    // Put after the Delete, the key of an empty field or member
+    // is the packed key
+    parsed_meta_value.Unpack();
+    for (const auto& entry : entries) {
+      DataKey data_key(tag, key, parsed_meta_value.version(), entry.first);
+      batch->Put(DataHandle(tag), data_key.Encode(), entry.second);
+    }
+  }
+  batch->Put(MetaKey(key).Encode(), *meta_value);
+}
+
+Status Gilmour::Set(const Slice& key, const Slice& value) {
+  ScopeRecordLock l(lock_mgr_, key);
+  return db_->Put(rocksdb::WriteOptions(), MetaKey(key).Encode(),
+                  EncodeStringsValue(value, 0));
+}
+
+Status Gilmour::Get(const Slice& key, std::string* value) {
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kStrings, &meta_value);
+  if (s.ok()) {
+    *value = ParsedMetaValue(&meta_value).user_value().ToString();
+  }
+  return s;
+}
+
+Status Gilmour::MSet(const std::vector<KeyValue>& kvs) {
+  KeyValueBatch batch;
+  size_t bytes = 0;
+  for (const auto& kv : kvs) {
+    bytes += kv.key.size() + kv.value.size();
+  }
+  batch.Reserve(kvs.size(), bytes);
+  for (const auto& kv : kvs) {
+    batch.Add(kv.key, kv.value);
+  }
+  return MSet(batch);
+}
+
+Status Gilmour::MSet(const KeyValueBatch& kvs) {
+  std::vector<std::string> keys;
+  keys.reserve(kvs.size());
+  for (size_t i = 0; i < kvs.size(); i++) {
+    keys.push_back(kvs.key(i).ToString());
+  }
+
+  MultiScopeRecordLock ml(lock_mgr_, keys);
+  rocksdb::WriteBatch batch;
+  for (size_t i = 0; i < kvs.size(); i++) {
+    batch.Put(MetaKey(kvs.key(i)).Encode(),
+              EncodeStringsValue(kvs.value(i), 0));
+  }
+  return db_->Write(rocksdb::WriteOptions(), &batch);
+}
+
+// The tags of the data keys a collection of type is stored under
+static std::vector<char> DataTagsOf(DataType type) {
+  switch (type) {
+    case kHashes:
+      return {kHashesDataTag};
+    case kSets:
+      return {kSetsDataTag};
+    case kZSets:
+      return {kZSetsMemberTag, kZSetsScoreTag};
+    case kLists:
+      return {kListsDataTag};
+    default:
+      return {};
+  }
+}
+
+// The number of data keys of the collection with meta_value
+static int64_t DataKeysOf(std::string* meta_value) {
+  ParsedMetaValue parsed_meta_value(meta_value);
+  switch (parsed_meta_value.type()) {
+    case kZSets:
+      // A zset member is stored under two data keys
+      return parsed_meta_value.count() * 2;
+    case kLists:
+      return ParsedListsMetaValue(meta_value).chunks();
+    default:
+      return parsed_meta_value.packed() ? 1 : parsed_meta_value.count();
+  }
+}
+
+// One range tombstone per data tag covers [tag | key | version], the
+// cost does not depend on the size of the collection. Reads of a newer
+// version Seek() to another prefix and never step into the range.
+static void DeleteDataRange(
+    const std::vector<rocksdb::ColumnFamilyHandle*>& handles,
+    rocksdb::WriteBatch* batch, DataType type, const Slice& key,
+    uint64_t version) {
+  for (char tag : DataTagsOf(type)) {
+    DataKey data_key(tag, key, version, Slice());
+    Slice begin = data_key.EncodePrefix();
+    batch->DeleteRange(handles[FamilyOf(tag)], begin,
+                       PrefixUpperBound(begin));
+  }
+}
+
+Status Gilmour::Del(const std::vector<std::string>& keys, int64_t* count) {
+  *count = 0;
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  for (const auto& key : keys) {
+    ScopeRecordLock l(lock_mgr_, key);
+    MetaKey meta_key(key);
+    std::string meta_value;
+    Status s = db_->Get(rocksdb::ReadOptions(), meta_key.Encode(),
+                        &meta_value);
+    if (s.IsNotFound()) {
+      continue;
+    } else if (!s.ok()) {
+      return s;
+    }
+    // The data of a collection are left behind, nothing can reach
+    // them once the meta is gone since a new collection at the
+    // same key always gets a greater version
+    rocksdb::WriteBatch batch;
+    batch.Delete(meta_key.Encode());
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    if (parsed_meta_value.type() != kStrings && range_delete_threshold_ > 0
+      && parsed_meta_value.count() >= range_delete_threshold_) {
+      DeleteDataRange(handles_, &batch, parsed_meta_value.type(), key,
+                      parsed_meta_value.version());
+    }
+    s = db_->Write(rocksdb::WriteOptions(), &batch);
+    if (!s.ok()) {
+      return s;
+    }
+    if (!parsed_meta_value.IsStale(now)) {
+      (*count)++;
+    }
+    if (zset_indexes_ != nullptr && parsed_meta_value.type() == kZSets) {
+      zset_indexes_->Erase(key);
+    }
+    if (parsed_meta_value.type() != kStrings) {
+      UpdateKeyStatistics(key, DataKeysOf(&meta_value));
+    }
+  }
+  return Status::OK();
+}
+
+Status Gilmour::Scan(const std::string& start_key, const std::string& pattern,
+                     int64_t count, std::vector<std::string>* keys,
+                     std::string* next_key) {
+  GlobMatcher matcher(pattern);
+  std::string seek_key = EncodeMetaKey(std::max(start_key, matcher.prefix()));
+  // start_key may be the same string as next_key
+  next_key->clear();
+  // The meta family holds nothing but the metas and the internal
+  // keys after them, the scan reads no block of collection data
+  std::string upper_bound_key = matcher.PrefixUpperBound().empty()
+    ? PrefixUpperBound(Slice(&kMetaPrefix, 1))
+    : EncodeMetaKey(matcher.PrefixUpperBound());
+  Slice upper_bound(upper_bound_key);
+
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.iterate_upper_bound = &upper_bound;
+
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  std::unique_ptr<rocksdb::Iterator> iter(
+      db_->NewIterator(read_options, handles_[kMetaFamily]));
+  for (iter->Seek(seek_key); iter->Valid() && count > 0;
+       iter->Next(), count--) {
+    Slice key(iter->key().data() + 1, iter->key().size() - 1);
+    if (ParsedMetaValue(iter->value()).IsStale(now)) {
+      continue;
+    }
+    if (matcher.prefix_only() || matcher.Match(key.data(), key.size())) {
+      keys->push_back(key.ToString());
+    }
+  }
+  if (iter->Valid()) {
+    next_key->assign(iter->key().data() + 1, iter->key().size() - 1);
+  }
+  return iter->status();
+}
+
+Status Gilmour::Keys(const std::string& pattern,
+                     std::vector<std::string>* keys) {
+  std::string next_key;
+  return Scan("", pattern, std::numeric_limits<int64_t>::max(),
+              keys, &next_key);
+}
+
+Status Gilmour::Expire(const Slice& key, int32_t ttl, int32_t* ret) {
+  *ret = 0;
+  if (ttl <= 0) {
+    int64_t count = 0;
+    Status s = Del({key.ToString()}, &count);
+    *ret = static_cast<int32_t>(count);
+    return s;
+  }
+
+  ScopeRecordLock l(lock_mgr_, key);
+  MetaKey meta_key(key);
+  std::string meta_value;
+  Status s = db_->Get(rocksdb::ReadOptions(), meta_key.Encode(), &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (parsed_meta_value.IsStale(now)) {
+    return Status::OK();
+  }
+  // Only the meta carries the etime, the data of an expired
+  // collection are dropped by the compaction filter
+  uint32_t etime = static_cast<uint32_t>(now + ttl);
+  parsed_meta_value.set_etime(etime);
+  s = db_->Put(rocksdb::WriteOptions(), meta_key.Encode(), meta_value);
+  if (s.ok()) {
+    *ret = 1;
+    ScheduleExpire(key, etime);
+  }
+  return s;
+}
+
+Status Gilmour::TTL(const Slice& key, int64_t* ttl) {
+  *ttl = -2;
+  std::string meta_value;
+  Status s = db_->Get(rocksdb::ReadOptions(), MetaKey(key).Encode(),
+                      &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (!parsed_meta_value.IsStale(now)) {
+    *ttl = parsed_meta_value.etime() == 0
+      ? -1 : parsed_meta_value.etime() - now;
+  }
+  return Status::OK();
+}
+
+Status Gilmour::Type(const Slice& key, DataType* type) {
+  std::string meta_value;
+  Status s = db_->Get(rocksdb::ReadOptions(), MetaKey(key).Encode(),
+                      &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (parsed_meta_value.IsStale(now)) {
+    return Status::NotFound("Stale");
+  }
+  *type = parsed_meta_value.type();
+  return Status::OK();
+}
+
+Status Gilmour::HSet(const Slice& key, const Slice& field,
+                     const Slice& value, int32_t* res) {
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kHashes, &meta_value);
+  if (UsePacked(s, kHashes, &meta_value)) {
+    std::string packed;
+    std::map<std::string, std::string> entries;
+    s = ReadPacked(rocksdb::ReadOptions(), kHashesDataTag, key, meta_value,
+                   &packed, &entries);
+    if (!s.ok()) {
+      return s;
+    }
+    auto iter = entries.find(field.ToString());
+    *res = iter == entries.end() ? 1 : 0;
+    if (iter != entries.end() && iter->second == value.ToString()) {
+      return Status::OK();
+    }
+    entries[field.ToString()] = value.ToString();
+    WritePacked(kHashesDataTag, key, &meta_value, entries, &batch);
+  } else if (s.ok()) {
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    DataKey data_key(kHashesDataTag, key, parsed_meta_value.version(), field);
+    std::string old_value;
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kHashesFamily],
+                 data_key.Encode(), &old_value);
+    if (s.ok()) {
+      *res = 0;
+      if (old_value == value) {
+        return Status::OK();
+      }
+      batch.Put(handles_[kHashesFamily], data_key.Encode(), value);
+    } else if (s.IsNotFound()) {
+      *res = 1;
+      parsed_meta_value.ModifyCount(1);
+      batch.Put(MetaKey(key).Encode(), meta_value);
+      batch.Put(handles_[kHashesFamily], data_key.Encode(), value);
+    } else {
+      return s;
+    }
+  } else if (s.IsNotFound()) {
+    *res = 1;
+    uint64_t version = NewVersion();
+    batch.Put(MetaKey(key).Encode(), EncodeMetaValue(kHashes, 0, version, 1));
+    DataKey data_key(kHashesDataTag, key, version, field);
+    batch.Put(handles_[kHashesFamily], data_key.Encode(), value);
+  } else {
+    return s;
+  }
+  return db_->Write(rocksdb::WriteOptions(), &batch);
+}
+
+Status Gilmour::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
+  FieldValueBatch batch;
+  size_t bytes = 0;
+  for (const auto& fv : fvs) {
+    bytes += fv.field.size() + fv.value.size();
+  }
+  batch.Reserve(fvs.size(), bytes);
+  for (const auto& fv : fvs) {
+    batch.Add(fv.field, fv.value);
+  }
+  return HMSet(key, batch);
+}
+
+Status Gilmour::HMSet(const Slice& key, const FieldValueBatch& fvs) {
+  if (fvs.empty()) {
+    return Status::OK();
+  }
+  // The last value of a duplicated field wins, filtered_fvs holds the
+  // index in fvs of the pair that does
+  std::unordered_set<std::string> fields;
+  std::vector<size_t> filtered_fvs;
+  for (size_t i = fvs.size(); i > 0; i--) {
+    if (fields.insert(fvs.field(i - 1).ToString()).second) {
+      filtered_fvs.push_back(i - 1);
+    }
+  }
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kHashes, &meta_value);
+  if (UsePacked(s, kHashes, &meta_value)) {
+    std::string packed;
+    std::map<std::string, std::string> entries;
+    s = ReadPacked(rocksdb::ReadOptions(), kHashesDataTag, key, meta_value,
+                   &packed, &entries);
+    if (!s.ok()) {
+      return s;
+    }
+    for (size_t i : filtered_fvs) {
+      entries[fvs.field(i).ToString()] = fvs.value(i).ToString();
+    }
+    WritePacked(kHashesDataTag, key, &meta_value, entries, &batch);
+  } else if (s.ok()) {
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    int32_t count = 0;
+    std::string old_value;
+    for (size_t i : filtered_fvs) {
+      DataKey data_key(kHashesDataTag, key,
+                       parsed_meta_value.version(), fvs.field(i));
+      s = db_->Get(rocksdb::ReadOptions(), handles_[kHashesFamily],
+                   data_key.Encode(), &old_value);
+      if (s.IsNotFound()) {
+        count++;
+      } else if (!s.ok()) {
+        return s;
+      }
+      batch.Put(handles_[kHashesFamily], data_key.Encode(), fvs.value(i));
+    }
+    parsed_meta_value.ModifyCount(count);
+    batch.Put(MetaKey(key).Encode(), meta_value);
+  } else if (s.IsNotFound()) {
+    uint64_t version = NewVersion();
+    batch.Put(MetaKey(key).Encode(), EncodeMetaValue(kHashes, 0, version,
+          static_cast<int32_t>(filtered_fvs.size())));
+    for (size_t i : filtered_fvs) {
+      DataKey data_key(kHashesDataTag, key, version, fvs.field(i));
+      batch.Put(handles_[kHashesFamily], data_key.Encode(), fvs.value(i));
+    }
+  } else {
+    return s;
+  }
+  return db_->Write(rocksdb::WriteOptions(), &batch);
+}
+
+Status Gilmour::HGet(const Slice& key, const Slice& field,
+                     std::string* value) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kHashes, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  if (ParsedMetaValue(&meta_value).packed()) {
+    std::string packed;
+    s = ReadPacked(read_options, kHashesDataTag, key, meta_value, &packed);
+    if (!s.ok()) {
+      return s;
+    }
+    PackedEntries entries(packed, true);
+    uint32_t index;
+    Slice packed_field;
+    Slice packed_value;
+    if (!entries.Find(field, &index)
+      || !entries.Get(index, &packed_field, &packed_value)) {
+      return Status::NotFound();
+    }
+    value->assign(packed_value.data(), packed_value.size());
+    return Status::OK();
+  }
+  DataKey data_key(kHashesDataTag, key,
+                   ParsedMetaValue(&meta_value).version(), field);
+  return db_->Get(read_options, handles_[kHashesFamily],
+                  data_key.Encode(), value);
+}
+
+Status Gilmour::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kHashes, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  fvs->reserve(fvs->size() + parsed_meta_value.count());
+  DataHandler handler = [fvs](const Slice& field, const Slice& value) {
+    fvs->push_back({field.ToString(), value.ToString()});
+    return true;
+  };
+  if (parsed_meta_value.packed()) {
+    return ScanPacked(read_options, kHashesDataTag, key, meta_value, handler);
+  }
+  return ScanData(read_options, kHashesDataTag, key,
+                  parsed_meta_value.version(), handler);
+}
+
+Status Gilmour::HKeys(const Slice& key, std::vector<std::string>* fields) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kHashes, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  fields->reserve(fields->size() + parsed_meta_value.count());
+  DataHandler handler = [fields](const Slice& field, const Slice& value) {
+    fields->push_back(field.ToString());
+    return true;
+  };
+  if (parsed_meta_value.packed()) {
+    return ScanPacked(read_options, kHashesDataTag, key, meta_value, handler);
+  }
+  return ScanData(read_options, kHashesDataTag, key,
+                  parsed_meta_value.version(), handler);
+}
+
+Status Gilmour::HDel(const Slice& key, const std::vector<std::string>& fields,
+                     int32_t* ret) {
+  *ret = 0;
+  std::unordered_set<std::string> filtered_fields(fields.begin(),
+                                                  fields.end());
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kHashes, &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+
+  if (ParsedMetaValue(&meta_value).packed()) {
+    std::string packed;
+    std::map<std::string, std::string> entries;
+    s = ReadPacked(rocksdb::ReadOptions(), kHashesDataTag, key, meta_value,
+                   &packed, &entries);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto& field : filtered_fields) {
+      *ret += static_cast<int32_t>(entries.erase(field));
+    }
+    if (*ret == 0) {
+      return Status::OK();
+    }
+    WritePacked(kHashesDataTag, key, &meta_value, entries, &batch);
+    return db_->Write(rocksdb::WriteOptions(), &batch);
+  }
+
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  std::string value;
+  for (const auto& field : filtered_fields) {
+    DataKey data_key(kHashesDataTag, key, parsed_meta_value.version(), field);
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kHashesFamily],
+                 data_key.Encode(), &value);
+    if (s.ok()) {
+      (*ret)++;
+      batch.Delete(handles_[kHashesFamily], data_key.Encode());
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+  }
+  if (*ret == 0) {
+    return Status::OK();
+  }
+  parsed_meta_value.ModifyCount(-*ret);
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    UpdateKeyStatistics(key, *ret);
+  }
+  return s;
+}
+
+Status Gilmour::HLen(const Slice& key, int32_t* ret) {
+  *ret = 0;
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kHashes, &meta_value);
+  if (s.ok()) {
+    *ret = ParsedMetaValue(&meta_value).count();
+  }
+  return s;
+}
+
+Status Gilmour::SAdd(const Slice& key, const std::vector<std::string>& members,
+                     int32_t* ret) {
+  *ret = 0;
+  if (members.empty()) {
+    return Status::OK();
+  }
+  std::unordered_set<std::string> filtered_members(members.begin(),
+                                                   members.end());
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kSets, &meta_value);
+  if (UsePacked(s, kSets, &meta_value)) {
+    std::string packed;
+    std::map<std::string, std::string> entries;
+    s = ReadPacked(rocksdb::ReadOptions(), kSetsDataTag, key, meta_value,
+                   &packed, &entries);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto& member : filtered_members) {
+      *ret += entries.insert(std::make_pair(member, "")).second ? 1 : 0;
+    }
+    if (*ret == 0) {
+      return Status::OK();
+    }
+    WritePacked(kSetsDataTag, key, &meta_value, entries, &batch);
+  } else if (s.ok()) {
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    std::string value;
+    for (const auto& member : filtered_members) {
+      DataKey data_key(kSetsDataTag, key, parsed_meta_value.version(), member);
+      s = db_->Get(rocksdb::ReadOptions(), handles_[kSetsFamily],
+                   data_key.Encode(), &value);
+      if (s.IsNotFound()) {
+        (*ret)++;
+        batch.Put(handles_[kSetsFamily], data_key.Encode(), Slice());
+      } else if (!s.ok()) {
+        return s;
+      }
+    }
+    if (*ret == 0) {
+      return Status::OK();
+    }
+    parsed_meta_value.ModifyCount(*ret);
+    batch.Put(MetaKey(key).Encode(), meta_value);
+  } else if (s.IsNotFound()) {
+    uint64_t version = NewVersion();
+    *ret = static_cast<int32_t>(filtered_members.size());
+    batch.Put(MetaKey(key).Encode(), EncodeMetaValue(kSets, 0, version, *ret));
+    for (const auto& member : filtered_members) {
+      DataKey data_key(kSetsDataTag, key, version, member);
+      batch.Put(handles_[kSetsFamily], data_key.Encode(), Slice());
+    }
+  } else {
+    return s;
+  }
+  return db_->Write(rocksdb::WriteOptions(), &batch);
 }
+
+Status Gilmour::SRem(const Slice& key, const std::vector<std::string>& members,
+                     int32_t* ret) {
+  *ret = 0;
+  std::unordered_set<std::string> filtered_members(members.begin(),
+                                                   members.end());
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kSets, &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+
+  if (ParsedMetaValue(&meta_value).packed()) {
+    std::string packed;
+    std::map<std::string, std::string> entries;
+    s = ReadPacked(rocksdb::ReadOptions(), kSetsDataTag, key, meta_value,
+                   &packed, &entries);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto& member : filtered_members) {
+      *ret += static_cast<int32_t>(entries.erase(member));
+    }
+    if (*ret == 0) {
+      return Status::OK();
+    }
+    WritePacked(kSetsDataTag, key, &meta_value, entries, &batch);
+    return db_->Write(rocksdb::WriteOptions(), &batch);
+  }
+
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  std::string value;
+  for (const auto& member : filtered_members) {
+    DataKey data_key(kSetsDataTag, key, parsed_meta_value.version(), member);
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kSetsFamily],
+                 data_key.Encode(), &value);
+    if (s.ok()) {
+      (*ret)++;
+      batch.Delete(handles_[kSetsFamily], data_key.Encode());
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+  }
+  if (*ret == 0) {
+    return Status::OK();
+  }
+  parsed_meta_value.ModifyCount(-*ret);
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    UpdateKeyStatistics(key, *ret);
+  }
+  return s;
+}
+
+Status Gilmour::SMembers(const Slice& key, std::vector<std::string>* members) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  members->reserve(members->size() + parsed_meta_value.count());
+  DataHandler handler = [members](const Slice& member, const Slice& value) {
+    members->push_back(member.ToString());
+    return true;
+  };
+  if (parsed_meta_value.packed()) {
+    return ScanPacked(read_options, kSetsDataTag, key, meta_value, handler);
+  }
+  return ScanData(read_options, kSetsDataTag, key,
+                  parsed_meta_value.version(), handler);
+}
+
+Status Gilmour::SIsMember(const Slice& key, const Slice& member,
+                          int32_t* ret) {
+  *ret = 0;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string value;
+  if (ParsedMetaValue(&meta_value).packed()) {
+    s = ReadPacked(read_options, kSetsDataTag, key, meta_value, &value);
+    uint32_t index;
+    if (s.ok() && PackedEntries(value, false).Find(member, &index)) {
+      *ret = 1;
+    }
+    return s;
+  }
+  DataKey data_key(kSetsDataTag, key,
+                   ParsedMetaValue(&meta_value).version(), member);
+  s = db_->Get(read_options, handles_[kSetsFamily], data_key.Encode(), &value);
+  if (s.ok()) {
+    *ret = 1;
+  }
+  return s.IsNotFound() ? Status::OK() : s;
+}
+
+Status Gilmour::SCard(const Slice& key, int32_t* ret) {
+  *ret = 0;
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kSets, &meta_value);
+  if (s.ok()) {
+    *ret = ParsedMetaValue(&meta_value).count();
+  }
+  return s;
+}
+
+Status Gilmour::ZAdd(const Slice& key,
+                     const std::vector<ScoreMember>& score_members,
+                     int32_t* ret) {
+  *ret = 0;
+  if (score_members.empty()) {
+    return Status::OK();
+  }
+  // The last score of a duplicated member wins
+  std::unordered_set<std::string> members;
+  std::vector<const ScoreMember*> filtered_sms;
+  for (auto iter = score_members.rbegin();
+       iter != score_members.rend(); ++iter) {
+    if (members.insert(iter->member).second) {
+      filtered_sms.push_back(&*iter);
+    }
+  }
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  uint64_t version;
+  bool exists;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kZSets, &meta_value);
+  if (s.ok()) {
+    exists = true;
+    version = ParsedMetaValue(&meta_value).version();
+  } else if (s.IsNotFound()) {
+    exists = false;
+    version = NewVersion();
+    meta_value = EncodeMetaValue(kZSets, 0, version, 0);
+  } else {
+    return s;
+  }
+
+  // The changes the index of the zset, if it has one, goes through
+  // once the batch is written
+  std::shared_ptr<ZSetIndex> index = exists ? FindZSetIndex(key, version)
+                                            : nullptr;
+  std::vector<std::pair<double, const std::string*>> removed;
+  std::vector<const ScoreMember*> inserted;
+
+  char score_buf[kScoreLength];
+  std::string score_member;
+  std::string old_score;
+  int64_t deleted = 0;
+  for (const auto sm : filtered_sms) {
+    DataKey member_key(kZSetsMemberTag, key, version, sm->member);
+    if (exists) {
+      s = db_->Get(rocksdb::ReadOptions(), handles_[kZSetsMemberFamily],
+                   member_key.Encode(), &old_score);
+    } else {
+      s = Status::NotFound();
+    }
+    if (s.ok()) {
+      double score;
+      memcpy(&score, old_score.data(), sizeof(score));
+      if (score == sm->score) {
+        continue;
+      }
+      EncodeScore(score_buf, score);
+      score_member.assign(score_buf, kScoreLength);
+      score_member.append(sm->member);
+      DataKey score_key(kZSetsScoreTag, key, version, score_member);
+      batch.Delete(handles_[kZSetsScoreFamily], score_key.Encode());
+      deleted++;
+      if (index != nullptr) {
+        removed.push_back(std::make_pair(score, &sm->member));
+      }
+    } else if (s.IsNotFound()) {
+      (*ret)++;
+    } else {
+      return s;
+    }
+    batch.Put(handles_[kZSetsMemberFamily], member_key.Encode(),
+              Slice(reinterpret_cast<const char*>(&sm->score), kScoreLength));
+    EncodeScore(score_buf, sm->score);
+    score_member.assign(score_buf, kScoreLength);
+    score_member.append(sm->member);
+    DataKey score_key(kZSetsScoreTag, key, version, score_member);
+    batch.Put(handles_[kZSetsScoreFamily], score_key.Encode(), Slice());
+    if (index != nullptr) {
+      inserted.push_back(sm);
+    }
+  }
+  if (*ret != 0 || !exists) {
+    ParsedMetaValue(&meta_value).ModifyCount(*ret);
+    batch.Put(MetaKey(key).Encode(), meta_value);
+  }
+  // The readers of the index hold its mutex too, they see the zset
+  // either before or after the batch with an index which matches
+  std::unique_lock<std::mutex> index_lock;
+  if (index != nullptr) {
+    index_lock = std::unique_lock<std::mutex>(*index->mutex());
+  }
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    for (const auto& score_member : removed) {
+      index->Remove(score_member.first, *score_member.second);
+    }
+    for (const auto sm : inserted) {
+      index->Insert(sm->score, sm->member);
+    }
+    UpdateKeyStatistics(key, deleted);
+  }
+  return s;
+}
+
+Status Gilmour::ZScore(const Slice& key, const Slice& member, double* score) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kZSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string value;
+  DataKey member_key(kZSetsMemberTag, key,
+                     ParsedMetaValue(&meta_value).version(), member);
+  s = db_->Get(read_options, handles_[kZSetsMemberFamily],
+               member_key.Encode(), &value);
+  if (s.ok()) {
+    memcpy(score, value.data(), sizeof(*score));
+  }
+  return s;
+}
+
+Status Gilmour::ZRange(const Slice& key, int32_t start, int32_t stop,
+                       std::vector<ScoreMember>* score_members) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kZSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (parsed_meta_value.count() >= zset_index_min_members_
+    && ReadZSetIndex(key, [&](const ZSetIndex& index, uint64_t version) {
+         if (NormalizeRange(index.size(), &start, &stop)) {
+           index.Range(start, stop, score_members);
+         }
+         return Status::OK();
+       }, &s)) {
+    return s;
+  }
+  if (!NormalizeRange(parsed_meta_value.count(), &start, &stop)) {
+    return Status::OK();
+  }
+
+  int32_t index = 0;
+  return ScanData(read_options, kZSetsScoreTag, key,
+                  parsed_meta_value.version(),
+                  [&](const Slice& score_member, const Slice& value) {
+                    if (index >= start) {
+                      score_members->push_back({
+                        DecodeScore(score_member.data()),
+                        std::string(score_member.data() + kScoreLength,
+                                    score_member.size() - kScoreLength)});
+                    }
+                    return ++index <= stop;
+                  });
+}
+
+Status Gilmour::ZRangeByScore(const Slice& key, double min, double max,
+                              std::vector<ScoreMember>* score_members) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kZSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (parsed_meta_value.count() >= zset_index_min_members_
+    && ReadZSetIndex(key, [&](const ZSetIndex& index, uint64_t version) {
+         index.RangeByScore(min, max, score_members);
+         return Status::OK();
+       }, &s)) {
+    return s;
+  }
+
+  // The score keys sort by score, the scan starts at the first one
+  // not less than min and stops after the last one not greater than max
+  char min_buf[kScoreLength];
+  char max_buf[kScoreLength];
+  EncodeScore(min_buf, min);
+  EncodeScore(max_buf, max);
+  return ScanData(read_options, kZSetsScoreTag, key,
+                  parsed_meta_value.version(),
+                  [&](const Slice& score_member, const Slice& value) {
+                    if (memcmp(score_member.data(), max_buf,
+                               kScoreLength) > 0) {
+                      return false;
+                    }
+                    score_members->push_back({
+                      DecodeScore(score_member.data()),
+                      std::string(score_member.data() + kScoreLength,
+                                  score_member.size() - kScoreLength)});
+                    return true;
+                  }, Slice(min_buf, kScoreLength));
+}
+
+Status Gilmour::ZRank(const Slice& key, const Slice& member,
+                      int32_t* rank) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kZSets, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  std::string value;
+  if (parsed_meta_value.count() >= zset_index_min_members_
+    && ReadZSetIndex(key, [&](const ZSetIndex& index, uint64_t version) {
+         // Read after the index is locked, so the score is the one
+         // the index holds
+         DataKey member_key(kZSetsMemberTag, key, version, member);
+         Status get_s = db_->Get(rocksdb::ReadOptions(),
+                                 handles_[kZSetsMemberFamily],
+                                 member_key.Encode(), &value);
+         if (!get_s.ok()) {
+           return get_s;
+         }
+         double score;
+         memcpy(&score, value.data(), sizeof(score));
+         int64_t index_rank = index.Rank(score, member);
+         if (index_rank < 0) {
+           return Status::Corruption("Member missing from the zset index");
+         }
+         *rank = static_cast<int32_t>(index_rank);
+         return Status::OK();
+       }, &s)) {
+    return s;
+  }
+
+  DataKey member_key(kZSetsMemberTag, key,
+                     parsed_meta_value.version(), member);
+  s = db_->Get(read_options, handles_[kZSetsMemberFamily],
+               member_key.Encode(), &value);
+  if (!s.ok()) {
+    return s;
+  }
+  // Counts the score keys before the one of member
+  double score;
+  memcpy(&score, value.data(), sizeof(score));
+  std::string target(kScoreLength, '\0');
+  EncodeScore(&target[0], score);
+  target.append(member.data(), member.size());
+  int32_t index = 0;
+  bool found = false;
+  s = ScanData(read_options, kZSetsScoreTag, key,
+               parsed_meta_value.version(),
+               [&](const Slice& score_member, const Slice& value) {
+                 if (score_member == target) {
+                   found = true;
+                   return false;
+                 }
+                 index++;
+                 return true;
+               });
+  if (!s.ok()) {
+    return s;
+  } else if (!found) {
+    return Status::Corruption("Score key missing");
+  }
+  *rank = index;
+  return s;
+}
+
+Status Gilmour::ZRem(const Slice& key, const std::vector<std::string>& members,
+                     int32_t* ret) {
+  *ret = 0;
+  std::unordered_set<std::string> filtered_members(members.begin(),
+                                                   members.end());
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kZSets, &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  std::shared_ptr<ZSetIndex> index =
+    FindZSetIndex(key, parsed_meta_value.version());
+  std::vector<std::pair<double, const std::string*>> removed;
+  char score_buf[kScoreLength];
+  std::string score_member;
+  std::string value;
+  for (const auto& member : filtered_members) {
+    DataKey member_key(kZSetsMemberTag, key,
+                       parsed_meta_value.version(), member);
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kZSetsMemberFamily],
+                 member_key.Encode(), &value);
+    if (s.ok()) {
+      (*ret)++;
+      double score;
+      memcpy(&score, value.data(), sizeof(score));
+      EncodeScore(score_buf, score);
+      score_member.assign(score_buf, kScoreLength);
+      score_member.append(member);
+      DataKey score_key(kZSetsScoreTag, key,
+                        parsed_meta_value.version(), score_member);
+      batch.Delete(handles_[kZSetsMemberFamily], member_key.Encode());
+      batch.Delete(handles_[kZSetsScoreFamily], score_key.Encode());
+      if (index != nullptr) {
+        removed.push_back(std::make_pair(score, &member));
+      }
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+  }
+  if (*ret == 0) {
+    return Status::OK();
+  }
+  parsed_meta_value.ModifyCount(-*ret);
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  std::unique_lock<std::mutex> index_lock;
+  if (index != nullptr) {
+    index_lock = std::unique_lock<std::mutex>(*index->mutex());
+  }
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    for (const auto& score_member : removed) {
+      index->Remove(score_member.first, *score_member.second);
+    }
+    // Both the member key and the score key are deleted
+    UpdateKeyStatistics(key, *ret * 2);
+  }
+  return s;
+}
+
+Status Gilmour::ZCard(const Slice& key, int32_t* ret) {
+  *ret = 0;
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kZSets, &meta_value);
+  if (s.ok()) {
+    *ret = ParsedMetaValue(&meta_value).count();
+  }
+  return s;
+}
+
+Status Gilmour::LPush(const Slice& key, const std::vector<std::string>& values,
+                      int32_t* len) {
+  *len = 0;
+  if (values.empty()) {
+    return Status::OK();
+  }
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kLists, &meta_value);
+  bool exists = s.ok();
+  if (s.IsNotFound()) {
+    meta_value = EncodeListsMetaValue(0, NewVersion(), list_chunk_size_);
+  } else if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  uint64_t version = parsed_meta_value.version();
+  uint32_t chunk_size = parsed_meta_value.chunk_size();
+
+  // The head chunk is read and rewritten once, however many of the
+  // values go into it, a full one is left alone
+  uint64_t seq = parsed_meta_value.head();
+  uint32_t chunk_elements = exists ? parsed_meta_value.head_size() : 0;
+  std::string chunk;
+  if (chunk_elements > 0 && chunk_elements < chunk_size) {
+    ListChunkKey chunk_key(key, version, seq);
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kListsFamily],
+                 chunk_key.Encode(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // The values going in front of chunk, the last one first
+  std::vector<const std::string*> front;
+  auto put_chunk = [&]() {
+    std::string new_chunk;
+    for (auto iter = front.rbegin(); iter != front.rend(); ++iter) {
+      AppendChunkElement(&new_chunk, **iter);
+    }
+    new_chunk.append(chunk);
+    ListChunkKey chunk_key(key, version, seq);
+    batch.Put(handles_[kListsFamily], chunk_key.Encode(), new_chunk);
+    chunk_elements += front.size();
+  };
+  for (const auto& value : values) {
+    if (chunk_elements + front.size() == chunk_size) {
+      if (!front.empty()) {
+        put_chunk();
+      }
+      seq--;
+      chunk.clear();
+      chunk_elements = 0;
+      front.clear();
+    }
+    front.push_back(&value);
+  }
+  put_chunk();
+
+  parsed_meta_value.set_head(seq);
+  parsed_meta_value.set_head_size(chunk_elements);
+  parsed_meta_value.ModifyCount(static_cast<int32_t>(values.size()));
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    *len = parsed_meta_value.count();
+  }
+  return s;
+}
+
+Status Gilmour::RPush(const Slice& key, const std::vector<std::string>& values,
+                      int32_t* len) {
+  *len = 0;
+  if (values.empty()) {
+    return Status::OK();
+  }
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kLists, &meta_value);
+  bool exists = s.ok();
+  if (s.IsNotFound()) {
+    meta_value = EncodeListsMetaValue(0, NewVersion(), list_chunk_size_);
+  } else if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  uint64_t version = parsed_meta_value.version();
+  uint32_t chunk_size = parsed_meta_value.chunk_size();
+
+  // The tail chunk is read and rewritten once, however many of the
+  // values go into it, a full one is left alone
+  uint64_t seq = parsed_meta_value.tail();
+  uint32_t chunk_elements = exists ? parsed_meta_value.tail_size() : 0;
+  std::string chunk;
+  if (chunk_elements > 0 && chunk_elements < chunk_size) {
+    ListChunkKey chunk_key(key, version, seq);
+    s = db_->Get(rocksdb::ReadOptions(), handles_[kListsFamily],
+                 chunk_key.Encode(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  bool dirty = false;
+  auto put_chunk = [&]() {
+    ListChunkKey chunk_key(key, version, seq);
+    batch.Put(handles_[kListsFamily], chunk_key.Encode(), chunk);
+    if (seq == parsed_meta_value.head()) {
+      parsed_meta_value.set_head_size(chunk_elements);
+    }
+  };
+  for (const auto& value : values) {
+    if (chunk_elements == chunk_size) {
+      if (dirty) {
+        put_chunk();
+      }
+      seq++;
+      chunk.clear();
+      chunk_elements = 0;
+    }
+    AppendChunkElement(&chunk, value);
+    chunk_elements++;
+    dirty = true;
+  }
+  put_chunk();
+
+  parsed_meta_value.set_tail(seq);
+  parsed_meta_value.ModifyCount(static_cast<int32_t>(values.size()));
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    *len = parsed_meta_value.count();
+  }
+  return s;
+}
+
+Status Gilmour::LPop(const Slice& key, std::string* element) {
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kLists, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  uint64_t head = parsed_meta_value.head();
+  ListChunkKey chunk_key(key, parsed_meta_value.version(), head);
+  std::string chunk;
+  s = db_->Get(rocksdb::ReadOptions(), handles_[kListsFamily],
+               chunk_key.Encode(), &chunk);
+  if (!s.ok()) {
+    return s;
+  }
+  KeyDecoder decoder(chunk);
+  Slice first;
+  if (!decoder.GetLengthPrefixed(&first)) {
+    return Status::Corruption("List chunk");
+  }
+  element->assign(first.data(), first.size());
+
+  rocksdb::WriteBatch batch;
+  bool emptied = parsed_meta_value.head_size() == 1;
+  if (!emptied) {
+    batch.Put(handles_[kListsFamily], chunk_key.Encode(),
+              decoder.remaining());
+    parsed_meta_value.set_head_size(parsed_meta_value.head_size() - 1);
+  } else if (head != parsed_meta_value.tail()) {
+    // The next chunk is full, unless it is the tail
+    batch.Delete(handles_[kListsFamily], chunk_key.Encode());
+    parsed_meta_value.set_head_size(head + 1 == parsed_meta_value.tail()
+        ? parsed_meta_value.tail_size() : parsed_meta_value.chunk_size());
+    parsed_meta_value.set_head(head + 1);
+  } else {
+    batch.Delete(handles_[kListsFamily], chunk_key.Encode());
+    parsed_meta_value.set_head_size(0);
+  }
+  parsed_meta_value.ModifyCount(-1);
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok() && emptied) {
+    UpdateKeyStatistics(key, 1);
+  }
+  return s;
+}
+
+Status Gilmour::RPop(const Slice& key, std::string* element) {
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kLists, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  uint64_t tail = parsed_meta_value.tail();
+  ListChunkKey chunk_key(key, parsed_meta_value.version(), tail);
+  std::string chunk;
+  s = db_->Get(rocksdb::ReadOptions(), handles_[kListsFamily],
+               chunk_key.Encode(), &chunk);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<Slice> elements;
+  if (!DecodeChunk(chunk, &elements) || elements.empty()) {
+    return Status::Corruption("List chunk");
+  }
+  element->assign(elements.back().data(), elements.back().size());
+
+  rocksdb::WriteBatch batch;
+  bool emptied = elements.size() == 1;
+  if (!emptied) {
+    const Slice& last = elements[elements.size() - 2];
+    batch.Put(handles_[kListsFamily], chunk_key.Encode(),
+              Slice(chunk.data(), last.data() + last.size() - chunk.data()));
+  } else {
+    batch.Delete(handles_[kListsFamily], chunk_key.Encode());
+  }
+  if (tail == parsed_meta_value.head()) {
+    parsed_meta_value.set_head_size(parsed_meta_value.head_size() - 1);
+  } else if (emptied) {
+    parsed_meta_value.set_tail(tail - 1);
+  }
+  parsed_meta_value.ModifyCount(-1);
+  batch.Put(MetaKey(key).Encode(), meta_value);
+  s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok() && emptied) {
+    UpdateKeyStatistics(key, 1);
+  }
+  return s;
+}
+
+Status Gilmour::LIndex(const Slice& key, int32_t index,
+                       std::string* element) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kLists, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  int64_t count = parsed_meta_value.count();
+  int64_t position = index >= 0 ? index : count + index;
+  if (position < 0 || position >= count) {
+    return Status::NotFound("Index out of range");
+  }
+
+  // One Get of the chunk the element is in
+  uint64_t seq;
+  uint32_t offset;
+  parsed_meta_value.Locate(position, &seq, &offset);
+  ListChunkKey chunk_key(key, parsed_meta_value.version(), seq);
+  std::string chunk;
+  s = db_->Get(read_options, handles_[kListsFamily], chunk_key.Encode(),
+               &chunk);
+  if (!s.ok()) {
+    return s;
+  }
+  KeyDecoder decoder(chunk);
+  Slice found;
+  for (uint32_t i = 0; i <= offset; i++) {
+    if (!decoder.GetLengthPrefixed(&found)) {
+      return Status::Corruption("List chunk");
+    }
+  }
+  element->assign(found.data(), found.size());
+  return s;
+}
+
+Status Gilmour::LRange(const Slice& key, int32_t start, int32_t stop,
+                       std::vector<std::string>* elements) {
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = GetMeta(read_options, key, kLists, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedListsMetaValue parsed_meta_value(&meta_value);
+  if (!NormalizeRange(parsed_meta_value.count(), &start, &stop)) {
+    return Status::OK();
+  }
+
+  // Seeks straight to the chunk of start, then reads the chunks in
+  // order until stop
+  uint64_t seq;
+  uint32_t offset;
+  parsed_meta_value.Locate(start, &seq, &offset);
+  char seq_buf[kChunkSeqLength];
+  EncodeBigEndian64(seq_buf, seq);
+  int64_t remaining = static_cast<int64_t>(stop) - start + 1;
+  elements->reserve(elements->size() + remaining);
+  return ScanData(read_options, kListsDataTag, key,
+                  parsed_meta_value.version(),
+                  [&](const Slice& suffix, const Slice& chunk) {
+                    KeyDecoder decoder(chunk);
+                    Slice element;
+                    while (remaining > 0
+                      && decoder.GetLengthPrefixed(&element)) {
+                      if (offset > 0) {
+                        offset--;
+                        continue;
+                      }
+                      elements->push_back(element.ToString());
+                      remaining--;
+                    }
+                    return remaining > 0;
+                  }, Slice(seq_buf, kChunkSeqLength));
+}
+
+Status Gilmour::LLen(const Slice& key, int32_t* len) {
+  *len = 0;
+  std::string meta_value;
+  Status s = GetMeta(rocksdb::ReadOptions(), key, kLists, &meta_value);
+  if (s.ok()) {
+    *len = ParsedMetaValue(&meta_value).count();
+  }
+  return s;
+}
+
+Status Gilmour::Compact() {
+  for (auto handle : handles_) {
+    Status s = db_->CompactRange(rocksdb::CompactRangeOptions(), handle,
+                                 nullptr, nullptr);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status Gilmour::CompactKey(const Slice& key) {
+  rocksdb::CompactRangeOptions compact_options;
+  MetaKey meta_key(key);
+  Slice meta_slice = meta_key.Encode();
+  Status s = db_->CompactRange(compact_options, handles_[kMetaFamily],
+                               &meta_slice, &meta_slice);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // [tag | key size | user key] covers every version of the key
+  const char tags[] = {kHashesDataTag, kSetsDataTag,
+                       kZSetsMemberTag, kZSetsScoreTag, kListsDataTag};
+  for (char tag : tags) {
+    DataKey data_key(tag, key, 0, Slice());
+    Slice begin = data_key.EncodeKeyPrefix();
+    std::string end_key = PrefixUpperBound(begin);
+    Slice end(end_key);
+    s = db_->CompactRange(compact_options, DataHandle(tag), &begin, &end);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+uint64_t Gilmour::GetProperty(const std::string& property) {
+  if (property == "gilmour.preloaded-keys") {
+    return preloaded_keys_;
+  } else if (property == "gilmour.preload-running") {
+    return preload_running_ ? 1 : 0;
+  } else if (property == "gilmour.zset-indexes") {
+    return zset_indexes_ != nullptr ? zset_indexes_->size() : 0;
+  } else if (property == "gilmour.zset-index-bytes") {
+    return zset_indexes_ != nullptr
+      ? zset_indexes_->ApproximateMemoryUsage() : 0;
+  }
+  uint64_t value = 0;
+  db_->GetAggregatedIntProperty(property, &value);
+  return value;
+}
+
+bool Gilmour::ReadZSetIndex(const Slice& key, const ZSetIndexReader& reader,
+                            Status* s) {
+  if (zset_indexes_ == nullptr) {
+    return false;
+  }
+  std::string meta_value;
+  std::shared_ptr<ZSetIndex> index = zset_indexes_->Lookup(key);
+  if (index != nullptr) {
+    // The writers update the index holding its mutex, the meta read
+    // with it held matches the index unless the index is stale
+    std::lock_guard<std::mutex> l(*index->mutex());
+    *s = GetMeta(rocksdb::ReadOptions(), key, kZSets, &meta_value);
+    if (!s->ok()) {
+      return true;
+    }
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    if (parsed_meta_value.version() == index->version()
+      && parsed_meta_value.count() == index->size()) {
+      *s = reader(*index, index->version());
+      return true;
+    }
+  }
+
+  // Built holding the record lock, so no write gets in between
+  // the scan of the score keys and the insertion into the cache
+  ScopeRecordLock l(lock_mgr_, key);
+  *s = GetMeta(rocksdb::ReadOptions(), key, kZSets, &meta_value);
+  if (!s->ok()) {
+    return true;
+  }
+  ParsedMetaValue parsed_meta_value(&meta_value);
+  if (parsed_meta_value.count() < zset_index_min_members_) {
+    zset_indexes_->Erase(key);
+    return false;
+  }
+  index = std::make_shared<ZSetIndex>(parsed_meta_value.version());
+  *s = ScanData(rocksdb::ReadOptions(), kZSetsScoreTag, key,
+                index->version(),
+                [&index](const Slice& score_member, const Slice& value) {
+                  index->Insert(DecodeScore(score_member.data()),
+                                Slice(score_member.data() + kScoreLength,
+                                      score_member.size() - kScoreLength));
+                  return true;
+                });
+  if (!s->ok()) {
+    return true;
+  }
+  zset_indexes_->Insert(key, index);
+  std::lock_guard<std::mutex> index_lock(*index->mutex());
+  *s = reader(*index, index->version());
+  return true;
+}
+
+std::shared_ptr<ZSetIndex> Gilmour::FindZSetIndex(const Slice& key,
+                                                  uint64_t version) {
+  if (zset_indexes_ == nullptr) {
+    return nullptr;
+  }
+  std::shared_ptr<ZSetIndex> index = zset_indexes_->Lookup(key);
+  if (index != nullptr && index->version() != version) {
+    return nullptr;
+  }
+  return index;
+}
+
+void Gilmour::UpdateKeyStatistics(const Slice& key, int64_t count) {
+  if (small_compaction_threshold_ <= 0 || count <= 0) {
+    return;
+  }
+  std::string key_str = key.ToString();
+  {
+    std::lock_guard<std::mutex> l(statistics_mutex_);
+    if (key_statistics_.size() >= kMaxStatisticsKeys
+      && key_statistics_.find(key_str) == key_statistics_.end()) {
+      key_statistics_.clear();
+    }
+    int64_t& total = key_statistics_[key_str];
+    total += count;
+    if (total < small_compaction_threshold_) {
+      return;
+    }
+    key_statistics_.erase(key_str);
+  }
+
+  {
+    std::lock_guard<std::mutex> l(bg_mutex_);
+    bg_tasks_.push_back(key_str);
+  }
+  bg_cv_.notify_one();
+}
+
+void Gilmour::RunBGTask() {
+  auto wake_up = [this] { return bg_stop_ || !bg_tasks_.empty(); };
+  while (true) {
+    std::string key;
+    bool compact = false;
+    {
+      std::unique_lock<std::mutex> l(bg_mutex_);
+      if (expire_wheel_ == nullptr) {
+        bg_cv_.wait(l, wake_up);
+      } else {
+        // The expiry wheel ticks once a second
+        bg_cv_.wait_for(l, std::chrono::seconds(1), wake_up);
+      }
+      if (bg_stop_) {
+        return;
+      }
+      if (!bg_tasks_.empty()) {
+        key = bg_tasks_.front();
+        bg_tasks_.pop_front();
+        compact = true;
+      }
+    }
+    if (expire_wheel_ != nullptr) {
+      DeleteExpiredKeys();
+    }
+    if (compact) {
+      CompactKey(key);
+    }
+  }
+}
+
+void Gilmour::ScheduleExpire(const Slice& key, uint32_t etime) {
+  if (expire_wheel_ == nullptr) {
+    return;
+  }
+  std::string key_str = key.ToString();
+  std::lock_guard<std::mutex> l(expire_mutex_);
+  auto iter = expire_timers_.find(key_str);
+  if (iter != expire_timers_.end()) {
+    expire_wheel_->Cancel(iter->second);
+    iter->second = expire_wheel_->Add(etime, key_str);
+  } else {
+    expire_timers_[key_str] = expire_wheel_->Add(etime, key_str);
+  }
+}
+
+void Gilmour::DeleteExpiredKeys() {
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  std::vector<std::string> keys;
+  {
+    std::lock_guard<std::mutex> l(expire_mutex_);
+    expire_wheel_->Advance(now, [this, &keys](const std::string& key) {
+      expire_timers_.erase(key);
+      keys.push_back(key);
+    });
+  }
+
+  for (size_t start = 0; start < keys.size(); start += expire_batch_size_) {
+    std::vector<std::string> batch_keys(keys.begin() + start,
+        keys.begin() + std::min(keys.size(), start + expire_batch_size_));
+    MultiScopeRecordLock ml(lock_mgr_, batch_keys);
+    rocksdb::WriteBatch batch;
+    std::vector<std::pair<std::string, int64_t>> orphaned;
+    for (const auto& key : batch_keys) {
+      // The key may have been deleted, overwritten or given
+      // another ttl since its timer was set
+      MetaKey meta_key(key);
+      std::string meta_value;
+      Status s = db_->Get(rocksdb::ReadOptions(), meta_key.Encode(),
+                          &meta_value);
+      if (!s.ok()) {
+        continue;
+      }
+      ParsedMetaValue parsed_meta_value(&meta_value);
+      if (parsed_meta_value.etime() == 0 || parsed_meta_value.etime() > now) {
+        continue;
+      }
+      batch.Delete(meta_key.Encode());
+      if (parsed_meta_value.type() != kStrings) {
+        if (range_delete_threshold_ > 0
+          && parsed_meta_value.count() >= range_delete_threshold_) {
+          DeleteDataRange(handles_, &batch, parsed_meta_value.type(), key,
+                          parsed_meta_value.version());
+        }
+        orphaned.push_back(std::make_pair(key, DataKeysOf(&meta_value)));
+      }
+    }
+    if (batch.Count() == 0
+      || !db_->Write(rocksdb::WriteOptions(), &batch).ok()) {
+      continue;
+    }
+    for (const auto& key_count : orphaned) {
+      UpdateKeyStatistics(key_count.first, key_count.second);
+      if (zset_indexes_ != nullptr) {
+        zset_indexes_->Erase(key_count.first);
+      }
+    }
+  }
+}
+
+void Gilmour::PreloadHotKeys() {
+  std::vector<std::string> keys;
+  HotKeys::Load(db_->GetName() + "/" + kHotKeysFile, &keys);
+  int64_t now;
+  db_->GetEnv()->GetCurrentTime(&now);
+  for (const auto& key : keys) {
+    if (preload_stop_) {
+      break;
+    }
+    // Still hot unless the new workload says otherwise
+    hot_keys_->Add(key);
+    std::string meta_value;
+    Status s = db_->Get(rocksdb::ReadOptions(), MetaKey(key).Encode(),
+                        &meta_value);
+    preloaded_keys_++;
+    if (!s.ok()) {
+      continue;
+    }
+    ParsedMetaValue parsed_meta_value(&meta_value);
+    DataType type = parsed_meta_value.type();
+    if (type == kStrings || parsed_meta_value.IsStale(now)) {
+      continue;
+    }
+    for (char tag : DataTagsOf(type)) {
+      int members = 0;
+      ScanData(rocksdb::ReadOptions(), tag, key, parsed_meta_value.version(),
+               [&members](const Slice& suffix, const Slice& value) {
+                 return ++members < kPreloadMembers;
+               });
+    }
+  }
+  preload_running_ = false;
+}
+
+}  //  namespace gilmour
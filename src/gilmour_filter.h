@@ -0,0 +1,157 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_GILMOUR_FILTER_H_
+#define SRC_GILMOUR_FILTER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+
+#include "src/format.h"
+
+namespace gilmour {
+
+// The versions of the bulk loads being ingested. A load ingests the
+// data of its collections ahead of their metas, until it is done the
+// filter must not take them for orphans
+class LoadingVersions {
+ public:
+  LoadingVersions() : oldest_(kNone) {
+  }
+
+  void Add(uint64_t version) {
+    std::lock_guard<std::mutex> l(mutex_);
+    versions_.insert(version);
+    oldest_ = *versions_.begin();
+  }
+
+  void Remove(uint64_t version) {
+    std::lock_guard<std::mutex> l(mutex_);
+    versions_.erase(versions_.find(version));
+    oldest_ = versions_.empty() ? kNone : *versions_.begin();
+  }
+
+  // The data keys of this version and newer ones are kept
+  uint64_t oldest() const { return oldest_.load(); }
+
+ private:
+  static const uint64_t kNone = std::numeric_limits<uint64_t>::max();
+
+  std::mutex mutex_;
+  std::multiset<uint64_t> versions_;
+  std::atomic<uint64_t> oldest_;
+};
+
+// Lazy garbage collection of the entries nothing can reach anymore:
+//   * meta keys which are expired, or collections whose count is 0
+//   * data keys whose meta is gone, holds another type, is expired, or
+//     holds a newer version (the collection was deleted and recreated)
+//
+// Del and Expire only touch the meta, the data of a big collection
+// are dropped here when compaction reaches them. A removed entry is
+// turned into a deletion by rocksdb, so older entries of the same key
+// in deeper levels never come back. The data of a bulk load in
+// progress are kept, see LoadingVersions.
+class GilmourFilter : public rocksdb::CompactionFilter {
+ public:
+  GilmourFilter(rocksdb::DB* db, const LoadingVersions* loading_versions)
+      : db_(db), loading_versions_(loading_versions), meta_not_found_(false),
+        meta_type_(kStrings), meta_version_(0) {
+    rocksdb::Env::Default()->GetCurrentTime(&now_);
+  }
+
+  bool Filter(int level, const Slice& key, const Slice& value,
+              std::string* new_value, bool* value_changed) const override {
+    if (key.size() > 0 && key[0] == kMetaPrefix) {
+      return ParsedMetaValue(value).IsStale(now_);
+    }
+    // Compactions which run while the db is being opened
+    // can not read the meta yet, keep everything
+    if (db_ == nullptr || key.size() == 0 || !IsDataTag(key[0])) {
+      return false;
+    }
+
+    // Keep what can not be decoded rather than guess
+    ParsedDataKey parsed_data_key(key);
+    if (!parsed_data_key.ok()
+      || parsed_data_key.version() >= loading_versions_->oldest()) {
+      return false;
+    }
+    if (parsed_data_key.key() != cur_key_) {
+      // The data keys of a collection are adjacent in their
+      // family, the meta is read from the default family
+      // once for all of them
+      cur_key_ = parsed_data_key.key().ToString();
+      std::string meta_value;
+      Status s = db_->Get(rocksdb::ReadOptions(),
+                          EncodeMetaKey(cur_key_), &meta_value);
+      if (s.ok()) {
+        ParsedMetaValue parsed_meta_value(&meta_value);
+        meta_not_found_ = parsed_meta_value.IsStale(now_);
+        meta_type_ = parsed_meta_value.type();
+        meta_version_ = meta_type_ != kStrings
+          ? parsed_meta_value.version() : 0;
+      } else if (s.IsNotFound()) {
+        meta_not_found_ = true;
+      } else {
+        // Keep the entry when in doubt, the next
+        // compaction will try again
+        cur_key_.clear();
+        return false;
+      }
+    }
+
+    if (meta_not_found_
+      || meta_type_ != DataTagType(parsed_data_key.tag())) {
+      return true;
+    }
+    return parsed_data_key.version() < meta_version_;
+  }
+
+  const char* Name() const override { return "GilmourFilter"; }
+
+ private:
+  rocksdb::DB* db_;
+  const LoadingVersions* loading_versions_;
+  int64_t now_;
+  mutable std::string cur_key_;
+  mutable bool meta_not_found_;
+  mutable DataType meta_type_;
+  mutable uint64_t meta_version_;
+};
+
+class GilmourFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  // db_ptr points to the member the opened db is stored into
+  GilmourFilterFactory(rocksdb::DB** db_ptr,
+                       const LoadingVersions* loading_versions)
+      : db_ptr_(db_ptr), loading_versions_(loading_versions) {
+  }
+
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::unique_ptr<rocksdb::CompactionFilter>(
+        new GilmourFilter(*db_ptr_, loading_versions_));
+  }
+
+  const char* Name() const override { return "GilmourFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_;
+  const LoadingVersions* loading_versions_;
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_GILMOUR_FILTER_H_
@@ -0,0 +1,333 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "gilmour/glob_matcher.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GILMOUR_X86_SIMD 1
+#endif
+
+namespace gilmour {
+
+typedef const char* (*FindFunc)(const char* hay, size_t n,
+                                const char* needle, size_t m);
+
+// Returns the leftmost occurrence of needle inside hay, or nullptr
+static const char* FindScalar(const char* hay, size_t n,
+                              const char* needle, size_t m) {
+  if (m == 0) {
+    return hay;
+  }
+  const char* end = hay + n;
+  while (static_cast<size_t>(end - hay) >= m) {
+    const char* p = static_cast<const char*>(
+        memchr(hay, needle[0], end - hay - m + 1));
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (memcmp(p + 1, needle + 1, m - 1) == 0) {
+      return p;
+    }
+    hay = p + 1;
+  }
+  return nullptr;
+}
+
+#ifdef GILMOUR_X86_SIMD
+// PCMPESTRI in "equal ordered" mode reports the first offset of the block
+// where the needle starts, including needles cut off by the end of the
+// block, so one instruction tests 16 candidate positions. Only usable for
+// needles which fit in one register.
+__attribute__((target("sse4.2")))
+static const char* FindSSE42(const char* hay, size_t n,
+                             const char* needle, size_t m) {
+  if (m == 0 || m > 16) {
+    return FindScalar(hay, n, needle, m);
+  }
+  const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ORDERED
+    | _SIDD_LEAST_SIGNIFICANT;
+  char needle_buf[16] = {0};
+  memcpy(needle_buf, needle, m);
+  const __m128i nv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(needle_buf));
+
+  size_t i = 0;
+  while (i + 16 <= n) {
+    const __m128i hv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+    int idx = _mm_cmpestri(nv, static_cast<int>(m), hv, 16, mode);
+    if (idx == 16) {
+      i += 16;
+    } else if (idx + m <= 16) {
+      return hay + i + idx;
+    } else {
+      // Partial match at the tail of the block, restart from there
+      i += idx;
+    }
+  }
+  const char* p = FindScalar(hay + i, n - i, needle, m);
+  return p;
+}
+
+// Compare the first and the last byte of the needle against 32
+// consecutive positions at once, only the positions where both of
+// them are equal are verified with memcmp.
+__attribute__((target("avx2")))
+static const char* FindAVX2(const char* hay, size_t n,
+                            const char* needle, size_t m) {
+  if (m < 2 || n < m) {
+    return FindScalar(hay, n, needle, m);
+  }
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+
+  size_t i = 0;
+  while (i + m - 1 + 32 <= n) {
+    const __m256i block_first = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(hay + i));
+    const __m256i block_last = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(hay + i + m - 1));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                           _mm256_cmpeq_epi8(last, block_last))));
+    while (mask != 0) {
+      size_t bit = __builtin_ctz(mask);
+      if (memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+    i += 32;
+  }
+  return FindScalar(hay + i, n - i, needle, m);
+}
+#endif
+
+static FindFunc ChooseFind() {
+#ifdef GILMOUR_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return FindAVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return FindSSE42;
+  }
+#endif
+  return FindScalar;
+}
+
+static const char* FindLiteral(const char* hay, size_t n,
+                               const char* needle, size_t m) {
+  static const FindFunc find = ChooseFind();
+  return find(hay, n, needle, m);
+}
+
+unsigned char GlobMatcher::Fold(char c) const {
+  unsigned char u = static_cast<unsigned char>(c);
+  return nocase_ ? static_cast<unsigned char>(tolower(u)) : u;
+}
+
+GlobMatcher::GlobMatcher(const std::string& pattern, bool nocase)
+    : nocase_(nocase), has_star_(false) {
+  segments_.push_back(Segment());
+  const char* p = pattern.data();
+  const char* end = p + pattern.size();
+  while (p < end) {
+    Segment* segment = &segments_.back();
+    switch (*p) {
+      case '*':
+        // Consecutive stars are the same as one
+        while (p + 1 < end && p[1] == '*') {
+          p++;
+        }
+        has_star_ = true;
+        segments_.push_back(Segment());
+        break;
+      case '?':
+        segment->bytes.push_back('\0');
+        segment->kinds.push_back(kAnyByte);
+        segment->is_literal = false;
+        break;
+      case '[': {
+        std::bitset<256> set, escaped;
+        bool negate = false;
+        p++;
+        if (p < end && *p == '^') {
+          negate = true;
+          p++;
+        }
+        // Same as stringmatchlen(), an unterminated class
+        // swallows the rest of the pattern. With nocase the set is
+        // built from lower cased bytes, and the ends of a range are
+        // lower cased after they are ordered, so [Z-a] matches nothing.
+        // An escaped byte is compared with its case even then
+        while (p < end && *p != ']') {
+          if (*p == '\\' && p + 1 < end) {
+            p++;
+            escaped.set(static_cast<unsigned char>(*p));
+          } else if (p + 2 < end && p[1] == '-') {
+            unsigned char start = p[0], stop = p[2];
+            if (start > stop) {
+              std::swap(start, stop);
+            }
+            for (int c = Fold(start); c <= Fold(stop); c++) {
+              set.set(c);
+            }
+            p += 2;
+          } else {
+            set.set(Fold(*p));
+          }
+          p++;
+        }
+        if (nocase_) {
+          // A byte is in the class when its lower case is, lower
+          // case bytes map to themselves so this works in place
+          for (int c = 0; c < 256; c++) {
+            set[c] = set[tolower(c)];
+          }
+        }
+        set |= escaped;
+        if (negate) {
+          set.flip();
+        }
+        segment->bytes.push_back('\0');
+        segment->kinds.push_back(static_cast<int16_t>(classes_.size()));
+        segment->is_literal = false;
+        classes_.push_back(set);
+        break;
+      }
+      case '\\':
+        // A trailing backslash matches itself
+        if (p + 1 < end) {
+          p++;
+        }
+        // fall through
+      default:
+        if (segment->first_literal == -1) {
+          segment->first_literal = static_cast<int32_t>(segment->bytes.size());
+        }
+        segment->bytes.push_back(Fold(*p));
+        segment->kinds.push_back(kLiteral);
+        break;
+    }
+    p++;
+  }
+
+  for (auto& segment : segments_) {
+    segment.width = segment.bytes.size();
+    // The SIMD search compares raw bytes, a case insensitive
+    // literal takes the byte by byte path
+    if (nocase_) {
+      segment.is_literal = false;
+    }
+  }
+
+  if (!nocase_) {
+    const Segment& head = segments_.front();
+    for (size_t i = 0; i < head.width && head.kinds[i] == kLiteral; i++) {
+      prefix_.push_back(head.bytes[i]);
+    }
+  }
+}
+
+std::string GlobMatcher::PrefixUpperBound() const {
+  std::string bound = prefix_;
+  while (!bound.empty()) {
+    unsigned char c = static_cast<unsigned char>(bound.back());
+    if (c != 0xff) {
+      bound.back() = static_cast<char>(c + 1);
+      return bound;
+    }
+    bound.pop_back();
+  }
+  return bound;
+}
+
+bool GlobMatcher::MatchAt(const Segment& segment, const char* str) const {
+  if (segment.is_literal) {
+    return memcmp(str, segment.bytes.data(), segment.width) == 0;
+  }
+  for (size_t i = 0; i < segment.width; i++) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    int16_t kind = segment.kinds[i];
+    if (kind == kLiteral) {
+      if ((nocase_ ? tolower(c) : c)
+        != static_cast<unsigned char>(segment.bytes[i])) {
+        return false;
+      }
+    } else if (kind != kAnyByte && !classes_[kind].test(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char* GlobMatcher::Find(const Segment& segment,
+                              const char* str, size_t len) const {
+  if (segment.width > len) {
+    return nullptr;
+  }
+  if (segment.is_literal) {
+    return FindLiteral(str, len, segment.bytes.data(), segment.width);
+  }
+
+  const char* last = str + len - segment.width;
+  const char* p = str;
+  while (p <= last) {
+    // Skip to the next place where the first literal byte
+    // of the segment lines up, then verify the whole segment
+    if (!nocase_ && segment.first_literal != -1) {
+      const char* anchor = static_cast<const char*>(
+          memchr(p + segment.first_literal,
+                 segment.bytes[segment.first_literal], last - p + 1));
+      if (anchor == nullptr) {
+        return nullptr;
+      }
+      p = anchor - segment.first_literal;
+    }
+    if (MatchAt(segment, p)) {
+      return p;
+    }
+    p++;
+  }
+  return nullptr;
+}
+
+bool GlobMatcher::Match(const char* str, size_t len) const {
+  const Segment& head = segments_.front();
+  if (!has_star_) {
+    return len == head.width && MatchAt(head, str);
+  }
+
+  // Every segment has a fixed width, so the head must match at the
+  // beginning, the tail at the end, and the leftmost match of each
+  // middle segment is always the best choice.
+  const Segment& tail = segments_.back();
+  if (len < head.width + tail.width) {
+    return false;
+  }
+  if (!MatchAt(head, str)
+    || !MatchAt(tail, str + len - tail.width)) {
+    return false;
+  }
+
+  const char* p = str + head.width;
+  const char* end = str + len - tail.width;
+  for (size_t i = 1; i + 1 < segments_.size(); i++) {
+    const Segment& segment = segments_[i];
+    const char* found = Find(segment, p, end - p);
+    if (found == nullptr) {
+      return false;
+    }
+    p = found + segment.width;
+  }
+  return true;
+}
+
+}  //  namespace gilmour
@@ -0,0 +1,111 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/hot_keys.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "src/coding.h"
+
+namespace gilmour {
+
+HotKeys::HotKeys(size_t capacity)
+    : capacity_(capacity) {
+}
+
+void HotKeys::Record(const Slice& key) {
+  // Per thread, the calls which are not sampled take no lock
+  static thread_local uint32_t calls = 0;
+  if (++calls % kSampleRate != 0) {
+    return;
+  }
+  Add(key);
+}
+
+void HotKeys::Add(const Slice& key) {
+  std::lock_guard<std::mutex> l(mutex_);
+  counts_[key.ToString()]++;
+  if (counts_.size() >= 2 * capacity_) {
+    Decay();
+  }
+}
+
+void HotKeys::Decay() {
+  std::vector<std::pair<uint32_t, std::string>> entries;
+  entries.reserve(counts_.size());
+  for (const auto& key_count : counts_) {
+    entries.push_back({key_count.second, key_count.first});
+  }
+  size_t keep = std::min(capacity_, entries.size());
+  std::nth_element(entries.begin(), entries.begin() + keep, entries.end(),
+                   std::greater<std::pair<uint32_t, std::string>>());
+  counts_.clear();
+  for (size_t i = 0; i < keep; i++) {
+    counts_[entries[i].second] = std::max(entries[i].first / 2, 1u);
+  }
+}
+
+void HotKeys::Top(std::vector<std::string>* keys) {
+  std::vector<std::pair<uint32_t, std::string>> entries;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (const auto& key_count : counts_) {
+      entries.push_back({key_count.second, key_count.first});
+    }
+  }
+  std::sort(entries.begin(), entries.end(),
+            std::greater<std::pair<uint32_t, std::string>>());
+  keys->clear();
+  for (size_t i = 0; i < entries.size() && i < capacity_; i++) {
+    keys->push_back(entries[i].second);
+  }
+}
+
+Status HotKeys::Save(const std::string& path) {
+  std::vector<std::string> keys;
+  Top(&keys);
+  std::string tmp_path = path + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    return Status::IOError(tmp_path);
+  }
+  std::string buf;
+  for (const auto& key : keys) {
+    PutFixed32(&buf, static_cast<uint32_t>(key.size()));
+    buf.append(key);
+  }
+  bool ok = fwrite(buf.data(), 1, buf.size(), file) == buf.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    return Status::IOError(path);
+  }
+  return Status::OK();
+}
+
+Status HotKeys::Load(const std::string& path,
+                     std::vector<std::string>* keys) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return Status::NotFound(path);
+  }
+  keys->clear();
+  char size_buf[sizeof(uint32_t)];
+  while (fread(size_buf, 1, sizeof(size_buf), file) == sizeof(size_buf)) {
+    std::string key(DecodeFixed32(size_buf), '\0');
+    if (!key.empty() && fread(&key[0], 1, key.size(), file) != key.size()) {
+      fclose(file);
+      return Status::Corruption(path);
+    }
+    keys->push_back(key);
+  }
+  fclose(file);
+  return Status::OK();
+}
+
+}  //  namespace gilmour
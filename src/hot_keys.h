@@ -0,0 +1,61 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_HOT_KEYS_H_
+#define SRC_HOT_KEYS_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+
+namespace gilmour {
+
+using Slice = rocksdb::Slice;
+using Status = rocksdb::Status;
+
+// Approximate set of the most used keys. One in kSampleRate calls of
+// Record() counts its key, once twice the capacity keys are counted
+// the counts are halved and only the hottest capacity keys are kept,
+// so keys which were hot a long time ago age out.
+class HotKeys {
+ public:
+  static const uint32_t kSampleRate = 16;
+
+  explicit HotKeys(size_t capacity);
+
+  void Record(const Slice& key);
+  // Counts key once without sampling
+  void Add(const Slice& key);
+
+  // The hottest keys first, at most capacity of them
+  void Top(std::vector<std::string>* keys);
+
+  // The file is a run of key size(4) | key, replaced atomically
+  Status Save(const std::string& path);
+  static Status Load(const std::string& path,
+                     std::vector<std::string>* keys);
+
+ private:
+  // Called with mutex_ held
+  void Decay();
+
+  size_t capacity_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, uint32_t> counts_;
+
+  // No copying allowed
+  HotKeys(const HotKeys&);
+  void operator=(const HotKeys&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_HOT_KEYS_H_
@@ -0,0 +1,59 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/lock_mgr.h"
+
+#include <algorithm>
+
+namespace gilmour {
+
+LockMgr::LockMgr(size_t num_stripes)
+    : mutexes_(num_stripes) {
+}
+
+size_t LockMgr::StripeIndex(const Slice& key) const {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size(); i++) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash % mutexes_.size();
+}
+
+std::vector<size_t> LockMgr::SortedStripes(
+    const std::vector<std::string>& keys) const {
+  std::vector<size_t> stripes;
+  stripes.reserve(keys.size());
+  for (const auto& key : keys) {
+    stripes.push_back(StripeIndex(key));
+  }
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  return stripes;
+}
+
+void LockMgr::Lock(const Slice& key) {
+  mutexes_[StripeIndex(key)].lock();
+}
+
+void LockMgr::Unlock(const Slice& key) {
+  mutexes_[StripeIndex(key)].unlock();
+}
+
+void LockMgr::MultiLock(const std::vector<std::string>& keys) {
+  for (size_t stripe : SortedStripes(keys)) {
+    mutexes_[stripe].lock();
+  }
+}
+
+void LockMgr::MultiUnlock(const std::vector<std::string>& keys) {
+  std::vector<size_t> stripes = SortedStripes(keys);
+  for (auto iter = stripes.rbegin(); iter != stripes.rend(); ++iter) {
+    mutexes_[*iter].unlock();
+  }
+}
+
+}  //  namespace gilmour
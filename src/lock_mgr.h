@@ -0,0 +1,82 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_LOCK_MGR_H_
+#define SRC_LOCK_MGR_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+namespace gilmour {
+
+using Slice = rocksdb::Slice;
+
+// Serializes the read-modify-write of the same key, keys are
+// hashed onto a fixed number of mutexes
+class LockMgr {
+ public:
+  explicit LockMgr(size_t num_stripes);
+
+  void Lock(const Slice& key);
+  void Unlock(const Slice& key);
+
+  // Locks the stripes of all the keys in ascending
+  // order, so that two MultiLock never deadlock
+  void MultiLock(const std::vector<std::string>& keys);
+  void MultiUnlock(const std::vector<std::string>& keys);
+
+ private:
+  size_t StripeIndex(const Slice& key) const;
+  std::vector<size_t> SortedStripes(const std::vector<std::string>& keys) const;
+
+  std::vector<std::mutex> mutexes_;
+
+  // No copying allowed
+  LockMgr(const LockMgr&);
+  void operator=(const LockMgr&);
+};
+
+class ScopeRecordLock {
+ public:
+  ScopeRecordLock(LockMgr* lock_mgr, const Slice& key)
+      : lock_mgr_(lock_mgr), key_(key) {
+    lock_mgr_->Lock(key_);
+  }
+  ~ScopeRecordLock() {
+    lock_mgr_->Unlock(key_);
+  }
+
+ private:
+  LockMgr* const lock_mgr_;
+  Slice key_;
+
+  ScopeRecordLock(const ScopeRecordLock&);
+  void operator=(const ScopeRecordLock&);
+};
+
+class MultiScopeRecordLock {
+ public:
+  MultiScopeRecordLock(LockMgr* lock_mgr, const std::vector<std::string>& keys)
+      : lock_mgr_(lock_mgr), keys_(keys) {
+    lock_mgr_->MultiLock(keys_);
+  }
+  ~MultiScopeRecordLock() {
+    lock_mgr_->MultiUnlock(keys_);
+  }
+
+ private:
+  LockMgr* const lock_mgr_;
+  const std::vector<std::string>& keys_;
+
+  MultiScopeRecordLock(const MultiScopeRecordLock&);
+  void operator=(const MultiScopeRecordLock&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_LOCK_MGR_H_
@@ -0,0 +1,44 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <assert.h>
+
+#include "gilmour/gilmour.h"
+
+int main() {
+  gilmour::GilmourOptions options;
+  options.options.create_if_missing = true;
+
+  gilmour::Gilmour db;
+  std::string path = "./db";
+  gilmour::Status s = db.Open(options, path);
+  assert(s.ok());
+
+  std::string key = "key";
+  std::string value = "value";
+  s = db.Set(key, value);
+  assert(s.ok());
+
+  value.clear();
+  s = db.Get(key, &value);
+  assert(s.ok());
+  std::cout << key << " : " << value << std::endl;
+
+  int32_t ret = 0;
+  s = db.HSet("hash", "field", "value", &ret);
+  assert(s.ok());
+
+  std::vector<gilmour::FieldValue> fvs;
+  s = db.HGetall("hash", &fvs);
+  assert(s.ok());
+  for (const auto& fv : fvs) {
+    std::cout << "hash " << fv.field << " : " << fv.value << std::endl;
+  }
+
+  int64_t count = 0;
+  s = db.Del({key, "hash"}, &count);
+  assert(s.ok());
+  return 0;
+}
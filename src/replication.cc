@@ -0,0 +1,772 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "gilmour/replication.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "rocksdb/env.h"
+#include "rocksdb/transaction_log.h"
+
+#include "src/coding.h"
+#include "src/format.h"
+#include "src/scope_snapshot.h"
+
+namespace gilmour {
+
+// Every frame is type(1) | payload size(4) | payload
+//
+// Sync request  'Y' : next sequence(8), 0 asks for a full sync
+// Full sync     'F' : snapshot sequence(8), the replica drops its data,
+//                     the snapshot follows in segments
+// Segment       'S' : next sequence(8) | primary sequence(8) |
+//                     send time(8) | batches(4) | raw size(4) |
+//                     compressed(1) | body
+//
+// The raw body is a run of size(4) | write batch rep. The next sequence
+// of a segment is the position after its last batch, the segments of a
+// snapshot carry 0, a replica which stops in the middle of one starts
+// over. An empty segment is a heartbeat.
+static const char kSyncRequest = 'Y';
+static const char kFullSync = 'F';
+static const char kSegment = 'S';
+static const size_t kFrameHeaderSize = 1 + sizeof(uint32_t);
+static const size_t kSegmentHeaderSize = 3 * sizeof(uint64_t)
+  + 2 * sizeof(uint32_t) + 1;
+// A segment larger than this is a broken stream
+static const uint32_t kMaxFrameSize = 256 << 20;
+// How long a sender waits for new writes before looking again
+static const int kPollMicros = 1000;
+static const int kReconnectMillis = 1000;
+
+// A replica going away must not raise SIGPIPE in the primary
+static bool WriteFull(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool ReadFull(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool WriteFrame(int fd, char type, const std::string& payload) {
+  char header[kFrameHeaderSize];
+  header[0] = type;
+  EncodeFixed32(header + 1, static_cast<uint32_t>(payload.size()));
+  return WriteFull(fd, header, sizeof(header))
+    && WriteFull(fd, payload.data(), payload.size());
+}
+
+static bool ReadFrame(int fd, char* type, std::string* payload) {
+  char header[kFrameHeaderSize];
+  if (!ReadFull(fd, header, sizeof(header))) {
+    return false;
+  }
+  *type = header[0];
+  uint32_t size = DecodeFixed32(header + 1);
+  if (size > kMaxFrameSize) {
+    return false;
+  }
+  payload->resize(size);
+  return size == 0 || ReadFull(fd, &(*payload)[0], size);
+}
+
+static int ConnectTo(const std::string& address) {
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return -1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(address.c_str() + colon + 1));
+  if (inet_pton(AF_INET, address.substr(0, colon).c_str(),
+                &addr.sin_addr) != 1) {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+// FNV-1a of the user key, decides the applier of a write
+static uint64_t HashKey(const Slice& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size(); i++) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Splits a write batch of the primary by the applier of every key.
+// Both sides create the column families of Gilmour in the same
+// order, a family has the same id on the primary and the replica.
+// The internal keys of the primary are dropped, the replica keeps
+// its own
+class BatchSplitter : public rocksdb::WriteBatch::Handler {
+ public:
+  BatchSplitter(const std::vector<rocksdb::WriteBatch*>& parts,
+                const std::vector<rocksdb::ColumnFamilyHandle*>& handles)
+      : parts_(parts), handles_(handles) {
+  }
+
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    rocksdb::ColumnFamilyHandle* handle = HandleOf(column_family_id);
+    if (handle == nullptr) {
+      return Status::NotSupported("Column family");
+    } else if (IsInternal(key)) {
+      return Status::OK();
+    }
+    PartOf(key)->Put(handle, key, value);
+    return Status::OK();
+  }
+
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    rocksdb::ColumnFamilyHandle* handle = HandleOf(column_family_id);
+    if (handle == nullptr) {
+      return Status::NotSupported("Column family");
+    } else if (IsInternal(key)) {
+      return Status::OK();
+    }
+    PartOf(key)->Delete(handle, key);
+    return Status::OK();
+  }
+
+  // The range tombstones of Gilmour cover the data of one version
+  // of one key, begin_key holds that key
+  Status DeleteRangeCF(uint32_t column_family_id, const Slice& begin_key,
+                       const Slice& end_key) override {
+    rocksdb::ColumnFamilyHandle* handle = HandleOf(column_family_id);
+    if (handle == nullptr) {
+      return Status::NotSupported("Column family");
+    } else if (IsInternal(begin_key)) {
+      return Status::OK();
+    }
+    PartOf(begin_key)->DeleteRange(handle, begin_key, end_key);
+    return Status::OK();
+  }
+
+  Status SingleDeleteCF(uint32_t, const Slice&) override {
+    return Status::NotSupported("SingleDelete");
+  }
+
+  Status MergeCF(uint32_t, const Slice&, const Slice&) override {
+    return Status::NotSupported("Merge");
+  }
+
+ private:
+  static bool IsInternal(const Slice& key) {
+    return !key.empty() && key[0] == kInternalPrefix;
+  }
+
+  rocksdb::WriteBatch* PartOf(const Slice& key) {
+    return parts_[HashKey(UserKeyOf(key)) % parts_.size()];
+  }
+
+  rocksdb::ColumnFamilyHandle* HandleOf(uint32_t column_family_id) {
+    for (auto handle : handles_) {
+      if (handle->GetID() == column_family_id) {
+        return handle;
+      }
+    }
+    return nullptr;
+  }
+
+  const std::vector<rocksdb::WriteBatch*>& parts_;
+  const std::vector<rocksdb::ColumnFamilyHandle*>& handles_;
+};
+
+ReplicationMaster::ReplicationMaster(Gilmour* db,
+                                     const ReplicationOptions& options)
+    : db_(db),
+      options_(options),
+      listen_fd_(-1),
+      stop_(false) {
+}
+
+ReplicationMaster::~ReplicationMaster() {
+  Stop();
+}
+
+Status ReplicationMaster::Start(int port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ == -1) {
+    return Status::IOError("socket", strerror(errno));
+  }
+  int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) == -1 || listen(listen_fd_, 16) == -1) {
+    Status s = Status::IOError("bind", strerror(errno));
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return s;
+  }
+  accept_thread_ = std::thread(&ReplicationMaster::AcceptLoop, this);
+  return Status::OK();
+}
+
+void ReplicationMaster::Stop() {
+  if (listen_fd_ == -1) {
+    return;
+  }
+  stop_ = true;
+  // Wakes up the accept() and the reads of the senders
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+  std::vector<std::thread> senders;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (int fd : fds_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    senders.swap(senders_);
+    finished_.clear();
+  }
+  for (auto& sender : senders) {
+    sender.join();
+  }
+}
+
+void ReplicationMaster::GetStats(ReplicationStats* stats) {
+  std::lock_guard<std::mutex> l(mutex_);
+  *stats = stats_;
+  stats->connections = fds_.size();
+  stats->primary_sequence = db_->db_->GetLatestSequenceNumber();
+}
+
+void ReplicationMaster::AcceptLoop() {
+  while (!stop_) {
+    int fd = accept(listen_fd_, NULL, NULL);
+    if (fd == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    // The senders of the replicas which went away are joined here, a
+    // replica reconnecting again and again does not pile them up
+    std::vector<std::thread> finished;
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      for (std::thread::id id : finished_) {
+        auto iter = std::find_if(senders_.begin(), senders_.end(),
+                                 [id](const std::thread& sender) {
+                                   return sender.get_id() == id;
+                                 });
+        finished.push_back(std::move(*iter));
+        senders_.erase(iter);
+      }
+      finished_.clear();
+      fds_.push_back(fd);
+      senders_.emplace_back(&ReplicationMaster::Serve, this, fd);
+    }
+    for (auto& sender : finished) {
+      sender.join();
+    }
+  }
+}
+
+void ReplicationMaster::Serve(int fd) {
+  rocksdb::DB* db = db_->db_;
+  char type;
+  std::string payload;
+  uint64_t next = 0;
+  bool ok = ReadFrame(fd, &type, &payload) && type == kSyncRequest
+    && payload.size() == sizeof(uint64_t);
+  if (ok) {
+    next = DecodeFixed64(payload.data());
+    // The position must still be in the WAL, a replica ahead of the
+    // latest sequence was synced from another db
+    uint64_t latest = db->GetLatestSequenceNumber();
+    bool full = next == 0 || next > latest + 1;
+    if (!full && next <= latest) {
+      std::unique_ptr<rocksdb::TransactionLogIterator> iter;
+      Status s = db->GetUpdatesSince(next, &iter);
+      full = !s.ok() || !iter->Valid() || iter->GetBatch().sequence > next;
+    }
+    if (full) {
+      ok = SendSnapshot(fd, &next);
+    }
+  }
+
+  std::string batches;
+  int count = 0;
+  uint64_t last_send = db->GetEnv()->NowMicros();
+  uint64_t heartbeat = static_cast<uint64_t>(options_.heartbeat_ms) * 1000;
+  while (ok && !stop_) {
+    if (db->GetLatestSequenceNumber() < next) {
+      if (db->GetEnv()->NowMicros() - last_send >= heartbeat) {
+        ok = SendSegment(fd, batches, 0, next);
+        last_send = db->GetEnv()->NowMicros();
+      } else {
+        usleep(kPollMicros);
+      }
+      continue;
+    }
+    std::unique_ptr<rocksdb::TransactionLogIterator> iter;
+    Status s = db->GetUpdatesSince(next, &iter);
+    if (!s.ok()) {
+      break;
+    }
+    for (; ok && iter->Valid(); iter->Next()) {
+      rocksdb::BatchResult result = iter->GetBatch();
+      uint64_t end = result.sequence + result.writeBatchPtr->Count();
+      // GetUpdatesSince() starts at the batch holding next
+      if (end <= next) {
+        continue;
+      }
+      const std::string& rep = result.writeBatchPtr->Data();
+      PutFixed32(&batches, static_cast<uint32_t>(rep.size()));
+      batches.append(rep);
+      count++;
+      next = end;
+      if (batches.size() >= options_.segment_size) {
+        ok = SendSegment(fd, batches, count, next);
+        batches.clear();
+        count = 0;
+      }
+    }
+    if (!iter->status().ok()) {
+      break;
+    }
+    if (ok && count > 0) {
+      ok = SendSegment(fd, batches, count, next);
+      batches.clear();
+      count = 0;
+    }
+    last_send = db->GetEnv()->NowMicros();
+  }
+
+  std::lock_guard<std::mutex> l(mutex_);
+  fds_.erase(std::find(fds_.begin(), fds_.end(), fd));
+  close(fd);
+  finished_.push_back(std::this_thread::get_id());
+}
+
+bool ReplicationMaster::SendSnapshot(int fd, uint64_t* sequence) {
+  rocksdb::DB* db = db_->db_;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db, &snapshot);
+  *sequence = snapshot->GetSequenceNumber() + 1;
+  std::string payload;
+  PutFixed64(&payload, snapshot->GetSequenceNumber());
+  if (!WriteFrame(fd, kFullSync, payload)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    stats_.full_syncs++;
+  }
+
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.total_order_seek = true;
+  read_options.fill_cache = false;
+  rocksdb::WriteBatch batch;
+  for (auto handle : db_->handles_) {
+    std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(read_options,
+                                                            handle));
+    for (iter->SeekToFirst(); iter->Valid() && !stop_; iter->Next()) {
+      if (iter->key()[0] == kInternalPrefix) {
+        break;
+      }
+      batch.Put(handle, iter->key(), iter->value());
+      if (batch.GetDataSize() >= options_.segment_size) {
+        std::string batches;
+        PutFixed32(&batches, static_cast<uint32_t>(batch.GetDataSize()));
+        batches.append(batch.Data());
+        if (!SendSegment(fd, batches, 1, 0)) {
+          return false;
+        }
+        batch.Clear();
+      }
+    }
+    if (!iter->status().ok() || stop_) {
+      return false;
+    }
+  }
+  std::string batches;
+  if (batch.Count() > 0) {
+    PutFixed32(&batches, static_cast<uint32_t>(batch.GetDataSize()));
+    batches.append(batch.Data());
+  }
+  return SendSegment(fd, batches, batches.empty() ? 0 : 1, *sequence);
+}
+
+bool ReplicationMaster::SendSegment(int fd, const std::string& batches,
+                                    int count, uint64_t next_sequence) {
+  rocksdb::DB* db = db_->db_;
+  std::string payload;
+  payload.reserve(kSegmentHeaderSize + batches.size());
+  PutFixed64(&payload, next_sequence);
+  PutFixed64(&payload, db->GetLatestSequenceNumber());
+  PutFixed64(&payload, db->GetEnv()->NowMicros());
+  PutFixed32(&payload, static_cast<uint32_t>(count));
+  PutFixed32(&payload, static_cast<uint32_t>(batches.size()));
+
+  // WAL records of one workload repeat the same key prefixes and
+  // values, even the fastest zlib level takes most of it away
+  bool compressed = false;
+  if (options_.compression_level > 0 && !batches.empty()) {
+    uLongf size = compressBound(batches.size());
+    std::string body(size, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&body[0]), &size,
+                  reinterpret_cast<const Bytef*>(batches.data()),
+                  batches.size(), options_.compression_level) == Z_OK
+      && size < batches.size()) {
+      payload.push_back(1);
+      payload.append(body.data(), size);
+      compressed = true;
+    }
+  }
+  if (!compressed) {
+    payload.push_back(0);
+    payload.append(batches);
+  }
+  if (!WriteFrame(fd, kSegment, payload)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> l(mutex_);
+  stats_.segments++;
+  stats_.batches += count;
+  stats_.bytes += kFrameHeaderSize + payload.size();
+  stats_.raw_bytes += kFrameHeaderSize + kSegmentHeaderSize + batches.size();
+  return true;
+}
+
+Replica::Replica(const ReplicationOptions& options)
+    : options_(options),
+      db_(nullptr),
+      stop_(false),
+      fd_(-1),
+      generation_(0),
+      remaining_(0),
+      applying_(false),
+      apply_ok_(true),
+      next_sequence_(0),
+      pending_sequence_(0),
+      send_micros_(0) {
+}
+
+Replica::~Replica() {
+  Close();
+  delete db_;
+}
+
+Status Replica::Open(const GilmourOptions& gilmour_options,
+                     const std::string& db_path, const std::string& primary) {
+  // The segments are written to the db directly, past the zset
+  // indexes, which would go stale
+  GilmourOptions replica_options(gilmour_options);
+  replica_options.zset_index_keys = 0;
+  db_ = new Gilmour();
+  Status s = db_->Open(replica_options, db_path);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string position;
+  s = db_->db_->Get(rocksdb::ReadOptions(), kReplicationPositionKey,
+                    &position);
+  if (s.ok() && position.size() == sizeof(uint64_t)) {
+    next_sequence_ = DecodeFixed64(position.data());
+    stats_.applied_sequence = next_sequence_ - 1;
+  } else if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+
+  primary_ = primary;
+  int threads = std::max(options_.apply_threads, 1);
+  for (int i = 0; i < threads; i++) {
+    appliers_.push_back(new Applier());
+  }
+  for (int i = 0; i < threads; i++) {
+    appliers_[i]->thread = std::thread(&Replica::ApplyLoop, this, i);
+  }
+  sync_thread_ = std::thread(&Replica::SyncLoop, this);
+  return Status::OK();
+}
+
+void Replica::Close() {
+  if (stop_.exchange(true)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(apply_mutex_);
+    if (fd_ != -1) {
+      shutdown(fd_, SHUT_RDWR);
+    }
+  }
+  if (sync_thread_.joinable()) {
+    sync_thread_.join();
+  }
+  {
+    std::lock_guard<std::mutex> l(apply_mutex_);
+    apply_cv_.notify_all();
+  }
+  for (auto applier : appliers_) {
+    applier->thread.join();
+    delete applier;
+  }
+  appliers_.clear();
+}
+
+void Replica::GetStats(ReplicationStats* stats) {
+  std::lock_guard<std::mutex> l(stats_mutex_);
+  *stats = stats_;
+}
+
+void Replica::SyncLoop() {
+  while (!stop_) {
+    int fd = ConnectTo(primary_);
+    if (fd == -1) {
+      for (int i = 0; i < kReconnectMillis / 100 && !stop_; i++) {
+        usleep(100000);
+      }
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> l(apply_mutex_);
+      fd_ = fd;
+    }
+    // Closed right before it was published
+    if (stop_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    {
+      std::lock_guard<std::mutex> l(stats_mutex_);
+      stats_.connections = 1;
+    }
+    Stream(fd);
+    {
+      std::lock_guard<std::mutex> l(stats_mutex_);
+      stats_.connections = 0;
+    }
+    std::lock_guard<std::mutex> l(apply_mutex_);
+    fd_ = -1;
+    close(fd);
+  }
+}
+
+void Replica::Stream(int fd) {
+  // Resumes after the last segment which is fully applied
+  if (!WaitApplied()) {
+    return;
+  }
+  std::string payload;
+  PutFixed64(&payload, next_sequence_);
+  if (!WriteFrame(fd, kSyncRequest, payload)) {
+    return;
+  }
+  char type;
+  while (!stop_ && ReadFrame(fd, &type, &payload)) {
+    if (type == kFullSync) {
+      if (!WaitApplied() || !Clear()) {
+        break;
+      }
+    } else if (type != kSegment || !ApplySegment(payload)) {
+      break;
+    }
+  }
+  WaitApplied();
+}
+
+bool Replica::Clear() {
+  rocksdb::WriteBatch batch;
+  batch.Delete(kReplicationPositionKey);
+  for (auto handle : db_->handles_) {
+    batch.DeleteRange(handle, Slice(), std::string(1, kInternalPrefix));
+  }
+  if (!db_->db_->Write(rocksdb::WriteOptions(), &batch).ok()) {
+    return false;
+  }
+  next_sequence_ = 0;
+  std::lock_guard<std::mutex> l(stats_mutex_);
+  stats_.full_syncs++;
+  stats_.applied_sequence = 0;
+  return true;
+}
+
+bool Replica::ApplySegment(const std::string& payload) {
+  if (payload.size() < kSegmentHeaderSize) {
+    return false;
+  }
+  const char* ptr = payload.data();
+  uint64_t next_sequence = DecodeFixed64(ptr);
+  uint64_t primary_sequence = DecodeFixed64(ptr + 8);
+  uint64_t send_micros = DecodeFixed64(ptr + 16);
+  uint32_t count = DecodeFixed32(ptr + 24);
+  uint32_t raw_size = DecodeFixed32(ptr + 28);
+  bool compressed = ptr[32] != 0;
+  Slice body(ptr + kSegmentHeaderSize, payload.size() - kSegmentHeaderSize);
+
+  std::string raw;
+  if (compressed) {
+    raw.resize(raw_size);
+    uLongf size = raw_size;
+    if (raw_size > kMaxFrameSize
+      || uncompress(reinterpret_cast<Bytef*>(&raw[0]), &size,
+                    reinterpret_cast<const Bytef*>(body.data()),
+                    body.size()) != Z_OK
+      || size != raw_size) {
+      return false;
+    }
+    body = raw;
+  } else if (body.size() != raw_size) {
+    return false;
+  }
+
+  // The appliers own their batches until they are done with the
+  // previous segment, meanwhile this one was read and decompressed
+  if (!WaitApplied()) {
+    return false;
+  }
+  std::vector<rocksdb::WriteBatch*> parts;
+  for (auto applier : appliers_) {
+    parts.push_back(&applier->batch);
+  }
+  BatchSplitter splitter(parts, db_->handles_);
+  for (uint32_t i = 0; i < count; i++) {
+    if (body.size() < sizeof(uint32_t)) {
+      return false;
+    }
+    uint32_t size = DecodeFixed32(body.data());
+    body.remove_prefix(sizeof(uint32_t));
+    if (body.size() < size) {
+      return false;
+    }
+    rocksdb::WriteBatch batch(std::string(body.data(), size));
+    body.remove_prefix(size);
+    if (!batch.Iterate(&splitter).ok()) {
+      return false;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> l(stats_mutex_);
+    stats_.segments++;
+    stats_.batches += count;
+    stats_.bytes += kFrameHeaderSize + payload.size();
+    stats_.raw_bytes += kFrameHeaderSize + kSegmentHeaderSize + raw_size;
+    stats_.primary_sequence = primary_sequence;
+  }
+
+  std::lock_guard<std::mutex> l(apply_mutex_);
+  pending_sequence_ = next_sequence;
+  send_micros_ = send_micros;
+  remaining_ = static_cast<int>(appliers_.size());
+  applying_ = true;
+  generation_++;
+  apply_cv_.notify_all();
+  return true;
+}
+
+void Replica::ApplyLoop(size_t index) {
+  Applier* applier = appliers_[index];
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> l(apply_mutex_);
+      apply_cv_.wait(l, [&] { return stop_ || generation_ != seen; });
+      if (generation_ == seen) {
+        return;
+      }
+      seen = generation_;
+    }
+    Status s;
+    if (applier->batch.Count() > 0) {
+      s = db_->db_->Write(rocksdb::WriteOptions(), &applier->batch);
+      applier->batch.Clear();
+    }
+    std::unique_lock<std::mutex> l(apply_mutex_);
+    apply_ok_ = apply_ok_ && s.ok();
+    if (--remaining_ > 0) {
+      continue;
+    }
+    // The last applier of the segment records its position, after
+    // the data of the segment in the WAL of the replica
+    if (apply_ok_ && pending_sequence_ != 0
+      && pending_sequence_ != next_sequence_) {
+      std::string position;
+      PutFixed64(&position, pending_sequence_);
+      apply_ok_ = db_->db_->Put(rocksdb::WriteOptions(),
+                                kReplicationPositionKey, position).ok();
+      if (apply_ok_) {
+        next_sequence_ = pending_sequence_;
+      }
+    }
+    if (apply_ok_) {
+      std::lock_guard<std::mutex> sl(stats_mutex_);
+      if (next_sequence_ != 0) {
+        stats_.applied_sequence = next_sequence_ - 1;
+      }
+      uint64_t now = db_->db_->GetEnv()->NowMicros();
+      stats_.apply_delay_micros = now > send_micros_ ? now - send_micros_ : 0;
+    }
+    applying_ = false;
+    done_cv_.notify_all();
+  }
+}
+
+bool Replica::WaitApplied() {
+  std::unique_lock<std::mutex> l(apply_mutex_);
+  done_cv_.wait(l, [this] { return !applying_; });
+  // A failed write leaves the position where it was, the segments
+  // after it are asked for again on the next connection
+  bool ok = apply_ok_;
+  apply_ok_ = true;
+  return ok;
+}
+
+}  //  namespace gilmour
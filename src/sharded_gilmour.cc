@@ -0,0 +1,615 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "gilmour/sharded_gilmour.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace gilmour {
+
+// Holds the number of shards the store was created with
+static const char* kShardsFile = "SHARDS";
+
+struct ShardedGilmour::Shard {
+  Gilmour db;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> tasks;
+  bool stop = false;
+};
+
+// Counts down the parts of a command running on the shard threads
+class Waiter {
+ public:
+  explicit Waiter(size_t pending) : pending_(pending) {
+  }
+
+  void Done() {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (--pending_ == 0) {
+      cv_.notify_one();
+    }
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> l(mutex_);
+    cv_.wait(l, [this] { return pending_ == 0; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t pending_;
+};
+
+// FNV-1a, stable across builds and platforms since the
+// placement of the keys is persistent
+static uint64_t HashKey(const Slice& key) {
+  const char* data = key.data();
+  size_t size = key.size();
+  const char* open = static_cast<const char*>(memchr(data, '{', size));
+  if (open != nullptr) {
+    const char* tag = open + 1;
+    const char* close = static_cast<const char*>(
+        memchr(tag, '}', data + size - tag));
+    // "{}" is not a tag, the whole key is hashed
+    if (close != nullptr && close != tag) {
+      data = tag;
+      size = close - tag;
+    }
+  }
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static Status CheckNumShards(const std::string& db_path, int num_shards) {
+  std::string path = db_path + "/" + kShardsFile;
+  FILE* file = fopen(path.c_str(), "r");
+  if (file != nullptr) {
+    int created = 0;
+    int n = fscanf(file, "%d", &created);
+    fclose(file);
+    if (n != 1) {
+      return Status::Corruption(path);
+    } else if (created != num_shards) {
+      return Status::InvalidArgument("created with "
+          + std::to_string(created) + " shards, opened with "
+          + std::to_string(num_shards));
+    }
+    return Status::OK();
+  }
+  file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return Status::IOError(path);
+  }
+  fprintf(file, "%d\n", num_shards);
+  fclose(file);
+  return Status::OK();
+}
+
+ShardedGilmour::ShardedGilmour()
+    : thread_per_shard_(false) {
+}
+
+ShardedGilmour::~ShardedGilmour() {
+  for (Shard* shard : shards_) {
+    {
+      std::lock_guard<std::mutex> l(shard->mutex);
+      shard->stop = true;
+    }
+    shard->cv.notify_one();
+  }
+  for (Shard* shard : shards_) {
+    if (shard->thread.joinable()) {
+      shard->thread.join();
+    }
+    delete shard;
+  }
+}
+
+Status ShardedGilmour::Open(const ShardedGilmourOptions& options,
+                            const std::string& db_path) {
+  if (options.num_shards <= 0) {
+    return Status::InvalidArgument("num_shards must be positive");
+  }
+  GilmourOptions gilmour_options(options.gilmour_options);
+  rocksdb::Env* env = gilmour_options.options.env;
+  Status s = env->CreateDirIfMissing(db_path);
+  if (!s.ok()) {
+    return s;
+  }
+  s = CheckNumShards(db_path, options.num_shards);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // The shards share the thread pools of the env, give every shard
+  // one flush and one compaction thread of its own
+  env->IncBackgroundThreadsIfNeeded(options.num_shards, rocksdb::Env::HIGH);
+  env->IncBackgroundThreadsIfNeeded(options.num_shards, rocksdb::Env::LOW);
+  gilmour_options.block_cache_size /= options.num_shards;
+
+  // Each shard replays its own WAL, opening them at once spreads the
+  // recovery after a crash over num_shards threads
+  std::vector<Status> statuses(options.num_shards);
+  std::vector<std::thread> openers;
+  for (int i = 0; i < options.num_shards; i++) {
+    shards_.push_back(new Shard);
+  }
+  for (int i = 0; i < options.num_shards; i++) {
+    openers.emplace_back([&, i]() {
+      statuses[i] = shards_[i]->db.Open(gilmour_options,
+          db_path + "/shard_" + std::to_string(i));
+    });
+  }
+  for (auto& opener : openers) {
+    opener.join();
+  }
+  for (const auto& status : statuses) {
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  thread_per_shard_ = options.thread_per_shard;
+  if (thread_per_shard_) {
+    for (Shard* shard : shards_) {
+      shard->thread = std::thread(&ShardedGilmour::ShardLoop, this, shard);
+    }
+  }
+  return s;
+}
+
+size_t ShardedGilmour::ShardOf(const Slice& key) const {
+  return HashKey(key) % shards_.size();
+}
+
+Gilmour* ShardedGilmour::shard(size_t index) {
+  return &shards_[index]->db;
+}
+
+void ShardedGilmour::Submit(size_t index, const Task& task) {
+  Shard* shard = shards_[index];
+  if (!thread_per_shard_) {
+    task(&shard->db);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(shard->mutex);
+    shard->tasks.push_back([task, shard] { task(&shard->db); });
+  }
+  shard->cv.notify_one();
+}
+
+void ShardedGilmour::ShardLoop(Shard* shard) {
+  std::deque<std::function<void()>> tasks;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> l(shard->mutex);
+      shard->cv.wait(l, [shard] {
+        return shard->stop || !shard->tasks.empty();
+      });
+      // The queued tasks still run after stop
+      if (shard->tasks.empty()) {
+        return;
+      }
+      // Take everything queued so far with one lock
+      tasks.swap(shard->tasks);
+    }
+    for (const auto& task : tasks) {
+      task();
+    }
+    tasks.clear();
+  }
+}
+
+Status ShardedGilmour::RunOn(size_t index, const Command& command) {
+  Shard* shard = shards_[index];
+  // A task running on the shard thread would wait for itself
+  if (!thread_per_shard_
+    || shard->thread.get_id() == std::this_thread::get_id()) {
+    return command(&shard->db);
+  }
+  Status s;
+  Waiter waiter(1);
+  Submit(index, [&](Gilmour* db) {
+    s = command(db);
+    waiter.Done();
+  });
+  waiter.Wait();
+  return s;
+}
+
+Status ShardedGilmour::RunOnShards(const std::vector<size_t>& shards,
+                                   const ShardCommand& command) {
+  std::vector<Status> statuses(shards.size());
+  if (!thread_per_shard_ || shards.size() == 1) {
+    for (size_t i = 0; i < shards.size(); i++) {
+      size_t index = shards[i];
+      statuses[i] = RunOn(index, [&](Gilmour* db) {
+        return command(index, db);
+      });
+    }
+  } else {
+    Waiter waiter(shards.size());
+    for (size_t i = 0; i < shards.size(); i++) {
+      size_t index = shards[i];
+      Status* s = &statuses[i];
+      Submit(index, [&, index, s](Gilmour* db) {
+        *s = command(index, db);
+        waiter.Done();
+      });
+    }
+    waiter.Wait();
+  }
+  for (const auto& s : statuses) {
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status ShardedGilmour::RunOnAll(const ShardCommand& command) {
+  std::vector<size_t> shards(shards_.size());
+  for (size_t i = 0; i < shards.size(); i++) {
+    shards[i] = i;
+  }
+  return RunOnShards(shards, command);
+}
+
+Status ShardedGilmour::Set(const Slice& key, const Slice& value) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->Set(key, value);
+  });
+}
+
+Status ShardedGilmour::Get(const Slice& key, std::string* value) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->Get(key, value);
+  });
+}
+
+Status ShardedGilmour::MSet(const std::vector<KeyValue>& kvs) {
+  std::vector<std::vector<KeyValue>> parts(shards_.size());
+  std::vector<size_t> shards;
+  for (const auto& kv : kvs) {
+    size_t index = ShardOf(kv.key);
+    if (parts[index].empty()) {
+      shards.push_back(index);
+    }
+    parts[index].push_back(kv);
+  }
+  return RunOnShards(shards, [&](size_t index, Gilmour* db) {
+    return db->MSet(parts[index]);
+  });
+}
+
+Status ShardedGilmour::MSet(const KeyValueBatch& kvs) {
+  std::vector<KeyValueBatch> parts(shards_.size());
+  std::vector<size_t> shards;
+  for (size_t i = 0; i < kvs.size(); i++) {
+    size_t index = ShardOf(kvs.key(i));
+    if (parts[index].empty()) {
+      shards.push_back(index);
+    }
+    parts[index].Add(kvs.key(i), kvs.value(i));
+  }
+  return RunOnShards(shards, [&](size_t index, Gilmour* db) {
+    return db->MSet(parts[index]);
+  });
+}
+
+Status ShardedGilmour::Del(const std::vector<std::string>& keys,
+                           int64_t* count) {
+  std::vector<std::vector<std::string>> parts(shards_.size());
+  std::vector<int64_t> counts(shards_.size(), 0);
+  std::vector<size_t> shards;
+  for (const auto& key : keys) {
+    size_t index = ShardOf(key);
+    if (parts[index].empty()) {
+      shards.push_back(index);
+    }
+    parts[index].push_back(key);
+  }
+  Status s = RunOnShards(shards, [&](size_t index, Gilmour* db) {
+    return db->Del(parts[index], &counts[index]);
+  });
+  *count = 0;
+  for (int64_t shard_count : counts) {
+    *count += shard_count;
+  }
+  return s;
+}
+
+Status ShardedGilmour::Scan(const std::string& start_key,
+                            const std::string& pattern, int64_t count,
+                            std::vector<std::string>* keys,
+                            std::string* next_key) {
+  std::vector<std::vector<std::string>> parts(shards_.size());
+  std::vector<std::string> next_keys(shards_.size());
+  // start_key may be the same string as next_key
+  std::string start(start_key);
+  next_key->clear();
+  Status s = RunOnAll([&](size_t index, Gilmour* db) {
+    return db->Scan(start, pattern, count, &parts[index], &next_keys[index]);
+  });
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& shard_next_key : next_keys) {
+    if (!shard_next_key.empty()
+      && (next_key->empty() || shard_next_key < *next_key)) {
+      *next_key = shard_next_key;
+    }
+  }
+  // The keys of the other shards past next_key come again with the
+  // next call, a shard which stopped earlier may hold keys before them
+  size_t first = keys->size();
+  for (const auto& part : parts) {
+    for (const auto& key : part) {
+      if (next_key->empty() || key < *next_key) {
+        keys->push_back(key);
+      }
+    }
+  }
+  std::sort(keys->begin() + first, keys->end());
+  return s;
+}
+
+Status ShardedGilmour::Keys(const std::string& pattern,
+                            std::vector<std::string>* keys) {
+  std::vector<std::vector<std::string>> parts(shards_.size());
+  Status s = RunOnAll([&](size_t index, Gilmour* db) {
+    return db->Keys(pattern, &parts[index]);
+  });
+  size_t first = keys->size();
+  for (const auto& part : parts) {
+    keys->insert(keys->end(), part.begin(), part.end());
+  }
+  std::sort(keys->begin() + first, keys->end());
+  return s;
+}
+
+Status ShardedGilmour::Expire(const Slice& key, int32_t ttl, int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->Expire(key, ttl, ret);
+  });
+}
+
+Status ShardedGilmour::TTL(const Slice& key, int64_t* ttl) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->TTL(key, ttl);
+  });
+}
+
+Status ShardedGilmour::Type(const Slice& key, DataType* type) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->Type(key, type);
+  });
+}
+
+Status ShardedGilmour::HSet(const Slice& key, const Slice& field,
+                            const Slice& value, int32_t* res) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HSet(key, field, value, res);
+  });
+}
+
+Status ShardedGilmour::HMSet(const Slice& key,
+                             const std::vector<FieldValue>& fvs) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HMSet(key, fvs);
+  });
+}
+
+Status ShardedGilmour::HMSet(const Slice& key, const FieldValueBatch& fvs) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HMSet(key, fvs);
+  });
+}
+
+Status ShardedGilmour::HGet(const Slice& key, const Slice& field,
+                            std::string* value) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HGet(key, field, value);
+  });
+}
+
+Status ShardedGilmour::HGetall(const Slice& key,
+                               std::vector<FieldValue>* fvs) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HGetall(key, fvs);
+  });
+}
+
+Status ShardedGilmour::HKeys(const Slice& key,
+                             std::vector<std::string>* fields) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HKeys(key, fields);
+  });
+}
+
+Status ShardedGilmour::HDel(const Slice& key,
+                            const std::vector<std::string>& fields,
+                            int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HDel(key, fields, ret);
+  });
+}
+
+Status ShardedGilmour::HLen(const Slice& key, int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->HLen(key, ret);
+  });
+}
+
+Status ShardedGilmour::SAdd(const Slice& key,
+                            const std::vector<std::string>& members,
+                            int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->SAdd(key, members, ret);
+  });
+}
+
+Status ShardedGilmour::SRem(const Slice& key,
+                            const std::vector<std::string>& members,
+                            int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->SRem(key, members, ret);
+  });
+}
+
+Status ShardedGilmour::SMembers(const Slice& key,
+                                std::vector<std::string>* members) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->SMembers(key, members);
+  });
+}
+
+Status ShardedGilmour::SIsMember(const Slice& key, const Slice& member,
+                                 int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->SIsMember(key, member, ret);
+  });
+}
+
+Status ShardedGilmour::SCard(const Slice& key, int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->SCard(key, ret);
+  });
+}
+
+Status ShardedGilmour::ZAdd(const Slice& key,
+                            const std::vector<ScoreMember>& score_members,
+                            int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZAdd(key, score_members, ret);
+  });
+}
+
+Status ShardedGilmour::ZScore(const Slice& key, const Slice& member,
+                              double* score) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZScore(key, member, score);
+  });
+}
+
+Status ShardedGilmour::ZRange(const Slice& key, int32_t start, int32_t stop,
+                              std::vector<ScoreMember>* score_members) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZRange(key, start, stop, score_members);
+  });
+}
+
+Status ShardedGilmour::ZRangeByScore(const Slice& key, double min, double max,
+                                     std::vector<ScoreMember>* score_members) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZRangeByScore(key, min, max, score_members);
+  });
+}
+
+Status ShardedGilmour::ZRank(const Slice& key, const Slice& member,
+                             int32_t* rank) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZRank(key, member, rank);
+  });
+}
+
+Status ShardedGilmour::ZRem(const Slice& key,
+                            const std::vector<std::string>& members,
+                            int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZRem(key, members, ret);
+  });
+}
+
+Status ShardedGilmour::ZCard(const Slice& key, int32_t* ret) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->ZCard(key, ret);
+  });
+}
+
+Status ShardedGilmour::LPush(const Slice& key,
+                             const std::vector<std::string>& values,
+                             int32_t* len) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->LPush(key, values, len);
+  });
+}
+
+Status ShardedGilmour::RPush(const Slice& key,
+                             const std::vector<std::string>& values,
+                             int32_t* len) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->RPush(key, values, len);
+  });
+}
+
+Status ShardedGilmour::LPop(const Slice& key, std::string* element) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->LPop(key, element);
+  });
+}
+
+Status ShardedGilmour::RPop(const Slice& key, std::string* element) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->RPop(key, element);
+  });
+}
+
+Status ShardedGilmour::LIndex(const Slice& key, int32_t index,
+                              std::string* element) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->LIndex(key, index, element);
+  });
+}
+
+Status ShardedGilmour::LRange(const Slice& key, int32_t start, int32_t stop,
+                              std::vector<std::string>* elements) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->LRange(key, start, stop, elements);
+  });
+}
+
+Status ShardedGilmour::LLen(const Slice& key, int32_t* len) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->LLen(key, len);
+  });
+}
+
+Status ShardedGilmour::Compact() {
+  return RunOnAll([](size_t, Gilmour* db) {
+    return db->Compact();
+  });
+}
+
+Status ShardedGilmour::CompactKey(const Slice& key) {
+  return RunOn(ShardOf(key), [&](Gilmour* db) {
+    return db->CompactKey(key);
+  });
+}
+
+uint64_t ShardedGilmour::GetProperty(const std::string& property) {
+  // Properties are thread safe, no need to go through the shard threads
+  uint64_t value = 0;
+  for (Shard* shard : shards_) {
+    value += shard->db.GetProperty(property);
+  }
+  return value;
+}
+
+}  //  namespace gilmour
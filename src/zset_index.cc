@@ -0,0 +1,280 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/zset_index.h"
+
+#include <new>
+
+#include "gilmour/key_codec.h"
+
+namespace gilmour {
+
+// links[i].span is the number of level 0 steps from this node to
+// links[i].next, so the rank of a node is the sum of the spans of the
+// links followed from the head to reach it
+struct ZSetIndex::Node {
+  struct Link {
+    Node* next;
+    int64_t span;
+  };
+
+  // OrderedScore() of the score, compares as the score keys do
+  uint64_t score;
+  std::string member;
+  // As many as the height of the node
+  Link links[1];
+};
+
+static int Compare(uint64_t a_score, const Slice& a_member,
+                   uint64_t b_score, const Slice& b_member) {
+  if (a_score != b_score) {
+    return a_score < b_score ? -1 : 1;
+  }
+  return a_member.compare(b_member);
+}
+
+ZSetIndex::ZSetIndex(uint64_t version)
+    : version_(version),
+      head_(NewNode(kMaxHeight, 0, Slice())),
+      height_(1),
+      size_(0),
+      rnd_(version | 1),
+      memory_usage_(0) {
+}
+
+ZSetIndex::~ZSetIndex() {
+  Node* node = head_;
+  while (node != nullptr) {
+    Node* next = node->links[0].next;
+    DeleteNode(node);
+    node = next;
+  }
+}
+
+ZSetIndex::Node* ZSetIndex::NewNode(int height, uint64_t score,
+                                    const Slice& member) {
+  char* mem = new char[sizeof(Node) + sizeof(Node::Link) * (height - 1)];
+  Node* node = new (mem) Node();
+  node->score = score;
+  node->member.assign(member.data(), member.size());
+  for (int i = 0; i < height; i++) {
+    node->links[i].next = nullptr;
+    node->links[i].span = 0;
+  }
+  return node;
+}
+
+void ZSetIndex::DeleteNode(Node* node) {
+  node->~Node();
+  delete[] reinterpret_cast<char*>(node);
+}
+
+int ZSetIndex::RandomHeight() {
+  // One in 4 nodes goes up a level, as in redis
+  int height = 1;
+  while (height < kMaxHeight) {
+    rnd_ ^= rnd_ << 13;
+    rnd_ ^= rnd_ >> 7;
+    rnd_ ^= rnd_ << 17;
+    if ((rnd_ & 3) != 0) {
+      break;
+    }
+    height++;
+  }
+  return height;
+}
+
+void ZSetIndex::Insert(double score, const Slice& member) {
+  uint64_t ordered = OrderedScore(score);
+  Node* update[kMaxHeight];
+  int64_t rank[kMaxHeight];
+  Node* node = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    rank[i] = i == height_ - 1 ? 0 : rank[i + 1];
+    Node* next = node->links[i].next;
+    while (next != nullptr
+      && Compare(next->score, next->member, ordered, member) < 0) {
+      rank[i] += node->links[i].span;
+      node = next;
+      next = node->links[i].next;
+    }
+    update[i] = node;
+  }
+
+  int height = RandomHeight();
+  if (height > height_) {
+    for (int i = height_; i < height; i++) {
+      rank[i] = 0;
+      update[i] = head_;
+      head_->links[i].span = size_;
+    }
+    height_ = height;
+  }
+  node = NewNode(height, ordered, member);
+  for (int i = 0; i < height; i++) {
+    node->links[i].next = update[i]->links[i].next;
+    update[i]->links[i].next = node;
+    node->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+    update[i]->links[i].span = rank[0] - rank[i] + 1;
+  }
+  for (int i = height; i < height_; i++) {
+    update[i]->links[i].span++;
+  }
+  size_++;
+  memory_usage_ += sizeof(Node) + sizeof(Node::Link) * (height - 1)
+    + member.size();
+}
+
+bool ZSetIndex::Remove(double score, const Slice& member) {
+  uint64_t ordered = OrderedScore(score);
+  Node* update[kMaxHeight];
+  Node* node = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    Node* next = node->links[i].next;
+    while (next != nullptr
+      && Compare(next->score, next->member, ordered, member) < 0) {
+      node = next;
+      next = node->links[i].next;
+    }
+    update[i] = node;
+  }
+  node = node->links[0].next;
+  if (node == nullptr
+    || Compare(node->score, node->member, ordered, member) != 0) {
+    return false;
+  }
+
+  int height = 0;
+  for (int i = 0; i < height_; i++) {
+    if (update[i]->links[i].next == node) {
+      update[i]->links[i].span += node->links[i].span - 1;
+      update[i]->links[i].next = node->links[i].next;
+      height++;
+    } else {
+      update[i]->links[i].span--;
+    }
+  }
+  while (height_ > 1 && head_->links[height_ - 1].next == nullptr) {
+    height_--;
+  }
+  size_--;
+  memory_usage_ -= sizeof(Node) + sizeof(Node::Link) * (height - 1)
+    + member.size();
+  DeleteNode(node);
+  return true;
+}
+
+int64_t ZSetIndex::Rank(double score, const Slice& member) const {
+  uint64_t ordered = OrderedScore(score);
+  int64_t rank = 0;
+  const Node* node = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    const Node* next = node->links[i].next;
+    while (next != nullptr
+      && Compare(next->score, next->member, ordered, member) <= 0) {
+      rank += node->links[i].span;
+      node = next;
+      next = node->links[i].next;
+    }
+    if (node != head_
+      && Compare(node->score, node->member, ordered, member) == 0) {
+      return rank - 1;
+    }
+  }
+  return -1;
+}
+
+void ZSetIndex::Range(int64_t start, int64_t stop,
+                      std::vector<ScoreMember>* score_members) const {
+  // The node ranked start is start + 1 level 0 steps from the head
+  int64_t traversed = 0;
+  const Node* node = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    while (node->links[i].next != nullptr
+      && traversed + node->links[i].span <= start + 1) {
+      traversed += node->links[i].span;
+      node = node->links[i].next;
+    }
+  }
+  for (int64_t rank = start; rank <= stop && node != nullptr; rank++) {
+    score_members->push_back({ScoreOfOrdered(node->score), node->member});
+    node = node->links[0].next;
+  }
+}
+
+void ZSetIndex::RangeByScore(double min, double max,
+                             std::vector<ScoreMember>* score_members) const {
+  uint64_t ordered_min = OrderedScore(min);
+  uint64_t ordered_max = OrderedScore(max);
+  const Node* node = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    while (node->links[i].next != nullptr
+      && node->links[i].next->score < ordered_min) {
+      node = node->links[i].next;
+    }
+  }
+  for (node = node->links[0].next;
+       node != nullptr && node->score <= ordered_max;
+       node = node->links[0].next) {
+    score_members->push_back({ScoreOfOrdered(node->score), node->member});
+  }
+}
+
+ZSetIndexCache::ZSetIndexCache(size_t max_keys)
+    : max_keys_(max_keys) {
+}
+
+std::shared_ptr<ZSetIndex> ZSetIndexCache::Lookup(const Slice& key) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto iter = indexes_.find(key.ToString());
+  if (iter == indexes_.end()) {
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, iter->second);
+  return iter->second->second;
+}
+
+void ZSetIndexCache::Insert(const Slice& key,
+                            const std::shared_ptr<ZSetIndex>& index) {
+  std::string key_str = key.ToString();
+  std::lock_guard<std::mutex> l(mutex_);
+  auto iter = indexes_.find(key_str);
+  if (iter != indexes_.end()) {
+    iter->second->second = index;
+    lru_.splice(lru_.begin(), lru_, iter->second);
+    return;
+  }
+  lru_.push_front(std::make_pair(key_str, index));
+  indexes_[key_str] = lru_.begin();
+  while (lru_.size() > max_keys_) {
+    indexes_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+void ZSetIndexCache::Erase(const Slice& key) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto iter = indexes_.find(key.ToString());
+  if (iter != indexes_.end()) {
+    lru_.erase(iter->second);
+    indexes_.erase(iter);
+  }
+}
+
+size_t ZSetIndexCache::size() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return lru_.size();
+}
+
+size_t ZSetIndexCache::ApproximateMemoryUsage() {
+  std::lock_guard<std::mutex> l(mutex_);
+  size_t usage = 0;
+  for (const auto& key_index : lru_) {
+    usage += key_index.second->ApproximateMemoryUsage();
+  }
+  return usage;
+}
+
+}  //  namespace gilmour
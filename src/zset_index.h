@@ -0,0 +1,118 @@
+//  Copyright (c) 2017-present The gilmour Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_ZSET_INDEX_H_
+#define SRC_ZSET_INDEX_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gilmour/gilmour.h"
+
+namespace gilmour {
+
+// The members of one version of a zset in (score, member) order, the
+// order of its score keys on disk. A skiplist whose links also count
+// the members they jump over, so the rank of a member and the member
+// at a rank are found in O(log n) instead of by walking the score keys
+// from the first one.
+//
+// Not thread safe, the readers and the writers hold mutex().
+class ZSetIndex {
+ public:
+  explicit ZSetIndex(uint64_t version);
+  ~ZSetIndex();
+
+  uint64_t version() const { return version_; }
+  int64_t size() const { return size_; }
+  std::mutex* mutex() { return &mutex_; }
+  // Of the nodes and the members, readable without mutex()
+  size_t ApproximateMemoryUsage() const { return memory_usage_; }
+
+  // member must not be in the index yet
+  void Insert(double score, const Slice& member);
+  // Returns false if member is not in the index with score
+  bool Remove(double score, const Slice& member);
+
+  // The zero based rank of member, which has score, -1 if it is not
+  // in the index
+  int64_t Rank(double score, const Slice& member) const;
+
+  // Appends the members ranked start to stop, both within [0, size)
+  void Range(int64_t start, int64_t stop,
+             std::vector<ScoreMember>* score_members) const;
+
+  // Appends the members with min <= score <= max
+  void RangeByScore(double min, double max,
+                    std::vector<ScoreMember>* score_members) const;
+
+ private:
+  static const int kMaxHeight = 32;
+
+  struct Node;
+
+  static Node* NewNode(int height, uint64_t score, const Slice& member);
+  static void DeleteNode(Node* node);
+  int RandomHeight();
+  // The last node at level 0 before (score, member)
+  const Node* FindLess(uint64_t score, const Slice& member) const;
+
+  uint64_t version_;
+  Node* head_;
+  int height_;
+  int64_t size_;
+  uint64_t rnd_;
+  std::atomic<size_t> memory_usage_;
+  std::mutex mutex_;
+
+  // No copying allowed
+  ZSetIndex(const ZSetIndex&);
+  void operator=(const ZSetIndex&);
+};
+
+// The indexes of the max_keys zsets looked up last. An index is shared
+// with the readers and the writers using it when it is evicted or
+// replaced, it is freed once the last of them is done with it.
+class ZSetIndexCache {
+ public:
+  explicit ZSetIndexCache(size_t max_keys);
+
+  // nullptr if key has no index, the index may be of an older version
+  // of the zset
+  std::shared_ptr<ZSetIndex> Lookup(const Slice& key);
+  // Replaces the index of key, evicts the least recently used one
+  // when there are too many of them
+  void Insert(const Slice& key, const std::shared_ptr<ZSetIndex>& index);
+  void Erase(const Slice& key);
+
+  size_t size();
+  size_t ApproximateMemoryUsage();
+
+ private:
+  typedef std::list<std::pair<std::string, std::shared_ptr<ZSetIndex>>>
+    LRUList;
+
+  size_t max_keys_;
+  std::mutex mutex_;
+  // Most recently used first
+  LRUList lru_;
+  std::unordered_map<std::string, LRUList::iterator> indexes_;
+
+  // No copying allowed
+  ZSetIndexCache(const ZSetIndexCache&);
+  void operator=(const ZSetIndexCache&);
+};
+
+}  //  namespace gilmour
+
+#endif  //  SRC_ZSET_INDEX_H_